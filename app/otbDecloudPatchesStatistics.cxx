@@ -0,0 +1,284 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "itkObjectFactory.h"
+#include "otbWrapperApplicationFactory.h"
+#include "itkMultiThreader.h"
+#include "itksys/SystemTools.hxx"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Validity bitmap
+#include "otbImageFileReader.h"
+#include "otbStreamingValidityBitmapImageFilter.h"
+
+// Statistics rasters
+#include "gdal.h"
+
+namespace otb
+{
+
+namespace Wrapper
+{
+
+// Counted pixels, in the order of the "count" parameter choices
+enum CountMode
+{
+  COUNT_VALID, // Pixels with at least one band different from the no-data value
+  COUNT_NODATA // Pixels with all their bands equal to the no-data value
+};
+
+/**
+ * The OTB Application, that computes the statistics of the valid pixels of images patches, for several images and
+ * several patch sizes.
+ */
+class DecloudPatchesStatistics : public Application
+{
+public:
+  /** Standard class typedefs. */
+  typedef DecloudPatchesStatistics      Self;
+  typedef Application                   Superclass;
+  typedef itk::SmartPointer<Self>       Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+
+  /** Standard macro */
+  itkNewMacro(Self);
+  itkTypeMacro(DecloudPatchesStatistics, Application);
+
+  /** Filters */
+  typedef otb::ImageFileReader<FloatVectorImageType>                    ReaderType;
+  typedef otb::StreamingValidityBitmapImageFilter<FloatVectorImageType> BitmapFilterType;
+  typedef BitmapFilterType::BitmapPointerType                           BitmapPointerType;
+
+  void
+  DoUpdateParameters()
+  {}
+
+  void
+  DoInit()
+  {
+
+    // Documentation
+    SetName("DecloudPatchesStatistics");
+    SetDescription("This application computes the number of valid (or no-data) pixels of the patches of images.");
+    SetDocLongDescription("This application computes, for each image and each patch size, a raster with one pixel "
+                          "per (complete) square patch of the image, whose value is the number of valid pixels (a "
+                          "pixel is valid if at least one of its bands is different from the no-data value), or of "
+                          "no-data pixels, of the patch. Each image is read once, in streaming, to compute its "
+                          "validity bitmap (or the bitmap is read from the cache directory, e.g. the one of "
+                          "DecloudTimeSeriesPreProcessor): the statistics of all the patch sizes are computed from "
+                          "the bitmap. Images are processed in parallel.");
+    SetDocLimitations("Input images are read from files. Outputs are 16 bits unsigned rasters (32 bits when the "
+                      "patches have more than 65535 pixels).");
+    SetDocAuthors("Remi Cresson, Nicolas Narcon");
+
+    AddParameter(ParameterType_InputFilenameList, "il", "Input images");
+    AddParameter(ParameterType_StringList, "patchsizes", "Patch sizes, in pixels");
+    AddParameter(ParameterType_StringList,
+                 "out",
+                 "Output statistics rasters: one per image and per patch size, ordered by image then by patch size");
+    AddParameter(ParameterType_Float, "nodata", "No data value of the input images");
+    SetDefaultParameterFloat("nodata", 0.0);
+    AddParameter(ParameterType_Choice, "count", "Pixels counted in each patch");
+    AddChoice("count.valid", "Valid pixels");
+    AddChoice("count.nodata", "No-data pixels");
+    AddParameter(ParameterType_Directory,
+                 "cachedir",
+                 "Directory of the validity bitmaps (named after the images file names, with the .validity "
+                 "extension): bitmaps are read from it when they match the images and the no-data value, and "
+                 "written in it otherwise");
+    MandatoryOff("cachedir");
+    AddParameter(ParameterType_Int, "jobs", "Number of images processed in parallel");
+    SetDefaultParameterInt("jobs", 4);
+    SetMinimumParameterIntValue("jobs", 1);
+
+    AddRAMParameter();
+  }
+
+  // Validity bitmap of an image, from the cache file when it matches the image
+  BitmapPointerType
+  GetValidityBitmap(const std::string & filename,
+                    const std::string & cacheFile,
+                    float               noDataValue,
+                    unsigned int        nbThreads,
+                    unsigned int        ram,
+                    std::string &       log)
+  {
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(filename);
+    reader->UpdateOutputInformation();
+    const FloatVectorImageType::RegionType region = reader->GetOutput()->GetLargestPossibleRegion();
+
+    BitmapPointerType bitmap = std::make_shared<ValidityBitmap>();
+    if (!cacheFile.empty() && bitmap->Load(cacheFile) &&
+        bitmap->Matches(region.GetIndex(0), region.GetIndex(1), region.GetSize(0), region.GetSize(1), noDataValue))
+    {
+      log = "validity bitmap read from " + cacheFile;
+      return bitmap;
+    }
+
+    BitmapFilterType::Pointer filter = BitmapFilterType::New();
+    filter->SetInput(reader->GetOutput());
+    filter->SetNoDataValue(noDataValue);
+    filter->GetFilter()->SetNumberOfThreads(nbThreads);
+    filter->GetStreamer()->SetAutomaticAdaptativeStreaming(ram);
+    filter->Update();
+    bitmap = filter->GetBitmap();
+    log = "validity bitmap computed";
+    if (!cacheFile.empty() && !bitmap->Save(cacheFile))
+      log += " (unable to write " + cacheFile + ")";
+    return bitmap;
+  }
+
+  // Write the statistics raster of a patch size: the georeferencing is the one of the image, with the spacing of
+  // the patches. Returns false if the file can't be written.
+  static bool
+  WriteStatistics(const ValidityBitmap & bitmap,
+                  GDALDatasetH           imageDataset,
+                  unsigned int           patchSize,
+                  bool                   countNoData,
+                  const std::string &    filename)
+  {
+    const int    sizeX = GDALGetRasterXSize(imageDataset) / patchSize;
+    const int    sizeY = GDALGetRasterYSize(imageDataset) / patchSize;
+    const bool   wide = static_cast<unsigned long>(patchSize) * patchSize > 65535;
+    const char * options[] = { "COMPRESS=DEFLATE", nullptr };
+    GDALDriverH  driver = GDALGetDriverByName("GTiff");
+    GDALDatasetH dataset = nullptr;
+    if (sizeX > 0 && sizeY > 0 && driver != nullptr)
+      dataset = GDALCreate(
+        driver, filename.c_str(), sizeX, sizeY, 1, wide ? GDT_UInt32 : GDT_UInt16, const_cast<char **>(options));
+    if (dataset == nullptr)
+      return false;
+
+    double geoTransform[6];
+    if (GDALGetGeoTransform(imageDataset, geoTransform) == CE_None)
+    {
+      for (int i : { 1, 2, 4, 5 })
+        geoTransform[i] *= patchSize;
+      GDALSetGeoTransform(dataset, geoTransform);
+    }
+    GDALSetProjection(dataset, GDALGetProjectionRef(imageDataset));
+
+    // One row of patches at a time
+    const unsigned long  patchArea = static_cast<unsigned long>(patchSize) * patchSize;
+    std::vector<GUInt32> counts(sizeX);
+    bool                 written = true;
+    for (int py = 0; py < sizeY && written; py++)
+    {
+      for (int px = 0; px < sizeX; px++)
+      {
+        const unsigned long nbValid =
+          bitmap.GetNumberOfValidPixels(px * patchSize, py * patchSize, patchSize, patchSize);
+        counts[px] = countNoData ? patchArea - nbValid : nbValid;
+      }
+      written = GDALRasterIO(GDALGetRasterBand(dataset, 1),
+                             GF_Write,
+                             0,
+                             py,
+                             sizeX,
+                             1,
+                             counts.data(),
+                             sizeX,
+                             1,
+                             GDT_UInt32,
+                             0,
+                             0) == CE_None;
+    }
+    GDALClose(dataset);
+    return written;
+  }
+
+  void
+  DoExecute()
+  {
+    const std::vector<std::string> images = GetParameterStringList("il");
+    const std::vector<std::string> outputs = GetParameterStringList("out");
+    std::vector<unsigned int>      patchSizes;
+    for (const auto & str : GetParameterStringList("patchsizes"))
+    {
+      const int patchSize = std::stoi(str);
+      if (patchSize <= 0)
+        otbAppLogFATAL("Patch sizes must be positive");
+      patchSizes.push_back(patchSize);
+    }
+    if (outputs.size() != images.size() * patchSizes.size())
+      otbAppLogFATAL("There is " << outputs.size() << " output rasters, but " << images.size() << " images and "
+                                 << patchSizes.size() << " patch sizes");
+
+    const float        noDataValue = GetParameterFloat("nodata");
+    const bool         countNoData = static_cast<CountMode>(GetParameterInt("count")) == COUNT_NODATA;
+    const std::string  cacheDir = HasValue("cachedir") ? GetParameterString("cachedir") : "";
+    const unsigned int nbJobs = std::max<std::size_t>(std::min<std::size_t>(GetParameterInt("jobs"), images.size()), 1);
+    const unsigned int nbThreads = std::max(1u, itk::MultiThreader::GetGlobalDefaultNumberOfThreads() / nbJobs);
+    const unsigned int ram = std::max(1u, static_cast<unsigned int>(GetParameterInt("ram")) / nbJobs);
+    otbAppLogINFO("Processing " << images.size() << " images, " << nbJobs << " at a time (" << nbThreads
+                                << " threads each)");
+
+    GDALAllRegister();
+
+    // Images are processed by a pool of jobs: the logs are written one at a time, and the first error stops the
+    // jobs once their images are processed
+    std::atomic<std::size_t> next(0);
+    std::mutex               mutex;
+    std::string              error;
+    auto                     job = [&]() {
+      for (std::size_t i = next++; i < images.size(); i = next++)
+      {
+        try
+        {
+          std::string cacheFile;
+          if (!cacheDir.empty())
+            cacheFile = cacheDir + "/" + itksys::SystemTools::GetFilenameName(images[i]) + ".validity";
+          std::string             log;
+          const BitmapPointerType bitmap = GetValidityBitmap(images[i], cacheFile, noDataValue, nbThreads, ram, log);
+
+          GDALDatasetH imageDataset = GDALOpen(images[i].c_str(), GA_ReadOnly);
+          if (imageDataset == nullptr)
+            throw std::runtime_error("Unable to open " + images[i]);
+          bool written = true;
+          for (std::size_t j = 0; j < patchSizes.size() && written; j++)
+            written = WriteStatistics(
+              *bitmap, imageDataset, patchSizes[j], countNoData, outputs[i * patchSizes.size() + j]);
+          GDALClose(imageDataset);
+          if (!written)
+            throw std::runtime_error("Unable to write the statistics of " + images[i]);
+
+          std::lock_guard<std::mutex> lock(mutex);
+          otbAppLogINFO(images[i] << ": " << log << ", " << bitmap->GetNumberOfValidPixels() << " valid pixels");
+        }
+        catch (const std::exception & e)
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (error.empty())
+            error = e.what();
+          next = images.size();
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int j = 0; j < nbJobs; j++)
+      threads.emplace_back(job);
+    for (auto & thread : threads)
+      thread.join();
+    if (!error.empty())
+      otbAppLogFATAL(error);
+  }
+
+}; // end of class
+
+} // namespace Wrapper
+} // end namespace otb
+
+OTB_APPLICATION_EXPORT(otb::Wrapper::DecloudPatchesStatistics)
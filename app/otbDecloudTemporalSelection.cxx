@@ -0,0 +1,115 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "itkObjectFactory.h"
+#include "otbWrapperApplicationFactory.h"
+
+// Temporal index
+#include "otbTemporalIndex.h"
+
+namespace otb
+{
+
+namespace Wrapper
+{
+
+/**
+ * The OTB Application, that selects the images of a time series the closest to target dates.
+ */
+class DecloudTemporalSelection : public Application
+{
+public:
+  /** Standard class typedefs. */
+  typedef DecloudTemporalSelection      Self;
+  typedef Application                   Superclass;
+  typedef itk::SmartPointer<Self>       Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+
+  /** Standard macro */
+  itkNewMacro(Self);
+  itkTypeMacro(DecloudTemporalSelection, Application);
+
+  void
+  DoUpdateParameters()
+  {}
+
+  void
+  DoInit()
+  {
+
+    // Documentation
+    SetName("DecloudTemporalSelection");
+    SetDescription("This application selects the images of a time series the closest to target dates.");
+    SetDocLongDescription("This application takes as inputs the timestamps of the images of a time series, and the "
+                          "timestamps of target dates. For each target date, it returns the indices of the N images "
+                          "the closest to the date (optionally strictly before or after the date), from the closest "
+                          "to the farthest. Images at the same gap are ordered by index. This is the selection used "
+                          "by the batch mode of DecloudTimeSeriesPreProcessor.");
+    SetDocLimitations("None");
+    SetDocAuthors("Remi Cresson, Nicolas Narcon");
+
+    // Timestamps
+    AddParameter(ParameterType_StringList, "timestamps", "Timestamps of the images of the time series");
+    AddParameter(ParameterType_StringList, "targets", "Timestamps of the target dates");
+
+    // Selection
+    AddParameter(ParameterType_Choice, "period", "Period of the selected images, relatively to the target dates");
+    AddChoice("period.any", "Any image");
+    AddChoice("period.before", "Images strictly before the target date");
+    AddChoice("period.after", "Images strictly after the target date");
+    AddParameter(ParameterType_Int, "nimages", "Maximum number of selected images per target date");
+    SetDefaultParameterInt("nimages", 12);
+    SetMinimumParameterIntValue("nimages", 1);
+    AddParameter(
+      ParameterType_Float, "maxgap", "Maximum gap between the selected images and the target date, in seconds");
+    MandatoryOff("maxgap");
+
+    // Output
+    AddParameter(ParameterType_StringList,
+                 "out",
+                 "For each target date, the comma separated indices of the selected images, from the closest to "
+                 "the farthest");
+    SetParameterRole("out", Role_Output);
+  }
+
+  void
+  DoExecute()
+  {
+    // Temporal index of the time series
+    TemporalIndex::TimestampListType timestamps;
+    for (const auto & str : GetParameterStringList("timestamps"))
+      timestamps.push_back(std::stod(str));
+    const TemporalIndex index(timestamps);
+
+    const TemporalIndex::Period  period = static_cast<TemporalIndex::Period>(GetParameterInt("period"));
+    const unsigned int           nbImages = GetParameterInt("nimages");
+    TemporalIndex::TimestampType maxGap = std::numeric_limits<TemporalIndex::TimestampType>::max();
+    if (HasValue("maxgap"))
+      maxGap = GetParameterFloat("maxgap");
+
+    // Selection for each target date
+    std::vector<std::string> out;
+    for (const auto & target : GetParameterStringList("targets"))
+    {
+      std::string selection;
+      for (const auto idx : index.GetClosest(std::stod(target), period, nbImages, maxGap))
+        selection += (selection.empty() ? "" : ",") + std::to_string(idx);
+      otbAppLogINFO("Images selected for target date " << target << ": " << selection);
+      out.push_back(selection);
+    }
+    SetParameterStringList("out", out);
+  }
+
+}; // end of class
+
+} // namespace Wrapper
+} // end namespace otb
+
+OTB_APPLICATION_EXPORT(otb::Wrapper::DecloudTemporalSelection)
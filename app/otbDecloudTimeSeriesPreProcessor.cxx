@@ -16,18 +16,62 @@
 #include "otbStandardFilterWatcher.h"
 #include "itkFixedArray.h"
 
-// Stack
-#include "otbTensorflowSource.h"
+// Environment variables
 #include "otbTensorflowCommon.h"
 #include <vector>
 #include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <numeric>
+#include <unordered_map>
 
-// Functor
-#include "otbFunctorImageFilter.h"
+// Drilling filter
+#include "otbTimeSeriesDrillImageFilter.h"
 
-// Channels slices
+// Pairs formation
+#include "otbTimeSeriesPairing.h"
+#include "otbPairPlans.h"
+
+// Native pixel types
+#include "otbImageFileReader.h"
+#include "otbImageIOBase.h"
+
+// Batch mode
+#include "otbMultiImageFileWriter.h"
+
+// Footprints
+#include "otbStreamingFootprintImageFilter.h"
+#include "otbStreamingValidityBitmapImageFilter.h"
+#include "itksys/SystemTools.hxx"
+
+// Cache of decoded blocks
+#include "otbCachedImageFileReader.h"
+
+// Model serving
+#include "otbTensorflowGraphOperations.h"
+#include "otbTensorflowMultisourceModelFilter.h"
+#include "otbTensorflowStreamerFilter.h"
+
+// Low resolution outputs
+#include "itkShrinkImageFilter.h"
+#include "itkChangeInformationImageFilter.h"
+
+// Tile grid
+#include "otbTileGrid.h"
 #include "otbMultiChannelExtractROI.h"
+#include "gdal_utils.h"
+
+// Arrays of patches
+#include "otbPatchArrayWriter.h"
+
+// Performance report
+#include <chrono>
+#include <fstream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
 
 namespace otb
 {
@@ -38,182 +82,35 @@ namespace Wrapper
 // Name of the environment variable for the number of outputs
 const std::string ENV_VAR_NOUTPUTS = "DECLOUD_PREPROCESSING_NOUTPUTS";
 
-// Structure to store one timestamp and one index
-template <class TimestampType>
-struct TimestampWithIndex
+// Name of the environment variable for the number of pair-plans
+const std::string ENV_VAR_NPLANS = "DECLOUD_PREPROCESSING_NPLANS";
+
+// Footprints modes
+enum FootprintsMode
 {
-  TimestampType timestamp;
-  unsigned int  index;
+  FOOTPRINTS_NONE,   // No footprint
+  FOOTPRINTS_COMPUTE // Footprints computed from the images (or read from the cache directory)
 };
 
-// Sorting modes
-enum SortMode
+// Instruction sets, in the order of the "simd" parameter choices
+const simd::InstructionSet INSTRUCTION_SETS[] = { simd::AUTO, simd::SCALAR, simd::AVX2, simd::AVX512 };
+
+// Pixel type modes, in the order of the "pixeltype" parameter choices
+enum PixelTypeMode
 {
-  ASC, // Ascending order
-  DES, // Descending order
-  ABS  // Ascending order computed from the abs(t-tref)
+  PIXELTYPE_NATIVE, // Native pixel type of the images files
+  PIXELTYPE_FLOAT   // Float
 };
 
-/*
- * \class PixelFunction
- *
- * \brief Computes the output pixel from
- * - SAR pixels (stacked in channels)
- * - Optical pixels (stacked in channels)
- * - pairs (list of pair of SAR and Optical input images indices)
- * - Nodata (of SAR, and Optical)
- * - Number of channels (in SAR, and Optical)
- *
- * The function that computes the output pixel, outputs the stacked [SAR, Optical] pixels in channels
- *
- * \ingroup OTBDecloud
- */
-template <class TPixel, class TPairList>
-class PixelFunction
+// Processing modes, in the order of the "mode" parameter choices
+enum ProcessingMode
 {
-public:
-  PixelFunction() {}
-  ~PixelFunction() {}
-  bool
-  operator!=(const PixelFunction &) const
-  {
-    return false;
-  }
-  bool
-  operator==(const PixelFunction & other) const
-  {
-    return !(*this != other);
-  }
-
-  // Returns the output pixel size
-  std::size_t
-  OutputSize(std::array<size_t, 2ul> Inputs) const
-  {
-    return m_NbOutputImages * (m_SARNbBands + m_OptNbBands);
-  }
-
-  // Set parameters
-  void
-  SetParameters(TPairList    pairs,
-                unsigned int sarNbBands,
-                unsigned int optNbBands,
-                float        sarNdVal,
-                float        optNdVal,
-                unsigned int nbOutputImages)
-  {
-    m_Pairs = pairs;
-    m_SARNbBands = sarNbBands;
-    m_OptNbBands = optNbBands;
-    m_SARNoDataValue = sarNdVal;
-    m_OptNoDataValue = optNdVal;
-    m_NbOutputImages = nbOutputImages;
-  }
-
-  /*
-   * Get the pixel of n input image
-   */
-  TPixel
-  GetPixel(const TPixel & inPix, unsigned int idx, unsigned int nbBands) const
-  {
-    TPixel pix;
-    pix.SetSize(nbBands);
-
-    unsigned int outBand = 0;
-    unsigned int start = idx * nbBands;
-    for (unsigned int i = start; i < start + nbBands; i++)
-    {
-      pix[outBand] = inPix[i];
-      outBand++;
-    }
-
-    return pix;
-  }
-
-  /*
-   * Tell if the pixel is full on no-data values
-   */
-  bool
-  IsNoData(const TPixel & pix, const float noDataValue) const
-  {
-    for (unsigned int i = 0; i < pix.GetSize(); i++)
-      if (pix[i] != noDataValue)
-        return false;
-    return true;
-  }
-
-  /*
-   * Compute output pixel.
-   * inSARPix: pixel of the stacked SAR images (N x m_SARNbBands)
-   * inOptPix: pixel of the stacker optical images (M x m_OptNbBands)
-   */
-  inline TPixel
-  operator()(const TPixel & inSARPix, const TPixel & inOptPix) const
-  {
-
-    // Prepare output pixel
-    TPixel outPix;
-    outPix.SetSize(m_NbOutputImages * (m_SARNbBands + m_OptNbBands));
-    unsigned int outBand = 0, i = 0;
-    for (unsigned int imgIdx = 0; imgIdx < m_NbOutputImages; imgIdx++)
-    {
-      for (i = 0; i < m_SARNbBands; i++)
-      {
-        outPix[outBand] = m_SARNoDataValue;
-        outBand++;
-      }
-      for (i = 0; i < m_OptNbBands; i++)
-      {
-        outPix[outBand] = m_OptNoDataValue;
-        outBand++;
-      }
-    }
-
-    // Index of the current pair
-    unsigned int currentNbOutput = 0;
-
-    // Iterate through pairs
-    outBand = 0;
-    for (auto pair = m_Pairs.begin(); pair != m_Pairs.end() && currentNbOutput < m_NbOutputImages; ++pair)
-    {
-      unsigned int sarIdx = pair->first;  // Index of the SAR image
-      unsigned int optIdx = pair->second; // Index of the optical image
-
-      // Read pixels of both SAR and optical images
-      TPixel sarPix = GetPixel(inSARPix, sarIdx, m_SARNbBands);
-      TPixel optPix = GetPixel(inOptPix, optIdx, m_OptNbBands);
-
-      // Return the output pixel (concatenate SAR and optical pixel) if both pixels are not no-data
-      if (!IsNoData(sarPix, m_SARNoDataValue) && !IsNoData(optPix, m_OptNoDataValue))
-      {
-        for (i = 0; i < m_SARNbBands; i++)
-        {
-          outPix[outBand] = sarPix[i];
-          outBand++;
-        }
-        for (i = 0; i < m_OptNbBands; i++)
-        {
-          outPix[outBand] = optPix[i];
-          outBand++;
-        }
-        currentNbOutput++;
-      }
-
-    } // next pair
-
-    // Return the output pixel
-    return outPix;
-  }
-
-
-private:
-  unsigned int m_NbOutputImages;
-  TPairList    m_Pairs;
-  unsigned int m_SARNbBands;
-  unsigned int m_OptNbBands;
-  float        m_SARNoDataValue;
-  float        m_OptNoDataValue;
-}; // PixelFunction
-
+  MODE_PLANS, // Pair-plans given as parameters, outputs are the output images parameters
+  MODE_BATCH, // T-1 and T+1 pair-plans of several target dates, outputs are written in a directory
+  MODE_MODEL, // Pair-plans given as parameters, outputs are fed to a TensorFlow model
+  MODE_MOSAIC, // SAR images of the first plan only, closest first to a date: the output is their mosaic
+  MODE_PATCHES // Pair-plans given as parameters, outputs are written as arrays of patches in a directory
+};
 
 /**
  * The OTB Application, that does the work with the functor.
@@ -233,33 +130,70 @@ public:
   itkNewMacro(Self);
   itkTypeMacro(CRGAPreProcessor, Application);
 
-  /** Typedefs for image concatenation */
-  typedef TensorflowSource<FloatVectorImageType> TFSourceType;
-
   /** Typedefs for various stuff */
-  typedef float                                                     DeltaTimestampType;
-  typedef float                                                     TimestampType;
+  typedef TemporalIndex::TimestampType                              DeltaTimestampType;
+  typedef TemporalIndex::TimestampType                              TimestampType;
   typedef std::vector<TimestampType>                                TimestampList;
   typedef std::pair<unsigned int, unsigned int>                     IndicesPair;
   typedef std::vector<IndicesPair>                                  IndicesPairList;
-  typedef TimestampWithIndex<TimestampType>                         TimestampWithIndexType;
-  typedef std::vector<TimestampWithIndexType>                       TimestampWithIndexList;
+  typedef TimeSeriesPairing::TimestampWithIndexType                 TimestampWithIndexType;
+  typedef TimeSeriesPairing::TimestampWithIndexList                 TimestampWithIndexList;
   typedef std::pair<TimestampWithIndexType, TimestampWithIndexType> CandidatePairType;
   typedef std::vector<CandidatePairType>                            CandidatePairListType;
+  typedef std::pair<std::string, unsigned int>                      ImageRefType; // Images list key, and index
+  typedef std::vector<ImageRefType>                                 ImageRefList;
+  typedef std::unordered_map<std::string, unsigned int>             ImageIdMapType; // Index of selected images, per id
 
+  /** inputs */
+  typedef otb::ImageFileReader<FloatVectorImageType> FloatReaderType;
+  typedef otb::ImageIOBase::IOComponentType          ComponentType;
 
-  /** functor */
-  typedef FloatVectorImageType::PixelType           PixelType;
-  typedef PixelFunction<PixelType, IndicesPairList> FunctorType;
-  typedef otb::FunctorImageFilter<FunctorType>      FilterType;
+  /** footprints */
+  typedef std::vector<ImageFootprint>            FootprintListType;
+  typedef std::shared_ptr<const ValidityBitmap>  ValidityBitmapPointerType;
+  typedef std::vector<ValidityBitmapPointerType> ValidityBitmapListType;
 
-  /** slicing */
-  typedef otb::MultiChannelExtractROI<PixelType::ValueType, PixelType::ValueType> ExtractorType;
+  /** model serving */
+  typedef otb::TensorflowMultisourceModelFilter<FloatVectorImageType, FloatVectorImageType> ModelFilterType;
+  typedef otb::TensorflowStreamerFilter<FloatVectorImageType, FloatVectorImageType>         ModelStreamerType;
 
 
   void
   DoUpdateParameters()
-  {}
+  {
+    // In batch mode, outputs are written in the output directory. In model mode, outputs are fed to the model.
+    // With a tile grid, the tiles of the outputs are written in the grid directory.
+    const bool grid = HasValue("grid.outdir");
+    const bool plans = static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_PLANS && !grid;
+    for (unsigned int plan = 0; plan < m_Plans; plan++)
+      for (int i = 1; i <= m_Outputs; i++)
+        for (const std::string prefix : { "outsar", "outopt" })
+        {
+          if (!plans)
+            MandatoryOff(GetPlanKey(plan, prefix + std::to_string(i)));
+          else
+            MandatoryOn(GetPlanKey(plan, prefix + std::to_string(i)));
+        }
+    if (grid)
+      MandatoryOff("mode.model.out");
+    else
+      MandatoryOn("mode.model.out");
+    if (grid)
+      MandatoryOff("mode.mosaic.out");
+    else
+      MandatoryOn("mode.mosaic.out");
+
+    // In mosaic mode, only the SAR images of the first plan are used
+    const bool mosaic = static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_MOSAIC;
+    for (unsigned int plan = 0; plan < m_Plans; plan++)
+      for (const std::string key : { "ilsar", "timestampssar", "ilopt", "timestampsopt" })
+      {
+        if (mosaic && (plan > 0 || key == "ilopt" || key == "timestampsopt"))
+          MandatoryOff(GetPlanKey(plan, key));
+        else
+          MandatoryOn(GetPlanKey(plan, key));
+      }
+  }
 
   void
   DoInit()
@@ -270,24 +204,125 @@ public:
     SetDescription("This application prepares input time series of SAR/Optical sync pairs.");
     SetDocLongDescription("This application takes as inputs : 1 optical time series, 1 SAR time series, and their "
                           "respective timestamps lists. Change the " +
-                          ENV_VAR_NOUTPUTS + " environment variable to select the number of output images.");
+                          ENV_VAR_NOUTPUTS + " environment variable to select the number of output images. Change "
+                          "the " + ENV_VAR_NPLANS + " environment variable to process several pair-plans (e.g. T-1 "
+                          "and T+1 pairs) in a single pass: the parameters of the plan #N (N>1) are in the planN "
+                          "group, and the images shared between plans are read once. In batch mode, the T-1 and T+1 "
+                          "pairs of several target dates are computed from the images of the (first) plan in a "
+                          "single pass, and written in the output directory. In mosaic mode, the SAR images of the "
+                          "(first) plan are mosaicked, from the closest to the farthest to a date.");
     SetDocLimitations("None");
     SetDocAuthors("Remi Cresson, Nicolas Narcon");
 
-    // Input time series
-    AddParameter(ParameterType_InputImageList, "ilsar", "Input SAR images list");
-    AddParameter(ParameterType_InputImageList, "ilopt", "Input optical images list");
-
-    // Input timestamps
-    AddParameter(ParameterType_StringList, "timestampssar", "Input SAR images timestamps list");
-    AddParameter(ParameterType_StringList, "timestampsopt", "Input optical images timestamps list");
+    // Pair-plans: inputs, timestamps and sorting of each plan
+    m_Plans = std::max(otb::tf::GetEnvironmentVariableAsInt(ENV_VAR_NPLANS), 1);
+    for (unsigned int plan = 0; plan < m_Plans; plan++)
+    {
+      if (plan > 0)
+        AddParameter(ParameterType_Group, GetPlanKey(plan, ""), "Pair-plan #" + std::to_string(plan + 1));
+
+      // Input time series
+      AddParameter(ParameterType_InputImageList, GetPlanKey(plan, "ilsar"), "Input SAR images list");
+      AddParameter(ParameterType_InputImageList, GetPlanKey(plan, "ilopt"), "Input optical images list");
+      AddParameter(ParameterType_InputImageList,
+                   GetPlanKey(plan, "iloptlowres"),
+                   "Input optical images list at a lower resolution (e.g. the 20m bands), in the same order as the "
+                   "optical images list: the pairs are also drilled at this resolution, in the same execution");
+      MandatoryOff(GetPlanKey(plan, "iloptlowres"));
+
+      // Input timestamps
+      AddParameter(ParameterType_StringList, GetPlanKey(plan, "timestampssar"), "Input SAR images timestamps list");
+      AddParameter(
+        ParameterType_StringList, GetPlanKey(plan, "timestampsopt"), "Input optical images timestamps list");
+
+      // Sorting behavior
+      const std::string sortingKey = GetPlanKey(plan, "sorting");
+      AddParameter(ParameterType_Choice, sortingKey, "The way images pairs are sorted");
+      AddChoice(sortingKey + ".asc", "Sort pairs in ascending chronological order");
+      AddChoice(sortingKey + ".des", "Sort pairs in descending chronological order");
+      AddChoice(sortingKey + ".abs", "Sort pairs in descending absolute gap wrt. reference timestamp");
+      AddParameter(ParameterType_String, sortingKey + ".abs.reftimestamp", "Reference timestamp");
+    }
 
-    // Sorting behavior
-    AddParameter(ParameterType_Choice, "sorting", "The way images pairs are sorted");
-    AddChoice("sorting.asc", "Sort pairs in ascending chronological order");
-    AddChoice("sorting.des", "Sort pairs in descending chronological order");
-    AddChoice("sorting.abs", "Sort pairs in descending absolute gap wrt. reference timestamp");
-    AddParameter(ParameterType_String, "sorting.abs.reftimestamp", "Reference timestamp");
+    // Processing mode
+    AddParameter(ParameterType_Choice, "mode", "Processing mode");
+    AddChoice("mode.plans", "Compute the pair-plans given as parameters, and set the output images parameters");
+    AddChoice("mode.batch",
+              "Compute the T-1 and T+1 pairs of each target date from the images of the first plan (the whole time "
+              "series), and write the outputs of all target dates in a single pass");
+    AddParameter(ParameterType_StringList, "mode.batch.targets", "Timestamps of the target dates");
+    AddParameter(ParameterType_StringList,
+                 "mode.batch.names",
+                 "Names of the target dates, used to name the output files (default: timestamps)");
+    MandatoryOff("mode.batch.names");
+    AddParameter(ParameterType_Int,
+                 "mode.batch.nimagessar",
+                 "Number of SAR images selected before (T-1) and after (T+1) each target date, from the closest to "
+                 "the farthest");
+    SetDefaultParameterInt("mode.batch.nimagessar", 12);
+    SetMinimumParameterIntValue("mode.batch.nimagessar", 1);
+    AddParameter(ParameterType_Int,
+                 "mode.batch.nimagesopt",
+                 "Number of optical images selected before (T-1) and after (T+1) each target date, from the closest "
+                 "to the farthest");
+    SetDefaultParameterInt("mode.batch.nimagesopt", 12);
+    SetMinimumParameterIntValue("mode.batch.nimagesopt", 1);
+    AddParameter(ParameterType_Directory,
+                 "mode.batch.outdir",
+                 "Output directory. The outputs of each target date are named <name>_tm1_outsarN.tif, "
+                 "<name>_tm1_outoptN.tif, <name>_tp1_outsarN.tif and <name>_tp1_outoptN.tif");
+    AddParameter(ParameterType_Bool,
+                 "mode.batch.incremental",
+                 "Write the pair-plans of each target date in <outdir>/<name>.plans along with its outputs, and skip "
+                 "the target dates whose outputs exist and whose pairs are the ones of this file (e.g. when new "
+                 "acquisitions are added to the time series, only the target dates whose pairs change are computed)");
+    AddParameter(ParameterType_StringList, "mode.batch.updated", "Names of the target dates whose outputs are written");
+    SetParameterRole("mode.batch.updated", Role_Output);
+    AddChoice("mode.model",
+              "Compute the pair-plans given as parameters, and feed their outputs to a TensorFlow model, tile by "
+              "tile: the outputs are copied in the input tensors of the model, without intermediate images (only "
+              "float images are processed)");
+    AddParameter(ParameterType_Directory, "mode.model.dir", "SavedModel directory");
+    AddParameter(ParameterType_StringList,
+                 "mode.model.placeholders",
+                 "Placeholders of the outputs fed to the model, as <output key>=<placeholder> (e.g. "
+                 "outsar1=s1_tm1 outopt1=s2_tm1 plan2.outsar1=s1_tp1 plan2.outopt1=s2_tp1). The first one is the "
+                 "reference of the output grid");
+    AddParameter(
+      ParameterType_InputImageList, "mode.model.il", "Other sources of the model (e.g. S1 and S2 images at t, DEM)");
+    MandatoryOff("mode.model.il");
+    AddParameter(ParameterType_StringList, "mode.model.ilplaceholders", "Placeholders of the other sources");
+    MandatoryOff("mode.model.ilplaceholders");
+    AddParameter(ParameterType_StringList,
+                 "mode.model.ilscales",
+                 "Resolution factors of the other sources, wrt. the output grid (default: 1, e.g. 2 for a 20m DEM)");
+    MandatoryOff("mode.model.ilscales");
+    AddParameter(ParameterType_String, "mode.model.output", "Name of the output tensor");
+    AddParameter(ParameterType_Int, "mode.model.pad", "Margin of the tiles, for blocking artefacts removal");
+    SetDefaultParameterInt("mode.model.pad", 64);
+    SetMinimumParameterIntValue("mode.model.pad", 0);
+    AddParameter(ParameterType_Int, "mode.model.ts", "Size of the tiles (multiple of 64)");
+    SetDefaultParameterInt("mode.model.ts", 256);
+    SetMinimumParameterIntValue("mode.model.ts", 64);
+    AddParameter(ParameterType_OutputImage, "mode.model.out", "Output image of the model");
+    AddChoice("mode.mosaic",
+              "Mosaic of the SAR images of the first plan: each pixel is the first valid SAR pixel, with the images "
+              "sorted from the closest to the farthest to a date. Images are read only over the regions which are "
+              "not filled yet by the closer ones (the optical images are not used)");
+    AddParameter(ParameterType_String, "mode.mosaic.timestamp", "Timestamp of the date of the mosaic");
+    AddParameter(ParameterType_OutputImage, "mode.mosaic.out", "Mosaic of the SAR images");
+    AddChoice("mode.patches",
+              "Compute the pair-plans given as parameters, and write their outputs as arrays of square patches, "
+              "for training: each output is written in <outdir>/<key>.npy, a NumPy array of shape (patch rows, "
+              "patch cols, patch size, patch size, bands) with the native pixel type of the output, where each patch "
+              "is contiguous (e.g. to memory-map the arrays). The number of valid pixels of each patch is written in "
+              "<outdir>/<key>_valid.npy, the (row, col) of the patches whose pixels are all valid in all the outputs "
+              "in <outdir>/index.npy, and the description of the arrays (patch size, georeferencing of the patches, "
+              "files) in <outdir>/patches.json");
+    AddParameter(ParameterType_Directory, "mode.patches.outdir", "Output directory");
+    AddParameter(ParameterType_Int, "mode.patches.size", "Size of the patches, in pixels");
+    SetDefaultParameterInt("mode.patches.size", 64);
+    SetMinimumParameterIntValue("mode.patches.size", 1);
 
     // SAR-optical gap
     AddParameter(ParameterType_Float, "maxgap", "maximum gap between SAR and optical images in seconds (!!!");
@@ -299,25 +334,158 @@ public:
     AddParameter(ParameterType_Float, "nodataopt", "No data value for optical images");
     SetDefaultParameterFloat("nodataopt", -10000.0);
 
+    // Footprints
+    AddParameter(ParameterType_Choice, "footprints", "Footprints of the valid pixels of input images");
+    AddChoice("footprints.none", "Do not use footprints");
+    AddChoice("footprints.compute",
+              "Compute the footprint of each selected input image, and skip the pairs whose images have no valid "
+              "pixel in the processed region");
+    AddParameter(ParameterType_Int, "footprints.compute.blocksize", "Size of the footprints blocks, in pixels");
+    SetDefaultParameterInt("footprints.compute.blocksize", 256);
+    SetMinimumParameterIntValue("footprints.compute.blocksize", 1);
+    AddParameter(ParameterType_Directory,
+                 "footprints.compute.cachedir",
+                 "Directory where footprints are stored, and read from when already computed (only for input "
+                 "images read from files, named after the images file names)");
+    MandatoryOff("footprints.compute.cachedir");
+    AddParameter(ParameterType_Bool,
+                 "footprints.compute.bitmaps",
+                 "Compute the validity bitmap of each selected input image (one bit per pixel), derive the "
+                 "footprints from the bitmaps, and also skip the pairs whose images have no valid pixel among the "
+                 "pixels of the region not resolved yet. Bitmaps are stored in the cache directory too.");
+
+    // Pair-plans files
+    AddParameter(ParameterType_InputFilename,
+                 "inplans",
+                 "Pair-plans file written by a previous run (see outplans). The pairs are not formed again from the "
+                 "timestamps: the selected images and their pairs are read from the file");
+    MandatoryOff("inplans");
+    AddParameter(ParameterType_OutputFilename,
+                 "outplans",
+                 "Write the resolved pair-plans (selected images, pairs of indices, number of bands and no-data "
+                 "values) in this file");
+    MandatoryOff("outplans");
+
+    // Instruction set
+    AddParameter(ParameterType_Choice, "simd", "Instruction set used to drill the time series");
+    AddChoice("simd.auto", "Best instruction set supported by the CPU, selected at runtime (scalar code otherwise)");
+    AddChoice("simd.scalar", "Scalar code");
+    AddChoice("simd.avx2",
+              "AVX2 instructions: no-data tests of blocks of 8 pixels for 2 SAR bands with 4 or 6 optical bands, "
+              "of the bands of each float pixel otherwise");
+    AddChoice("simd.avx512", "AVX-512 instructions (see AVX2)");
+    AddParameter(ParameterType_Bool,
+                 "gpu",
+                 "Drill the time series on the CUDA device (the module must be built with -DOTBDecloud_USE_CUDA=ON): "
+                 "the inputs of the streamed regions are uploaded once, and the outputs downloaded once per "
+                 "pair-plan. The instruction set is then unused");
+
+    // Pixel type
+    AddParameter(ParameterType_Choice, "pixeltype", "Pixel type used to process the images");
+    AddChoice("pixeltype.native",
+              "Native pixel type of the images files: 16 bits integer images are processed in their encoding, other "
+              "images (and images not read from files) are processed as float images. Set the pixel type of the "
+              "outputs accordingly (e.g. uint16 for SAR and int16 for optical outputs) to avoid conversions");
+    AddChoice("pixeltype.float", "Process all images as float images");
+
+    // Input/output
+    AddParameter(ParameterType_Int,
+                 "iothreads",
+                 "Number of input images read concurrently ahead of the pairs being applied (0: images are read one "
+                 "after the other, when needed): the images of the next pairs over the streamed region being "
+                 "processed, then the images it has used over the next streamed region, while its outputs are "
+                 "written. Only used when all the selected images are read from files.");
+    SetDefaultParameterInt("iothreads", 0);
+    SetMinimumParameterIntValue("iothreads", 0);
+    AddParameter(ParameterType_Int,
+                 "blockcache",
+                 "Size of the cache of decoded blocks of the input images files, in MB (0: no cache). The cache is "
+                 "shared by all the DecloudTimeSeriesPreProcessor applications of the process: a block of a file is "
+                 "decoded once, as long as it stays in the cache. The last size set applies.");
+    SetDefaultParameterInt("blockcache", 0);
+    SetMinimumParameterIntValue("blockcache", 0);
+
+    // Tile grid
+    AddParameter(
+      ParameterType_Group, "grid", "Partition of the outputs in tiles, shared by the jobs of a multi-node run");
+    AddParameter(ParameterType_Directory,
+                 "grid.outdir",
+                 "Output directory of the tiles (not used by default). The tiles of the outputs (or of the model "
+                 "output, in model mode) are written in <outdir>/tiles/<key>_r<row>_c<col>.tif with a manifest per "
+                 "tile, the tiles already done are skipped, and the job which completes the grid assembles the tiles "
+                 "of each output in <outdir>/<key>.vrt");
+    MandatoryOff("grid.outdir");
+    AddParameter(ParameterType_Int, "grid.size", "Size of the tiles, in pixels");
+    SetDefaultParameterInt("grid.size", 2048);
+    SetMinimumParameterIntValue("grid.size", 64);
+    AddParameter(ParameterType_Int, "grid.jobindex", "Index of the job, in [0, jobcount)");
+    SetDefaultParameterInt("grid.jobindex", 0);
+    SetMinimumParameterIntValue("grid.jobindex", 0);
+    AddParameter(ParameterType_Int, "grid.jobcount", "Number of jobs: each job processes a contiguous range of tiles");
+    SetDefaultParameterInt("grid.jobcount", 1);
+    SetMinimumParameterIntValue("grid.jobcount", 1);
+
     // Output images
     m_Outputs = std::max(otb::tf::GetEnvironmentVariableAsInt(ENV_VAR_NOUTPUTS), 1);
-    for (int i = 1; i <= m_Outputs; i++)
-    {
-      std::stringstream sarKey, optKey;
-      sarKey << "outsar" << i;
-      optKey << "outopt" << i;
-      AddParameter(ParameterType_OutputImage, sarKey.str(), "output SAR image");
-      AddParameter(ParameterType_OutputImage, optKey.str(), "output optical image");
-    }
+    for (unsigned int plan = 0; plan < m_Plans; plan++)
+      for (int i = 1; i <= m_Outputs; i++)
+      {
+        std::stringstream sarKey, optKey;
+        sarKey << "outsar" << i;
+        optKey << "outopt" << i;
+        AddParameter(ParameterType_OutputImage, GetPlanKey(plan, sarKey.str()), "output SAR image");
+        AddParameter(ParameterType_OutputImage, GetPlanKey(plan, optKey.str()), "output optical image");
+        AddParameter(ParameterType_OutputImage,
+                     GetPlanKey(plan, sarKey.str() + "lowres"),
+                     "output SAR image at the resolution of the low resolution optical images (only with iloptlowres)");
+        AddParameter(ParameterType_OutputImage,
+                     GetPlanKey(plan, optKey.str() + "lowres"),
+                     "output low resolution optical image (only with iloptlowres)");
+        MandatoryOff(GetPlanKey(plan, sarKey.str() + "lowres"));
+        MandatoryOff(GetPlanKey(plan, optKey.str() + "lowres"));
+      }
+
+    AddRAMParameter();
+
+    // Performance report
+    AddParameter(ParameterType_OutputFilename,
+                 "report",
+                 "Collect statistics of the processing, and write them in this JSON file once the outputs are "
+                 "written: time spent reading each input and in the drilling kernel, bytes read, pairs applied on "
+                 "the CUDA device, pixels resolved by each pair of the plans, no-data fraction of the outputs, and "
+                 "peak memory of the process");
+    MandatoryOff("report");
+
+    // Memory model
+    AddParameter(ParameterType_Int,
+                 "bytesperpixel",
+                 "Estimated memory used per pixel of the processed regions, in bytes (buffers of the inputs used by "
+                 "the pair-plans, of the outputs, and of their conversion to the output pixel types)");
+    SetParameterRole("bytesperpixel", Role_Output);
+    AddParameter(ParameterType_Int,
+                 "tileheight",
+                 "Height of the largest strips of the output images that fit in the available RAM, from the "
+                 "estimated memory used per pixel (used to write the outputs in batch mode)");
+    SetParameterRole("tileheight", Role_Output);
 
     SetMultiWriting(true);
   }
 
+  // Returns the key of a parameter of a plan: plans #2 and more have their parameters in the "planN" group
+  static std::string
+  GetPlanKey(unsigned int plan, const std::string & key)
+  {
+    if (plan == 0)
+      return key;
+    const std::string group = "plan" + std::to_string(plan + 1);
+    return key.empty() ? group : group + "." + key;
+  }
+
   // Converts a std::string to a TimestampType
   TimestampType
   Str2Timestamp(std::string str)
   {
-    return std::stof(str);
+    return std::stod(str);
   }
 
   // Return a vector of timestamps with indices
@@ -326,187 +494,433 @@ public:
   {
     // Get timestamp from ParameterStringList
     otbAppLogINFO("Get timestamps of key " << key);
-    TimestampWithIndexList ts;
-    unsigned int           count = 0;
+    TimeSeriesPairing::TimestampListType timestamps;
     for (auto & str : GetParameterStringList(key))
-    {
-      TimestampWithIndexType newTimestampWithIndex;
-      newTimestampWithIndex.index = count;
-      newTimestampWithIndex.timestamp = Str2Timestamp(str);
-      ts.push_back(newTimestampWithIndex);
-      count++;
-    }
-
-    return ts;
+      timestamps.push_back(Str2Timestamp(str));
+    return TimeSeriesPairing::GetTimestampsWithIndices(timestamps);
   }
 
-  // Sort the elements from the timestamp
-  // The function modifies the "ts" vector.
+  // Log the sorting strategy of timestamps
   void
-  SortTimestampsWithIndices(TimestampWithIndexList & ts)
+  LogSortMode(SortMode sortMode, TimestampType refTimestamp)
   {
-    // Sort timestamp (3 different strategies)
-    SortMode sortMode = static_cast<SortMode>(GetParameterInt("sorting"));
     if (sortMode == ASC)
-    {
       otbAppLogINFO("Sorting timestamps in ascending order");
-      std::sort(ts.begin(), ts.end(), [](const TimestampWithIndexType & a, const TimestampWithIndexType & b) {
-        return a.timestamp < b.timestamp;
-      });
-    }
     else if (sortMode == DES)
-    {
       otbAppLogINFO("Sorting timestamps in descending order");
-      std::sort(ts.begin(), ts.end(), [](const TimestampWithIndexType & a, const TimestampWithIndexType & b) {
-        return a.timestamp > b.timestamp;
-      });
-    }
     else if (sortMode == ABS)
-    {
-      const TimestampType refTimestamp = Str2Timestamp(GetParameterAsString("sorting.abs.reftimestamp"));
       otbAppLogINFO("Sorting timestamps in ascending order from the gap with reference timestamp " << refTimestamp);
-      std::sort(
-        ts.begin(), ts.end(), [refTimestamp](const TimestampWithIndexType & a, const TimestampWithIndexType & b) {
-          return std::abs(a.timestamp - refTimestamp) < std::abs(b.timestamp - refTimestamp);
-        });
-    }
     else
       otbAppLogCRITICAL("Wrong sorting mode");
   }
 
-  // This function return a std::vector of pairs of SAR and Optical images indices.
+  // Sort the elements from the timestamp
+  // The function modifies the "ts" vector.
+  void
+  SortTimestampsWithIndices(TimestampWithIndexList & ts, SortMode sortMode, TimestampType refTimestamp)
+  {
+    LogSortMode(sortMode, refTimestamp);
+    TimeSeriesPairing::SortTimestampsWithIndices(ts, sortMode, refTimestamp);
+  }
+
+  // Returns the n images the closest to a target timestamp, strictly before or after it, from the closest to the
+  // farthest
+  static TimestampWithIndexList
+  GetClosestTimestamps(const TimestampWithIndexList & ts,
+                       const TemporalIndex &          index,
+                       TimestampType                  target,
+                       TemporalIndex::Period          period,
+                       unsigned int                   n)
+  {
+    TimestampWithIndexList closest;
+    for (const auto pos : index.GetClosest(target, period, n))
+      closest.push_back(ts[pos]);
+    return closest;
+  }
+
+  // This function return a std::vector of pairs of SAR and Optical images indices, for one plan.
   // The function uses the images timestamps to form the pairs.
   // After this function, the timestamps are not used anymore.
   IndicesPairList
-  GetCandidatesPairs()
+  GetCandidatesPairs(unsigned int plan)
   {
     // Get images timestamps and indices
-    TimestampWithIndexList sarTsWithIdxList = GetTimestampsWithIndices("timestampssar");
-    TimestampWithIndexList optTsWithIdxList = GetTimestampsWithIndices("timestampsopt");
+    TimestampWithIndexList sarTsWithIdxList = GetTimestampsWithIndices(GetPlanKey(plan, "timestampssar"));
+    TimestampWithIndexList optTsWithIdxList = GetTimestampsWithIndices(GetPlanKey(plan, "timestampsopt"));
+
+    // Sorting strategy of the optical images, from the application parameter choice "sorting"
+    const std::string sortingKey = GetPlanKey(plan, "sorting");
+    const SortMode    sortMode = static_cast<SortMode>(GetParameterInt(sortingKey));
+    TimestampType     refTimestamp = 0;
+    if (sortMode == ABS)
+      refTimestamp = Str2Timestamp(GetParameterAsString(sortingKey + ".abs.reftimestamp"));
+
+    IndicesPairList indicesPairs = GetCandidatesPairs(sarTsWithIdxList, optTsWithIdxList, sortMode, refTimestamp);
+    if (indicesPairs.size() == 0)
+    {
+      otbAppLogFATAL(<< "No S1/S2 pairs found. You could try to increase the maxgap and/or double check the dates of your timeseries");
+    }
+    return indicesPairs;
+  }
 
+  // Pairs of SAR and Optical images indices, formed from SAR and optical images timestamps
+  //  sarTsWithIdxList, optTsWithIdxList: timestamps and indices of the SAR and optical images
+  //  sortMode, refTimestamp: sorting strategy of the optical images
+  IndicesPairList
+  GetCandidatesPairs(const TimestampWithIndexList & sarTsWithIdxList,
+                     const TimestampWithIndexList & optTsWithIdxList,
+                     SortMode                       sortMode,
+                     TimestampType                  refTimestamp)
+  {
     // Get maxgap
     const DeltaTimestampType maxgap = GetParameterFloat("maxgap");
     if (maxgap < 3600.0)
       otbAppLogWARNING("maxgap is small (" << maxgap << " seconds). Did you miss to convert maxgap in seconds?");
 
-    // Sort the optical images timestamps using ASC, DES or ABS strategy, depending on
-    // the application parameter choice "sorting".
-    SortTimestampsWithIndices(optTsWithIdxList);
-
-    // Iterate over optical images, since they are freshly re-ordered
-    IndicesPairList indicesPairs;
-    for (auto optTsWithIdx : optTsWithIdxList)
-    {
-      // Timestamp of the optical image
-      TimestampType optTs = optTsWithIdx.timestamp;
-
-      // Index of the optical image, in the application parameter input image list
-      unsigned int optIdx = optTsWithIdx.index;
+    // Sort the optical images timestamps using ASC, DES or ABS strategy, then pair each optical image with the SAR
+    // images satisfying the maxgap, from the closest to the farthest
+    LogSortMode(sortMode, refTimestamp);
+    const IndicesPairList indicesPairs =
+      TimeSeriesPairing::GetCandidatesPairs(sarTsWithIdxList, optTsWithIdxList, sortMode, refTimestamp, maxgap);
 
-      // For each optical image, we sort the available SAR images from the closest to the farthest
-      // Indices are sorted such as the first index is the closest to the optical image timestamp
-      std::sort(sarTsWithIdxList.begin(),
-                sarTsWithIdxList.end(),
-                [&](const TimestampWithIndexType i, const TimestampWithIndexType j) {
-                  return std::abs(i.timestamp - optTs) < std::abs(j.timestamp - optTs);
-                });
+    otbAppLogDEBUG("Candidate pairs of indices:");
+    for (const auto & pair : indicesPairs)
+      otbAppLogDEBUG(<< "\tSAR: " << pair.first << " OPT: " << pair.second);
 
-      // Now we pick all SAR images satisfying the maxgap, in the sorted order.
-      // And we add them into the pairs list.
-      for (auto sarTsWithIdx : sarTsWithIdxList)
-        if (std::abs(sarTsWithIdx.timestamp - optTs) <= maxgap)
-          indicesPairs.push_back({ sarTsWithIdx.index, optIdx });
-    }
+    otbAppLogINFO("Number of candidate pairs: " << indicesPairs.size());
+    return indicesPairs;
+  }
 
-    otbAppLogINFO("Candidate pairs of indices:");
-    for (auto & indicesPair : indicesPairs)
-      otbAppLogINFO(<< "\t"
-                    << "SAR: " << indicesPair.first << " ("
-                    << std::to_string(sarTsWithIdxList[indicesPair.first].timestamp) << ") "
-                    << "OPT: " << indicesPair.second << " ("
-                    << std::to_string(optTsWithIdxList[indicesPair.second].timestamp) << ")");
+  // Identifier of an input image: its file name when it is read from a file, or its address
+  std::string
+  GetImageId(const ImageRefType & ref)
+  {
+    const std::string fileName = GetInputFileName(ref.first, ref.second);
+    if (!fileName.empty())
+      return "file:" + fileName;
+    std::ostringstream oss;
+    oss << "image:" << GetInputImage(ref.first, ref.second);
+    return oss.str();
+  }
 
-    if (indicesPairs.size() == 0)
-    {
-      otbAppLogFATAL(<< "No S1/S2 pairs found. You could try to increase the maxgap and/or double check the dates of your timeseries");
-    }
-    return indicesPairs;
+  // Add an image to the selected images (if not already selected), and return its index in the selected images
+  unsigned int
+  SelectImage(const ImageRefType & ref, ImageRefList & refs, ImageIdMapType & ids)
+  {
+    // Retrieve position in new index if its already in the list of used images
+    const std::string id = GetImageId(ref);
+    auto              search = ids.find(id);
+    if (search != ids.end())
+      return search->second;
+
+    // Add the new index if its not already in the list of used images
+    otbAppLogDEBUG("\tAdd " << ref.first << " image #" << ref.second);
+    refs.push_back(ref);
+    ids.emplace(id, refs.size() - 1);
+    return refs.size() - 1;
   }
 
-  // This function prepares the input layerstack for each source, and populates the factorised list of pairs (outPairs)
-  //  sarSrc: SAR source (modified in the function)
-  //  optSrc: Optical source (modified in the function)
+  // This function selects the input images of a plan, and populates the factorised list of pairs (outPairs)
+  //  sarKey, optKey: keys of the SAR and optical input images lists of the plan
   //  inIndicesPairs: a std::vector of std::pairs of indices. It describes the original paired images with their
   //  indices. outIndicesPairs: a std::vector of std::pairs of indices (modified in the function). It describes the
-  //  paired images with their indices, after we have removed all unused ones. inSARList: input SAR FloatVectorImageList
-  //  inOptList: input optical FloatVectorImageList
+  //  paired images with their indices in the selected images, after we have removed all unused ones.
+  // Images are selected in m_SARImages and m_OptImages, which are shared by all plans: an image used by several
+  // plans (e.g. the same file) is selected only once.
   void
-  InstantiateSources(TFSourceType &                    sarSrc,
-                     TFSourceType &                    optSrc,
-                     const IndicesPairList &           inIndicesPairs,
-                     IndicesPairList &                 outIndicesPairs,
-                     FloatVectorImageListType::Pointer inSARList,
-                     FloatVectorImageListType::Pointer inOptList)
+  InstantiateSources(const std::string &     sarKey,
+                     const std::string &     optKey,
+                     const IndicesPairList & inIndicesPairs,
+                     IndicesPairList &       outIndicesPairs)
   {
-
-    otbAppLogINFO("Preparing input images stacks");
-
-    // New images list, that will contain only the images that are in "inPairs"
-    FloatVectorImageListType::Pointer sarList = FloatVectorImageListType::New();
-    FloatVectorImageListType::Pointer optList = FloatVectorImageListType::New();
-
-    // Here we build SAR and optical stacks, and update pairs with the indices of the actual images used
+    // Here we select SAR and optical images, and update pairs with the indices of the actual images used
     outIndicesPairs.clear();
-    std::vector<unsigned int> sarOldIdx, optOldIdx;
-    unsigned int              sarNewIdxCounter = 0, optNewIdxCounter = 0;
-    unsigned int              sarNewIdx, optNewIdx;
     for (const auto pair : inIndicesPairs)
     {
       // Original indices
       const unsigned int sarIdx = pair.first;
       const unsigned int optIdx = pair.second;
 
-      // Add the new index if its not already in the list of used images
-      auto sarSearch = std::find(sarOldIdx.begin(), sarOldIdx.end(), sarIdx);
-      if (sarSearch == sarOldIdx.end())
+      // New indices
+      const unsigned int sarNewIdx = SelectImage({ sarKey, sarIdx }, m_SARImages, m_SARImageIds);
+      const unsigned int optNewIdx = SelectImage({ optKey, optIdx }, m_OptImages, m_OptImageIds);
+
+      // Update pairs with new indices
+      otbAppLogDEBUG("\tNew indices: SAR image #" << sarIdx << " --> " << sarNewIdx << ", Optical image #" << optIdx
+                                                  << " --> " << optNewIdx);
+      outIndicesPairs.push_back({ sarNewIdx, optNewIdx });
+    }
+  }
+
+  // Number of images of an input images list, without opening them
+  unsigned int
+  GetNumberOfInputImages(const std::string & imgsKey)
+  {
+    return GetParameterStringList(imgsKey).size();
+  }
+
+  // File name of an input image (empty when the image is not read from a file), without opening it
+  std::string
+  GetInputFileName(const std::string & imgsKey, unsigned int idx)
+  {
+    return GetParameterStringList(imgsKey)[idx];
+  }
+
+  // Input image of an images list. Only this image is opened: GetParameterImageList() would open all the images of
+  // the list, including the ones that are never paired.
+  FloatVectorImageType *
+  GetInputImage(const std::string & imgsKey, unsigned int idx)
+  {
+    return dynamic_cast<InputImageListParameter *>(GetParameterByKey(imgsKey))->GetNthImage(idx);
+  }
+
+  // Reader of an input image, or nullptr when the image is not read from a file
+  FloatReaderType *
+  GetInputReader(const std::string & imgsKey, unsigned int idx)
+  {
+    FloatVectorImageType * image = GetInputImage(imgsKey, idx);
+    image->UpdateOutputInformation();
+    return dynamic_cast<FloatReaderType *>(image->GetSource().GetPointer());
+  }
+
+  // Tell if all the selected images of a list are read from files
+  bool
+  AreReadFromFiles(const ImageRefList & refs)
+  {
+    return std::all_of(refs.begin(), refs.end(), [this](const ImageRefList::value_type & ref) {
+      return GetInputReader(ref.first, ref.second) != nullptr;
+    });
+  }
+
+  // Tell if a no-data value is exactly representable with a pixel type
+  template <class TValue>
+  static bool
+  IsRepresentable(float noDataValue)
+  {
+    return noDataValue >= static_cast<float>(std::numeric_limits<TValue>::lowest()) &&
+           noDataValue <= static_cast<float>(std::numeric_limits<TValue>::max()) &&
+           static_cast<float>(static_cast<TValue>(noDataValue)) == noDataValue;
+  }
+
+  /**
+   * Returns the pixel type used to process selected images: the component type of the images files if they are all
+   * 16 bits integers images of the same type, and if the no-data value is representable with this type. Otherwise,
+   * images are processed as float images.
+   * imgsLabel: label of the images (for logging)
+   * refs: selected images
+   * noDataValue: no-data value of the images
+   */
+  ComponentType
+  GetProcessingComponentType(const std::string & imgsLabel, const ImageRefList & refs, float noDataValue)
+  {
+    // The model is fed with float images
+    if (static_cast<PixelTypeMode>(GetParameterInt("pixeltype")) == PIXELTYPE_FLOAT ||
+        static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_MODEL)
+      return otb::ImageIOBase::FLOAT;
+
+    ComponentType componentType = otb::ImageIOBase::UNKNOWNCOMPONENTTYPE;
+    for (const auto & ref : refs)
+    {
+      FloatReaderType * reader = GetInputReader(ref.first, ref.second);
+      if (reader == nullptr || reader->GetImageIO() == nullptr)
       {
-        otbAppLogINFO("\tAdd SAR image #" << sarIdx);
-        sarOldIdx.push_back(sarIdx);
-        sarList->PushBack(inSARList->GetNthElement(sarIdx));
-        sarNewIdx = sarNewIdxCounter;
-        sarNewIdxCounter++;
+        otbAppLogINFO(ref.first << " image #" << ref.second << " is not read from a file: " << imgsLabel
+                                << " images are processed as float images");
+        return otb::ImageIOBase::FLOAT;
       }
-      // Retrieve position in new index if its already in the list of used images
-      else
+      const ComponentType imageComponentType = reader->GetImageIO()->GetComponentType();
+      if (componentType != otb::ImageIOBase::UNKNOWNCOMPONENTTYPE && imageComponentType != componentType)
       {
-        sarNewIdx = sarSearch - sarOldIdx.begin();
+        otbAppLogINFO(imgsLabel << " images have different pixel types: they are processed as float images");
+        return otb::ImageIOBase::FLOAT;
       }
+      componentType = imageComponentType;
+    }
+
+    if ((componentType == otb::ImageIOBase::SHORT && IsRepresentable<short>(noDataValue)) ||
+        (componentType == otb::ImageIOBase::USHORT && IsRepresentable<unsigned short>(noDataValue)))
+      return componentType;
+    return otb::ImageIOBase::FLOAT;
+  }
+
+  // Image of a file, read with a new reader (through the cache of decoded blocks when enabled)
+  template <class TImage>
+  TImage *
+  ReadImage(const std::string & filename)
+  {
+    typedef otb::ImageFileReader<TImage>       ReaderType;
+    typedef otb::CachedImageFileReader<TImage> CachedReaderType;
+    if (GetParameterInt("blockcache") > 0)
+    {
+      typename CachedReaderType::Pointer reader = CachedReaderType::New();
+      reader->SetFileName(filename);
+      m_Readers.push_back(reader.GetPointer());
+      return reader->GetOutput();
+    }
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(filename);
+    m_Readers.push_back(reader.GetPointer());
+    return reader->GetOutput();
+  }
+
+  // Selected images, in their native pixel type (read with new readers)
+  template <class TImage>
+  typename otb::ImageList<TImage>::Pointer
+  GetSelectedImages(const ImageRefList & refs, const TImage *)
+  {
+    typename otb::ImageList<TImage>::Pointer imgsList = otb::ImageList<TImage>::New();
+    for (const auto & ref : refs)
+      imgsList->PushBack(ReadImage<TImage>(GetInputFileName(ref.first, ref.second)));
+    return imgsList;
+  }
 
-      // Add the new index if its not already in the list of used images
-      auto optSearch = std::find(optOldIdx.begin(), optOldIdx.end(), optIdx);
-      if (optSearch == optOldIdx.end())
+  // Selected images, as float images (images files are read through the cache of decoded blocks, when enabled)
+  FloatVectorImageListType::Pointer
+  GetSelectedImages(const ImageRefList & refs, const FloatVectorImageType *)
+  {
+    FloatVectorImageListType::Pointer imgsList = FloatVectorImageListType::New();
+    for (const auto & ref : refs)
+    {
+      if (GetParameterInt("blockcache") > 0 && GetInputReader(ref.first, ref.second) != nullptr)
+        imgsList->PushBack(ReadImage<FloatVectorImageType>(GetInputFileName(ref.first, ref.second)));
+      else
+        imgsList->PushBack(GetInputImage(ref.first, ref.second));
+    }
+    return imgsList;
+  }
+
+  /**
+   * Compute the validity bitmap of an image, or read it from the cache file when it matches the image.
+   * image: input image
+   * name: name of the image, for the logs
+   * cacheFile: bitmap file (empty if no cache)
+   * noDataValue: no-data value of the image
+   */
+  template <class TImage>
+  ValidityBitmapPointerType
+  ComputeValidityBitmap(TImage * image, const std::string & name, const std::string & cacheFile, float noDataValue)
+  {
+    typedef otb::StreamingValidityBitmapImageFilter<TImage> BitmapFilterType;
+
+    const typename TImage::RegionType region = image->GetLargestPossibleRegion();
+    std::shared_ptr<ValidityBitmap>   bitmap = std::make_shared<ValidityBitmap>();
+    if (!cacheFile.empty() && bitmap->Load(cacheFile) &&
+        bitmap->Matches(region.GetIndex(0), region.GetIndex(1), region.GetSize(0), region.GetSize(1), noDataValue))
+    {
+      otbAppLogINFO("\tValidity bitmap of " << name << " read from " << cacheFile);
+      return bitmap;
+    }
+
+    otbAppLogINFO("\tComputing validity bitmap of " << name);
+    typename BitmapFilterType::Pointer bitmapFilter = BitmapFilterType::New();
+    bitmapFilter->SetInput(image);
+    bitmapFilter->SetNoDataValue(noDataValue);
+    AddProcess(bitmapFilter->GetStreamer(), "Computing validity bitmap of " + name);
+    bitmapFilter->Update();
+    bitmap = bitmapFilter->GetBitmap();
+    if (!cacheFile.empty() && !bitmap->Save(cacheFile))
+      otbAppLogWARNING("Unable to write validity bitmap file " << cacheFile);
+    return bitmap;
+  }
+
+  /**
+   * Compute the footprints of selected images.
+   * imgsList: selected images
+   * refs: input images lists keys and indices of the selected images
+   * noDataValue: no-data value of the images
+   * bitmaps: if not null, the validity bitmaps of the images are computed too, and the footprints are derived from
+   *          them
+   */
+  template <class TImage>
+  FootprintListType
+  ComputeFootprints(typename otb::ImageList<TImage>::Pointer imgsList,
+                    const ImageRefList &                     refs,
+                    float                                    noDataValue,
+                    ValidityBitmapListType *                 bitmaps = nullptr)
+  {
+    typedef otb::StreamingFootprintImageFilter<TImage> FootprintFilterType;
+
+    const unsigned int blockSize = GetParameterInt("footprints.compute.blocksize");
+    std::string        cacheDir;
+    if (HasValue("footprints.compute.cachedir"))
+      cacheDir = GetParameterString("footprints.compute.cachedir");
+
+    FootprintListType footprints;
+    for (unsigned int i = 0; i < imgsList->Size(); i++)
+    {
+      TImage * image = imgsList->GetNthElement(i);
+      image->UpdateOutputInformation();
+      const typename TImage::RegionType region = image->GetLargestPossibleRegion();
+
+      // Cached footprint file
+      const std::string  imgsKey = refs[i].first;
+      const unsigned int idx = refs[i].second;
+      FloatReaderType *  reader = GetInputReader(imgsKey, idx);
+      std::string        cacheFile;
+      if (!cacheDir.empty() && reader != nullptr)
+        cacheFile = cacheDir + "/" + itksys::SystemTools::GetFilenameName(reader->GetFileName());
+
+      ImageFootprint footprint;
+      if (bitmaps != nullptr)
       {
-        otbAppLogINFO("\tAdd optical image #" << optIdx);
-        optOldIdx.push_back(optIdx);
-        optList->PushBack(inOptList->GetNthElement(optIdx));
-        optNewIdx = optNewIdxCounter;
-        optNewIdxCounter++;
+        // The footprint is derived from the bitmap, without reading the image again
+        const std::string name = imgsKey + " image #" + std::to_string(idx);
+        bitmaps->push_back(
+          ComputeValidityBitmap<TImage>(image, name, cacheFile.empty() ? "" : cacheFile + ".validity", noDataValue));
+        footprint = bitmaps->back()->ToFootprint(blockSize);
+      }
+      else if (!cacheFile.empty() && footprint.Load(cacheFile + ".footprint") &&
+               footprint.Matches(
+                 region.GetIndex(0), region.GetIndex(1), region.GetSize(0), region.GetSize(1), blockSize, noDataValue))
+      {
+        otbAppLogINFO("\tFootprint of " << imgsKey << " image #" << idx << " read from " << cacheFile << ".footprint");
       }
-      // Retrieve position in new index if its already in the list of used images
       else
       {
-        optNewIdx = optSearch - optOldIdx.begin();
+        otbAppLogINFO("\tComputing footprint of " << imgsKey << " image #" << idx);
+        typename FootprintFilterType::Pointer footprintFilter = FootprintFilterType::New();
+        footprintFilter->SetInput(image);
+        footprintFilter->SetNoDataValue(noDataValue);
+        footprintFilter->SetBlockSize(blockSize);
+        AddProcess(footprintFilter->GetStreamer(),
+                   "Computing footprint of " + imgsKey + " image #" + std::to_string(idx));
+        footprintFilter->Update();
+        footprint = footprintFilter->GetFootprint();
+        if (!cacheFile.empty() && !footprint.Save(cacheFile + ".footprint"))
+          otbAppLogWARNING("Unable to write footprint file " << cacheFile << ".footprint");
       }
-
-      // Update pairs with new indices
-      otbAppLogINFO("\tNew indices: SAR image #" << sarIdx << " --> " << sarNewIdx << ", Optical image #" << optIdx
-                                                 << " --> " << optNewIdx);
-      outIndicesPairs.push_back({ sarNewIdx, optNewIdx });
+      if (footprint.IsEmpty())
+        otbAppLogINFO("\t" << imgsKey << " image #" << idx << " has no valid pixel");
+      footprints.push_back(footprint);
     }
+    return footprints;
+  }
+
+  // When no pair is left (e.g. no target date of the batch mode has images within the maxgap), the first images of
+  // the plan #1 are selected for the geometry and the numbers of bands of the outputs only: they are used by no pair,
+  // so their pixels are not read, and the outputs are filled with no-data
+  void
+  SelectImagesForGeometry()
+  {
+    if (!m_SARImages.empty())
+      return;
+    if (GetNumberOfInputImages("ilsar") == 0)
+      otbAppLogFATAL("There is no SAR image at input ilsar");
+    otbAppLogWARNING("No S1/S2 pairs found for any plan: outputs are filled with no-data");
+    SelectImage({ "ilsar", 0 }, m_SARImages, m_SARImageIds);
+    if (static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_MOSAIC)
+      return;
+    if (!HasValue("ilopt") || GetNumberOfInputImages("ilopt") == 0)
+      otbAppLogFATAL("There is no optical image at input ilopt");
+    SelectImage({ "ilopt", 0 }, m_OptImages, m_OptImageIds);
+  }
 
-    // Set source
-    sarSrc.Set(sarList);
-    optSrc.Set(optList);
+  // Summarize the selected images: the other input images are never opened
+  void
+  LogSelectedImages()
+  {
+    otbAppLogINFO("Selected images (only these images are opened): " << m_SARImages.size() << " SAR images, "
+                                                                     << m_OptImages.size() << " optical images");
   }
 
   /**
@@ -517,7 +931,7 @@ public:
   CheckNumbers(const std::string imgsKey, const std::string timestampKey)
   {
     // Check that images and timestamps sizes match
-    unsigned int nImgs = GetParameterImageList(imgsKey)->Size();
+    unsigned int nImgs = GetNumberOfInputImages(imgsKey);
     unsigned int nTimestamps = GetParameterStringList(timestampKey).size();
     if (nTimestamps != nImgs)
       otbAppLogFATAL("There is " << nImgs << " input images at input " << imgsKey << " but " << nTimestamps
@@ -530,116 +944,1264 @@ public:
   }
 
   /**
-   * Set-up the filter, and the slicers (because SAR and Optical images are stacked together)
-   * which is the last part of the pipeline
+   * Set-up the pipeline, in the pixel types used to process the SAR and optical images
    */
   void
-  InitFilter(FilterType::Pointer &                 filter,
-             std::vector<ExtractorType::Pointer> & sarSlicers,
-             std::vector<ExtractorType::Pointer> & optSlicers,
-             IndicesPairList &                     indicesPairs,
-             TFSourceType &                        sarSrc,
-             TFSourceType &                        optSrc)
+  InitPipeline()
   {
+    const ComponentType sarType = GetProcessingComponentType("SAR", m_SARImages, GetParameterFloat("nodatasar"));
+    otbAppLogINFO("Pixel type used to process SAR images: " << otb::ImageIOBase::GetComponentTypeAsString(sarType));
+    if (sarType == otb::ImageIOBase::SHORT)
+      InitPipeline<Int16VectorImageType>();
+    else if (sarType == otb::ImageIOBase::USHORT)
+      InitPipeline<UInt16VectorImageType>();
+    else
+      InitPipeline<FloatVectorImageType>();
+  }
 
-    // Clear slicers lists
-    sarSlicers.clear();
-    optSlicers.clear();
+  template <class TSARImage>
+  void
+  InitPipeline()
+  {
+    // Without optical images (mosaic mode), the optical outputs have no band
+    if (m_OptImages.empty())
+    {
+      InitFilter<TSARImage, TSARImage>();
+      return;
+    }
+    // Optical images are processed in the same pixel type at both resolutions
+    ImageRefList optImages = m_OptImages;
+    optImages.insert(optImages.end(), m_LowResOptImages.begin(), m_LowResOptImages.end());
+    const ComponentType optType = GetProcessingComponentType("optical", optImages, GetParameterFloat("nodataopt"));
+    otbAppLogINFO("Pixel type used to process optical images: "
+                  << otb::ImageIOBase::GetComponentTypeAsString(optType));
+    if (optType == otb::ImageIOBase::SHORT)
+      InitFilter<TSARImage, Int16VectorImageType>();
+    else if (optType == otb::ImageIOBase::USHORT)
+      InitFilter<TSARImage, UInt16VectorImageType>();
+    else
+      InitFilter<TSARImage, FloatVectorImageType>();
+  }
+
+  /**
+   * Set-up the filter, which is the last part of the pipeline: each output of the filter is an output of the
+   * application
+   */
+  template <class TSARImage, class TOptImage>
+  void
+  InitFilter()
+  {
+    typedef otb::TimeSeriesDrillImageFilter<TSARImage, TOptImage> DrillFilterType;
+    typedef typename DrillFilterType::SARValueType                SARValueType;
+    typedef typename DrillFilterType::OptValueType                OptValueType;
+
+    // Selected images
+    typename otb::ImageList<TSARImage>::Pointer sarList =
+      GetSelectedImages(m_SARImages, static_cast<const TSARImage *>(nullptr));
+    typename otb::ImageList<TOptImage>::Pointer optList =
+      GetSelectedImages(m_OptImages, static_cast<const TOptImage *>(nullptr));
 
     // Get the number of bands in images
-    GetParameterImageList("ilsar")->GetNthElement(0)->UpdateOutputInformation();
-    GetParameterImageList("ilopt")->GetNthElement(0)->UpdateOutputInformation();
-    unsigned int sarNbBands = GetParameterImageList("ilsar")->GetNthElement(0)->GetNumberOfComponentsPerPixel();
-    unsigned int optNbBands = GetParameterImageList("ilopt")->GetNthElement(0)->GetNumberOfComponentsPerPixel();
+    sarList->GetNthElement(0)->UpdateOutputInformation();
+    unsigned int sarNbBands = sarList->GetNthElement(0)->GetNumberOfComponentsPerPixel();
+    unsigned int optNbBands = 0;
+    if (optList->Size() > 0)
+    {
+      optList->GetNthElement(0)->UpdateOutputInformation();
+      optNbBands = optList->GetNthElement(0)->GetNumberOfComponentsPerPixel();
+    }
     otbAppLogINFO("Number of bands found in SAR images: " << sarNbBands);
     otbAppLogINFO("Number of bands found in Optical images: " << optNbBands);
+    if (m_PlansSARNbBands > 0 && (sarNbBands != m_PlansSARNbBands || optNbBands != m_PlansOptNbBands))
+      otbAppLogFATAL("The pair-plans file has been computed for " << m_PlansSARNbBands << " SAR bands and "
+                                                                  << m_PlansOptNbBands << " optical bands");
+    if (HasValue("outplans"))
+      ExportPlans(sarNbBands, optNbBands);
 
     // No-data values
     float sarNoData = GetParameterFloat("nodatasar");
     float optNoData = GetParameterFloat("nodataopt");
 
+    // Instruction set
+    const simd::InstructionSet requestedIS = INSTRUCTION_SETS[GetParameterInt("simd")];
+    const simd::InstructionSet is = simd::Resolve(requestedIS);
+    if (requestedIS != simd::AUTO && is != requestedIS)
+      otbAppLogWARNING("Instruction set " << simd::GetName(requestedIS) << " is not supported by the CPU");
+    otbAppLogINFO("Using instruction set: " << simd::GetName(is));
+    if (DrillFilterType::KernelType::IsSpecialized(sarNbBands, optNbBands))
+      otbAppLogINFO("Using drilling kernel specialized for " << sarNbBands << " SAR bands and " << optNbBands
+                                                             << " optical bands");
+
+    // CUDA device
+    bool useGPU = GetParameterInt("gpu");
+    if (useGPU && !DrillFilterType::IsGPUAvailable())
+    {
+      otbAppLogWARNING("No CUDA device available, or module built without CUDA: the time series is drilled on the CPU");
+      useGPU = false;
+    }
+    if (useGPU)
+      otbAppLogINFO("Drilling the time series on the CUDA device");
+
     // Initialize filter
-    filter = FilterType::New();
-    filter->GetModifiableFunctor().SetParameters(indicesPairs, sarNbBands, optNbBands, sarNoData, optNoData, m_Outputs);
-    filter->SetInputs(sarSrc.Get(), optSrc.Get());
+    typename DrillFilterType::Pointer filter = DrillFilterType::New();
+    const ProcessingMode mode = static_cast<ProcessingMode>(GetParameterInt("mode"));
+    const unsigned int   nbPlans = m_PairsIndices.size();
+    filter->SetNumberOfPlans(nbPlans);
+    for (unsigned int plan = 0; plan < nbPlans; plan++)
+    {
+      filter->SetPairs(plan, m_PairsIndices[plan]);
+      filter->SetNumberOfOutputImages(plan, mode == MODE_MOSAIC ? 1 : m_Outputs);
+    }
+    filter->SetSARNoDataValue(static_cast<SARValueType>(sarNoData));
+    filter->SetOptNoDataValue(static_cast<OptValueType>(optNoData));
+    filter->SetInstructionSet(is);
+    filter->SetUseGPU(useGPU);
+    filter->SetInputs(sarList, optList);
+
+    // Concurrent reads: in-memory pipelines may share filters, their images are read one after the other
+    unsigned int nbIOThreads = GetParameterInt("iothreads");
+    if (nbIOThreads > 0 && !(AreReadFromFiles(m_SARImages) && AreReadFromFiles(m_OptImages)))
+    {
+      otbAppLogINFO("Some selected images are not read from files: images are read one after the other");
+      nbIOThreads = 0;
+    }
+    filter->SetNumberOfIOThreads(nbIOThreads);
+    filter->SetCollectStatistics(HasValue("report"));
+    m_Filter = filter.GetPointer();
+
+    // Footprints (not computed for the images selected for the geometry only, see SelectImagesForGeometry())
+    const bool hasPairs = std::any_of(
+      m_PairsIndices.begin(), m_PairsIndices.end(), [](const IndicesPairList & pairs) { return !pairs.empty(); });
+    const bool useFootprints =
+      hasPairs && static_cast<FootprintsMode>(GetParameterInt("footprints")) == FOOTPRINTS_COMPUTE;
+    if (useFootprints)
+    {
+      otbAppLogINFO("Computing footprints of input images");
+      if (GetParameterInt("footprints.compute.bitmaps"))
+      {
+        ValidityBitmapListType sarBitmaps, optBitmaps;
+        filter->SetSARFootprints(ComputeFootprints<TSARImage>(sarList, m_SARImages, sarNoData, &sarBitmaps));
+        filter->SetOptFootprints(ComputeFootprints<TOptImage>(optList, m_OptImages, optNoData, &optBitmaps));
+        filter->SetSARValidityBitmaps(sarBitmaps);
+        filter->SetOptValidityBitmaps(optBitmaps);
+      }
+      else
+      {
+        filter->SetSARFootprints(ComputeFootprints<TSARImage>(sarList, m_SARImages, sarNoData));
+        filter->SetOptFootprints(ComputeFootprints<TOptImage>(optList, m_OptImages, optNoData));
+      }
+    }
 
-    // Initialize slicers
-    FloatVectorImageListType::Pointer sarList = FloatVectorImageListType::New();
-    FloatVectorImageListType::Pointer optList = FloatVectorImageListType::New();
-    unsigned int                      start = 1;
-    for (int i = 1; i <= m_Outputs; i++)
+    // Summary of the block cache, and of the regions and pairs skipped from the footprints, once outputs are written
+    DrillFilterType * drillFilter = filter.GetPointer();
+    const bool          useBlockCache = GetParameterInt("blockcache") > 0;
+    const unsigned long cacheHits = BlockCache::GetInstance().GetNumberOfHits();
+    const unsigned long cacheMisses = BlockCache::GetInstance().GetNumberOfMisses();
+    m_SummarizeFilter = [this, drillFilter, useFootprints, useBlockCache, cacheHits, cacheMisses]() {
+      if (useBlockCache)
+      {
+        const BlockCache & cache = BlockCache::GetInstance();
+        otbAppLogINFO("Cache of decoded blocks: " << cache.GetNumberOfHits() - cacheHits << " hits, "
+                                                  << cache.GetNumberOfMisses() - cacheMisses << " misses ("
+                                                  << cache.GetNumberOfBlocks() << " blocks, "
+                                                  << (cache.GetSize() >> 20) << " MB cached in the process)");
+      }
+      if (HasValue("report"))
+        WriteReport(drillFilter);
+      if (!useFootprints)
+        return;
+      otbAppLogINFO("Regions filled with no-data without reading inputs: "
+                    << drillFilter->GetNumberOfSkippedRegions() << " / "
+                    << drillFilter->GetNumberOfProcessedRegions());
+      otbAppLogINFO("Pairs skipped from footprints and validity bitmaps: " << drillFilter->GetNumberOfPrunedPairs());
+    };
+
+    // Write the outputs of all target dates in batch mode, or set outputs
+    filter->UpdateOutputInformation();
+    ComputeTileHeight(drillFilter);
+    if (mode == MODE_BATCH)
+    {
+      WriteBatchOutputs(drillFilter);
+      return;
+    }
+    if (mode == MODE_PATCHES)
+    {
+      WritePatches(drillFilter);
+      return;
+    }
+    if (mode == MODE_MOSAIC)
     {
-      // SAR image
-      ExtractorType::Pointer sarSlicer = ExtractorType::New();
-      sarSlicer->SetFirstChannel(start);
-      sarSlicer->SetLastChannel(start + sarNbBands - 1);
-      sarSlicer->SetInput(filter->GetOutput());
-      sarSlicer->UpdateOutputInformation();
-      sarSlicers.push_back(sarSlicer);
+      SetParameterOutputImage("mode.mosaic.out", filter->GetSAROutput(0, 0));
+      if (HasValue("grid.outdir"))
+        WriteTiles(drillFilter);
+      return;
+    }
+    for (unsigned int plan = 0; plan < nbPlans; plan++)
+      for (int i = 1; i <= m_Outputs; i++)
+      {
+        std::stringstream sarKey, optKey;
+        sarKey << "outsar" << i;
+        optKey << "outopt" << i;
+        SetParameterOutputImage(GetPlanKey(plan, sarKey.str()), filter->GetSAROutput(plan, i - 1));
+        SetParameterOutputImage(GetPlanKey(plan, optKey.str()), filter->GetOptOutput(plan, i - 1));
+      }
+    if (!m_LowResOptImages.empty())
+      InitLowResFilter(drillFilter, sarList, useFootprints);
+    if (mode == MODE_MODEL)
+      InitModel(filter.GetPointer());
+    if (HasValue("grid.outdir"))
+      WriteTiles(drillFilter);
+  }
 
-      // Optical image
-      ExtractorType::Pointer optSlicer = ExtractorType::New();
-      optSlicer->SetFirstChannel(sarNbBands + start);
-      optSlicer->SetLastChannel(start + sarNbBands + optNbBands - 1);
-      optSlicer->SetInput(filter->GetOutput());
-      optSlicer->UpdateOutputInformation();
-      optSlicers.push_back(optSlicer);
+  /**
+   * Set-up the filter of the low resolution outputs: the pairs of the plans are drilled again with the low resolution
+   * optical images, and the SAR images downsampled to their grid (nearest neighbour). Only the optical images are
+   * pruned from their footprints, since the footprints of the SAR images are computed at their own resolution.
+   */
+  template <class TSARImage, class TOptImage>
+  void
+  InitLowResFilter(otb::TimeSeriesDrillImageFilter<TSARImage, TOptImage> * filter,
+                   typename otb::ImageList<TSARImage>::Pointer             sarList,
+                   bool                                                    useFootprints)
+  {
+    typedef otb::TimeSeriesDrillImageFilter<TSARImage, TOptImage> DrillFilterType;
+    typedef itk::ShrinkImageFilter<TSARImage, TSARImage>          ShrinkFilterType;
+    typedef itk::ChangeInformationImageFilter<TSARImage>          ChangeInformationFilterType;
+
+    // The low resolution grid must be nested in the grid of the SAR images
+    typename otb::ImageList<TOptImage>::Pointer optList =
+      GetSelectedImages(m_LowResOptImages, static_cast<const TOptImage *>(nullptr));
+    const TSARImage * sarImage = sarList->GetNthElement(0);
+    TOptImage *       optImage = optList->GetNthElement(0);
+    optImage->UpdateOutputInformation();
+    const double       ratio = optImage->GetSpacing()[0] / sarImage->GetSpacing()[0];
+    const unsigned int factor = static_cast<unsigned int>(std::lround(ratio));
+    bool               nested = factor >= 2 && std::abs(ratio - factor) < 1e-6;
+    for (unsigned int dim = 0; dim < 2; dim++)
+    {
+      const double origin = sarImage->GetOrigin()[dim] + 0.5 * (factor - 1) * sarImage->GetSignedSpacing()[dim];
+      nested = nested && std::abs(optImage->GetOrigin()[dim] - origin) < 1e-3 * std::abs(sarImage->GetSpacing()[dim]);
+    }
+    if (!nested)
+      otbAppLogFATAL("The grid of the low resolution optical images must be nested in the grid of the SAR images, "
+                     "with a spacing multiple of the SAR images spacing");
+    otbAppLogINFO("Low resolution outputs: SAR images downsampled by a factor " << factor);
+
+    // Nearest neighbour downsampling: the origin is the one of the nested grid (the shrink filter aligns the centers
+    // of the images, which differ by half a pixel when a size is not a multiple of the factor)
+    typename otb::ImageList<TSARImage>::Pointer lowResSARList = otb::ImageList<TSARImage>::New();
+    for (unsigned int i = 0; i < sarList->Size(); i++)
+    {
+      typename ShrinkFilterType::Pointer shrinkFilter = ShrinkFilterType::New();
+      shrinkFilter->SetInput(sarList->GetNthElement(i));
+      shrinkFilter->SetShrinkFactors(factor);
+      typename ChangeInformationFilterType::Pointer changeInformationFilter = ChangeInformationFilterType::New();
+      changeInformationFilter->SetInput(shrinkFilter->GetOutput());
+      changeInformationFilter->SetOutputOrigin(optImage->GetOrigin());
+      changeInformationFilter->ChangeOriginOn();
+      m_Readers.push_back(shrinkFilter.GetPointer());
+      m_Readers.push_back(changeInformationFilter.GetPointer());
+      lowResSARList->PushBack(changeInformationFilter->GetOutput());
+    }
 
-      start += sarNbBands + optNbBands;
+    typename DrillFilterType::Pointer lowResFilter = DrillFilterType::New();
+    lowResFilter->SetNumberOfPlans(filter->GetNumberOfPlans());
+    for (unsigned int plan = 0; plan < filter->GetNumberOfPlans(); plan++)
+    {
+      lowResFilter->SetPairs(plan, m_PairsIndices[plan]);
+      lowResFilter->SetNumberOfOutputImages(plan, m_Outputs);
+    }
+    lowResFilter->SetSARNoDataValue(filter->GetSARNoDataValue());
+    lowResFilter->SetOptNoDataValue(filter->GetOptNoDataValue());
+    lowResFilter->SetInstructionSet(filter->GetInstructionSet());
+    lowResFilter->SetUseGPU(filter->GetUseGPU());
+    lowResFilter->SetInputs(lowResSARList, optList);
+    lowResFilter->SetNumberOfIOThreads(AreReadFromFiles(m_LowResOptImages) ? filter->GetNumberOfIOThreads() : 0);
+    if (useFootprints)
+    {
+      otbAppLogINFO("Computing footprints of low resolution optical images");
+      const float optNoData = GetParameterFloat("nodataopt");
+      if (GetParameterInt("footprints.compute.bitmaps"))
+      {
+        ValidityBitmapListType optBitmaps;
+        lowResFilter->SetOptFootprints(
+          ComputeFootprints<TOptImage>(optList, m_LowResOptImages, optNoData, &optBitmaps));
+        lowResFilter->SetOptValidityBitmaps(optBitmaps);
+      }
+      else
+        lowResFilter->SetOptFootprints(ComputeFootprints<TOptImage>(optList, m_LowResOptImages, optNoData));
     }
+    m_LowResFilter = lowResFilter.GetPointer();
+
+    for (unsigned int plan = 0; plan < filter->GetNumberOfPlans(); plan++)
+      for (int i = 1; i <= m_Outputs; i++)
+      {
+        SetParameterOutputImage(GetPlanKey(plan, "outsar" + std::to_string(i) + "lowres"),
+                                lowResFilter->GetSAROutput(plan, i - 1));
+        SetParameterOutputImage(GetPlanKey(plan, "outopt" + std::to_string(i) + "lowres"),
+                                lowResFilter->GetOptOutput(plan, i - 1));
+      }
   }
 
+  // Output of the filter of an output image key (e.g. "plan2.outopt1"), as a float image (nullptr if the key is
+  // not the key of an output, or if the outputs are not float images)
+  template <class TFilter>
+  FloatVectorImageType *
+  GetFloatOutput(TFilter * filter, const std::string & key)
+  {
+    for (unsigned int plan = 0; plan < filter->GetNumberOfPlans(); plan++)
+      for (int i = 1; i <= m_Outputs; i++)
+      {
+        itk::DataObject * output = nullptr;
+        if (key == GetPlanKey(plan, "outsar" + std::to_string(i)))
+          output = filter->GetSAROutput(plan, i - 1);
+        else if (key == GetPlanKey(plan, "outopt" + std::to_string(i)))
+          output = filter->GetOptOutput(plan, i - 1);
+        if (output != nullptr)
+          return dynamic_cast<FloatVectorImageType *>(output);
+      }
+    return nullptr;
+  }
+
+  /**
+   * Feed the outputs of the filter, and the other sources, to the TensorFlow model (like TensorflowModelServe does
+   * with a fully convolutional model, processing tiles of ts x ts pixels with a margin of pad pixels). The outputs
+   * of the filter are the inputs of the model filter, which copies them in the input tensors of each tile: they are
+   * not extracted and stacked again in intermediate images.
+   */
+  template <class TFilter>
   void
-  DoExecute()
+  InitModel(TFilter * filter)
+  {
+    typedef ModelFilterType::SizeType SizeType;
+
+    const unsigned int ts = GetParameterInt("mode.model.ts");
+    const unsigned int pad = GetParameterInt("mode.model.pad");
+    if (ts % 64 != 0)
+      otbAppLogFATAL("The tile size must be a multiple of 64");
+    const unsigned int rfield = ts + 2 * pad; // Receptive field
+    otbAppLogINFO("Receptive field: " << rfield << ", expression field: " << ts);
+
+    otbAppLogINFO("Loading model " << GetParameterAsString("mode.model.dir"));
+    otb::tf::LoadModel(GetParameterAsString("mode.model.dir"), m_SavedModel, { "serve" });
+    m_ModelFilter = ModelFilterType::New();
+    m_ModelFilter->SetSavedModel(&m_SavedModel);
+
+    // Outputs of the filter
+    for (const std::string & item : GetParameterStringList("mode.model.placeholders"))
+    {
+      const std::size_t sep = item.find('=');
+      if (sep == std::string::npos)
+        otbAppLogFATAL("Wrong placeholder " << item << ": expected <output key>=<placeholder>");
+      FloatVectorImageType * image = GetFloatOutput(filter, item.substr(0, sep));
+      if (image == nullptr)
+        otbAppLogFATAL("Wrong placeholder " << item << ": " << item.substr(0, sep) << " is not an output key");
+      otbAppLogINFO("Placeholder " << item.substr(sep + 1) << ": output " << item.substr(0, sep));
+      SizeType size;
+      size.Fill(rfield);
+      m_ModelFilter->PushBackInputTensorBundle(item.substr(sep + 1), size, image);
+    }
+
+    // Other sources, at the resolution of the output grid or coarser
+    const std::vector<std::string> placeholders = GetParameterStringList("mode.model.ilplaceholders");
+    const std::vector<std::string> scales = GetParameterStringList("mode.model.ilscales");
+    const unsigned int nbSources = HasValue("mode.model.il") ? GetNumberOfInputImages("mode.model.il") : 0;
+    if (placeholders.size() != nbSources || (!scales.empty() && scales.size() != nbSources))
+      otbAppLogFATAL("There is " << nbSources << " other sources but " << placeholders.size() << " placeholders and "
+                                 << scales.size() << " resolution factors");
+    for (unsigned int i = 0; i < nbSources; i++)
+    {
+      const float scale = scales.empty() ? 1.0 : std::stof(scales[i]);
+      SizeType    size;
+      size.Fill(static_cast<unsigned int>(rfield / scale));
+      otbAppLogINFO("Placeholder " << placeholders[i] << ": source #" << i << " (receptive field: " << size[0] << ")");
+      m_ModelFilter->PushBackInputTensorBundle(placeholders[i], size, GetInputImage("mode.model.il", i));
+    }
+
+    // Fully convolutional model, processing one tile at a time
+    SizeType efield;
+    efield.Fill(ts);
+    m_ModelFilter->SetOutputTensors({ GetParameterString("mode.model.output") });
+    m_ModelFilter->SetOutputExpressionFields({ efield });
+    m_ModelFilter->SetFullyConvolutional(true);
+    m_ModelStreamer = ModelStreamerType::New();
+    m_ModelStreamer->SetOutputGridSize(efield);
+    m_ModelStreamer->SetInput(m_ModelFilter->GetOutput());
+    SetParameterOutputImage("mode.model.out", m_ModelStreamer->GetOutput());
+  }
+
+  // Escape a string for JSON
+  static std::string
+  ToJSON(const std::string & str)
+  {
+    std::string json = "\"";
+    for (const char c : str)
+    {
+      if (c == '"' || c == '\\')
+        json += '\\';
+      if (static_cast<unsigned char>(c) >= 0x20)
+        json += c;
+    }
+    return json + "\"";
+  }
+
+  // Peak resident memory of the process, in kB (0 if unknown)
+  static long
+  GetPeakMemory()
+  {
+#if defined(__unix__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+      return usage.ru_maxrss;
+#elif defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+      return usage.ru_maxrss / 1024;
+#endif
+    return 0;
+  }
+
+  /**
+   * Write the statistics of the processing in the JSON report file.
+   * Pixels resolved by the pair #k of a plan have examined k pairs; pixels not resolved have examined all of them.
+   */
+  template <class TFilter>
+  void
+  WriteReport(TFilter * filter)
+  {
+    const typename TFilter::StatisticsType & stats = filter->GetStatistics();
+    const std::string                        filename = GetParameterString("report");
+    std::ofstream                            ofs(filename);
+    ofs.precision(6);
+    ofs << std::fixed << "{\n"
+        << "  \"wall_time\": " << std::chrono::duration<double>(std::chrono::steady_clock::now() - m_StartTime).count()
+        << ",\n"
+        << "  \"peak_memory_kb\": " << GetPeakMemory() << ",\n"
+        << "  \"regions\": " << filter->GetNumberOfProcessedRegions() << ",\n"
+        << "  \"regions_skipped\": " << filter->GetNumberOfSkippedRegions() << ",\n"
+        << "  \"pairs_pruned\": " << filter->GetNumberOfPrunedPairs() << ",\n"
+        << "  \"kernel_time\": " << stats.KernelTime << ",\n"
+        << "  \"input_wait_time\": " << stats.InputWaitTime << ",\n"
+        << "  \"gpu_pairs\": " << stats.GPUPairs << ",\n";
+
+    // Inputs
+    std::size_t bytesRead = 0;
+    ofs << "  \"inputs\": [";
+    for (std::size_t idx = 0; idx < stats.InputReads.size(); idx++)
+    {
+      const bool          sar = idx < m_SARImages.size();
+      const ImageRefType & ref = sar ? m_SARImages[idx] : m_OptImages[idx - m_SARImages.size()];
+      bytesRead += stats.InputBytesRead[idx];
+      ofs << (idx == 0 ? "\n" : ",\n") << "    {\"type\": " << (sar ? "\"sar\"" : "\"opt\"")
+          << ", \"key\": " << ToJSON(ref.first) << ", \"index\": " << ref.second
+          << ", \"id\": " << ToJSON(GetImageId(ref)) << ", \"reads\": " << stats.InputReads[idx]
+          << ", \"bytes_read\": " << stats.InputBytesRead[idx] << ", \"read_time\": " << stats.InputReadTime[idx]
+          << "}";
+    }
+    ofs << "\n  ],\n"
+        << "  \"bytes_read\": " << bytesRead << ",\n";
+
+    // Plans
+    ofs << "  \"plans\": [";
+    for (std::size_t plan = 0; plan < stats.Pixels.size(); plan++)
+    {
+      const std::size_t pixels = stats.Pixels[plan];
+      const double      nbOutputPixels = static_cast<double>(pixels) * filter->GetNumberOfOutputImages(plan);
+      ofs << (plan == 0 ? "\n" : ",\n") << "    {\"pairs\": " << stats.ResolvedPixels[plan].size()
+          << ", \"pixels\": " << pixels << ", \"unresolved_pixels\": " << stats.UnresolvedPixels[plan]
+          << ", \"nodata_fraction\": " << (nbOutputPixels > 0 ? stats.NoDataPixels[plan] / nbOutputPixels : 0.0)
+          << ",\n     \"resolved_by_pair\": [";
+      for (std::size_t pass = 0; pass < stats.ResolvedPixels[plan].size(); pass++)
+        ofs << (pass == 0 ? "" : ", ")
+            << (pixels > 0 ? static_cast<double>(stats.ResolvedPixels[plan][pass]) / pixels : 0.0);
+      ofs << "],\n     \"pairs_examined\": [";
+      for (std::size_t pass = 0; pass < stats.ResolvedPixels[plan].size(); pass++)
+        ofs << (pass == 0 ? "" : ", ")
+            << stats.ResolvedPixels[plan][pass] +
+                 (pass + 1 == stats.ResolvedPixels[plan].size() ? stats.UnresolvedPixels[plan] : 0);
+      ofs << "]}";
+    }
+    ofs << "\n  ]\n}\n";
+
+    if (!ofs)
+      otbAppLogWARNING("Unable to write report file " << filename);
+    else
+      otbAppLogINFO("Performance report written in " << filename);
+  }
+
+  /**
+   * Estimate the memory used per pixel of the processed regions, and the height of the largest strips of the output
+   * images that fit in the available RAM. On top of the buffers of the filter, the outputs are converted to the
+   * pixel types of the output images, and the images read through the cache of decoded blocks are buffered twice
+   * (by the file reader, and by the cached reader).
+   */
+  template <class TFilter>
+  void
+  ComputeTileHeight(TFilter * filter)
+  {
+    std::size_t bytesPerPixel = filter->GetMemoryPrintPerPixel() + filter->GetOutputsMemoryPrintPerPixel();
+    if (GetParameterInt("blockcache") > 0)
+      bytesPerPixel += filter->GetInputsMemoryPrintPerPixel();
+
+    const typename TFilter::RegionType region = filter->GetSAROutput(0)->GetLargestPossibleRegion();
+    const std::size_t                  ram = static_cast<std::size_t>(GetParameterInt("ram")) << 20;
+    const std::size_t                  bytesPerLine = std::max<std::size_t>(region.GetSize(0), 1) * bytesPerPixel;
+    m_TileHeight = std::max<std::size_t>(1, std::min<std::size_t>(region.GetSize(1), ram / bytesPerLine));
+    otbAppLogINFO("Estimated memory: " << bytesPerPixel << " bytes per pixel, " << (bytesPerLine >> 10)
+                                       << " kB per line of the output images: strips of " << m_TileHeight
+                                       << " lines fit in " << GetParameterInt("ram") << " MB");
+    SetParameterInt("bytesperpixel", bytesPerPixel);
+    SetParameterInt("tileheight", m_TileHeight);
+  }
+
+  /**
+   * Write the outputs of the filter in batch mode: the T-1 and T+1 plans of all target dates are written in a
+   * single pass, so that the images shared between target dates are read once per region
+   */
+  template <class TFilter>
+  void
+  WriteBatchOutputs(TFilter * filter)
+  {
+    const std::string outDir = GetParameterString("mode.batch.outdir");
+    if (!itksys::SystemTools::MakeDirectory(outDir))
+      otbAppLogFATAL("Unable to create output directory " << outDir);
+
+    otb::MultiImageFileWriter::Pointer writer = otb::MultiImageFileWriter::New();
+    for (unsigned int plan = 0; plan < filter->GetNumberOfPlans(); plan++)
+      for (int i = 1; i <= m_Outputs; i++)
+      {
+        writer->AddInputImage(filter->GetSAROutput(plan, i - 1), GetBatchFileName(plan, "outsar", i));
+        writer->AddInputImage(filter->GetOptOutput(plan, i - 1), GetBatchFileName(plan, "outopt", i));
+      }
+    otbAppLogINFO("Writing " << 2 * m_Outputs * filter->GetNumberOfPlans() << " output images in " << outDir);
+    writer->SetNumberOfLinesStrippedStreaming(m_TileHeight);
+    AddProcess(writer, "Writing outputs of " + std::to_string(m_BatchNames.size()) + " target dates");
+    writer->Update();
+
+    // Pair-plans of the target dates, once their outputs are written
+    if (GetParameterInt("mode.batch.incremental"))
+      for (unsigned int k = 0; k < m_BatchNames.size(); k++)
+      {
+        const std::string filename = outDir + "/" + m_BatchNames[k] + ".plans";
+        if (!GetTargetPlans(k, filter->GetSARNbBands(), filter->GetOptNbBands()).Save(filename))
+          otbAppLogFATAL("Unable to write pair-plans file " << filename);
+      }
+  }
+
+  /**
+   * Write the outputs of the filter in patches mode: the outputs are computed by strips of whole rows of patches (as
+   * high as the RAM allows), and each strip is appended to the array of patches of each output (see PatchArrayWriter).
+   * Then the numbers of valid pixels of the patches, the index of the patches valid in all the outputs, and the
+   * description of the arrays are written.
+   */
+  template <class TFilter>
+  void
+  WritePatches(TFilter * filter)
+  {
+    const std::string outDir = GetParameterString("mode.patches.outdir");
+    if (!itksys::SystemTools::MakeDirectory(outDir))
+      otbAppLogFATAL("Unable to create output directory " << outDir);
+
+    // Grid of the patches, from the upper left corner of the outputs
+    const typename TFilter::RegionType region = filter->GetSAROutput(0, 0)->GetLargestPossibleRegion();
+    const unsigned int                 patchSize = GetParameterInt("mode.patches.size");
+    const unsigned long                nbPatchesX = region.GetSize(0) / patchSize;
+    const unsigned long                nbPatchesY = region.GetSize(1) / patchSize;
+    if (nbPatchesX == 0 || nbPatchesY == 0)
+      otbAppLogFATAL("The outputs (" << region.GetSize(0) << "x" << region.GetSize(1) << " pixels) are smaller than "
+                                     << "one patch of " << patchSize << " pixels");
+    const unsigned long patchRowsPerStrip = std::max(1u, m_TileHeight / patchSize);
+    otbAppLogINFO("Writing " << 2 * m_Outputs * filter->GetNumberOfPlans() << " arrays of " << nbPatchesX << "x"
+                             << nbPatchesY << " patches in " << outDir << ", " << patchRowsPerStrip
+                             << " rows of patches at a time");
+
+    // One writer per output, which appends the rows of patches of a strip once the strip is computed
+    std::vector<std::string>                       keys;
+    std::vector<std::unique_ptr<PatchArrayWriter>> writers;
+    std::vector<std::function<void(const typename TFilter::RegionType &)>> writeStrip;
+    const double sarNoData = GetParameterFloat("nodatasar");
+    const double optNoData = GetParameterFloat("nodataopt");
+    for (unsigned int plan = 0; plan < filter->GetNumberOfPlans(); plan++)
+      for (int i = 1; i <= m_Outputs; i++)
+      {
+        keys.push_back(GetPlanKey(plan, "outsar" + std::to_string(i)));
+        writers.emplace_back(new PatchArrayWriter());
+        writeStrip.push_back(OpenPatchArray(
+          filter->GetSAROutput(plan, i - 1), outDir, keys.back(), patchSize, sarNoData, *writers.back()));
+        keys.push_back(GetPlanKey(plan, "outopt" + std::to_string(i)));
+        writers.emplace_back(new PatchArrayWriter());
+        writeStrip.push_back(OpenPatchArray(
+          filter->GetOptOutput(plan, i - 1), outDir, keys.back(), patchSize, optNoData, *writers.back()));
+      }
+
+    // Strips of whole rows of patches: the update of the first output computes the strip of all the outputs
+    for (unsigned long py = 0; py < nbPatchesY; py += patchRowsPerStrip)
+    {
+      typename TFilter::RegionType strip;
+      strip.SetIndex(0, region.GetIndex(0));
+      strip.SetIndex(1, region.GetIndex(1) + py * patchSize);
+      strip.SetSize(0, nbPatchesX * patchSize);
+      strip.SetSize(1, std::min(patchRowsPerStrip, nbPatchesY - py) * patchSize);
+      for (const auto & write : writeStrip)
+        write(strip);
+      otbAppLogDEBUG("Rows of patches " << py << " to " << py + strip.GetSize(1) / patchSize << " written");
+    }
+
+    // Valid pixels of the patches, and patches whose pixels are all valid in all the outputs
+    const std::uint32_t             patchArea = patchSize * patchSize;
+    PatchArrayWriter::CountListType index;
+    std::vector<bool>               valid(nbPatchesX * nbPatchesY, true);
+    for (unsigned int k = 0; k < writers.size(); k++)
+    {
+      const std::string filename = outDir + "/" + keys[k] + "_valid.npy";
+      if (!writers[k]->Close() ||
+          !PatchArrayWriter::WriteArray(filename, writers[k]->GetValidCounts(), { nbPatchesY, nbPatchesX }))
+        otbAppLogFATAL("Unable to write " << filename);
+      for (std::size_t patch = 0; patch < valid.size(); patch++)
+        valid[patch] = valid[patch] && writers[k]->GetValidCounts()[patch] == patchArea;
+    }
+    for (std::size_t patch = 0; patch < valid.size(); patch++)
+      if (valid[patch])
+      {
+        index.push_back(patch / nbPatchesX);
+        index.push_back(patch % nbPatchesX);
+      }
+    if (!PatchArrayWriter::WriteArray(outDir + "/index.npy", index, { index.size() / 2, 2 }))
+      otbAppLogFATAL("Unable to write " << outDir << "/index.npy");
+    otbAppLogINFO(index.size() / 2 << " patches of " << nbPatchesX * nbPatchesY << " are valid in all the outputs");
+
+    // Description of the arrays: georeferencing of the upper left corner of the first patch, and spacing
+    const auto *  image = filter->GetSAROutput(0, 0);
+    std::ofstream ofs(outDir + "/patches.json");
+    ofs.precision(10);
+    ofs << "{\n"
+        << "  \"patchsize\": " << patchSize << ",\n"
+        << "  \"rows\": " << nbPatchesY << ",\n"
+        << "  \"cols\": " << nbPatchesX << ",\n"
+        << "  \"origin\": [" << image->GetOrigin()[0] - 0.5 * image->GetSignedSpacing()[0] << ", "
+        << image->GetOrigin()[1] - 0.5 * image->GetSignedSpacing()[1] << "],\n"
+        << "  \"spacing\": [" << image->GetSignedSpacing()[0] << ", " << image->GetSignedSpacing()[1] << "],\n"
+        << "  \"projection\": " << ToJSON(image->GetProjectionRef()) << ",\n"
+        << "  \"index\": \"index.npy\",\n"
+        << "  \"outputs\": {";
+    for (unsigned int k = 0; k < keys.size(); k++)
+      ofs << (k > 0 ? "," : "") << "\n    " << ToJSON(keys[k]) << ": {\"array\": " << ToJSON(keys[k] + ".npy")
+          << ", \"valid\": " << ToJSON(keys[k] + "_valid.npy") << "}";
+    ofs << "\n  }\n}\n";
+    if (!ofs)
+      otbAppLogFATAL("Unable to write " << outDir << "/patches.json");
+  }
+
+  /**
+   * Open the array of patches of an output in patches mode (<outDir>/<key>.npy), and return the function computing a
+   * strip of the output and appending its rows of patches to the array
+   */
+  template <class TImage>
+  std::function<void(const typename TImage::RegionType &)>
+  OpenPatchArray(TImage *            image,
+                 const std::string & outDir,
+                 const std::string & key,
+                 unsigned int        patchSize,
+                 double              noDataValue,
+                 PatchArrayWriter &  writer)
+  {
+    typedef typename TImage::RegionType        RegionType;
+    typedef typename TImage::InternalPixelType ValueType;
+    const RegionType region = image->GetLargestPossibleRegion();
+    if (!writer.Open<ValueType>(outDir + "/" + key + ".npy",
+                                region.GetSize(0),
+                                region.GetSize(1),
+                                image->GetNumberOfComponentsPerPixel(),
+                                patchSize,
+                                noDataValue))
+      otbAppLogFATAL("Unable to write " << outDir << "/" << key << ".npy");
+    return [this, image, key, patchSize, &writer](const RegionType & strip) {
+      image->SetRequestedRegion(strip);
+      image->Update();
+      const std::size_t nbBands = image->GetNumberOfComponentsPerPixel();
+      if (!writer.WritePatchRows(image->GetBufferPointer() + image->ComputeOffset(strip.GetIndex()) * nbBands,
+                                 image->GetBufferedRegion().GetSize(0) * nbBands,
+                                 strip.GetSize(1) / patchSize))
+        otbAppLogFATAL("Unable to write the patches of " << key);
+    };
+  }
+
+  // Output file of a plan in batch mode (plans #2k and #2k+1 are the T-1 and T+1 plans of the target date #k)
+  std::string
+  GetBatchFileName(unsigned int plan, const std::string & prefix, int i)
+  {
+    const std::string suffix = (plan % 2 == 0 ? "_tm1_" : "_tp1_");
+    return GetParameterString("mode.batch.outdir") + "/" + m_BatchNames[plan / 2] + suffix + prefix +
+           std::to_string(i) + ".tif";
+  }
+
+  // Pair-plans of the target date #k (its T-1 and T+1 plans, with the images they use)
+  PairPlans
+  GetTargetPlans(unsigned int k, unsigned int sarNbBands, unsigned int optNbBands)
+  {
+    PairPlans plans;
+    plans.SetParameters(
+      sarNbBands, optNbBands, GetParameterFloat("nodatasar"), GetParameterFloat("nodataopt"), m_Outputs);
+    std::unordered_map<unsigned int, unsigned int> sarIndices, optIndices; // Indices in the images of the target
+    for (unsigned int plan = 2 * k; plan < 2 * k + 2; plan++)
+    {
+      plans.GetPlans().push_back(IndicesPairList());
+      for (const auto & pair : m_PairsIndices[plan])
+      {
+        const ImageRefType & sarRef = m_SARImages[pair.first];
+        const ImageRefType & optRef = m_OptImages[pair.second];
+        if (sarIndices.emplace(pair.first, plans.GetSARImages().size()).second)
+          plans.GetSARImages().push_back({ sarRef.first, sarRef.second, GetImageId(sarRef) });
+        if (optIndices.emplace(pair.second, plans.GetOptImages().size()).second)
+          plans.GetOptImages().push_back({ optRef.first, optRef.second, GetImageId(optRef) });
+        plans.GetPlans().back().push_back({ sarIndices[pair.first], optIndices[pair.second] });
+      }
+    }
+    return plans;
+  }
+
+  /**
+   * Skip the target dates whose outputs are up to date, in incremental batch mode: their outputs exist, and their
+   * pairs are the ones they have been computed from. The pair-plans file of the other target dates is removed until
+   * their outputs are written again. Images which are not read from files can't be compared with the ones of a
+   * previous run: target dates using such images are always computed. Only the images used by the remaining target
+   * dates stay selected.
+   */
+  void
+  SkipUnchangedTargets()
+  {
+    const std::string            outDir = GetParameterString("mode.batch.outdir");
+    std::vector<std::string>     names;
+    std::vector<IndicesPairList> pairsIndices;
+    for (unsigned int k = 0; k < m_BatchNames.size(); k++)
+    {
+      const std::string filename = outDir + "/" + m_BatchNames[k] + ".plans";
+      PairPlans         plans = GetTargetPlans(k, 0, 0);
+      PairPlans         done;
+      bool              upToDate = done.Load(filename) && done.HasSamePairs(plans);
+      for (const auto & images : { plans.GetSARImages(), plans.GetOptImages() })
+        for (const auto & image : images)
+          upToDate = upToDate && image.id.compare(0, 5, "file:") == 0;
+      for (unsigned int plan = 2 * k; plan < 2 * k + 2; plan++)
+        for (int i = 1; i <= m_Outputs; i++)
+          upToDate = upToDate && itksys::SystemTools::FileExists(GetBatchFileName(plan, "outsar", i), true) &&
+                     itksys::SystemTools::FileExists(GetBatchFileName(plan, "outopt", i), true);
+      if (upToDate)
+      {
+        otbAppLogINFO("Target date " << m_BatchNames[k] << " is up to date: its outputs are not computed again");
+        continue;
+      }
+      std::remove(filename.c_str());
+      names.push_back(m_BatchNames[k]);
+      pairsIndices.push_back(m_PairsIndices[2 * k]);
+      pairsIndices.push_back(m_PairsIndices[2 * k + 1]);
+    }
+    m_BatchNames = names;
+
+    // Select again the images used by the remaining target dates only (the images of the skipped ones are neither
+    // opened nor drilled), and update their pairs with the new indices
+    const ImageRefList sarImages = m_SARImages;
+    const ImageRefList optImages = m_OptImages;
+    m_SARImages.clear();
+    m_OptImages.clear();
+    m_SARImageIds.clear();
+    m_OptImageIds.clear();
+    m_PairsIndices.clear();
+    for (const auto & indicesPairs : pairsIndices)
+    {
+      m_PairsIndices.push_back(IndicesPairList());
+      for (const auto & pair : indicesPairs)
+        m_PairsIndices.back().push_back({ SelectImage(sarImages[pair.first], m_SARImages, m_SARImageIds),
+                                          SelectImage(optImages[pair.second], m_OptImages, m_OptImageIds) });
+    }
+
+    // The remaining target dates may have no pairs: their outputs are filled with no-data
+    if (!m_BatchNames.empty())
+      SelectImagesForGeometry();
+  }
+
+  // Extract a tile of an output image, written by the writer of the tile
+  template <class TImage>
+  void
+  AddTileOutput(otb::MultiImageFileWriter * writer,
+                TImage *                    image,
+                const std::string &         filename,
+                const otb::TileGrid &       grid,
+                unsigned long               tile)
+  {
+    typedef typename TImage::InternalPixelType                ValueType;
+    typedef otb::MultiChannelExtractROI<ValueType, ValueType> ExtractType;
+
+    long          x, y;
+    unsigned long sizeX, sizeY;
+    grid.GetTile(tile, x, y, sizeX, sizeY);
+    typename ExtractType::Pointer extract = ExtractType::New();
+    extract->SetInput(image);
+    extract->SetStartX(x);
+    extract->SetStartY(y);
+    extract->SetSizeX(sizeX);
+    extract->SetSizeY(sizeY);
+    writer->AddInputImage(extract->GetOutput(), filename);
+    m_TileFilters.push_back(extract.GetPointer());
+  }
+
+  /**
+   * Write the tiles of the job: the tiles of all the outputs (or of the model output, in model mode) are written in
+   * a single pass per tile, then the manifest of the tile. Tiles which have a manifest are skipped, so that a job
+   * restarted after a pre-emption only processes the remaining tiles.
+   */
+  template <class TFilter>
+  void
+  WriteTiles(TFilter * filter)
+  {
+    const std::string  outDir = GetParameterString("grid.outdir");
+    const std::string  tilesDir = outDir + "/tiles";
+    const unsigned int jobIndex = GetParameterInt("grid.jobindex");
+    const unsigned int jobCount = GetParameterInt("grid.jobcount");
+    if (jobIndex >= jobCount)
+      otbAppLogFATAL("The job index must be less than the number of jobs (" << jobCount << ")");
+    if (!itksys::SystemTools::MakeDirectory(tilesDir))
+      otbAppLogFATAL("Unable to create output directory " << tilesDir);
+
+    // Grid of the model output in model mode, else of the outputs of the filter
+    const bool model = static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_MODEL;
+    if (model)
+      m_ModelStreamer->UpdateOutputInformation();
+    const auto &  region = model ? m_ModelStreamer->GetOutput()->GetLargestPossibleRegion()
+                                 : filter->GetSAROutput(0, 0)->GetLargestPossibleRegion();
+    otb::TileGrid grid;
+    grid.Initialize(
+      region.GetIndex(0), region.GetIndex(1), region.GetSize(0), region.GetSize(1), GetParameterInt("grid.size"));
+    const auto tiles = grid.GetJobTiles(jobIndex, jobCount);
+    otbAppLogINFO("Grid of " << grid.GetNumberOfTilesX() << "x" << grid.GetNumberOfTilesY() << " tiles: job #"
+                             << jobIndex << " processes tiles " << tiles.first << " to " << tiles.second);
+
+    unsigned long nbSkipped = 0;
+    for (unsigned long tile = tiles.first; tile < tiles.second; tile++)
+    {
+      const std::string name = grid.GetTileName(tile);
+      const std::string                  manifest = tilesDir + "/" + name + ".manifest";
+      const otb::TileGrid::SignatureType signature = GetTileSignature(filter, grid, tile);
+      if (grid.IsDone(manifest, tile, signature))
+      {
+        nbSkipped++;
+        continue;
+      }
+
+      otb::MultiImageFileWriter::Pointer writer = otb::MultiImageFileWriter::New();
+      otb::TileGrid::FileListType        files;
+      m_TileFilters.clear();
+      if (model)
+      {
+        files.push_back({ "model", tilesDir + "/model_" + name + ".tif" });
+        AddTileOutput(writer.GetPointer(), m_ModelStreamer->GetOutput(), files.back().second, grid, tile);
+      }
+      else if (static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_MOSAIC)
+      {
+        files.push_back({ "mosaic", tilesDir + "/mosaic_" + name + ".tif" });
+        AddTileOutput(writer.GetPointer(), filter->GetSAROutput(0, 0), files.back().second, grid, tile);
+      }
+      else
+        for (unsigned int plan = 0; plan < filter->GetNumberOfPlans(); plan++)
+          for (int i = 1; i <= m_Outputs; i++)
+          {
+            const std::string sarKey = GetPlanKey(plan, "outsar" + std::to_string(i));
+            const std::string optKey = GetPlanKey(plan, "outopt" + std::to_string(i));
+            files.push_back({ sarKey, tilesDir + "/" + sarKey + "_" + name + ".tif" });
+            AddTileOutput(writer.GetPointer(), filter->GetSAROutput(plan, i - 1), files.back().second, grid, tile);
+            files.push_back({ optKey, tilesDir + "/" + optKey + "_" + name + ".tif" });
+            AddTileOutput(writer.GetPointer(), filter->GetOptOutput(plan, i - 1), files.back().second, grid, tile);
+          }
+      writer->SetNumberOfLinesStrippedStreaming(m_TileHeight);
+      AddProcess(writer, "Writing tile " + name);
+      writer->Update();
+      if (!grid.SaveManifest(manifest, tile, files, signature))
+        otbAppLogFATAL("Unable to write the manifest " << manifest);
+    }
+    m_TileFilters.clear();
+    otbAppLogINFO(nbSkipped << " tiles already done (with the same inputs) were skipped");
+
+    AssembleTiles(grid, outDir);
+  }
+
+  /**
+   * Signature of the inputs of a tile: the images of the pairs of each plan which may have valid pixels in the tile
+   * (from the footprints and validity bitmaps when they are computed), and in model mode the model and its other
+   * sources. A tile is computed again when its signature changes, e.g. when new acquisitions are added. Images which
+   * are not read from files are identified by their position in their list.
+   */
+  template <class TFilter>
+  otb::TileGrid::SignatureType
+  GetTileSignature(TFilter * filter, const otb::TileGrid & grid, unsigned long tile)
+  {
+    const bool    model = static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_MODEL;
+    long          x, y;
+    unsigned long sizeX, sizeY;
+    grid.GetTile(tile, x, y, sizeX, sizeY);
+    typename TFilter::RegionType region;
+    region.SetIndex(0, x);
+    region.SetIndex(1, y);
+    region.SetSize(0, sizeX);
+    region.SetSize(1, sizeY);
+    if (model)
+      region.PadByRadius(GetParameterInt("mode.model.pad")); // Receptive field of the tile
+
+    auto getId = [this](const ImageRefType & ref) {
+      const std::string id = GetImageId(ref);
+      return id.compare(0, 5, "file:") == 0 ? id : "image:" + ref.first + "#" + std::to_string(ref.second);
+    };
+    otb::TileGrid::SignatureType signature;
+    for (unsigned int plan = 0; plan < filter->GetNumberOfPlans(); plan++)
+      for (const auto & pair : filter->GetCandidatePairs(plan, region))
+        signature.push_back("plan" + std::to_string(plan + 1) + " " + getId(m_SARImages[pair.first]) +
+                            (m_OptImages.empty() ? "" : " " + getId(m_OptImages[pair.second])));
+    if (!model)
+      return signature;
+    signature.push_back("model " + GetParameterAsString("mode.model.dir") + " " +
+                        GetParameterString("mode.model.output") + " " + GetParameterAsString("mode.model.ts") + " " +
+                        GetParameterAsString("mode.model.pad"));
+    const unsigned int nbSources = HasValue("mode.model.il") ? GetNumberOfInputImages("mode.model.il") : 0;
+    for (unsigned int i = 0; i < nbSources; i++)
+      signature.push_back("source " + getId({ "mode.model.il", i }));
+    return signature;
+  }
+
+  // Assemble the tiles of each output in a VRT, once all the tiles of the grid are done
+  void
+  AssembleTiles(const otb::TileGrid & grid, const std::string & outDir)
+  {
+    std::vector<std::string>                                  keys;      // Output keys, in the order of the manifests
+    std::unordered_map<std::string, std::vector<std::string>> tileFiles; // Files of the tiles of each output
+    for (unsigned long tile = 0; tile < grid.GetNumberOfTiles(); tile++)
+    {
+      otb::TileGrid::FileListType  files;
+      otb::TileGrid::SignatureType signature;
+      if (!grid.LoadManifest(outDir + "/tiles/" + grid.GetTileName(tile) + ".manifest", tile, files, signature))
+      {
+        otbAppLogINFO("Tile " << grid.GetTileName(tile) << " is not done yet: the tiles will be assembled by the job "
+                              << "which completes the grid");
+        return;
+      }
+      for (const auto & file : files)
+      {
+        if (tileFiles.count(file.first) == 0)
+          keys.push_back(file.first);
+        tileFiles[file.first].push_back(file.second);
+      }
+    }
+
+    GDALAllRegister();
+    for (const std::string & key : keys)
+    {
+      // The VRT is written under a temporary name, so that a VRT of an output is complete when it exists
+      const std::string         filename = outDir + "/" + key + ".vrt";
+      const std::string         tmpFilename = filename + ".tmp";
+      std::vector<const char *> names;
+      for (const std::string & file : tileFiles[key])
+        names.push_back(file.c_str());
+      GDALBuildVRTOptions * options = GDALBuildVRTOptionsNew(nullptr, nullptr);
+      int                   usageError = 0;
+      GDALDatasetH ds = GDALBuildVRT(tmpFilename.c_str(), names.size(), nullptr, names.data(), options, &usageError);
+      GDALBuildVRTOptionsFree(options);
+      if (ds == nullptr)
+        otbAppLogFATAL("Unable to assemble the tiles of " << key << " in " << filename);
+      GDALClose(ds);
+      if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0)
+        otbAppLogFATAL("Unable to write " << filename);
+      otbAppLogINFO("Tiles of " << key << " assembled in " << filename);
+    }
+  }
+
+  // Names of the target dates, in batch mode
+  void
+  SetBatchNames()
+  {
+    const std::vector<std::string> targets = GetParameterStringList("mode.batch.targets");
+    if (targets.empty())
+      otbAppLogFATAL("No target date");
+    m_BatchNames = targets;
+    if (HasValue("mode.batch.names"))
+      m_BatchNames = GetParameterStringList("mode.batch.names");
+    if (m_BatchNames.size() != targets.size())
+      otbAppLogFATAL("There is " << targets.size() << " target dates but " << m_BatchNames.size() << " names");
+  }
+
+  // Form the T-1 and T+1 pairs of each target date, from the images of the first plan
+  void
+  PrepareBatchPlans()
   {
-    // Check that timestamps lists have the same length as images lists
+    if (m_Plans > 1)
+      otbAppLogWARNING("In batch mode, only the images of the first plan are used");
+
     CheckNumbers("ilsar", "timestampssar");
     CheckNumbers("ilopt", "timestampsopt");
+    const std::vector<std::string> targets = GetParameterStringList("mode.batch.targets");
+    const TimestampWithIndexList   sarTsWithIdxList = GetTimestampsWithIndices("timestampssar");
+    const TimestampWithIndexList   optTsWithIdxList = GetTimestampsWithIndices("timestampsopt");
+    const unsigned int             nbSARImages = GetParameterInt("mode.batch.nimagessar");
+    const unsigned int             nbOptImages = GetParameterInt("mode.batch.nimagesopt");
+    const TemporalIndex            sarIndex = TimeSeriesPairing::GetTemporalIndex(sarTsWithIdxList);
+    const TemporalIndex            optIndex = TimeSeriesPairing::GetTemporalIndex(optTsWithIdxList);
+
+    // Plans #2k and #2k+1 are the T-1 and T+1 pairs of the target date #k
+    for (unsigned int k = 0; k < targets.size(); k++)
+    {
+      const TimestampType target = Str2Timestamp(targets[k]);
+      for (const TemporalIndex::Period period : { TemporalIndex::BEFORE, TemporalIndex::AFTER })
+      {
+        const bool before = (period == TemporalIndex::BEFORE);
+        otbAppLogINFO("Preparing " << (before ? "T-1" : "T+1") << " pairs of target date " << m_BatchNames[k]
+                                   << " (" << targets[k] << ")");
+        const IndicesPairList indicesPairs =
+          GetCandidatesPairs(GetClosestTimestamps(sarTsWithIdxList, sarIndex, target, period, nbSARImages),
+                             GetClosestTimestamps(optTsWithIdxList, optIndex, target, period, nbOptImages),
+                             before ? ASC : DES,
+                             target);
+        if (indicesPairs.size() == 0)
+          otbAppLogWARNING("No S1/S2 pairs found: outputs are filled with no-data");
+        m_PairsIndices.push_back(IndicesPairList());
+        InstantiateSources("ilsar", "ilopt", indicesPairs, m_PairsIndices.back());
+      }
+    }
+  }
+
+  // Plan of the mosaic mode: the SAR images of the first plan, from the closest to the farthest to the date of the
+  // mosaic, without optical images
+  void
+  PrepareMosaicPlan()
+  {
+    if (m_Plans > 1)
+      otbAppLogWARNING("In mosaic mode, only the SAR images of the first plan are used");
+
+    CheckNumbers("ilsar", "timestampssar");
+    TimestampWithIndexList sarTsWithIdxList = GetTimestampsWithIndices("timestampssar");
+    SortTimestampsWithIndices(sarTsWithIdxList, ABS, Str2Timestamp(GetParameterAsString("mode.mosaic.timestamp")));
+    m_PairsIndices.push_back(IndicesPairList());
+    for (const auto & sarTsWithIdx : sarTsWithIdxList)
+      m_PairsIndices.back().push_back({ SelectImage({ "ilsar", sarTsWithIdx.index }, m_SARImages, m_SARImageIds), 0 });
+  }
+
+  // Low resolution optical images of the selected optical images (e.g. "plan2.iloptlowres" image #3 for
+  // "plan2.ilopt" image #3), when the plans have low resolution optical images lists
+  void
+  PrepareLowResImages()
+  {
+    m_LowResOptImages.clear();
+    bool lowRes = false;
+    for (unsigned int plan = 0; plan < m_Plans; plan++)
+      lowRes = lowRes || HasValue(GetPlanKey(plan, "iloptlowres"));
+    if (!lowRes)
+      return;
+
+    const ProcessingMode mode = static_cast<ProcessingMode>(GetParameterInt("mode"));
+    if ((mode != MODE_PLANS && mode != MODE_MODEL) || HasValue("grid.outdir"))
+      otbAppLogFATAL("Low resolution optical images are only processed in plans and model modes, without tile grid");
+    for (const auto & ref : m_OptImages)
+    {
+      const std::string key = ref.first + "lowres";
+      if (!HasValue(key) || GetNumberOfInputImages(key) != GetNumberOfInputImages(ref.first))
+        otbAppLogFATAL("There must be as many images at input " << key << " as at input " << ref.first);
+      m_LowResOptImages.push_back({ key, ref.second });
+    }
+  }
+
+  // Form the pairs of each plan given as parameters
+  void
+  PreparePlans()
+  {
+    for (unsigned int plan = 0; plan < m_Plans; plan++)
+    {
+      // Check that timestamps lists have the same length as images lists
+      CheckNumbers(GetPlanKey(plan, "ilsar"), GetPlanKey(plan, "timestampssar"));
+      CheckNumbers(GetPlanKey(plan, "ilopt"), GetPlanKey(plan, "timestampsopt"));
+
+      // Form the pairs of images indices.
+      // In this step, optical images are sorted using the ASC, DES, or ABS strategy.
+      // The optical images are first sorted regarding their timestamps.
+      // Then, for each optical image, available SAR images satisfying the
+      // "maxgap" criterion are kept and pairs are formed (Pairs are formed
+      // using the order of SAR images: they are sorted using ABS strategy
+      // relatively to the current optical image).
+      IndicesPairList indicesPairs = GetCandidatesPairs(plan);
+
+      // Select the input images that will be used, and find
+      // the indices of corresponding (SAR, Optical) pairs
+      otbAppLogINFO("Preparing input images lists of plan #" << (plan + 1));
+      m_PairsIndices.push_back(IndicesPairList());
+      InstantiateSources(GetPlanKey(plan, "ilsar"), // Key of the SAR images list
+                         GetPlanKey(plan, "ilopt"), // Key of the optical images list
+                         indicesPairs,              // (SAR, Optical) indices pairs list
+                         m_PairsIndices.back());    // List of pairs of indices for selected images (modified)
+    }
+  }
 
-    // Form the pairs of images indices.
-    // In this step, optical images are sorted using the ASC, DES, or ABS strategy.
-    // The optical images are first sorted regarding their timestamps.
-    // Then, for each optical image, available SAR images satisfying the
-    // "maxgap" criterion are kept and pairs are formed (Pairs are formed
-    // using the order of SAR images: they are sorted using ABS strategy
-    // relatively to the current optical image).
-    IndicesPairList indicesPairs = GetCandidatesPairs();
+  // Tell if a key is the key of an input images list
+  bool
+  IsInputImagesListKey(const std::string & key) const
+  {
+    for (unsigned int plan = 0; plan < m_Plans; plan++)
+      if (key == GetPlanKey(plan, "ilsar") || key == GetPlanKey(plan, "ilopt"))
+        return true;
+    return false;
+  }
 
-    // Prepare images stacks of input images that will be used use, and find
-    // the indices of corresponding (SAR, Optical) pairs
-    InstantiateSources(m_SARStack,                      // Selected SAR images stack (modified)
-                       m_OptStack,                      // Selected optical images stack (modified)
-                       indicesPairs,                    // (SAR, Optical) indices pairs list
-                       m_PairsIndices,                  // List of pairs of indices for selected images (modified)
-                       GetParameterImageList("ilsar"),  // Input SAR images list
-                       GetParameterImageList("ilopt")); // Input optical images list
+  // Select an image of a pair-plans file, after checking that it is still the same input image
+  void
+  ImportImage(const PairPlans::ImageType & image, ImageRefList & refs, ImageIdMapType & ids)
+  {
+    if (!IsInputImagesListKey(image.key) || image.index >= GetNumberOfInputImages(image.key) ||
+        GetImageId({ image.key, image.index }) != image.id)
+      otbAppLogFATAL("The image " << image.id << " of the pair-plans file is not the " << image.key << " image #"
+                                  << image.index);
+    ids.emplace(image.id, refs.size());
+    refs.push_back({ image.key, image.index });
+  }
 
+  // Read the selected images and the pairs of each plan from a pair-plans file, instead of forming the pairs
+  void
+  ImportPlans()
+  {
+    const std::string filename = GetParameterString("inplans");
+    PairPlans         plans;
+    if (!plans.Load(filename))
+      otbAppLogFATAL("Unable to read pair-plans file " << filename);
+    if (plans.GetNumberOfOutputImages() != static_cast<unsigned int>(m_Outputs))
+      otbAppLogFATAL("The pair-plans file has been computed for " << plans.GetNumberOfOutputImages()
+                                                                  << " output images per plan");
+    if (static_cast<float>(plans.GetSARNoDataValue()) != GetParameterFloat("nodatasar") ||
+        static_cast<float>(plans.GetOptNoDataValue()) != GetParameterFloat("nodataopt"))
+      otbAppLogFATAL("The pair-plans file has been computed with other no-data values (SAR: "
+                     << plans.GetSARNoDataValue() << ", optical: " << plans.GetOptNoDataValue() << ")");
+
+    for (const auto & image : plans.GetSARImages())
+      ImportImage(image, m_SARImages, m_SARImageIds);
+    for (const auto & image : plans.GetOptImages())
+      ImportImage(image, m_OptImages, m_OptImageIds);
+    m_PairsIndices = plans.GetPlans();
+    m_PlansSARNbBands = plans.GetSARNbBands();
+    m_PlansOptNbBands = plans.GetOptNbBands();
+    otbAppLogINFO("Pair-plans read from " << filename << ": " << m_PairsIndices.size() << " plans");
+  }
 
-    // Initialize the filter that computes the output SAR and optical time series
-    InitFilter(m_Filter,       // The filter that "drills" the input time series (modified)
-               m_OutSAR,       // The output list of SAR images (modified)
-               m_OutOpt,       // The output list of optical images (modified)
-               m_PairsIndices, // List of pairs of indices for selected images
-               m_SARStack,     // Selected SAR images stack
-               m_OptStack);    // Selected optical images stack
+  // Write the selected images and the pairs of each plan in a pair-plans file
+  void
+  ExportPlans(unsigned int sarNbBands, unsigned int optNbBands)
+  {
+    const std::string filename = GetParameterString("outplans");
+    PairPlans         plans;
+    plans.SetParameters(
+      sarNbBands, optNbBands, GetParameterFloat("nodatasar"), GetParameterFloat("nodataopt"), m_Outputs);
+    for (const auto & ref : m_SARImages)
+      plans.GetSARImages().push_back({ ref.first, ref.second, GetImageId(ref) });
+    for (const auto & ref : m_OptImages)
+      plans.GetOptImages().push_back({ ref.first, ref.second, GetImageId(ref) });
+    plans.GetPlans() = m_PairsIndices;
+    if (!plans.Save(filename))
+      otbAppLogFATAL("Unable to write pair-plans file " << filename);
+    otbAppLogINFO("Pair-plans written in " << filename);
+    for (const auto & images : { plans.GetSARImages(), plans.GetOptImages() })
+      for (const auto & image : images)
+        if (image.id.compare(0, 5, "file:") != 0)
+        {
+          otbAppLogWARNING("Some selected images are not read from files: the pair-plans file can't be imported");
+          return;
+        }
+  }
+
+  void
+  DoExecute()
+  {
+    m_StartTime = std::chrono::steady_clock::now();
+    m_SARImages.clear();
+    m_OptImages.clear();
+    m_LowResOptImages.clear();
+    m_SARImageIds.clear();
+    m_OptImageIds.clear();
+    m_PairsIndices.clear();
+    m_PlansSARNbBands = 0;
+    m_PlansOptNbBands = 0;
+    m_TileHeight = 1;
+    m_SummarizeFilter = nullptr;
+
+    // Pairs of each plan: from the pair-plans file, or formed from the timestamps
+    const bool batch = static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_BATCH;
+    const bool mosaic = static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_MOSAIC;
+    const bool patches = static_cast<ProcessingMode>(GetParameterInt("mode")) == MODE_PATCHES;
+    if ((batch || patches) && HasValue("grid.outdir"))
+      otbAppLogFATAL("The tile grid is not available in " << (batch ? "batch" : "patches") << " mode");
+    if (batch)
+      SetBatchNames();
+    if (HasValue("inplans"))
+      ImportPlans();
+    else if (batch)
+      PrepareBatchPlans();
+    else if (mosaic)
+      PrepareMosaicPlan();
+    else
+      PreparePlans();
+    const std::size_t nbPlans = batch ? 2 * m_BatchNames.size() : (mosaic ? 1 : m_Plans);
+    if (m_PairsIndices.size() != nbPlans)
+      otbAppLogFATAL("There is " << m_PairsIndices.size() << " pair-plans but " << nbPlans << " are expected");
+    SelectImagesForGeometry();
+    PrepareLowResImages();
+
+    // In incremental batch mode, only the target dates whose pairs have changed are computed
+    if (batch && GetParameterInt("mode.batch.incremental"))
+      SkipUnchangedTargets();
+    if (batch)
+      SetParameterStringList("mode.batch.updated", m_BatchNames);
+    if (batch && m_BatchNames.empty())
+    {
+      otbAppLogINFO("All the target dates are up to date");
+      return;
+    }
+
+    // Cache of decoded blocks, shared by the applications of the process
+    if (GetParameterInt("blockcache") > 0)
+      BlockCache::GetInstance().SetCapacity(static_cast<std::size_t>(GetParameterInt("blockcache")) << 20);
 
-    // Set outputs
-    for (int i = 1; i <= m_Outputs; i++)
+    // Initialize the filter that computes the output SAR and optical time series, and set outputs
+    LogSelectedImages();
+    m_Readers.clear();
+    InitPipeline();
+
+    // In batch and patches modes, and with a tile grid, outputs are already written
+    if (batch || patches || HasValue("grid.outdir"))
     {
-      std::stringstream sarKey, optKey;
-      sarKey << "outsar" << i;
-      optKey << "outopt" << i;
-      SetParameterOutputImage(sarKey.str(), m_OutSAR[i - 1]->GetOutput());
-      SetParameterOutputImage(optKey.str(), m_OutOpt[i - 1]->GetOutput());
+      if (m_SummarizeFilter)
+        m_SummarizeFilter();
+      m_SummarizeFilter = nullptr;
     }
   }
 
+  void
+  AfterExecuteAndWriteOutputs()
+  {
+    // Summarize the regions and pairs skipped from the footprints
+    if (m_SummarizeFilter)
+      m_SummarizeFilter();
+  }
+
 private:
-  int                                 m_Outputs;              // Number of outputs
-  TFSourceType                        m_SARStack, m_OptStack; // Layerstacks for inputs
-  FilterType::Pointer                 m_Filter;               // Time series "drilling" filter
-  IndicesPairList                     m_PairsIndices;         // List of pairs of indices for inputs
-  std::vector<ExtractorType::Pointer> m_OutSAR, m_OutOpt;     // Channels slicers for outputs
+  int                                      m_Outputs;                    // Number of outputs (per plan)
+  unsigned int                             m_Plans;                      // Number of pair-plans
+  ImageRefList                             m_SARImages, m_OptImages;     // Selected inputs (shared by plans)
+  ImageRefList                             m_LowResOptImages;            // Low resolution of the optical inputs
+  ImageIdMapType                           m_SARImageIds, m_OptImageIds; // Identifiers of selected inputs
+  std::vector<itk::ProcessObject::Pointer> m_Readers;                    // Readers (and downsampling) of the inputs
+  itk::ProcessObject::Pointer              m_Filter;                     // Time series "drilling" filter
+  itk::ProcessObject::Pointer              m_LowResFilter;               // Drilling filter of the low resolution
+  std::function<void()>                    m_SummarizeFilter;            // Logs the statistics of the filter
+  std::vector<IndicesPairList>             m_PairsIndices;               // Lists of pairs of indices, per plan
+  std::vector<std::string>                 m_BatchNames;                 // Names of the target dates (batch mode)
+  unsigned int                             m_PlansSARNbBands;            // Number of SAR bands of imported plans
+  unsigned int                             m_PlansOptNbBands;            // Number of optical bands of imported plans
+  unsigned int                             m_TileHeight;                 // Largest strips that fit in the RAM
+  std::chrono::steady_clock::time_point    m_StartTime;                  // Start of the execution
+  tensorflow::SavedModelBundle             m_SavedModel;                 // Model (model mode)
+  ModelFilterType::Pointer                 m_ModelFilter;                // Model serving filter (model mode)
+  ModelStreamerType::Pointer               m_ModelStreamer;              // Tiles of the model output (model mode)
+  std::vector<itk::ProcessObject::Pointer> m_TileFilters;                // Extracts of the tile being written
 
 }; // end of class
 
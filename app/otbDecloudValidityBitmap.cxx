@@ -0,0 +1,96 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "itkObjectFactory.h"
+#include "otbWrapperApplicationFactory.h"
+
+// Validity bitmap
+#include "otbStreamingValidityBitmapImageFilter.h"
+
+namespace otb
+{
+
+namespace Wrapper
+{
+
+/**
+ * The OTB Application, that computes the validity bitmap of an image.
+ */
+class DecloudValidityBitmap : public Application
+{
+public:
+  /** Standard class typedefs. */
+  typedef DecloudValidityBitmap         Self;
+  typedef Application                   Superclass;
+  typedef itk::SmartPointer<Self>       Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+
+  /** Standard macro */
+  itkNewMacro(Self);
+  itkTypeMacro(DecloudValidityBitmap, Application);
+
+  /** Filter */
+  typedef otb::StreamingValidityBitmapImageFilter<FloatVectorImageType> BitmapFilterType;
+
+  void
+  DoUpdateParameters()
+  {}
+
+  void
+  DoInit()
+  {
+
+    // Documentation
+    SetName("DecloudValidityBitmap");
+    SetDescription("This application computes the validity bitmap of an image.");
+    SetDocLongDescription("This application computes the validity of each pixel of an image (a pixel is valid if at "
+                          "least one of its bands is different from the no-data value), and writes it in a bitmap "
+                          "file, with one bit per pixel. The file has a 64 bytes header, followed by the rows of the "
+                          "bitmap, each one stored in 64 bits little-endian words. The files are the ones stored in "
+                          "the cache directory of DecloudTimeSeriesPreProcessor, and can be memory-mapped.");
+    SetDocLimitations("None");
+    SetDocAuthors("Remi Cresson, Nicolas Narcon");
+
+    AddParameter(ParameterType_InputImage, "in", "Input image");
+    AddParameter(ParameterType_Float, "nodata", "No data value of the input image");
+    SetDefaultParameterFloat("nodata", 0.0);
+    AddParameter(ParameterType_OutputFilename, "out", "Output validity bitmap file");
+
+    // Output
+    AddParameter(ParameterType_Int, "nbvalid", "Number of valid pixels of the input image");
+    SetParameterRole("nbvalid", Role_Output);
+
+    AddRAMParameter();
+  }
+
+  void
+  DoExecute()
+  {
+    BitmapFilterType::Pointer filter = BitmapFilterType::New();
+    filter->SetInput(GetParameterFloatVectorImage("in"));
+    filter->SetNoDataValue(GetParameterFloat("nodata"));
+    filter->GetStreamer()->SetAutomaticAdaptativeStreaming(GetParameterInt("ram"));
+    AddProcess(filter->GetStreamer(), "Computing validity bitmap");
+    filter->Update();
+
+    const unsigned long nbValid = filter->GetBitmap()->GetNumberOfValidPixels();
+    otbAppLogINFO("Number of valid pixels: " << nbValid);
+    SetParameterInt("nbvalid", nbValid);
+
+    if (!filter->GetBitmap()->Save(GetParameterString("out")))
+      otbAppLogFATAL("Unable to write validity bitmap file " << GetParameterString("out"));
+  }
+
+}; // end of class
+
+} // namespace Wrapper
+} // end namespace otb
+
+OTB_APPLICATION_EXPORT(otb::Wrapper::DecloudValidityBitmap)
@@ -0,0 +1,265 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "otbTimeSeriesDrillingKernel.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Microbenchmark of the time series drilling kernel.
+ *
+ * The kernel is applied pair after pair to a run of pixels, like TimeSeriesDrillImageFilter does: each pair has its
+ * own SAR and optical buffers, and the pairs are applied until all the pixels are resolved. The benchmark sweeps:
+ * - the number of pairs,
+ * - the layouts of the bands (specialized layouts, and the generic implementation),
+ * - the fraction of no-data pixels in each input image,
+ * - the value types (float, and the native uint16 SAR / int16 optical encoding),
+ * - the instruction sets.
+ *
+ * Results are written as a JSON document, one record per configuration, with the throughput of the best of the
+ * repetitions in pixels/s and in bytes/s (bytes of the input pixels of the applied pairs, plus output pixels).
+ *
+ * Usage: otbDecloudDrillingKernelBenchmark [-pixels N] [-repeat R] [-out file.json]
+ */
+
+namespace
+{
+
+struct Options
+{
+  std::size_t  Pixels = 1 << 20;
+  unsigned int Repeat = 5;
+  std::string  Out;
+};
+
+struct Layout
+{
+  unsigned int SARNbBands;
+  unsigned int OptNbBands;
+};
+
+struct Result
+{
+  double      Seconds;
+  std::size_t Bytes;
+  std::size_t Unresolved;
+};
+
+template <class TValue>
+const char *
+GetTypeName()
+{
+  return std::is_same<TValue, float>::value ? "float" : (std::is_signed<TValue>::value ? "int16" : "uint16");
+}
+
+// Fill a buffer of nbPixels pixels with valid values, and with no-data for a fraction of the pixels
+template <class TValue>
+void
+Generate(std::vector<TValue> & buffer,
+         std::size_t           nbPixels,
+         unsigned int          nbBands,
+         TValue                noDataValue,
+         double                noDataRatio,
+         std::mt19937 &        rng)
+{
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::uniform_int_distribution<int>     values(1, 10000);
+  buffer.resize(nbPixels * nbBands);
+  for (std::size_t k = 0; k < nbPixels; k++)
+  {
+    const bool noData = uniform(rng) < noDataRatio;
+    for (unsigned int b = 0; b < nbBands; b++)
+      buffer[k * nbBands + b] = noData ? noDataValue : static_cast<TValue>(values(rng));
+  }
+}
+
+// Apply the pairs to the run of pixels, until all the pixels are resolved
+template <class TKernel>
+Result
+Run(const TKernel &                                                 kernel,
+    const std::vector<std::vector<typename TKernel::SARValueType>> & sar,
+    const std::vector<std::vector<typename TKernel::OptValueType>> & opt,
+    std::vector<std::vector<typename TKernel::SARValueType>> &       sarOut,
+    std::vector<std::vector<typename TKernel::OptValueType>> &       optOut,
+    std::vector<unsigned int> &                                      filled)
+{
+  typedef typename TKernel::SARValueType SARValueType;
+  typedef typename TKernel::OptValueType OptValueType;
+
+  const std::size_t           nbPixels = filled.size();
+  const unsigned int          sarNbBands = kernel.GetSARNbBands(), optNbBands = kernel.GetOptNbBands();
+  std::vector<SARValueType *> sarOutPtrs;
+  std::vector<OptValueType *> optOutPtrs;
+  for (unsigned int n = 0; n < kernel.GetNbOutputImages(); n++)
+  {
+    sarOutPtrs.push_back(sarOut[n].data());
+    optOutPtrs.push_back(optOut[n].data());
+  }
+
+  Result result;
+  result.Bytes = nbPixels * kernel.GetNbOutputImages() *
+                 (sarNbBands * sizeof(SARValueType) + optNbBands * sizeof(OptValueType));
+  const auto start = std::chrono::steady_clock::now();
+  std::fill(filled.begin(), filled.end(), 0);
+  std::size_t nbUnresolved = nbPixels;
+  for (auto pair = kernel.GetPairs().begin(); pair != kernel.GetPairs().end() && nbUnresolved > 0; ++pair)
+  {
+    nbUnresolved -= kernel.ProcessPair(sar[pair->first].data(),
+                                       sarNbBands,
+                                       opt[pair->second].data(),
+                                       optNbBands,
+                                       sarOutPtrs.data(),
+                                       optOutPtrs.data(),
+                                       nbPixels,
+                                       filled.data());
+    result.Bytes += nbPixels * (sarNbBands * sizeof(SARValueType) + optNbBands * sizeof(OptValueType));
+  }
+  if (nbUnresolved > 0)
+    kernel.FillNoData(sarOutPtrs.data(), optOutPtrs.data(), nbPixels, filled.data());
+  result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  result.Unresolved = nbUnresolved;
+  return result;
+}
+
+// Benchmark all the configurations for a pair of value types, and write their records
+template <class TSARValue, class TOptValue>
+void
+Sweep(const Options & options, TSARValue sarNoData, TOptValue optNoData, std::ostream & os, bool & first)
+{
+  typedef otb::TimeSeriesDrillingKernel<TSARValue, TOptValue> KernelType;
+
+  const std::vector<unsigned int>              pairCounts = { 1, 2, 4, 8, 16 };
+  const std::vector<Layout>                    layouts = { { 2, 4 }, { 2, 6 }, { 2, 10 }, { 1, 4 } };
+  const std::vector<double>                    noDataRatios = { 0.0, 0.25, 0.5, 0.9 };
+  const std::vector<otb::simd::InstructionSet> instructionSets = {
+    otb::simd::SCALAR, otb::simd::AVX2, otb::simd::AVX512
+  };
+  const unsigned int                           nbOutputImages = 1;
+  const std::size_t                            nbPixels = options.Pixels;
+
+  for (const Layout & layout : layouts)
+    for (const double noDataRatio : noDataRatios)
+    {
+      // One SAR and one optical image per pair, shared by all the pair counts
+      std::mt19937                        rng(42);
+      const unsigned int                  maxPairs = pairCounts.back();
+      std::vector<std::vector<TSARValue>> sar(maxPairs);
+      std::vector<std::vector<TOptValue>> opt(maxPairs);
+      for (unsigned int i = 0; i < maxPairs; i++)
+      {
+        Generate(sar[i], nbPixels, layout.SARNbBands, sarNoData, noDataRatio, rng);
+        Generate(opt[i], nbPixels, layout.OptNbBands, optNoData, noDataRatio, rng);
+      }
+      std::vector<std::vector<TSARValue>> sarOut(nbOutputImages,
+                                                 std::vector<TSARValue>(nbPixels * layout.SARNbBands));
+      std::vector<std::vector<TOptValue>> optOut(nbOutputImages,
+                                                 std::vector<TOptValue>(nbPixels * layout.OptNbBands));
+      std::vector<unsigned int>           filled(nbPixels);
+
+      for (const unsigned int nbPairs : pairCounts)
+      {
+        typename KernelType::IndicesPairListType pairs;
+        for (unsigned int i = 0; i < nbPairs; i++)
+          pairs.push_back({ i, i });
+
+        for (const otb::simd::InstructionSet is : instructionSets)
+        {
+          // Instruction sets not supported by the CPU are skipped (they would fall back to another one)
+          if (otb::simd::Resolve(is) != is)
+            continue;
+          KernelType kernel;
+          kernel.SetParameters(pairs, layout.SARNbBands, layout.OptNbBands, sarNoData, optNoData, nbOutputImages);
+          kernel.SetInstructionSet(is);
+
+          Result best = Run(kernel, sar, opt, sarOut, optOut, filled);
+          for (unsigned int r = 1; r < options.Repeat; r++)
+          {
+            const Result result = Run(kernel, sar, opt, sarOut, optOut, filled);
+            if (result.Seconds < best.Seconds)
+              best = result;
+          }
+
+          const bool specialized = KernelType::IsSpecialized(layout.SARNbBands, layout.OptNbBands);
+          os << (first ? "\n" : ",\n") << "    {\"sar_type\": \"" << GetTypeName<TSARValue>() << "\", \"opt_type\": \""
+             << GetTypeName<TOptValue>() << "\", \"sar_bands\": " << layout.SARNbBands
+             << ", \"opt_bands\": " << layout.OptNbBands << ", \"specialized\": " << (specialized ? "true" : "false")
+             << ", \"pairs\": " << nbPairs << ", \"nodata_ratio\": " << noDataRatio
+             << ", \"instruction_set\": \"" << otb::simd::GetName(is) << "\", \"pixels\": " << nbPixels
+             << ", \"unresolved_pixels\": " << best.Unresolved << ", \"seconds\": " << best.Seconds
+             << ", \"pixels_per_second\": " << nbPixels / best.Seconds
+             << ", \"bytes_per_second\": " << best.Bytes / best.Seconds << "}";
+          first = false;
+          std::cerr << GetTypeName<TSARValue>() << "/" << GetTypeName<TOptValue>() << " " << layout.SARNbBands << "+"
+                    << layout.OptNbBands << " bands, " << nbPairs << " pairs, " << noDataRatio * 100
+                    << "% no-data, " << otb::simd::GetName(is) << ": " << nbPixels / best.Seconds / 1e6
+                    << " Mpixels/s" << std::endl;
+        }
+      }
+    }
+}
+
+} // end anonymous namespace
+
+int
+main(int argc, char * argv[])
+{
+  Options options;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (arg == "-pixels" && i + 1 < argc)
+      options.Pixels = std::strtoul(argv[++i], nullptr, 10);
+    else if (arg == "-repeat" && i + 1 < argc)
+      options.Repeat = std::strtoul(argv[++i], nullptr, 10);
+    else if (arg == "-out" && i + 1 < argc)
+      options.Out = argv[++i];
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [-pixels N] [-repeat R] [-out file.json]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (options.Pixels == 0 || options.Repeat == 0)
+  {
+    std::cerr << "The number of pixels and of repetitions must be positive" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::stringstream json;
+  bool              first = true;
+  json << "{\n  \"benchmark\": \"drilling_kernel\",\n  \"best_instruction_set\": \""
+       << otb::simd::GetName(otb::simd::GetBestInstructionSet()) << "\",\n  \"results\": [";
+  Sweep<float, float>(options, 0.0f, -10000.0f, json, first);
+  Sweep<std::uint16_t, std::int16_t>(options, 0, -10000, json, first);
+  json << "\n  ]\n}\n";
+
+  if (options.Out.empty())
+  {
+    std::cout << json.str();
+    return EXIT_SUCCESS;
+  }
+  std::ofstream ofs(options.Out);
+  ofs << json.str();
+  if (!ofs)
+  {
+    std::cerr << "Unable to write " << options.Out << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
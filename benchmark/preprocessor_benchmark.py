@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Copyright (c) 2020-2022 INRAE
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+"""
+"""End-to-end benchmark of the DecloudTimeSeriesPreProcessor application, on synthetic S1/S2 time series"""
+import argparse
+import datetime
+import json
+import logging
+import os
+import subprocess
+import sys
+import time
+import numpy as np
+import gdal
+
+S1_NODATA = 0
+S2_NODATA = -10000
+
+
+def write_image(filename, array, gdal_type, nodata):
+    """
+    Write a (bands, rows, cols) array in a tiled GeoTiff file, on a 10m grid
+
+    :param filename: output file
+    :param array: pixels
+    :param gdal_type: GDAL pixel type
+    :param nodata: no-data value
+    """
+    nbands, rows, cols = array.shape
+    driver = gdal.GetDriverByName('GTiff')
+    ds = driver.Create(filename, cols, rows, nbands, gdal_type, options=['TILED=YES'])
+    ds.SetGeoTransform((600000.0, 10.0, 0.0, 4800000.0, 0.0, -10.0))
+    for i in range(nbands):
+        band = ds.GetRasterBand(i + 1)
+        band.SetNoDataValue(nodata)
+        band.WriteArray(array[i])
+    ds = None
+
+
+def generate_time_series(outdir, size, nb_s1, nb_s2, nodata_ratio, seed=42):
+    """
+    Generate synthetic S1 (2 bands, uint16) and S2 (4 bands, int16) time series, one image per day. S2 images have
+    no-data "clouds" (square blocks of 64x64 pixels) over a fraction of their pixels.
+
+    :param outdir: output directory
+    :param size: number of rows and columns of the images
+    :param nb_s1: number of S1 images
+    :param nb_s2: number of S2 images
+    :param nodata_ratio: fraction of the blocks of the S2 images which are no-data
+    :param seed: seed of the random generator
+    :return: S1 files, S2 files, S1 timestamps, S2 timestamps
+    """
+    rng = np.random.default_rng(seed)
+    os.makedirs(outdir, exist_ok=True)
+    start = datetime.datetime(2020, 9, 1, tzinfo=datetime.timezone.utc)
+    s1_files, s2_files, s1_timestamps, s2_timestamps = [], [], [], []
+    for i in range(nb_s1):
+        filename = os.path.join(outdir, 's1_{}.tif'.format(i))
+        if not os.path.exists(filename):
+            write_image(filename, rng.integers(1, 10000, (2, size, size), dtype=np.uint16), gdal.GDT_UInt16,
+                        S1_NODATA)
+        s1_files.append(filename)
+        s1_timestamps.append(str((start + datetime.timedelta(days=i, hours=6)).timestamp()))
+    blocks = (size + 63) // 64
+    for i in range(nb_s2):
+        filename = os.path.join(outdir, 's2_{}_{}.tif'.format(i, nodata_ratio))
+        if not os.path.exists(filename):
+            array = rng.integers(0, 10000, (4, size, size), dtype=np.int16)
+            clouds = np.kron(rng.random((blocks, blocks)) < nodata_ratio, np.ones((64, 64), dtype=bool))
+            array[:, clouds[:size, :size]] = S2_NODATA
+            write_image(filename, array, gdal.GDT_Int16, S2_NODATA)
+        s2_files.append(filename)
+        s2_timestamps.append(str((start + datetime.timedelta(days=i, hours=10)).timestamp()))
+    return s1_files, s2_files, s1_timestamps, s2_timestamps
+
+
+def run_preprocessor(inputs, outdir, tile_size, nb_threads, launcher):
+    """
+    Run the pre-processor in a separate process (the number of threads of ITK is set once per process), with outputs
+    written in tiles of tile_size x tile_size pixels
+
+    :param inputs: S1 files, S2 files, S1 timestamps, S2 timestamps
+    :param outdir: output directory
+    :param tile_size: size of the tiles of the streamed regions
+    :param nb_threads: number of threads
+    :param launcher: command line launcher of the application
+    :return: the performance report of the application, with the wall time of the process
+    """
+    s1_files, s2_files, s1_timestamps, s2_timestamps = inputs
+    ext = '?&streaming:type=tiled&streaming:sizemode=height&streaming:sizevalue={}'.format(tile_size)
+    report = os.path.join(outdir, 'report.json')
+    cmd = [launcher,
+           '-ilsar'] + s1_files + ['-ilopt'] + s2_files + \
+          ['-timestampssar'] + s1_timestamps + ['-timestampsopt'] + s2_timestamps + \
+          ['-maxgap', str(72 * 3600), '-sorting', 'asc', '-pixeltype', 'native',
+           '-outsar1', os.path.join(outdir, 'outsar1.tif') + ext, 'uint16',
+           '-outopt1', os.path.join(outdir, 'outopt1.tif') + ext, 'int16',
+           '-report', report]
+    env = dict(os.environ, ITK_GLOBAL_DEFAULT_NUMBER_OF_THREADS=str(nb_threads))
+    start = time.perf_counter()
+    subprocess.run(cmd, env=env, check=True, stdout=subprocess.DEVNULL)
+    process_time = time.perf_counter() - start
+    with open(report) as f:
+        result = json.load(f)
+    result['process_time'] = process_time
+    return result
+
+
+def main(args):
+    parser = argparse.ArgumentParser(description="Benchmark of DecloudTimeSeriesPreProcessor on synthetic images")
+    parser.add_argument("--size", type=int, default=2048, help="Number of rows and columns of the images")
+    parser.add_argument("--nb_s1", type=int, default=8, help="Number of S1 images")
+    parser.add_argument("--nb_s2", type=int, default=8, help="Number of S2 images")
+    parser.add_argument("--nodata_ratios", type=float, nargs='+', default=[0.0, 0.5, 0.9],
+                        help="Fractions of the S2 images covered with no-data")
+    parser.add_argument("--tile_sizes", type=int, nargs='+', default=[128, 512, 2048], help="Streamed tile sizes")
+    parser.add_argument("--threads", type=int, nargs='+', default=[1, 4, os.cpu_count()], help="Numbers of threads")
+    parser.add_argument("--workdir", default='/tmp/decloud_benchmark', help="Directory of the synthetic images")
+    parser.add_argument("--launcher", default='otbcli_DecloudTimeSeriesPreProcessor',
+                        help="Command line launcher of the application")
+    parser.add_argument("--out", help="Output JSON file (default: standard output)")
+    params = parser.parse_args(args)
+
+    logging.basicConfig(format='%(asctime)s %(levelname)s %(message)s', level=logging.INFO)
+    results = []
+    for nodata_ratio in params.nodata_ratios:
+        inputs = generate_time_series(params.workdir, params.size, params.nb_s1, params.nb_s2, nodata_ratio)
+        for tile_size in params.tile_sizes:
+            for nb_threads in sorted(set(params.threads)):
+                report = run_preprocessor(inputs, params.workdir, tile_size, nb_threads, params.launcher)
+                pixels = params.size * params.size
+                results.append({'size': params.size, 'nb_s1': params.nb_s1, 'nb_s2': params.nb_s2,
+                                'nodata_ratio': nodata_ratio, 'tile_size': tile_size, 'threads': nb_threads,
+                                'wall_time': report['wall_time'], 'process_time': report['process_time'],
+                                'kernel_time': report['kernel_time'], 'bytes_read': report['bytes_read'],
+                                'peak_memory_kb': report['peak_memory_kb'],
+                                'pixels_per_second': pixels / report['wall_time'],
+                                'bytes_per_second': report['bytes_read'] / report['wall_time']})
+                logging.info("%s%% no-data, tiles of %s pixels, %s threads: %.2f Mpixels/s", nodata_ratio * 100,
+                             tile_size, nb_threads, results[-1]['pixels_per_second'] / 1e6)
+
+    output = json.dumps({'benchmark': 'preprocessor', 'results': results}, indent=2)
+    if params.out:
+        with open(params.out, 'w') as f:
+            f.write(output + '\n')
+    else:
+        print(output)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,370 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "otbTimeSeriesDrillingCUDA.h"
+#include <cuda_runtime.h>
+#include <cstdint>
+#include <stdexcept>
+
+namespace otb
+{
+namespace cuda
+{
+
+namespace
+{
+
+// Number of threads per block of the kernels
+const unsigned int BLOCK_SIZE = 256;
+
+// Throw the error of a call to the CUDA runtime
+void
+Check(cudaError_t err, const char * what)
+{
+  if (err != cudaSuccess)
+    throw std::runtime_error(std::string("CUDA error in ") + what + ": " + cudaGetErrorString(err));
+}
+
+unsigned int
+GetNumberOfBlocks(std::size_t nbPixels)
+{
+  return static_cast<unsigned int>((nbPixels + BLOCK_SIZE - 1) / BLOCK_SIZE);
+}
+
+// Tell if the n values are all equal to noDataValue (like simd::ScalarOps::IsNoData())
+template <class TValue>
+__device__ inline bool
+IsNoData(const TValue * pix, unsigned int n, TValue noDataValue)
+{
+  for (unsigned int i = 0; i < n; i++)
+    if (pix[i] != noDataValue)
+      return false;
+  return true;
+}
+
+// Apply a pair to the pixels of the region, one thread per pixel (see TimeSeriesDrillingKernel::ProcessPairImpl())
+template <class TSARValue, class TOptValue>
+__global__ void
+ProcessPairKernel(const TSARValue *    sar,
+                  const TOptValue *    opt,
+                  TSARValue *          sarOut,
+                  TOptValue *          optOut,
+                  unsigned int *       filled,
+                  std::size_t          nbPixels,
+                  unsigned int         sarNbBands,
+                  unsigned int         optNbBands,
+                  TSARValue            sarNoDataValue,
+                  TOptValue            optNoDataValue,
+                  unsigned int         nbOutputImages,
+                  unsigned long long * nbResolved)
+{
+  const std::size_t k = static_cast<std::size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  bool              resolved = false;
+  if (k < nbPixels)
+  {
+    const unsigned int n = filled[k];
+    const TSARValue *  sarPix = sar + k * sarNbBands;
+    const TOptValue *  optPix = opt + k * optNbBands;
+    if (n < nbOutputImages && !IsNoData(sarPix, sarNbBands, sarNoDataValue) &&
+        (optNbBands == 0 || !IsNoData(optPix, optNbBands, optNoDataValue)))
+    {
+      TSARValue * sarDst = sarOut + (n * nbPixels + k) * sarNbBands;
+      for (unsigned int i = 0; i < sarNbBands; i++)
+        sarDst[i] = sarPix[i];
+      TOptValue * optDst = optOut + (n * nbPixels + k) * optNbBands;
+      for (unsigned int i = 0; i < optNbBands; i++)
+        optDst[i] = optPix[i];
+      filled[k] = n + 1;
+      resolved = (n + 1 == nbOutputImages);
+    }
+  }
+
+  // One atomic operation per block
+  const int nbBlockResolved = __syncthreads_count(resolved);
+  if (threadIdx.x == 0 && nbBlockResolved > 0)
+    atomicAdd(nbResolved, static_cast<unsigned long long>(nbBlockResolved));
+}
+
+// Fill the output slots that have not been found with no-data (see TimeSeriesDrillingKernel::FillNoData())
+template <class TSARValue, class TOptValue>
+__global__ void
+FillNoDataKernel(TSARValue *          sarOut,
+                 TOptValue *          optOut,
+                 const unsigned int * filled,
+                 std::size_t          nbPixels,
+                 unsigned int         sarNbBands,
+                 unsigned int         optNbBands,
+                 TSARValue            sarNoDataValue,
+                 TOptValue            optNoDataValue,
+                 unsigned int         nbOutputImages)
+{
+  const std::size_t k = static_cast<std::size_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (k >= nbPixels)
+    return;
+  for (unsigned int n = filled[k]; n < nbOutputImages; n++)
+  {
+    TSARValue * sarDst = sarOut + (n * nbPixels + k) * sarNbBands;
+    for (unsigned int i = 0; i < sarNbBands; i++)
+      sarDst[i] = sarNoDataValue;
+    TOptValue * optDst = optOut + (n * nbPixels + k) * optNbBands;
+    for (unsigned int i = 0; i < optNbBands; i++)
+      optDst[i] = optNoDataValue;
+  }
+}
+
+// Upload a region of a pixel-interleaved buffer in a contiguous device buffer
+template <class TValue>
+void
+UploadRegion(void **        dst,
+             const TValue * src,
+             std::size_t    rowStride,
+             std::size_t    sizeX,
+             std::size_t    sizeY,
+             unsigned int   nbBands)
+{
+  const std::size_t rowSize = sizeX * nbBands * sizeof(TValue);
+  if (*dst == nullptr)
+    Check(cudaMalloc(dst, rowSize * sizeY), "cudaMalloc");
+  Check(cudaMemcpy2D(*dst, rowSize, src, rowStride * sizeof(TValue), rowSize, sizeY, cudaMemcpyHostToDevice),
+        "cudaMemcpy2D");
+}
+
+} // end anonymous namespace
+
+bool
+IsAvailable()
+{
+  int nbDevices = 0;
+  return cudaGetDeviceCount(&nbDevices) == cudaSuccess && nbDevices > 0;
+}
+
+std::string
+GetDeviceName()
+{
+  int            device = 0;
+  cudaDeviceProp properties;
+  if (!IsAvailable() || cudaGetDevice(&device) != cudaSuccess ||
+      cudaGetDeviceProperties(&properties, device) != cudaSuccess)
+    return std::string();
+  return properties.name;
+}
+
+template <class TSARValue, class TOptValue>
+DrillingContext<TSARValue, TOptValue>::DrillingContext()
+  : m_NbPixels(0)
+  , m_SizeX(0)
+  , m_SizeY(0)
+  , m_SARNbBands(0)
+  , m_OptNbBands(0)
+  , m_NbOutputImages(0)
+  , m_SARNoDataValue(0)
+  , m_OptNoDataValue(0)
+  , m_SAROutputs(nullptr)
+  , m_OptOutputs(nullptr)
+  , m_OutputsSize(0)
+  , m_OutputsSlots(0)
+  , m_Filled(nullptr)
+  , m_NbResolved(nullptr)
+  , m_FilledSize(0)
+{}
+
+template <class TSARValue, class TOptValue>
+DrillingContext<TSARValue, TOptValue>::~DrillingContext()
+{
+  Release();
+  cudaFree(m_NbResolved);
+}
+
+template <class TSARValue, class TOptValue>
+void
+DrillingContext<TSARValue, TOptValue>::Release()
+{
+  for (void *& input : m_Inputs)
+  {
+    cudaFree(input);
+    input = nullptr;
+  }
+  cudaFree(m_SAROutputs);
+  cudaFree(m_OptOutputs);
+  cudaFree(m_Filled);
+  m_SAROutputs = nullptr;
+  m_OptOutputs = nullptr;
+  m_Filled = nullptr;
+  m_OutputsSize = 0;
+  m_OutputsSlots = 0;
+  m_FilledSize = 0;
+}
+
+template <class TSARValue, class TOptValue>
+void
+DrillingContext<TSARValue, TOptValue>::BeginRegion(std::size_t  sizeX,
+                                                   std::size_t  sizeY,
+                                                   unsigned int nbInputs,
+                                                   unsigned int sarNbBands,
+                                                   unsigned int optNbBands)
+{
+  // Regions of the same size reuse the device buffers of the previous region
+  if (sizeX * sizeY != m_NbPixels || sarNbBands != m_SARNbBands || optNbBands != m_OptNbBands)
+    Release();
+  m_SizeX = sizeX;
+  m_SizeY = sizeY;
+  m_NbPixels = sizeX * sizeY;
+  m_SARNbBands = sarNbBands;
+  m_OptNbBands = optNbBands;
+  m_Inputs.resize(nbInputs, nullptr);
+  m_Uploaded.assign(nbInputs, false);
+  if (m_NbResolved == nullptr)
+    Check(cudaMalloc(&m_NbResolved, sizeof(unsigned long long)), "cudaMalloc");
+}
+
+template <class TSARValue, class TOptValue>
+bool
+DrillingContext<TSARValue, TOptValue>::HasInput(unsigned int idx) const
+{
+  return idx < m_Uploaded.size() && m_Uploaded[idx];
+}
+
+template <class TSARValue, class TOptValue>
+void
+DrillingContext<TSARValue, TOptValue>::UploadSARInput(unsigned int         idx,
+                                                      const SARValueType * buffer,
+                                                      std::size_t          rowStride)
+{
+  UploadRegion(&m_Inputs.at(idx), buffer, rowStride, m_SizeX, m_SizeY, m_SARNbBands);
+  m_Uploaded[idx] = true;
+}
+
+template <class TSARValue, class TOptValue>
+void
+DrillingContext<TSARValue, TOptValue>::UploadOptInput(unsigned int         idx,
+                                                      const OptValueType * buffer,
+                                                      std::size_t          rowStride)
+{
+  UploadRegion(&m_Inputs.at(idx), buffer, rowStride, m_SizeX, m_SizeY, m_OptNbBands);
+  m_Uploaded[idx] = true;
+}
+
+template <class TSARValue, class TOptValue>
+void
+DrillingContext<TSARValue, TOptValue>::BeginPlan(unsigned int nbOutputImages,
+                                                 SARValueType sarNoDataValue,
+                                                 OptValueType optNoDataValue)
+{
+  m_NbOutputImages = nbOutputImages;
+  m_SARNoDataValue = sarNoDataValue;
+  m_OptNoDataValue = optNoDataValue;
+  if (m_NbPixels == 0)
+    return;
+
+  // Output slots and counters, reused by the next plans with less output slots
+  if (m_OutputsSize != m_NbPixels || m_OutputsSlots < nbOutputImages)
+  {
+    cudaFree(m_SAROutputs);
+    cudaFree(m_OptOutputs);
+    m_SAROutputs = nullptr;
+    m_OptOutputs = nullptr;
+    Check(cudaMalloc(&m_SAROutputs, nbOutputImages * m_NbPixels * m_SARNbBands * sizeof(SARValueType)), "cudaMalloc");
+    if (m_OptNbBands > 0)
+      Check(cudaMalloc(&m_OptOutputs, nbOutputImages * m_NbPixels * m_OptNbBands * sizeof(OptValueType)),
+            "cudaMalloc");
+    m_OutputsSize = m_NbPixels;
+    m_OutputsSlots = nbOutputImages;
+  }
+  if (m_FilledSize != m_NbPixels)
+  {
+    cudaFree(m_Filled);
+    m_Filled = nullptr;
+    Check(cudaMalloc(&m_Filled, m_NbPixels * sizeof(unsigned int)), "cudaMalloc");
+    m_FilledSize = m_NbPixels;
+  }
+  Check(cudaMemset(m_Filled, 0, m_NbPixels * sizeof(unsigned int)), "cudaMemset");
+}
+
+template <class TSARValue, class TOptValue>
+std::size_t
+DrillingContext<TSARValue, TOptValue>::ProcessPair(unsigned int sarIdx, unsigned int optIdx)
+{
+  if (m_NbPixels == 0)
+    return 0;
+  const SARValueType * sar = static_cast<const SARValueType *>(m_Inputs.at(sarIdx));
+  const OptValueType * opt = m_OptNbBands > 0 ? static_cast<const OptValueType *>(m_Inputs.at(optIdx)) : nullptr;
+  Check(cudaMemset(m_NbResolved, 0, sizeof(unsigned long long)), "cudaMemset");
+  ProcessPairKernel<<<GetNumberOfBlocks(m_NbPixels), BLOCK_SIZE>>>(sar,
+                                                                   opt,
+                                                                   m_SAROutputs,
+                                                                   m_OptOutputs,
+                                                                   m_Filled,
+                                                                   m_NbPixels,
+                                                                   m_SARNbBands,
+                                                                   m_OptNbBands,
+                                                                   m_SARNoDataValue,
+                                                                   m_OptNoDataValue,
+                                                                   m_NbOutputImages,
+                                                                   m_NbResolved);
+  Check(cudaGetLastError(), "ProcessPairKernel");
+
+  // The copy waits for the kernel
+  unsigned long long nbResolved = 0;
+  Check(cudaMemcpy(&nbResolved, m_NbResolved, sizeof(unsigned long long), cudaMemcpyDeviceToHost), "cudaMemcpy");
+  return static_cast<std::size_t>(nbResolved);
+}
+
+template <class TSARValue, class TOptValue>
+void
+DrillingContext<TSARValue, TOptValue>::DownloadFilled(unsigned int * filled) const
+{
+  if (m_NbPixels > 0)
+    Check(cudaMemcpy(filled, m_Filled, m_NbPixels * sizeof(unsigned int), cudaMemcpyDeviceToHost), "cudaMemcpy");
+}
+
+template <class TSARValue, class TOptValue>
+void
+DrillingContext<TSARValue, TOptValue>::EndPlan(SARValueType * const * sarOut, OptValueType * const * optOut)
+{
+  if (m_NbPixels == 0)
+    return;
+  FillNoDataKernel<<<GetNumberOfBlocks(m_NbPixels), BLOCK_SIZE>>>(m_SAROutputs,
+                                                                  m_OptOutputs,
+                                                                  m_Filled,
+                                                                  m_NbPixels,
+                                                                  m_SARNbBands,
+                                                                  m_OptNbBands,
+                                                                  m_SARNoDataValue,
+                                                                  m_OptNoDataValue,
+                                                                  m_NbOutputImages);
+  Check(cudaGetLastError(), "FillNoDataKernel");
+  for (unsigned int n = 0; n < m_NbOutputImages; n++)
+  {
+    const std::size_t sarSize = m_NbPixels * m_SARNbBands;
+    Check(cudaMemcpy(
+            sarOut[n], m_SAROutputs + n * sarSize, sarSize * sizeof(SARValueType), cudaMemcpyDeviceToHost),
+          "cudaMemcpy");
+    if (m_OptNbBands == 0)
+      continue;
+    const std::size_t optSize = m_NbPixels * m_OptNbBands;
+    Check(cudaMemcpy(
+            optOut[n], m_OptOutputs + n * optSize, optSize * sizeof(OptValueType), cudaMemcpyDeviceToHost),
+          "cudaMemcpy");
+  }
+}
+
+// Value types of the pipelines of DecloudTimeSeriesPreProcessor
+template class DrillingContext<float, float>;
+template class DrillingContext<float, std::uint16_t>;
+template class DrillingContext<float, std::int16_t>;
+template class DrillingContext<std::uint16_t, float>;
+template class DrillingContext<std::uint16_t, std::uint16_t>;
+template class DrillingContext<std::uint16_t, std::int16_t>;
+template class DrillingContext<std::int16_t, float>;
+template class DrillingContext<std::int16_t, std::uint16_t>;
+template class DrillingContext<std::int16_t, std::int16_t>;
+
+} // end namespace cuda
+} // end namespace otb
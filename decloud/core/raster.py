@@ -55,6 +55,28 @@ def set_gdal_cachemax(gdal_cachemax):
     gdal.SetConfigOption("GDAL_CACHEMAX", gdal_cachemax)
 
 
+VALIDITY_BITMAP_HEADER = np.dtype([('magic', 'S8'), ('origin_x', '<i8'), ('origin_y', '<i8'), ('size_x', '<u8'),
+                                    ('size_y', '<u8'), ('words_per_row', '<u8'), ('nodata', '<f8'),
+                                    ('reserved', '<u8')])
+
+
+def read_validity_bitmap(filename):
+    """
+    Read a validity bitmap file (written by the DecloudValidityBitmap application, or stored in the cache directory of
+    DecloudTimeSeriesPreProcessor). The file is memory-mapped: only the rows which are used are read.
+
+    :param filename: validity bitmap file
+    :return: a (size_y, size_x) numpy array of booleans, True for the valid pixels, and the no-data value
+    """
+    header = np.fromfile(filename, dtype=VALIDITY_BITMAP_HEADER, count=1)
+    if len(header) != 1 or header['magic'][0] != b'DCLDVAL1':
+        raise Exception("{} is not a validity bitmap file".format(filename))
+    size_x, size_y, words_per_row = (int(header[key][0]) for key in ['size_x', 'size_y', 'words_per_row'])
+    words = np.memmap(filename, dtype=np.uint8, mode='r', offset=VALIDITY_BITMAP_HEADER.itemsize,
+                      shape=(size_y, words_per_row * 8))
+    return np.unpackbits(words, axis=1, count=size_x, bitorder='little').astype(bool), float(header['nodata'][0])
+
+
 def get_sub_arr(np_arr, patch_location, patch_size, ref_patch_size):
     """
     Get the np.array
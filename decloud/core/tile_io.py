@@ -29,12 +29,14 @@ import logging
 import multiprocessing
 from abc import ABC, abstractmethod
 import numpy as np
+from osgeo import gdal
 import rtree
 from scipy import spatial
 import otbApplication
 from decloud.core import system
 from decloud.preprocessing import constants
 from decloud.core import raster
+from decloud.core import timeseries
 
 # --------------------------------------------------- Constants --------------------------------------------------------
 
@@ -94,9 +96,23 @@ def get_s1images_in_directory(pth, ref_patchsize, patchsize_10m):
     :return: a list of S1Image instances
     """
     files = system.get_files(pth, "dB.tif")
+
+    # Stats of all the images at once (images are processed in parallel)
+    compute_patches_stats(images=files, outputs=[get_s1_stats_fn(fn) for fn in files], count="nodata",
+                          patchsize=ref_patchsize)
+
     return [create_s1_image(vvvh_gtiff=fn, ref_patchsize=ref_patchsize, patchsize_10m=patchsize_10m) for fn in files]
 
 
+def get_s1_stats_fn(vvvh_gtiff):
+    """
+    Returns the filename of the stats of a S1 image
+    :param vvvh_gtiff: input geotiff image
+    :return: the filename of the patches stats (number of no-data pixels)
+    """
+    return os.path.join(system.dirname(vvvh_gtiff), system.new_bname(vvvh_gtiff, constants.SUFFIX_STATS_S1))
+
+
 def create_s1_image(vvvh_gtiff, ref_patchsize, patchsize_10m):
     """
     Instantiate a S1Image from the given GeoTiff. The input image must be 2 channel (vv/vh) processed using
@@ -108,11 +124,10 @@ def create_s1_image(vvvh_gtiff, ref_patchsize, patchsize_10m):
     :return: an S1Image instance
     """
     metadata = s1_filename_to_md(vvvh_gtiff)
-    pth = system.dirname(vvvh_gtiff)
 
     # Compute stats
-    edge_stats_fn = os.path.join(pth, system.new_bname(metadata["filename"], constants.SUFFIX_STATS_S1))
-    compute_patches_stats(image=metadata["filename"], output_stats=edge_stats_fn, expr="im1b1==0&&im1b2==0",
+    edge_stats_fn = get_s1_stats_fn(metadata["filename"])
+    compute_patches_stats(images=[metadata["filename"]], outputs=[edge_stats_fn], count="nodata",
                           patchsize=ref_patchsize)
 
     return S1Image(acq_date=metadata["date"], edge_stats_fn=edge_stats_fn, vvvh_fn=metadata["filename"],
@@ -129,11 +144,59 @@ def get_s2images_in_directory(pth, ref_patchsize, patchsize_10m, with_cld_mask,
     :param with_20m_bands: True/False. If True, the S2Image are instantiated with 20m spacing bands support
     :return: a list of S2Image instances
     """
+    s2_products = system.get_directories(pth)
+
+    # Stats of all the products at once (images are processed in parallel)
+    masks = [(s2_product, mask) for s2_product in s2_products for mask in get_s2_product_files(s2_product)[:2]]
+    compute_patches_stats(images=[mask for _, mask in masks],
+                          outputs=[get_s2_stats_fn(s2_product, mask) for s2_product, mask in masks],
+                          count="valid", patchsize=ref_patchsize)
+
     return [create_s2_image_from_dir(s2_product,
                                      ref_patchsize=ref_patchsize,
                                      patchsize_10m=patchsize_10m,
                                      with_cld_mask=with_cld_mask,
-                                     with_20m_bands=with_20m_bands) for s2_product in system.get_directories(pth)]
+                                     with_20m_bands=with_20m_bands) for s2_product in s2_products]
+
+
+def get_s2_stats_fn(s2_product_dir, mask):
+    """
+    Returns the filename of the stats of a S2 mask
+    :param s2_product_dir: directory of the S2 product
+    :param mask: cloud mask or edge mask of the product
+    :return: the filename of the patches stats (number of cloudy or no-data pixels)
+    """
+    return os.path.join(s2_product_dir, system.new_bname(mask, constants.SUFFIX_STATS_S2))
+
+
+def get_s2_product_files(s2_product_dir):
+    """
+    Returns the files of a S2 product
+    :param s2_product_dir: directory of the S2 product
+    :return: the edge mask, the cloud mask, the 10m bands and the 20m bands files
+    """
+    files = system.get_files(s2_product_dir, ext=".tif")
+    edg_mask, cld_mask, b10m_imgs, b20m_imgs = None, None, None, None
+    for file in files:
+        if "EDG_R1.tif" in file:
+            edg_mask = file
+        if "CLM_R1.tif" in file:
+            cld_mask = file
+        if "FRE_10m.tif" in file:
+            b10m_imgs = file
+        if "FRE_20m.tif" in file:
+            b20m_imgs = file
+
+    # Check that files exists
+    def _check(title, filename):
+        if filename is None:
+            raise Exception(f"File for {title} does not exist in product {s2_product_dir}")
+
+    _check("edge mask", edg_mask)
+    _check("cloud mask", cld_mask)
+    _check("10m bands stack", b10m_imgs)
+    _check("20m bands stack", b20m_imgs)
+    return edg_mask, cld_mask, b10m_imgs, b20m_imgs
 
 
 def s2_filename_to_md(filename):
@@ -153,38 +216,38 @@ def s2_filename_to_md(filename):
     return metadata
 
 
-def compute_patches_stats(image, output_stats, patchsize, expr=""):
+def compute_patches_stats(images, outputs, patchsize, count="valid", nodata=0, cachedir=None):
     """
-    Run the "SquarePatchesSelection" OTB application over the input image, only if the output file does not exist
-    :param image: input image(s). Either a string, or a string list. For string list, the
-                  "expr" parameter must be set
-    :param output_stats: output image
-    :param expr: BandMath expression (optional for 1 input image, mandatory for multiple input image)
+    Run the "DecloudPatchesStatistics" OTB application over the input images whose output file does not exist. Each
+    image is read once, and the images are processed in parallel.
+    :param images: input images
+    :param outputs: output images (one per input image)
     :param patchsize: the patch size
+    :param count: pixels counted in each patch: "valid" (at least one band different from nodata) or "nodata"
+    :param nodata: no-data value of the input images
+    :param cachedir: Optional, directory of the validity bitmaps (e.g. the one of the time series pre-processing)
     """
-    logging.debug("Computing stats for %s. Result will be stored in %s.", image, output_stats)
-    if system.is_complete(output_stats):
-        logging.debug("File %s already exists. Skipping.", output_stats)
-    else:
-        app = otbApplication.Registry.CreateApplication("SquarePatchesSelection")
-        if expr:
-            thresh = otbApplication.Registry.CreateApplication("BandMath")
-            if isinstance(image, str):
-                thresh.SetParameterStringList("il", [image])
-            else:
-                thresh.SetParameterStringList("il", image)
-            thresh.SetParameterString("exp", expr)
-            thresh.Execute()
-            app.SetParameterInputImage("in", thresh.GetParameterOutputImage("out"))
+    todo = []
+    for image, output in zip(images, outputs):
+        if system.is_complete(output):
+            logging.debug("File %s already exists. Skipping.", output)
         else:
-            if not isinstance(image, str):
-                raise Exception("\"image\" must be of type str, if no expr is provided!")
-            app.SetParameterString("in", image)
-        app.SetParameterInt("patchsize", patchsize)
-        app.SetParameterString("out", f"{output_stats}?&gdal:co:COMPRESS=DEFLATE")
-        app.SetParameterOutputImagePixelType("out", otbApplication.ImagePixelType_uint16)
-        app.ExecuteAndWriteOutput()
-        system.declare_complete(output_stats)
+            logging.debug("Computing stats for %s. Result will be stored in %s.", image, output)
+            todo.append((image, output))
+    if not todo:
+        return
+    app = otbApplication.Registry.CreateApplication("DecloudPatchesStatistics")
+    app.SetParameterStringList("il", [image for image, _ in todo])
+    app.SetParameterStringList("out", [output for _, output in todo])
+    app.SetParameterStringList("patchsizes", [str(patchsize)])
+    app.SetParameterString("count", count)
+    app.SetParameterFloat("nodata", nodata)
+    app.SetParameterInt("jobs", min(len(todo), multiprocessing.cpu_count()))
+    if cachedir:
+        app.SetParameterString("cachedir", cachedir)
+    app.ExecuteAndWriteOutput()
+    for _, output in todo:
+        system.declare_complete(output)
 
 
 def create_s2_image_from_dir(s2_product_dir, ref_patchsize, patchsize_10m, with_cld_mask, with_20m_bands):
@@ -202,27 +265,7 @@ def create_s2_image_from_dir(s2_product_dir, ref_patchsize, patchsize_10m, with_
     :return: an S2Image instance
     """
     logging.debug("Processing %s", s2_product_dir)
-    files = system.get_files(s2_product_dir, ext=".tif")
-    edg_mask, cld_mask, b10m_imgs, b20m_imgs = None, None, None, None
-    for file in files:
-        if "EDG_R1.tif" in file:
-            edg_mask = file
-        if "CLM_R1.tif" in file:
-            cld_mask = file
-        if "FRE_10m.tif" in file:
-            b10m_imgs = file
-        if "FRE_20m.tif" in file:
-            b20m_imgs = file
-
-    # Check that files exists
-    def _check(title, filename):
-        if filename is None:
-            raise Exception(f"File for {title} does not exist in product {s2_product_dir}")
-
-    _check("edge mask", edg_mask)
-    _check("cloud mask", cld_mask)
-    _check("10m bands stack", b10m_imgs)
-    _check("20m bands stack", b20m_imgs)
+    edg_mask, cld_mask, b10m_imgs, b20m_imgs = get_s2_product_files(s2_product_dir)
 
     # Print infos
     logging.debug("Cloud mask:\t%s", cld_mask)
@@ -232,10 +275,10 @@ def create_s2_image_from_dir(s2_product_dir, ref_patchsize, patchsize_10m, with_
     logging.debug("\t20m bands: %s", b20m_imgs)
 
     # Compute stats
-    clouds_stats_fn = os.path.join(s2_product_dir, system.new_bname(cld_mask, constants.SUFFIX_STATS_S2))
-    edge_stats_fn = os.path.join(s2_product_dir, system.new_bname(edg_mask, constants.SUFFIX_STATS_S2))
-    compute_patches_stats(image=cld_mask, output_stats=clouds_stats_fn, expr="im1b1>0", patchsize=ref_patchsize)
-    compute_patches_stats(image=edg_mask, output_stats=edge_stats_fn, patchsize=ref_patchsize)
+    clouds_stats_fn = get_s2_stats_fn(s2_product_dir, cld_mask)
+    edge_stats_fn = get_s2_stats_fn(s2_product_dir, edg_mask)
+    compute_patches_stats(images=[cld_mask, edg_mask], outputs=[clouds_stats_fn, edge_stats_fn], count="valid",
+                          patchsize=ref_patchsize)
 
     # Return a s2 image class
     metadata = s2_filename_to_md(s2_product_dir)
@@ -314,6 +357,86 @@ class PatchReader:
         return patch_ul_lon, patch_ul_lat, patch_lr_lon, patch_lr_lat  # (lon, lat) is the standard for GeoJSON
 
 
+class PatchArrayReader:
+    """
+    A patch reader of the arrays of patches written by the "patches" mode of DecloudTimeSeriesPreProcessor.
+    The arrays are memory-mapped: patches are read from the files without copy, already channel-last.
+    """
+
+    def __init__(self, patches_dir, key, dtype=None):
+        """
+        Initializer
+        :param patches_dir: The output directory of the "patches" mode
+        :param key: The key of the output (e.g. "outsar1", "outopt1")
+        :param dtype: Optional. The dtype of the patches (patches are copied when it is not the dtype of the array)
+        """
+        with open(os.path.join(patches_dir, "patches.json")) as f:
+            self.description = json.load(f)
+        if key not in self.description["outputs"]:
+            raise Exception(f"Key {key} not in the outputs of {patches_dir}. Available outputs keys: "
+                            f"{list(self.description['outputs'])}")
+        output = self.description["outputs"][key]
+
+        # Arrays of shape (patch rows, patch cols, patch size, patch size, bands), and (patch rows, patch cols)
+        self.array = np.load(os.path.join(patches_dir, output["array"]), mmap_mode='r')
+        self.valid_counts = np.load(os.path.join(patches_dir, output["valid"]), mmap_mode='r')
+
+        # Set patches sizes, and georeferencing
+        self.patch_size = self.description["patchsize"]
+        self.ulx, self.uly = self.description["origin"]
+        self.resolution_x, self.resolution_y = self.description["spacing"]
+        self.dtype = dtype
+
+    def get(self, patch_location):
+        """
+        Read a patch as numpy array
+        :param patch_location: (col, row) of the patch, like PatchReader
+        :return A numpy array, channel-last
+        """
+        myarray = self.array[patch_location[1], patch_location[0]]
+        if self.dtype is not None and myarray.dtype != self.dtype:
+            return myarray.astype(self.dtype)
+        return myarray
+
+    def is_valid(self, patch_location):
+        """
+        Tell if all the pixels of a patch are valid
+        :param patch_location: (col, row) of the patch
+        :return: True if all the pixels of the patch have at least one band different from the no-data value
+        """
+        return self.valid_counts[patch_location[1], patch_location[0]] == self.patch_size * self.patch_size
+
+    def get_geographic_info(self, patch_location):
+        """
+        Get the geographic info of a patch
+        :param patch_location: tuple
+        :return the coordinates of the bounding box (Upper left and Lower Right), in lat/lon 4326 coordinate system
+        """
+        patch_ulx = self.ulx + patch_location[0] * self.resolution_x * self.patch_size
+        patch_uly = self.uly + patch_location[1] * self.resolution_y * self.patch_size
+        patch_lrx = patch_ulx + self.patch_size * self.resolution_x
+        patch_lry = patch_uly + self.patch_size * self.resolution_y
+
+        # Convert to 4326, from a dataset with the projection of the patches
+        ds = gdal.GetDriverByName("MEM").Create("", 1, 1)
+        ds.SetProjection(self.description["projection"])
+        patch_ul_lon, patch_ul_lat = raster.convert_to_4326((patch_ulx, patch_uly), ds)
+        patch_lr_lon, patch_lr_lat = raster.convert_to_4326((patch_lrx, patch_lry), ds)
+
+        return patch_ul_lon, patch_ul_lat, patch_lr_lon, patch_lr_lat
+
+
+def get_valid_patches_locations(patches_dir):
+    """
+    Locations of the patches whose pixels are valid in all the outputs of the "patches" mode of
+    DecloudTimeSeriesPreProcessor
+    :param patches_dir: The output directory of the "patches" mode
+    :return: list of (col, row) patches locations, like the PatchReader ones
+    """
+    index = np.load(os.path.join(patches_dir, "index.npy"), mmap_mode='r')
+    return [(int(col), int(row)) for row, col in index]
+
+
 # ---------------------------------------------- Image base classes ----------------------------------------------------
 
 
@@ -631,7 +754,30 @@ class TileHandler:
 
         self.closest_s1 = dict()
         self.max_distance = 10 * 12 * 31 * 24 * 3600  # Maximum distance to search
-        if s1_dir is not None:
+        if s1_dir is not None and timeseries.is_available():
+            # Temporal index of the valid s1 images, with the C++ core of the pre-processor
+            s2_timestamps = [s2_image.get_timestamp() for s2_image in self.s2_images]
+
+            def find_closest_s1_image_with_index(pos):
+                """
+                Find the closest s1 image for each s2 images, at the specified location (pos_x, pos_y)
+                This function modifies:
+                    self.closest_s1
+                """
+                pos_x, pos_y = pos
+                s1_indices = [s1_index for s1_index in range(len(self.s1_images))
+                              if self.s1_images_validity[s1_index, pos_x, pos_y]]
+                s1_timestamps = [self.s1_images[s1_index].get_timestamp() for s1_index in s1_indices]
+                selections = timeseries.closest(s1_timestamps, s2_timestamps, n=1)
+                self.closest_s1[pos] = {}
+                for s2_idx, selection in enumerate(selections):
+                    if selection:
+                        distance = abs(s1_timestamps[selection[0]] - s2_timestamps[s2_idx])
+                        if distance < self.max_distance:
+                            self.closest_s1[pos][s2_idx] = Closest(index=s1_indices[selection[0]], distance=distance)
+
+            self.for_each_pos(find_closest_s1_image_with_index)
+        elif s1_dir is not None:
             # Build KDTree to index s1 images timestamps
             logging.info("Build KDTrees")
             s1_timestamps_kdtrees = dict()
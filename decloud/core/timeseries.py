@@ -0,0 +1,117 @@
+# -*- coding: utf-8 -*-
+"""
+Copyright (c) 2020-2022 INRAE
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+"""
+"""
+Pairing and drilling of the time series pre-processing on numpy arrays, with the C++ core of the
+DecloudTimeSeriesPreProcessor application (the "decloud_core" module, built with -DOTBDecloud_BUILD_PYTHON=ON).
+Arrays are read and written in place, without copy.
+"""
+import numpy as np
+
+try:
+    import decloud_core
+except ImportError:
+    decloud_core = None
+
+SORTING_MODES = {'asc': 0, 'des': 1, 'abs': 2}
+PERIODS = {'any': 0, 'before': 1, 'after': 2}
+SIMD = {'scalar': 0, 'avx2': 1, 'avx512': 2, 'auto': 3}
+DTYPES = (np.float32, np.uint16, np.int16)
+
+
+def is_available():
+    """
+    Tell if the decloud_core module is available
+
+    :return: True if the module can be imported
+    """
+    return decloud_core is not None
+
+
+def _check_available():
+    """ Raise an error if the decloud_core module is not available """
+    if decloud_core is None:
+        raise ImportError("The decloud_core module is not available: build the OTBDecloud module with "
+                          "-DOTBDecloud_BUILD_PYTHON=ON, and add its install directory to the PYTHONPATH")
+
+
+def candidate_pairs(sar_timestamps, opt_timestamps, maxgap, sorting='asc', reftimestamp=0.0):
+    """
+    Pairs of SAR and optical images, like the pairs of a plan of DecloudTimeSeriesPreProcessor
+
+    :param sar_timestamps: timestamps of the SAR images
+    :param opt_timestamps: timestamps of the optical images
+    :param maxgap: maximum gap between the SAR and the optical images of a pair, in seconds
+    :param sorting: sorting of the optical images ('asc', 'des', or 'abs' for the closest first to reftimestamp)
+    :param reftimestamp: reference timestamp of the 'abs' sorting
+    :return: numpy array of shape (number of pairs, 2), of the (SAR index, optical index) pairs
+    """
+    _check_available()
+    pairs = decloud_core.candidate_pairs([float(ts) for ts in sar_timestamps], [float(ts) for ts in opt_timestamps],
+                                         float(maxgap), SORTING_MODES[sorting], float(reftimestamp))
+    return np.asarray(pairs, dtype=np.uint32).reshape(-1, 2)
+
+
+def closest(timestamps, targets, n=None, period='any', maxgap=None):
+    """
+    Images the closest to target dates, like the selection of DecloudTemporalSelection
+
+    :param timestamps: timestamps of the images
+    :param targets: timestamps of the target dates
+    :param n: Optional. Maximum number of images selected for each target date
+    :param period: period of the images, relatively to the target dates ('any', 'before' or 'after')
+    :param maxgap: Optional. Maximum gap between the selected images and the target dates, in seconds
+    :return: list of lists of images indices, one for each target date, from the closest to the farthest
+    """
+    _check_available()
+    kwargs = {'period': PERIODS[period]}
+    if n is not None:
+        kwargs['n'] = n
+    if maxgap is not None:
+        kwargs['maxgap'] = float(maxgap)
+    return decloud_core.closest([float(ts) for ts in timestamps], [float(ts) for ts in targets], **kwargs)
+
+
+def drill(sar, opt, pairs, nb_outputs, sar_nodata=0, opt_nodata=-10000, simd='auto'):
+    """
+    Pixels of the first valid pairs, like the outputs of DecloudTimeSeriesPreProcessor
+
+    :param sar: SAR images, numpy array of shape (images, rows, cols, bands)
+    :param opt: optical images, numpy array of shape (images, rows, cols, bands), or None for pairs of SAR images
+    only (the pairs optical indices are ignored)
+    :param pairs: (SAR index, optical index) pairs, e.g. from candidate_pairs()
+    :param nb_outputs: number of outputs
+    :param sar_nodata: no-data value of the SAR images
+    :param opt_nodata: no-data value of the optical images
+    :param simd: instruction set ('scalar', 'avx2', 'avx512' or 'auto')
+    :return: SAR and optical outputs, numpy arrays of shape (nb_outputs, rows, cols, bands) (optical outputs are None
+    without optical images)
+    """
+    _check_available()
+    for array in (sar, opt):
+        if array is not None and (array.dtype not in DTYPES or not array.flags.c_contiguous):
+            raise ValueError("Images must be C-contiguous arrays of float32, uint16 or int16 values")
+    sar_out = np.empty((nb_outputs,) + sar.shape[1:], dtype=sar.dtype)
+    opt_out = np.empty((nb_outputs,) + opt.shape[1:], dtype=opt.dtype) if opt is not None else None
+    decloud_core.drill(sar, opt, [tuple(pair) for pair in pairs], sar_out, opt_out, sar_nodata, opt_nodata,
+                       SIMD[simd])
+    return sar_out, opt_out
@@ -23,6 +23,8 @@ DEALINGS IN THE SOFTWARE.
 """
 """Processor for CRGA models"""
 import argparse
+import logging
+import math
 import os
 import sys
 
@@ -30,12 +32,13 @@ import decloud.preprocessing.constants as constants
 from decloud.core import system
 import pyotb
 from decloud.production.products import Factory as ProductsFactory
-from decloud.production.inference import inference
+from decloud.production.inference import inference, postprocessing, sar_mosaic
 
 
 def crga_processor(il_s1after, il_s1before, il_s1, il_s2after, il_s2before, in_s2, dem, savedmodel,
                    output=None, output_20m=None, ts=256, pad=64,
-                   with_20m_bands=False, maxgap=144, with_intermediate=False):
+                   with_20m_bands=False, maxgap=144, with_intermediate=False, preprocessed=None, block_cache=0,
+                   ram=None, fused=False):
     """
     Apply CRGA model to input sources.
 
@@ -54,6 +57,16 @@ def crga_processor(il_s1after, il_s1before, il_s1, il_s2after, il_s2before, in_s
     :param with_20m_bands: whether to compute the 20m bands. If True, the saved model must have been trained accordingly
     :param maxgap: max gap (in hours) between S1 and S2 images
     :param with_intermediate: whether to write/return intermediate results (T-1, T+1 images output of the pre-processor)
+    :param preprocessed: Optional, dict of the T-1 and T+1 images already computed by the pre-processor (e.g. in batch
+                         mode), with keys s1_tm1, s2_tm1, s1_tp1, s2_tp1
+    :param block_cache: Optional, size (in MB) of the cache of decoded blocks of the images files, shared by the
+                        pre-processors of the process (e.g. by the successive calls of a time series). 0: no cache
+    :param ram: Optional, RAM budget (in MB) of the pre-processors. When specified, the tile size is the largest one
+                (multiple of 64) whose pre-processed regions fit in this budget, according to the memory estimated
+                by the pre-processors, and ts is an upper bound
+    :param fused: Optional, whether the pre-processor of the T-1 and T+1 images feeds the model itself (its outputs
+                  are copied in the input tensors of the model, without intermediate images). Not used with
+                  preprocessed. The tile size is not adapted to ram
 
     :return output, (sources): if output path is not specified, returns reconstructed in-memory pyotb object
                                optionally, if with_indermediate, also returns the input sources
@@ -75,70 +88,121 @@ def crga_processor(il_s1after, il_s1before, il_s1, il_s2after, il_s2before, in_s
     dates = {k: [str(product.get_timestamp()) for product in products] for k, products in products_dic.items()}
 
     # Handling potential 20m bands
+    fused = fused and preprocessed is None
     if with_20m_bands:
         s2_20m = {k + '_20m': [product.get_raster_20m() for product in products] for k, products in products_dic.items()
                   if k.startswith('s2')}
-        # we create a downsampled radar image that has the same resolution as 20m images
-        s1_20m = {k + '_20m': [pyotb.RigidTransformResample({'in': image_10m, 'transform.type.id.scalex': 0.5,
-                                                             'transform.type.id.scaley': 0.5, 'interpolator': 'nn'})
-                               for image_10m in images_10m] for k, images_10m in images.items() if k.startswith('s1')}
-        images.update(**s1_20m, **s2_20m)
-
-    # Pre-Processing: "merging" all available images by creating S1/S2 pairs that satisfy a S2/S1 maxgap parameter
-    preprocessor_tm1 = pyotb.DecloudTimeSeriesPreProcessor(maxgap=maxgap * 3600, ilsar=images['s1_tm1'],
-                                                           ilopt=images['s2_tm1'], timestampssar=dates['s1_tm1'],
-                                                           timestampsopt=dates['s2_tm1'], sorting="asc")
-    preprocessor_tp1 = pyotb.DecloudTimeSeriesPreProcessor(maxgap=maxgap * 3600, ilsar=images['s1_tp1'],
-                                                           ilopt=images['s2_tp1'], timestampssar=dates['s1_tp1'],
-                                                           timestampsopt=dates['s2_tp1'], sorting="des")
+        images.update(**s2_20m)
+        if fused or preprocessed is not None:
+            # we create a downsampled radar image that has the same resolution as 20m images, for a separate
+            # pre-processor of the 20m bands
+            s1_20m = {k + '_20m': [pyotb.RigidTransformResample({'in': image_10m, 'transform.type.id.scalex': 0.5,
+                                                                 'transform.type.id.scaley': 0.5,
+                                                                 'interpolator': 'nn'})
+                                   for image_10m in images_10m]
+                      for k, images_10m in images.items() if k.startswith('s1')}
+            images.update(**s1_20m)
+
+    # Pre-Processing: "merging" all available images by creating S1/S2 pairs that satisfy a S2/S1 maxgap parameter.
+    # T-1 (plan #1) and T+1 (plan #2) pairs are computed in a single pass, reading shared images once
+    # The 20m bands can be drilled in the same pass, from the same pairs (iloptlowres)
+    def _preprocessor(suffix='', model=None, lowres=False):
+        """Helper to create the preprocessor of T-1 and T+1 pairs (optionally feeding the model)"""
+        system.set_env_var("DECLOUD_PREPROCESSING_NPLANS", "2")
+        lowres_params = {}
+        if lowres:
+            lowres_params = {'iloptlowres': images['s2_tm1_20m'], 'plan2.iloptlowres': images['s2_tp1_20m']}
+        return pyotb.DecloudTimeSeriesPreProcessor({
+            'maxgap': maxgap * 3600,
+            'ilsar': images['s1_tm1' + suffix], 'ilopt': images['s2_tm1' + suffix],
+            'timestampssar': dates['s1_tm1'], 'timestampsopt': dates['s2_tm1'], 'sorting': "asc",
+            'plan2.ilsar': images['s1_tp1' + suffix], 'plan2.ilopt': images['s2_tp1' + suffix],
+            'plan2.timestampssar': dates['s1_tp1'], 'plan2.timestampsopt': dates['s2_tp1'], 'plan2.sorting': "des",
+            'blockcache': block_cache, **({'ram': ram} if ram else {}), **lowres_params,
+            **(model or {})})
+
+    preprocessors = []
+    preprocessed_20m = None
+
+    if preprocessed is None and not fused:
+        preprocessor = _preprocessor(lowres=with_20m_bands)
+        preprocessors.append(preprocessor)
+        preprocessed = {'s1_tm1': preprocessor.outsar1,
+                        's2_tm1': preprocessor.outopt1,
+                        's1_tp1': getattr(preprocessor, 'plan2.outsar1'),
+                        's2_tp1': getattr(preprocessor, 'plan2.outopt1')}
+        if with_20m_bands:
+            preprocessed_20m = {'s2_20m_tm1': preprocessor.outopt1lowres,
+                                's2_20m_tp1': getattr(preprocessor, 'plan2.outopt1lowres')}
 
     # For T date, there is only one S2 image, thus a simple mosaic of S1 images with the closest ones on top
-    def _closest_date(x):
-        """Helper to sort S1 products"""
-        return abs(s2t_product.get_timestamp() - x.get_timestamp())
-
-    s1t_products.sort(key=_closest_date, reverse=True)
-    # Getting the 10m rasters
-    input_s1_images_10m = [product.get_raster_10m() for product in s1t_products]
     s2t = s2t_product.get_raster_10m()
 
-    sources = {'s1_tm1': preprocessor_tm1.outsar1,
-               's2_tm1': preprocessor_tm1.outopt1,
-               's1_tp1': preprocessor_tp1.outsar1,
-               's2_tp1': preprocessor_tp1.outopt1,
-               's1_t': pyotb.Mosaic(il=input_s1_images_10m, nodata=0),
+    sources = {'s1_t': sar_mosaic(s1t_products, s2t_product.get_timestamp()),
                's2_t': s2t,
                "dem": dem}
+    if not fused:
+        sources = {**{name: preprocessed[name] for name in ['s1_tm1', 's2_tm1', 's1_tp1', 's2_tp1']}, **sources}
 
-    # Pre-Processing 20m bands
+    # Pre-Processing 20m bands (in a separate pass, unless they have been drilled with the 10m bands)
     if with_20m_bands:
-        preproc_20m_tm1 = pyotb.DecloudTimeSeriesPreProcessor(maxgap=maxgap * 3600, ilsar=images['s1_tm1_20m'],
-                                                              ilopt=images['s2_tm1_20m'], timestampssar=dates['s1_tm1'],
-                                                              timestampsopt=dates['s2_tm1'], sorting="asc")
-        preproc_20m_tp1 = pyotb.DecloudTimeSeriesPreProcessor(maxgap=maxgap * 3600, ilsar=images['s1_tp1_20m'],
-                                                              ilopt=images['s2_tp1_20m'], timestampssar=dates['s1_tp1'],
-                                                              timestampsopt=dates['s2_tp1'], sorting="des")
-        sources.update({"s2_20m_tm1": preproc_20m_tm1.outopt1,
-                        "s2_20m_tp1": preproc_20m_tp1.outopt1,
-                        "s2_20m_t": images['s2_t_20m'][0]})
+        if preprocessed_20m is None:
+            preprocessor_20m = _preprocessor('_20m')
+            preprocessors.append(preprocessor_20m)
+            preprocessed_20m = {'s2_20m_tm1': preprocessor_20m.outopt1,
+                                's2_20m_tp1': getattr(preprocessor_20m, 'plan2.outopt1')}
+        sources.update({**preprocessed_20m, "s2_20m_t": images['s2_t_20m'][0]})
 
     # Resolution factor
     sources_scales = {"dem": 2, 's2_20m_tm1': 2, 's2_20m_tp1': 2, 's2_20m_t': 2}
 
+    # Output tensor: stack of the 10m reconstruction and 20m reconstruction (resampled to 10m), or 10m reconstruction
+    out_tensor = "s2_all_bands_estim" if with_20m_bands else "s2_estim"
+    nodatavalues = {"s1_tm1": 0, "s2_tm1": -10000, "s1_tp1": 0, "s2_tp1": -10000, "s1_t": 0, "s2_t": -10000}
+
+    # Fused pre-processing and inference: the outputs of the T-1 and T+1 plans are the first sources of the model
+    if fused:
+        logging.info('Pre-processing of T-1 and T+1 images fused with the inference')
+        preprocessor = _preprocessor(model={
+            'mode': 'model', 'mode.model.dir': savedmodel,
+            'mode.model.placeholders': ['outsar1=s1_tm1', 'outopt1=s2_tm1', 'plan2.outsar1=s1_tp1',
+                                        'plan2.outopt1=s2_tp1'],
+            'mode.model.il': list(sources.values()), 'mode.model.ilplaceholders': list(sources.keys()),
+            'mode.model.ilscales': [str(sources_scales.get(name, 1)) for name in sources],
+            'mode.model.output': constants.padded_tensor_name(out_tensor, pad),
+            'mode.model.pad': pad, 'mode.model.ts': ts})
+        sources = {'s1_tm1': preprocessor.outsar1,
+                   's2_tm1': preprocessor.outopt1,
+                   's1_tp1': getattr(preprocessor, 'plan2.outsar1'),
+                   's2_tp1': getattr(preprocessor, 'plan2.outopt1'),
+                   **sources}
+        model_output = postprocessing(getattr(preprocessor, 'mode.model.out'), sources=sources, pad=pad,
+                                      out_nodatavalue=s2t_product.get_nodatavalue(),
+                                      out_pixeltype=s2t_product.get_raster_10m_encoding(),
+                                      nodatavalues=nodatavalues)
+
+    # Tile size: the pre-processed regions (tiles and their margins) must fit in the RAM budget
+    if ram and preprocessors and not fused:
+        bytes_per_pixel = max(preprocessor.app.GetParameterInt('bytesperpixel') for preprocessor in preprocessors)
+        side = int(math.sqrt(ram * 2 ** 20 / bytes_per_pixel)) - 2 * pad
+        ts = min(ts, max(64, side // 64 * 64))
+        logging.info('Tile size: %s (%s bytes per pre-processed pixel, %s MB)', ts, bytes_per_pixel, ram)
+
     # OTB extended filename that will be used for all writing
     filename_extension = ("&streaming:type=tiled&streaming:sizemode=height&streaming:sizevalue={}&"
                           "gdal:co:COMPRESS=DEFLATE&gdal:co:TILED=YES".format(ts))
 
     # Inference
+    if not fused:
+        model_output = inference(sources=sources, sources_scales=sources_scales, pad=pad,
+                                 ts=ts, savedmodel_dir=savedmodel,
+                                 out_tensor=out_tensor,
+                                 out_nodatavalue=s2t_product.get_nodatavalue(),
+                                 out_pixeltype=s2t_product.get_raster_10m_encoding(),
+                                 nodatavalues=nodatavalues)
+
     if with_20m_bands:
-        out_tensor = "s2_all_bands_estim"  # stack of the 10m reconstruction and 20m reconstruction (resampled to 10m)
-        resampled_all_bands = inference(sources=sources, sources_scales=sources_scales, pad=pad,
-                                        ts=ts, savedmodel_dir=savedmodel,
-                                        out_tensor=out_tensor,
-                                        out_nodatavalue=s2t_product.get_nodatavalue(),
-                                        out_pixeltype=s2t_product.get_raster_10m_encoding(),
-                                        nodatavalues={"s1_tm1": 0, "s2_tm1": -10000, "s1_tp1": 0,
-                                                      "s2_tp1": -10000, "s1_t": 0, "s2_t": -10000})
+        resampled_all_bands = model_output
 
         # If the user didn't specify output paths, return in-memory object
         if not (output and output_20m):
@@ -163,14 +227,7 @@ def crga_processor(il_s1after, il_s1before, il_s1, il_s2after, il_s2before, in_s
         os.remove(temp_outpath)
 
     else:
-        out_tensor = "s2_estim"
-        processed_10m = inference(sources=sources, sources_scales=sources_scales, pad=pad,
-                                  ts=ts, savedmodel_dir=savedmodel,
-                                  out_tensor=out_tensor,
-                                  out_nodatavalue=s2t_product.get_nodatavalue(),
-                                  out_pixeltype=s2t_product.get_raster_10m_encoding(),
-                                  nodatavalues={"s1_tm1": 0, "s2_tm1": -10000, "s1_tp1": 0,
-                                                "s2_tp1": -10000, "s1_t": 0, "s2_t": -10000})
+        processed_10m = model_output
 
         # If the user didn't specify output path, return in-memory object
         if not output:
@@ -225,6 +282,13 @@ def main():
                         help="Tile size. Tune this to process larger output image chunks, and speed up the process.")
     parser.add_argument('--maxgap', default=72, type=int,
                         help="Max gap (in hours) between S1 and S2 images for the selection of before and after pairs.")
+    parser.add_argument('--ram', type=int,
+                        help="RAM budget (in MB) of the pre-processing. When specified, the tile size is the largest "
+                             "one (up to --ts) whose pre-processed regions fit in this budget. Optional")
+    parser.add_argument('--fused', dest='fused', action='store_true',
+                        help="Feed the model with the outputs of the pre-processing directly, without intermediate "
+                             "images")
+    parser.set_defaults(fused=False)
 
     if len(sys.argv) == 1:
         parser.print_help()
@@ -235,7 +299,8 @@ def main():
     crga_processor(params.il_s1after, params.il_s1before, params.il_s1, params.il_s2after, params.il_s2before,
                    params.in_s2, params.dem, params.savedmodel,
                    params.output, params.output_20m, params.ts, params.pad,
-                   params.with_20m_bands, params.maxgap, params.write_intermediate)
+                   params.with_20m_bands, params.maxgap, params.write_intermediate, ram=params.ram,
+                   fused=params.fused)
 
 
 if __name__ == "__main__":
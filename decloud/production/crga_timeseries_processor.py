@@ -24,17 +24,71 @@ DEALINGS IN THE SOFTWARE.
 """Process time series with CRGA models"""
 import argparse
 import datetime
+import json
 import os
 import sys
 import logging
-import heapq
 import numpy as np
-from decloud.core import system
+import otbApplication
+from decloud.core import system, raster, timeseries
 from decloud.production.products import Factory as ProductsFactory
 from decloud.production.crga_processor import crga_processor
 import pyotb
 
 
+def select_nclosest(n, s2t_products, product_dic, period=None):
+    """
+    Finds the n temporally closest images of several S2 products, with the temporal index of the
+    DecloudTemporalSelection application (the selection used by the batch mode of the pre-processor), called
+    directly from the decloud_core module when it is available.
+
+    :param n: number of images to select
+    :param s2t_products: list of S2ProductBase images
+    :param product_dic: ProductBase images
+    :param period: Optional. Period of interest, can be 'before' or 'after' or any
+    :return res: list of filepaths lists, one for each S2 product, from the closest to the farthest
+    """
+    if not s2t_products:
+        return []
+    files = list(product_dic.keys())
+    period = period if period in ('before', 'after') else 'any'
+    if timeseries.is_available():
+        selections = timeseries.closest([product.get_timestamp() for product in product_dic.values()],
+                                        [s2t.get_timestamp() for s2t in s2t_products], n, period)
+        return [[files[idx] for idx in selection] for selection in selections]
+    app = otbApplication.Registry.CreateApplication('DecloudTemporalSelection')
+    app.SetParameterStringList('timestamps', [str(product.get_timestamp()) for product in product_dic.values()])
+    app.SetParameterStringList('targets', [str(s2t.get_timestamp()) for s2t in s2t_products])
+    app.SetParameterString('period', period)
+    app.SetParameterInt('nimages', n)
+    app.Execute()
+    return [[files[int(idx)] for idx in selection.split(',') if idx] for selection in app.GetParameterStringList('out')]
+
+
+def has_valid_pixels(filename, cache_dir, nodata=-10000):
+    """
+    Tell if an image has valid pixels, from its validity bitmap. The bitmap is read from the cache directory when
+    already computed, else it is computed with the DecloudValidityBitmap application and stored in the cache directory.
+
+    :param filename: image file
+    :param cache_dir: directory of the validity bitmaps
+    :param nodata: no-data value of the image
+    :return: True if at least one pixel of the image is valid
+    """
+    bitmap_file = os.path.join(cache_dir, os.path.basename(filename) + '.validity')
+    if system.file_exists(bitmap_file):
+        bitmap, bitmap_nodata = raster.read_validity_bitmap(bitmap_file)
+        if bitmap_nodata == nodata:
+            return bitmap.any()
+    system.mkdir(cache_dir)
+    app = otbApplication.Registry.CreateApplication('DecloudValidityBitmap')
+    app.SetParameterString('in', filename)
+    app.SetParameterFloat('nodata', nodata)
+    app.SetParameterString('out', bitmap_file)
+    app.ExecuteAndWriteOutput()
+    return app.GetParameterInt('nbvalid') > 0
+
+
 def get_nclosest(n, s2t, product_dic, period=None):
     """
     Finds the n temporally closest images of a given S2 product.
@@ -45,21 +99,48 @@ def get_nclosest(n, s2t, product_dic, period=None):
     :param period: Optional. Period of interest, can be 'before' or 'after' or any
     :return res: list of filepaths
     """
+    return select_nclosest(n, [s2t], product_dic, period)[0]
 
-    # Searching for candidates and gathering as dictionary {product:timedelta}
-    if period == 'before':
-        candidates = dict([(file, s2t.get_date() - product.get_date())
-                           for file, product in product_dic.items() if product.get_date() < s2t.get_date()])
-    elif period == 'after':
-        candidates = dict([(file, product.get_date() - s2t.get_date())
-                           for file, product in product_dic.items() if product.get_date() > s2t.get_date()])
-    else:
-        candidates = dict([(file, abs(product.get_date() - s2t.get_date())) for file, product in product_dic.items()])
 
-    # selecting the N best among the candidates
-    res = heapq.nsmallest(n, candidates, key=candidates.get)
+def get_inputs(task, params):
+    """
+    Inputs of the reconstruction of a date, other than the T-1 and T+1 pairs tracked by the pre-processor
+
+    :param task: task of the date
+    :param params: parameters of the processor
+    :return: dict of the inputs
+    """
+    s2_filepath, _, _, _, (_, _, s1t_paths, _, _) = task
+    return {'s2_t': s2_filepath, 's1_t': sorted(s1t_paths), 'dem': params.dem, 'model': params.model,
+            'roi': [params.ulx, params.uly, params.lrx, params.lry]}
+
 
-    return res
+def read_inputs(directory, name):
+    """
+    Read the inputs a date has been reconstructed from, recorded by write_inputs()
+
+    :param directory: directory of the records
+    :param name: name of the date
+    :return: dict of the inputs, or None if they have not been recorded
+    """
+    filename = os.path.join(directory, name + '.inputs.json')
+    if not system.file_exists(filename):
+        return None
+    with open(filename) as f:
+        return json.load(f)
+
+
+def write_inputs(directory, name, inputs):
+    """
+    Record the inputs a date has been reconstructed from
+
+    :param directory: directory of the records
+    :param name: name of the date
+    :param inputs: dict of the inputs
+    """
+    system.mkdir(directory)
+    with open(os.path.join(directory, name + '.inputs.json'), 'w') as f:
+        json.dump(inputs, f, indent=2)
 
 
 if __name__ == "__main__":
@@ -90,6 +171,9 @@ if __name__ == "__main__":
     parser.add_argument("--end", help="End date, format YYYY-MM-DD. Optional")
     parser.add_argument('--ts', default=256, type=int,
                         help="Tile size. Tune this to process larger output image chunks, and speed up the process.")
+    parser.add_argument('--ram', type=int,
+                        help="RAM budget (in MB) of the pre-processing. When specified, the tile size is the largest "
+                             "one (up to --ts) whose pre-processed regions fit in this budget. Optional")
     parser.add_argument('--write_intermediate', dest='write_intermediate', action='store_true',
                         help="Whether to write intermediary T-1 & T+1 input rasters used by the model.")
     parser.set_defaults(write_intermediate=False)
@@ -99,6 +183,22 @@ if __name__ == "__main__":
     parser.add_argument('--skip_nodata_images', dest='skip_nodata_images', action='store_true',
                         help="Whether to skip the reconstruction of the optical image if it is all NoData")
     parser.set_defaults(skip_nodata_images=False)
+    parser.add_argument('--validity_cache_dir',
+                        help="Directory where the validity bitmaps of the S2 images are stored, and read from when "
+                             "already computed, with --skip_nodata_images. Optional")
+    parser.add_argument('--block_cache', default=0, type=int,
+                        help="Size (in MB) of the cache of decoded blocks of the input images, shared by the "
+                             "pre-processing of the successive dates (the dates share most of their input images)")
+    parser.add_argument('--batch', dest='batch', action='store_true',
+                        help="Whether to pre-process the T-1 & T+1 images of all the dates in a single pass, before "
+                             "the inference. The pre-processed images are written in out_dir/preprocessing")
+    parser.set_defaults(batch=False)
+    parser.add_argument('--incremental', dest='incremental', action='store_true',
+                        help="Whether to reconstruct only the dates whose inputs have changed since the previous run "
+                             "(e.g. when new acquisitions are added), in batch mode. The pre-processor skips the dates "
+                             "whose pairs are unchanged, and the other inputs of each date are recorded in "
+                             "out_dir/preprocessing")
+    parser.set_defaults(incremental=False)
 
     if len(sys.argv) == 1:
         parser.print_help()
@@ -111,6 +211,9 @@ if __name__ == "__main__":
     if not (params.il_s1 or params.s1_dir):
         raise Exception('Missing --il_s1 or --s1_dir argument')
 
+    if params.incremental and not params.batch:
+        raise Exception('--incremental requires --batch')
+
     if params.il_s2 and params.s2_dir:
         logging.warning('Both --il_s2 and --s2_dir were specified. Discarding --s2_dir')
         params.s2_dir = None
@@ -166,7 +269,8 @@ if __name__ == "__main__":
     filename_extension = ("&streaming:type=tiled&streaming:sizemode=height&streaming:sizevalue={}&"
                           "gdal:co:COMPRESS=DEFLATE&gdal:co:TILED=YES".format(params.ts))
 
-    # looping through the dates
+    # Dates to process
+    dates = []
     for s2_filepath, s2t_product in input_s2_products.items():
         if (params.start and s2t_product.get_date() < start) or (params.end and s2t_product.get_date() > end):
             # skipping invalid timerange product
@@ -174,62 +278,118 @@ if __name__ == "__main__":
 
         output_filename = os.path.splitext(os.path.basename(s2_filepath))[0]+'_reconstructed.tif'
         output_path = os.path.join(params.out_dir, output_filename)
-        if params.overwrite or (not os.path.exists(output_path)):
-            s2tp1_paths = get_nclosest(s2_Nimages, s2t_product, input_s2_products, 'after')
-            s2tm1_paths = get_nclosest(s2_Nimages, s2t_product, input_s2_products, 'before')
-            s1t_paths = get_nclosest(s1_Nimages, s2t_product, input_s1_products)
-            s1tp1_paths = get_nclosest(s1_Nimages, s2t_product, input_s1_products, 'after')
-            s1tm1_paths = get_nclosest(s1_Nimages, s2t_product, input_s1_products, 'before')
-
-            if any([len(paths) == 0 for paths in [s1tp1_paths, s1tm1_paths, s1t_paths, s2tp1_paths, s2tm1_paths]]):
-                logging.warning('Could not find some T-1 or T+1 or S1T products. '
-                                'Skipping inference: {}'.format(os.path.basename(s2_filepath)))
-                continue
+        if params.overwrite or params.incremental or (not os.path.exists(output_path)):
+            dates.append((s2_filepath, s2t_product, output_filename, output_path))
+
+    # Selecting the closest images of all the dates at once
+    s2t_products = [s2t_product for _, s2t_product, _, _ in dates]
+    selections = zip(select_nclosest(s2_Nimages, s2t_products, input_s2_products, 'after'),
+                     select_nclosest(s2_Nimages, s2t_products, input_s2_products, 'before'),
+                     select_nclosest(s1_Nimages, s2t_products, input_s1_products),
+                     select_nclosest(s1_Nimages, s2t_products, input_s1_products, 'after'),
+                     select_nclosest(s1_Nimages, s2t_products, input_s1_products, 'before'))
+
+    # looping through the dates, to select the input images of each date
+    tasks = []
+    for (s2_filepath, s2t_product, output_filename, output_path), selection in zip(dates, selections):
+        s2tp1_paths, s2tm1_paths, s1t_paths, s1tp1_paths, s1tm1_paths = selection
+
+        if any([len(paths) == 0 for paths in [s1tp1_paths, s1tm1_paths, s1t_paths, s2tp1_paths, s2tm1_paths]]):
+            logging.warning('Could not find some T-1 or T+1 or S1T products. '
+                            'Skipping inference: {}'.format(os.path.basename(s2_filepath)))
+            continue
 
-            # Potentially skip the inference if the s2_t image is all NoData
-            if params.skip_nodata_images:
-                # we consider the 20m image (because it is smaller than 10m image)
-                s2t_20m = s2t_product.get_raster_20m()
-                # If needed, extracting ROI of all rasters
-                if params.lrx and params.lry and params.ulx and params.uly:
-                    s2t_20m = pyotb.ExtractROI({'in': s2t_20m, 'mode': 'extent', 'mode.extent.unit': 'phy',
-                                                'mode.extent.ulx': params.ulx, 'mode.extent.uly': params.uly,
-                                                'mode.extent.lrx': params.lrx, 'mode.extent.lry': params.lry})
-                s2t_20m = pyotb.Input(s2t_20m) if isinstance(s2t_20m, str) else s2t_20m
-                if np.max(np.asarray(s2t_20m)) <= 0:
-                    logging.warning(f'SKIPPING all NoData image: {s2_filepath}')
-                    continue
-
-            if params.write_intermediate:
-                processor, sources = crga_processor(s1tp1_paths, s1tm1_paths, s1t_paths, s2tp1_paths, s2tm1_paths,
-                                                    s2_filepath, params.dem, params.model, ts=params.ts,
-                                                    with_intermediate=True)
+        # Potentially skip the inference if the s2_t image is all NoData
+        if params.skip_nodata_images:
+            # we consider the 20m image (because it is smaller than 10m image)
+            s2t_20m = s2t_product.get_raster_20m()
+            # If needed, extracting ROI of all rasters
+            if params.lrx and params.lry and params.ulx and params.uly:
+                s2t_20m = pyotb.ExtractROI({'in': s2t_20m, 'mode': 'extent', 'mode.extent.unit': 'phy',
+                                            'mode.extent.ulx': params.ulx, 'mode.extent.uly': params.uly,
+                                            'mode.extent.lrx': params.lrx, 'mode.extent.lry': params.lry})
+            if params.validity_cache_dir and isinstance(s2t_20m, str):
+                all_nodata = not has_valid_pixels(s2t_20m, params.validity_cache_dir)
             else:
-                processor = crga_processor(s1tp1_paths, s1tm1_paths, s1t_paths, s2tp1_paths, s2tm1_paths,
-                                           s2_filepath, params.dem, params.model, ts=params.ts)
+                s2t_20m = pyotb.Input(s2t_20m) if isinstance(s2t_20m, str) else s2t_20m
+                all_nodata = np.max(np.asarray(s2t_20m)) <= 0
+            if all_nodata:
+                logging.warning(f'SKIPPING all NoData image: {s2_filepath}')
+                continue
 
-            # If needed, extracting ROI of the reconstructed image
-            if params.lrx and params.lry and params.ulx and params.uly:
-                processor = pyotb.ExtractROI({'in': processor, 'mode': 'extent', 'mode.extent.unit': 'phy',
-                                              'mode.extent.ulx': params.ulx, 'mode.extent.uly': params.uly,
-                                              'mode.extent.lrx': params.lrx, 'mode.extent.lry': params.lry},
-                                             propagate_pixel_type=True)
-
-            # Writing result
-            processor.write(out=output_path, filename_extension=filename_extension)
-
-            # Writing intermediate results: s2t and the outputs of preprocessor (s1tm1, s1tp1, s1t, s2tm1, s2t)
-            if params.write_intermediate:
-                for name, image in sources.items():
-                    if name != 'dem':
-                        # If needed, extracting ROI
-                        if params.lrx and params.lry and params.ulx and params.uly:
-                            image = pyotb.ExtractROI({'in': image, 'mode': 'extent', 'mode.extent.unit': 'phy',
-                                                      'mode.extent.ulx': params.ulx, 'mode.extent.uly': params.uly,
-                                                      'mode.extent.lrx': params.lrx, 'mode.extent.lry': params.lry},
-                                                     propagate_pixel_type=True)
-
-                        if isinstance(image, str):  # if needed transform the filepath to pyotb in-memory object
-                            image = pyotb.Input(image)
-                        image.write(os.path.join(params.out_dir, output_filename.replace('reconstructed', name)),
-                                    pixel_type='int32', filename_extension=filename_extension)
+        tasks.append((s2_filepath, s2t_product, output_filename, output_path,
+                      (s1tp1_paths, s1tm1_paths, s1t_paths, s2tp1_paths, s2tm1_paths)))
+
+    # In batch mode, the T-1 and T+1 images of all the dates are pre-processed in a single pass, sharing the reads of
+    # the images used by several dates
+    preprocessed = {}
+    preprocessing_dir = os.path.join(params.out_dir, 'preprocessing')
+    if params.batch and tasks:
+        names = [os.path.splitext(output_filename)[0] for _, _, output_filename, _, _ in tasks]
+        system.set_env_var("DECLOUD_PREPROCESSING_NPLANS", "1")
+        preprocessor = pyotb.DecloudTimeSeriesPreProcessor({
+            'maxgap': 144 * 3600,
+            'ilsar': [product.get_raster_10m() for product in input_s1_products.values()],
+            'ilopt': [product.get_raster_10m() for product in input_s2_products.values()],
+            'timestampssar': [str(product.get_timestamp()) for product in input_s1_products.values()],
+            'timestampsopt': [str(product.get_timestamp()) for product in input_s2_products.values()],
+            'mode': 'batch',
+            'mode.batch.targets': [str(s2t_product.get_timestamp()) for _, s2t_product, _, _, _ in tasks],
+            'mode.batch.names': names, 'mode.batch.nimagessar': s1_Nimages, 'mode.batch.nimagesopt': s2_Nimages,
+            'mode.batch.outdir': preprocessing_dir, 'mode.batch.incremental': params.incremental})
+        for name in names:
+            preprocessed[name] = {key: os.path.join(preprocessing_dir, '{}_{}_{}.tif'.format(name, suffix, out))
+                                  for key, suffix, out in [('s1_tm1', 'tm1', 'outsar1'), ('s2_tm1', 'tm1', 'outopt1'),
+                                                           ('s1_tp1', 'tp1', 'outsar1'), ('s2_tp1', 'tp1', 'outopt1')]}
+
+        # In incremental mode, a date is reconstructed again when its T-1 or T+1 pairs, or its other inputs, change
+        if params.incremental:
+            updated = set(preprocessor.app.GetParameterStringList('mode.batch.updated'))
+            logging.info('T-1 and T+1 pairs changed for %s of %s dates', len(updated), len(tasks))
+            tasks = [task for task in tasks
+                     if os.path.splitext(task[2])[0] in updated or not os.path.exists(task[3]) or
+                     read_inputs(preprocessing_dir, os.path.splitext(task[2])[0]) != get_inputs(task, params)]
+
+    # looping through the dates, to reconstruct each date
+    for task in tasks:
+        s2_filepath, s2t_product, output_filename, output_path, paths = task
+        s1tp1_paths, s1tm1_paths, s1t_paths, s2tp1_paths, s2tm1_paths = paths
+        name = os.path.splitext(output_filename)[0]
+        if params.write_intermediate:
+            processor, sources = crga_processor(s1tp1_paths, s1tm1_paths, s1t_paths, s2tp1_paths, s2tm1_paths,
+                                                s2_filepath, params.dem, params.model, ts=params.ts,
+                                                with_intermediate=True, preprocessed=preprocessed.get(name),
+                                                block_cache=params.block_cache, ram=params.ram)
+        else:
+            processor = crga_processor(s1tp1_paths, s1tm1_paths, s1t_paths, s2tp1_paths, s2tm1_paths,
+                                       s2_filepath, params.dem, params.model, ts=params.ts,
+                                       preprocessed=preprocessed.get(name), block_cache=params.block_cache,
+                                       ram=params.ram)
+
+        # If needed, extracting ROI of the reconstructed image
+        if params.lrx and params.lry and params.ulx and params.uly:
+            processor = pyotb.ExtractROI({'in': processor, 'mode': 'extent', 'mode.extent.unit': 'phy',
+                                          'mode.extent.ulx': params.ulx, 'mode.extent.uly': params.uly,
+                                          'mode.extent.lrx': params.lrx, 'mode.extent.lry': params.lry},
+                                         propagate_pixel_type=True)
+
+        # Writing result
+        processor.write(out=output_path, filename_extension=filename_extension)
+        if params.incremental:
+            write_inputs(preprocessing_dir, name, get_inputs(task, params))
+
+        # Writing intermediate results: s2t and the outputs of preprocessor (s1tm1, s1tp1, s1t, s2tm1, s2t)
+        if params.write_intermediate:
+            for name, image in sources.items():
+                if name != 'dem':
+                    # If needed, extracting ROI
+                    if params.lrx and params.lry and params.ulx and params.uly:
+                        image = pyotb.ExtractROI({'in': image, 'mode': 'extent', 'mode.extent.unit': 'phy',
+                                                  'mode.extent.ulx': params.ulx, 'mode.extent.uly': params.uly,
+                                                  'mode.extent.lrx': params.lrx, 'mode.extent.lry': params.lry},
+                                                 propagate_pixel_type=True)
+
+                    if isinstance(image, str):  # if needed transform the filepath to pyotb in-memory object
+                        image = pyotb.Input(image)
+                    image.write(os.path.join(params.out_dir, output_filename.replace('reconstructed', name)),
+                                pixel_type='int32', filename_extension=filename_extension)
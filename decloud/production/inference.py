@@ -93,7 +93,20 @@ def inference(sources, sources_scales, pad, ts, savedmodel_dir, out_tensor, out_
                           "optim.disabletiling": 1})
     infer.Execute()
 
-    # Post Processing
+    return postprocessing(infer, sources, pad, out_nodatavalue, out_pixeltype, nodatavalues)
+
+
+def postprocessing(infer, sources, pad, out_nodatavalue, out_pixeltype, nodatavalues=None):
+    """
+    Perform some post-processing of the output of the model, to keep only valid pixels.
+
+    :param infer: output of the model (pyotb object)
+    :param sources: a dict of sources, with keys=placeholder name, and value=str or pyotb object
+    :param pad: Margin size for blocking artefacts removal
+    :param out_nodatavalue: NoData value for the output reconstructed S2t image
+    :param out_pixeltype: PixelType for the output reconstructed S2t image
+    :param nodatavalues: Optional, dictionary of NoData with keys=placeholder name
+    """
     # For ESA Sentinel-2, remove potential zeros the network may have introduced in the valid parts of the image
     if out_pixeltype == otbApplication.ImagePixelType_uint16:
         infer = pyotb.where(infer <= 1, 1, infer)
@@ -126,3 +139,21 @@ def inference(sources, sources_scales, pad, ts, savedmodel_dir, out_tensor, out_
 
     infer.SetParameterOutputImagePixelType("out", out_pixeltype)
     return infer
+
+
+def sar_mosaic(s1_products, timestamp, nodata=0):
+    """
+    Mosaic of Sentinel-1 images at a date: each pixel is taken from the closest image to the date which is valid at
+    this pixel (i.e. one of its bands is not NoData). Images must be on the same grid.
+
+    :param s1_products: list of Sentinel-1 products
+    :param timestamp: timestamp of the date of the mosaic
+    :param nodata: NoData value of the Sentinel-1 images
+    :return: the mosaic (pyotb object)
+    """
+    system.set_env_var("DECLOUD_PREPROCESSING_NPLANS", "1")
+    mosaic = pyotb.DecloudTimeSeriesPreProcessor({
+        'ilsar': [product.get_raster_10m() for product in s1_products],
+        'timestampssar': [str(product.get_timestamp()) for product in s1_products],
+        'nodatasar': nodata, 'mode': 'mosaic', 'mode.mosaic.timestamp': str(timestamp)})
+    return getattr(mosaic, 'mode.mosaic.out')
@@ -27,7 +27,7 @@ import os
 import sys
 
 from decloud.production.products import Factory as ProductsFactory
-from decloud.production.inference import inference
+from decloud.production.inference import inference, sar_mosaic
 import decloud.preprocessing.constants as constants
 from decloud.core import system
 import pyotb
@@ -69,10 +69,9 @@ def meraner_processor(il_s1, in_s2, savedmodel, dem=None, output=None, output_20
     input_s1_products = input_s1_products[:s1_Nimages]
 
     # Getting the 10m rasters
-    input_s1_images_10m = [product.get_raster_10m() for product in input_s1_products]
     s2t = s2t_product.get_raster_10m()
 
-    sources = {"s1_t": pyotb.Mosaic(il=input_s1_images_10m, nodata=0),
+    sources = {"s1_t": sar_mosaic(input_s1_products, s2t_product.get_timestamp()),
                "s2_t": s2t}
 
     if with_20m_bands:
@@ -33,6 +33,7 @@ import otbApplication
 from decloud.core import system
 from decloud.preprocessing.constants import padded_tensor_name
 from decloud.production.products import Factory as ProductsFactory
+from decloud.production.inference import sar_mosaic
 import pyotb
 
 
@@ -270,9 +271,8 @@ if __name__ == "__main__":
                 return abs(s2_product.get_timestamp() - x.get_timestamp())
 
             input_s1_products.sort(key=_closest_date, reverse=True)
-            input_s1_images_10m = [product.get_raster_10m() for product in input_s1_products]
             # creating a mosaic with the N closest S1 images
-            s1t = pyotb.App('Mosaic', input_s1_images_10m[-s1_Nimages:], nodata=0)
+            s1t = sar_mosaic(input_s1_products[-s1_Nimages:], s2_product.get_timestamp())
 
             candidates.append({'s2': s2_product, 's1': s1t})
 
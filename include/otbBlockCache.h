@@ -0,0 +1,179 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbBlockCache_h
+#define otbBlockCache_h
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace otb
+{
+
+/**
+ * \class BlockCache
+ *
+ * \brief Process-wide cache of decoded raster blocks, bounded in size, with a least recently used eviction.
+ *
+ * Blocks are identified by a key (e.g. the file name, the pixel type and the block index, see
+ * CachedImageFileReader), and stored as raw bytes. Blocks are shared: a block evicted from the cache remains valid
+ * for the users which hold it. The cache is empty and disabled (zero capacity) until SetCapacity() is called.
+ *
+ * All methods are thread-safe.
+ *
+ * \ingroup OTBDecloud
+ */
+class BlockCache
+{
+public:
+  typedef std::vector<char>                BlockType;
+  typedef std::shared_ptr<const BlockType> BlockPointerType;
+
+  // The cache of the process
+  static BlockCache &
+  GetInstance()
+  {
+    static BlockCache instance;
+    return instance;
+  }
+
+  // Maximum size of the cached blocks, in bytes (0: blocks are never cached)
+  void
+  SetCapacity(std::size_t capacity)
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Capacity = capacity;
+    Evict();
+  }
+  std::size_t
+  GetCapacity() const
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Capacity;
+  }
+
+  // Return the block of a key (and make it the most recently used one), or a null pointer if it is not cached
+  BlockPointerType
+  Get(const std::string & key)
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const auto                  it = m_Index.find(key);
+    if (it == m_Index.end())
+    {
+      m_NumberOfMisses++;
+      return nullptr;
+    }
+    m_NumberOfHits++;
+    m_Blocks.splice(m_Blocks.begin(), m_Blocks, it->second);
+    return it->second->second;
+  }
+
+  // Cache the block of a key, as the most recently used one. Blocks larger than the capacity are not cached.
+  void
+  Insert(const std::string & key, const BlockPointerType & block)
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (block->size() > m_Capacity)
+      return;
+    const auto it = m_Index.find(key);
+    if (it != m_Index.end())
+    {
+      // Already inserted by another user
+      m_Blocks.splice(m_Blocks.begin(), m_Blocks, it->second);
+      return;
+    }
+    m_Blocks.emplace_front(key, block);
+    m_Index[key] = m_Blocks.begin();
+    m_Size += block->size();
+    Evict();
+  }
+
+  // Remove all the blocks, and reset the statistics
+  void
+  Clear()
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Blocks.clear();
+    m_Index.clear();
+    m_Size = 0;
+    m_NumberOfHits = 0;
+    m_NumberOfMisses = 0;
+  }
+
+  // Statistics
+  std::size_t
+  GetSize() const
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Size;
+  }
+  std::size_t
+  GetNumberOfBlocks() const
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Blocks.size();
+  }
+  unsigned long
+  GetNumberOfHits() const
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_NumberOfHits;
+  }
+  unsigned long
+  GetNumberOfMisses() const
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_NumberOfMisses;
+  }
+
+private:
+  typedef std::list<std::pair<std::string, BlockPointerType>>      BlockListType;
+  typedef std::unordered_map<std::string, BlockListType::iterator> BlockIndexType;
+
+  BlockCache()
+    : m_Capacity(0)
+    , m_Size(0)
+    , m_NumberOfHits(0)
+    , m_NumberOfMisses(0)
+  {}
+  BlockCache(const BlockCache &);             // purposely not implemented
+  BlockCache & operator=(const BlockCache &); // purposely not implemented
+
+  // Remove the least recently used blocks until the size fits the capacity (the mutex must be locked)
+  void
+  Evict()
+  {
+    while (m_Size > m_Capacity && !m_Blocks.empty())
+    {
+      m_Size -= m_Blocks.back().second->size();
+      m_Index.erase(m_Blocks.back().first);
+      m_Blocks.pop_back();
+    }
+  }
+
+  mutable std::mutex m_Mutex;
+  BlockListType      m_Blocks; // From the most recently used to the least recently used
+  BlockIndexType     m_Index;  // Position of the blocks in the list, per key
+  std::size_t        m_Capacity;
+  std::size_t        m_Size;
+  unsigned long      m_NumberOfHits;
+  unsigned long      m_NumberOfMisses;
+
+}; // end class
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,94 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbCachedImageFileReader_h
+#define otbCachedImageFileReader_h
+
+#include "itkImageSource.h"
+#include "otbImageFileReader.h"
+#include "otbBlockCache.h"
+
+namespace otb
+{
+
+/**
+ * \class CachedImageFileReader
+ *
+ * \brief Reads an image file through the process-wide cache of decoded blocks (see BlockCache).
+ *
+ * The image is divided in square blocks (BlockSize pixels, aligned on the largest possible region). The blocks
+ * intersecting the requested region are taken from the cache, or read from the file (and cached) when they are not
+ * cached yet. Readers of the same file, in the same pixel type and with the same block size, share the blocks: a
+ * block is decoded once as long as it stays in the cache.
+ *
+ * \ingroup OTBDecloud
+ */
+template <class TOutputImage>
+class ITK_EXPORT CachedImageFileReader : public itk::ImageSource<TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef CachedImageFileReader          Self;
+  typedef itk::ImageSource<TOutputImage> Superclass;
+  typedef itk::SmartPointer<Self>        Pointer;
+  typedef itk::SmartPointer<const Self>  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(CachedImageFileReader, itk::ImageSource);
+
+  /** Images typedefs */
+  typedef TOutputImage                          ImageType;
+  typedef typename ImageType::InternalPixelType ValueType;
+  typedef typename ImageType::RegionType        RegionType;
+  typedef otb::ImageFileReader<ImageType>       ReaderType;
+
+  /** Parameters */
+  itkSetStringMacro(FileName);
+  itkGetStringMacro(FileName);
+  itkSetMacro(BlockSize, unsigned int);
+  itkGetMacro(BlockSize, unsigned int);
+
+protected:
+  CachedImageFileReader();
+  ~CachedImageFileReader() override {}
+
+  void GenerateOutputInformation() override;
+
+  void GenerateData() override;
+
+private:
+  CachedImageFileReader(const Self &); // purposely not implemented
+  void operator=(const Self &);        // purposely not implemented
+
+  // Key of the block (bx, by) in the cache
+  std::string GetBlockKey(long bx, long by) const;
+
+  // Copy the block (bx, by) from the buffer of the file reader
+  BlockCache::BlockPointerType CopyBlock(long bx, long by) const;
+
+  // Region of the block (bx, by), clipped to the largest possible region
+  RegionType GetBlockRegion(long bx, long by) const;
+
+  std::string                  m_FileName;
+  unsigned int                 m_BlockSize;
+  typename ReaderType::Pointer m_Reader;
+
+}; // end class
+
+} // end namespace otb
+
+#ifndef OTB_MANUAL_INSTANTIATION
+#include "otbCachedImageFileReader.hxx"
+#endif
+
+#endif
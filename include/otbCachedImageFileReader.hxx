@@ -0,0 +1,172 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbCachedImageFileReader_hxx
+#define otbCachedImageFileReader_hxx
+
+#include "otbCachedImageFileReader.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <typeinfo>
+
+namespace otb
+{
+
+template <class TOutputImage>
+CachedImageFileReader<TOutputImage>::CachedImageFileReader()
+  : m_BlockSize(256)
+  , m_Reader(ReaderType::New())
+{}
+
+template <class TOutputImage>
+void
+CachedImageFileReader<TOutputImage>::GenerateOutputInformation()
+{
+  m_Reader->SetFileName(m_FileName);
+  m_Reader->UpdateOutputInformation();
+
+  ImageType * output = this->GetOutput();
+  output->CopyInformation(m_Reader->GetOutput());
+  output->SetNumberOfComponentsPerPixel(m_Reader->GetOutput()->GetNumberOfComponentsPerPixel());
+  output->SetLargestPossibleRegion(m_Reader->GetOutput()->GetLargestPossibleRegion());
+  output->SetMetaDataDictionary(m_Reader->GetOutput()->GetMetaDataDictionary());
+}
+
+template <class TOutputImage>
+typename CachedImageFileReader<TOutputImage>::RegionType
+CachedImageFileReader<TOutputImage>::GetBlockRegion(long bx, long by) const
+{
+  const RegionType & largestRegion = this->GetOutput()->GetLargestPossibleRegion();
+  RegionType         region;
+  region.SetIndex(0, largestRegion.GetIndex(0) + bx * m_BlockSize);
+  region.SetIndex(1, largestRegion.GetIndex(1) + by * m_BlockSize);
+  region.SetSize(0, m_BlockSize);
+  region.SetSize(1, m_BlockSize);
+  region.Crop(largestRegion);
+  return region;
+}
+
+template <class TOutputImage>
+std::string
+CachedImageFileReader<TOutputImage>::GetBlockKey(long bx, long by) const
+{
+  // Blocks are shared by the readers of the same file, in the same pixel type and with the same block size
+  std::stringstream key;
+  key << m_FileName << "\n" << typeid(ValueType).name() << "\n" << m_BlockSize << "\n" << bx << " " << by;
+  return key.str();
+}
+
+template <class TOutputImage>
+BlockCache::BlockPointerType
+CachedImageFileReader<TOutputImage>::CopyBlock(long bx, long by) const
+{
+  const RegionType   blockRegion = GetBlockRegion(bx, by);
+  const ImageType *  image = m_Reader->GetOutput();
+  const unsigned int nbBands = image->GetNumberOfComponentsPerPixel();
+  const std::size_t  lineSize = blockRegion.GetSize(0) * nbBands * sizeof(ValueType);
+  auto               block = std::make_shared<BlockCache::BlockType>(lineSize * blockRegion.GetSize(1));
+
+  typename RegionType::IndexType index = blockRegion.GetIndex();
+  for (unsigned long line = 0; line < blockRegion.GetSize(1); line++)
+  {
+    index[1] = blockRegion.GetIndex(1) + line;
+    std::memcpy(
+      block->data() + line * lineSize, image->GetBufferPointer() + image->ComputeOffset(index) * nbBands, lineSize);
+  }
+  return block;
+}
+
+template <class TOutputImage>
+void
+CachedImageFileReader<TOutputImage>::GenerateData()
+{
+  ImageType * output = this->GetOutput();
+  output->SetBufferedRegion(output->GetRequestedRegion());
+  output->Allocate();
+
+  const RegionType & region = output->GetRequestedRegion();
+  const RegionType & largestRegion = output->GetLargestPossibleRegion();
+  const unsigned int nbBands = output->GetNumberOfComponentsPerPixel();
+  if (region.GetNumberOfPixels() == 0)
+    return;
+
+  // Blocks intersecting the requested region, from the cache
+  const long firstBX = (region.GetIndex(0) - largestRegion.GetIndex(0)) / m_BlockSize;
+  const long firstBY = (region.GetIndex(1) - largestRegion.GetIndex(1)) / m_BlockSize;
+  const long lastBX = (region.GetIndex(0) + region.GetSize(0) - 1 - largestRegion.GetIndex(0)) / m_BlockSize;
+  const long lastBY = (region.GetIndex(1) + region.GetSize(1) - 1 - largestRegion.GetIndex(1)) / m_BlockSize;
+  const long nbBX = lastBX - firstBX + 1;
+  const long nbBY = lastBY - firstBY + 1;
+
+  BlockCache &                              cache = BlockCache::GetInstance();
+  std::vector<BlockCache::BlockPointerType> blocks(nbBX * nbBY);
+  RegionType                                missingRegion; // Bounding region of the blocks which are not cached
+  bool                                      missing = false;
+  for (long by = 0; by < nbBY; by++)
+    for (long bx = 0; bx < nbBX; bx++)
+    {
+      blocks[by * nbBX + bx] = cache.Get(GetBlockKey(firstBX + bx, firstBY + by));
+      if (blocks[by * nbBX + bx])
+        continue;
+      const RegionType blockRegion = GetBlockRegion(firstBX + bx, firstBY + by);
+      if (!missing)
+        missingRegion = blockRegion;
+      for (unsigned int dim = 0; dim < 2; dim++)
+      {
+        const long start = std::min(missingRegion.GetIndex(dim), blockRegion.GetIndex(dim));
+        const long end = std::max<long>(missingRegion.GetIndex(dim) + missingRegion.GetSize(dim),
+                                        blockRegion.GetIndex(dim) + blockRegion.GetSize(dim));
+        missingRegion.SetIndex(dim, start);
+        missingRegion.SetSize(dim, end - start);
+      }
+      missing = true;
+    }
+
+  // Decode the missing blocks with a single read, and cache them
+  if (missing)
+  {
+    m_Reader->GetOutput()->SetRequestedRegion(missingRegion);
+    m_Reader->GetOutput()->Update();
+    for (long by = 0; by < nbBY; by++)
+      for (long bx = 0; bx < nbBX; bx++)
+        if (!blocks[by * nbBX + bx])
+        {
+          blocks[by * nbBX + bx] = CopyBlock(firstBX + bx, firstBY + by);
+          cache.Insert(GetBlockKey(firstBX + bx, firstBY + by), blocks[by * nbBX + bx]);
+        }
+  }
+
+  // Copy the requested region from the blocks
+  for (long by = 0; by < nbBY; by++)
+    for (long bx = 0; bx < nbBX; bx++)
+    {
+      const RegionType blockRegion = GetBlockRegion(firstBX + bx, firstBY + by);
+      RegionType       copyRegion = blockRegion;
+      copyRegion.Crop(region);
+
+      const ValueType * blockPix = reinterpret_cast<const ValueType *>(blocks[by * nbBX + bx]->data());
+      typename RegionType::IndexType index = copyRegion.GetIndex();
+      for (unsigned long line = 0; line < copyRegion.GetSize(1); line++)
+      {
+        index[1] = copyRegion.GetIndex(1) + line;
+        const std::size_t blockOffset = (index[1] - blockRegion.GetIndex(1)) * blockRegion.GetSize(0) +
+                                        (index[0] - blockRegion.GetIndex(0));
+        std::copy(blockPix + blockOffset * nbBands,
+                  blockPix + (blockOffset + copyRegion.GetSize(0)) * nbBands,
+                  output->GetBufferPointer() + output->ComputeOffset(index) * nbBands);
+      }
+    }
+  this->UpdateProgress(1.0);
+}
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,209 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbImageFootprint_h
+#define otbImageFootprint_h
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace otb
+{
+
+/**
+ * \class ImageFootprint
+ *
+ * \brief Coarse footprint of the valid pixels of an image.
+ *
+ * The image is divided in square blocks of BlockSize x BlockSize pixels, and the footprint tells for each block if
+ * it contains at least one valid pixel (i.e. a pixel which is not no-data in all its bands). The footprint is
+ * conservative: a block without any valid pixel is never flagged valid, and a region which does not intersect the
+ * footprint has no valid pixel.
+ *
+ * An undefined footprint (default constructed) intersects any region.
+ *
+ * Footprints can be saved to, and loaded from, a small text file.
+ *
+ * \ingroup OTBDecloud
+ */
+class ImageFootprint
+{
+public:
+  ImageFootprint()
+    : m_OriginX(0)
+    , m_OriginY(0)
+    , m_SizeX(0)
+    , m_SizeY(0)
+    , m_BlockSize(0)
+    , m_GridSizeX(0)
+    , m_GridSizeY(0)
+    , m_NoDataValue(0)
+  {}
+
+  // Initialize an empty footprint (no valid block) for the image extent
+  void
+  Initialize(long originX, long originY, unsigned long sizeX, unsigned long sizeY, unsigned int blockSize,
+             double noDataValue)
+  {
+    m_OriginX = originX;
+    m_OriginY = originY;
+    m_SizeX = sizeX;
+    m_SizeY = sizeY;
+    m_BlockSize = std::max(blockSize, 1u);
+    m_GridSizeX = (sizeX + m_BlockSize - 1) / m_BlockSize;
+    m_GridSizeY = (sizeY + m_BlockSize - 1) / m_BlockSize;
+    m_NoDataValue = noDataValue;
+    m_Blocks.assign(m_GridSizeX * m_GridSizeY, 0);
+  }
+
+  // Tell if the footprint has been computed
+  bool
+  IsDefined() const
+  {
+    return m_BlockSize > 0;
+  }
+
+  // Tell if the image has no valid pixel (false if the footprint is undefined)
+  bool
+  IsEmpty() const
+  {
+    return IsDefined() && std::find(m_Blocks.begin(), m_Blocks.end(), 1) == m_Blocks.end();
+  }
+
+  // Tell if the footprint has been computed for the given image extent, block size and no-data value
+  bool
+  Matches(long originX, long originY, unsigned long sizeX, unsigned long sizeY, unsigned int blockSize,
+          double noDataValue) const
+  {
+    return IsDefined() && m_OriginX == originX && m_OriginY == originY && m_SizeX == sizeX && m_SizeY == sizeY &&
+           m_BlockSize == blockSize && m_NoDataValue == noDataValue;
+  }
+
+  // Index of the block containing the pixel (x, y)
+  unsigned long
+  GetBlockIndex(long x, long y) const
+  {
+    return ((y - m_OriginY) / m_BlockSize) * m_GridSizeX + (x - m_OriginX) / m_BlockSize;
+  }
+
+  // Flag the block containing the pixel (x, y) as valid
+  void
+  SetValid(long x, long y)
+  {
+    m_Blocks[GetBlockIndex(x, y)] = 1;
+  }
+
+  bool
+  IsValid(long x, long y) const
+  {
+    return m_Blocks[GetBlockIndex(x, y)] != 0;
+  }
+
+  // Merge the valid blocks of another footprint of the same image
+  void
+  Merge(const ImageFootprint & other)
+  {
+    for (std::size_t i = 0; i < m_Blocks.size() && i < other.m_Blocks.size(); i++)
+      m_Blocks[i] |= other.m_Blocks[i];
+  }
+
+  // Tell if a region (index and size, in pixels) intersects the footprint
+  bool
+  Intersects(long x, long y, unsigned long sizeX, unsigned long sizeY) const
+  {
+    if (!IsDefined())
+      return true;
+    if (sizeX == 0 || sizeY == 0)
+      return false;
+
+    // Clip the region to the image extent
+    const long startX = std::max(x, m_OriginX);
+    const long startY = std::max(y, m_OriginY);
+    const long endX = std::min<long>(x + sizeX, m_OriginX + m_SizeX) - 1;
+    const long endY = std::min<long>(y + sizeY, m_OriginY + m_SizeY) - 1;
+    if (startX > endX || startY > endY)
+      return false;
+
+    const unsigned long bx0 = (startX - m_OriginX) / m_BlockSize, bx1 = (endX - m_OriginX) / m_BlockSize;
+    const unsigned long by0 = (startY - m_OriginY) / m_BlockSize, by1 = (endY - m_OriginY) / m_BlockSize;
+    for (unsigned long by = by0; by <= by1; by++)
+      for (unsigned long bx = bx0; bx <= bx1; bx++)
+        if (m_Blocks[by * m_GridSizeX + bx])
+          return true;
+    return false;
+  }
+
+  // Save the footprint in a text file. Returns false if the file can't be written.
+  bool
+  Save(const std::string & filename) const
+  {
+    std::ofstream ofs(filename);
+    if (!ofs)
+      return false;
+    ofs.precision(17);
+    ofs << "DECLOUD_FOOTPRINT 1\n"
+        << m_OriginX << " " << m_OriginY << " " << m_SizeX << " " << m_SizeY << " " << m_BlockSize << " "
+        << m_NoDataValue << "\n";
+    for (unsigned long by = 0; by < m_GridSizeY; by++)
+    {
+      for (unsigned long bx = 0; bx < m_GridSizeX; bx++)
+        ofs << (m_Blocks[by * m_GridSizeX + bx] ? '1' : '0');
+      ofs << "\n";
+    }
+    return static_cast<bool>(ofs);
+  }
+
+  // Load the footprint from a text file. Returns false if the file can't be read.
+  bool
+  Load(const std::string & filename)
+  {
+    std::ifstream ifs(filename);
+    std::string   magic;
+    int           version = 0;
+    long          originX, originY;
+    unsigned long sizeX, sizeY;
+    unsigned int  blockSize;
+    double        noDataValue;
+    if (!(ifs >> magic >> version) || magic != "DECLOUD_FOOTPRINT" || version != 1)
+      return false;
+    if (!(ifs >> originX >> originY >> sizeX >> sizeY >> blockSize >> noDataValue) || blockSize == 0)
+      return false;
+
+    ImageFootprint footprint;
+    footprint.Initialize(originX, originY, sizeX, sizeY, blockSize, noDataValue);
+    std::string row;
+    for (unsigned long by = 0; by < footprint.m_GridSizeY; by++)
+    {
+      if (!(ifs >> row) || row.size() != footprint.m_GridSizeX)
+        return false;
+      for (unsigned long bx = 0; bx < footprint.m_GridSizeX; bx++)
+        footprint.m_Blocks[by * footprint.m_GridSizeX + bx] = (row[bx] == '1');
+    }
+    *this = footprint;
+    return true;
+  }
+
+private:
+  long                       m_OriginX;
+  long                       m_OriginY;
+  unsigned long              m_SizeX;
+  unsigned long              m_SizeY;
+  unsigned int               m_BlockSize;
+  unsigned long              m_GridSizeX;
+  unsigned long              m_GridSizeY;
+  double                     m_NoDataValue;
+  std::vector<unsigned char> m_Blocks;
+}; // ImageFootprint
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,240 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbPairPlans_h
+#define otbPairPlans_h
+
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace otb
+{
+
+/**
+ * \class PairPlans
+ *
+ * \brief Resolved pair-plans of a time series pre-processing.
+ *
+ * The pair-plans are the images selected in the SAR and optical input images lists (list key, index in the list,
+ * and identifier, e.g. the file name), and, for each plan, the list of [SAR, optical] pairs of indices in the
+ * selected images. The number of bands, the no-data values and the number of output images per plan they have been
+ * computed with are stored along, so that a plan can be checked before being applied again.
+ *
+ * Pair-plans can be saved to, and loaded from, a small text file. The file of the pair-plans of an output is its
+ * manifest: the images and the pairs it has been computed from (see HasSamePairs()).
+ *
+ * \ingroup OTBDecloud
+ */
+class PairPlans
+{
+public:
+  /** Selected input image */
+  struct ImageType
+  {
+    std::string  key;   // Key of the input images list
+    unsigned int index; // Index in the input images list
+    std::string  id;    // Identifier of the image
+  };
+  typedef std::vector<ImageType>                ImageListType;
+  typedef std::pair<unsigned int, unsigned int> IndicesPairType;
+  typedef std::vector<IndicesPairType>          IndicesPairListType;
+  typedef std::vector<IndicesPairListType>      PlansType;
+
+  PairPlans()
+    : m_SARNbBands(0)
+    , m_OptNbBands(0)
+    , m_SARNoDataValue(0)
+    , m_OptNoDataValue(0)
+    , m_NumberOfOutputImages(0)
+  {}
+
+  // Selected SAR and optical images
+  ImageListType &
+  GetSARImages()
+  {
+    return m_SARImages;
+  }
+  ImageListType &
+  GetOptImages()
+  {
+    return m_OptImages;
+  }
+
+  // Pairs of indices in the selected images, for each plan
+  PlansType &
+  GetPlans()
+  {
+    return m_Plans;
+  }
+
+  // Parameters the plans have been computed with
+  void
+  SetParameters(unsigned int sarNbBands,
+                unsigned int optNbBands,
+                double       sarNoDataValue,
+                double       optNoDataValue,
+                unsigned int nbOutputImages)
+  {
+    m_SARNbBands = sarNbBands;
+    m_OptNbBands = optNbBands;
+    m_SARNoDataValue = sarNoDataValue;
+    m_OptNoDataValue = optNoDataValue;
+    m_NumberOfOutputImages = nbOutputImages;
+  }
+  unsigned int
+  GetSARNbBands() const
+  {
+    return m_SARNbBands;
+  }
+  unsigned int
+  GetOptNbBands() const
+  {
+    return m_OptNbBands;
+  }
+  double
+  GetSARNoDataValue() const
+  {
+    return m_SARNoDataValue;
+  }
+  double
+  GetOptNoDataValue() const
+  {
+    return m_OptNoDataValue;
+  }
+  unsigned int
+  GetNumberOfOutputImages() const
+  {
+    return m_NumberOfOutputImages;
+  }
+
+  // Tell if the pairs of the plans are the same as the pairs of other pair-plans: same images (compared from their
+  // identifiers, not from their indices) in the same order, for the same no-data values and number of output images
+  bool
+  HasSamePairs(const PairPlans & other) const
+  {
+    if (m_Plans.size() != other.m_Plans.size() || m_SARNoDataValue != other.m_SARNoDataValue ||
+        m_OptNoDataValue != other.m_OptNoDataValue || m_NumberOfOutputImages != other.m_NumberOfOutputImages)
+      return false;
+    for (std::size_t plan = 0; plan < m_Plans.size(); plan++)
+    {
+      const IndicesPairListType & pairs = m_Plans[plan];
+      const IndicesPairListType & otherPairs = other.m_Plans[plan];
+      if (pairs.size() != otherPairs.size())
+        return false;
+      for (std::size_t i = 0; i < pairs.size(); i++)
+        if (m_SARImages[pairs[i].first].id != other.m_SARImages[otherPairs[i].first].id ||
+            m_OptImages[pairs[i].second].id != other.m_OptImages[otherPairs[i].second].id)
+          return false;
+    }
+    return true;
+  }
+
+  // Save the pair-plans in a text file. Returns false if the file can't be written.
+  bool
+  Save(const std::string & filename) const
+  {
+    std::ofstream ofs(filename);
+    if (!ofs)
+      return false;
+    ofs.precision(17);
+    ofs << "DECLOUD_PAIRPLANS 1\n"
+        << m_SARNbBands << " " << m_OptNbBands << " " << m_SARNoDataValue << " " << m_OptNoDataValue << " "
+        << m_NumberOfOutputImages << "\n";
+    SaveImages(ofs, m_SARImages);
+    SaveImages(ofs, m_OptImages);
+    ofs << m_Plans.size() << "\n";
+    for (const auto & pairs : m_Plans)
+    {
+      ofs << pairs.size();
+      for (const auto & pair : pairs)
+        ofs << " " << pair.first << " " << pair.second;
+      ofs << "\n";
+    }
+    return static_cast<bool>(ofs);
+  }
+
+  // Load the pair-plans from a text file. Returns false if the file can't be read, or if a pair refers to an image
+  // which is not selected.
+  bool
+  Load(const std::string & filename)
+  {
+    std::ifstream ifs(filename);
+    std::string   magic;
+    int           version = 0;
+    if (!(ifs >> magic >> version) || magic != "DECLOUD_PAIRPLANS" || version != 1)
+      return false;
+
+    PairPlans plans;
+    if (!(ifs >> plans.m_SARNbBands >> plans.m_OptNbBands >> plans.m_SARNoDataValue >> plans.m_OptNoDataValue >>
+          plans.m_NumberOfOutputImages))
+      return false;
+    if (!LoadImages(ifs, plans.m_SARImages) || !LoadImages(ifs, plans.m_OptImages))
+      return false;
+
+    std::size_t nbPlans;
+    if (!(ifs >> nbPlans))
+      return false;
+    plans.m_Plans.resize(nbPlans);
+    for (auto & pairs : plans.m_Plans)
+    {
+      std::size_t nbPairs;
+      if (!(ifs >> nbPairs))
+        return false;
+      pairs.resize(nbPairs);
+      for (auto & pair : pairs)
+        if (!(ifs >> pair.first >> pair.second) || pair.first >= plans.m_SARImages.size() ||
+            pair.second >= plans.m_OptImages.size())
+          return false;
+    }
+    *this = plans;
+    return true;
+  }
+
+private:
+  // One image per line: the identifier is the end of the line, so that it can contain spaces
+  static void
+  SaveImages(std::ofstream & ofs, const ImageListType & images)
+  {
+    ofs << images.size() << "\n";
+    for (const auto & image : images)
+      ofs << image.key << " " << image.index << " " << image.id << "\n";
+  }
+
+  static bool
+  LoadImages(std::ifstream & ifs, ImageListType & images)
+  {
+    std::size_t nbImages;
+    if (!(ifs >> nbImages))
+      return false;
+    images.resize(nbImages);
+    for (auto & image : images)
+    {
+      if (!(ifs >> image.key >> image.index) || ifs.get() != ' ' || !std::getline(ifs, image.id))
+        return false;
+    }
+    return true;
+  }
+
+  ImageListType m_SARImages;
+  ImageListType m_OptImages;
+  PlansType     m_Plans;
+  unsigned int  m_SARNbBands;
+  unsigned int  m_OptNbBands;
+  double        m_SARNoDataValue;
+  double        m_OptNoDataValue;
+  unsigned int  m_NumberOfOutputImages;
+
+}; // end class
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,217 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbPatchArrayWriter_h
+#define otbPatchArrayWriter_h
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace otb
+{
+
+/**
+ * \class PatchArrayWriter
+ *
+ * \brief Writes an image as an array of square patches, in a NumPy .npy file.
+ *
+ * The array has the shape (patch rows, patch cols, patch size, patch size, bands): patches are stored one after the
+ * other, each patch being a contiguous channel-last block of its pixels, so that a patch is read with a single
+ * contiguous read, or directly from the memory-mapped file (e.g. numpy.load(filename, mmap_mode='r')). The pixels of
+ * the last incomplete row and column of patches are not written.
+ *
+ * Rows of patches are written one after the other, from the pixel-interleaved buffers of strips of the image (like
+ * otb::VectorImage buffers). The number of valid pixels of each patch (pixels with at least one band different from
+ * the no-data value) is counted along.
+ *
+ * The header of the file is padded so that the data is aligned on 64 bytes.
+ *
+ * \ingroup OTBDecloud
+ */
+class PatchArrayWriter
+{
+public:
+  typedef std::vector<std::uint32_t> CountListType;
+  typedef std::vector<std::size_t>   ShapeType;
+
+  PatchArrayWriter()
+    : m_NbPatchesX(0)
+    , m_NbPatchesY(0)
+    , m_PatchSize(0)
+    , m_NbBands(0)
+    , m_NoDataValue(0)
+    , m_NbWrittenRows(0)
+  {}
+
+  /**
+   * Create the file of an image of TValue values
+   * sizeX, sizeY: size of the image, in pixels
+   * nbBands: number of bands of the image
+   * patchSize: size of the patches, in pixels
+   * noDataValue: no-data value of the image
+   * Returns false if the file can't be written.
+   */
+  template <class TValue>
+  bool
+  Open(const std::string & filename,
+       unsigned long       sizeX,
+       unsigned long       sizeY,
+       unsigned int        nbBands,
+       unsigned int        patchSize,
+       double              noDataValue)
+  {
+    m_NbPatchesX = sizeX / patchSize;
+    m_NbPatchesY = sizeY / patchSize;
+    m_PatchSize = patchSize;
+    m_NbBands = nbBands;
+    m_NoDataValue = noDataValue;
+    m_NbWrittenRows = 0;
+    m_Counts.assign(m_NbPatchesX * m_NbPatchesY, 0);
+    m_File.open(filename, std::ios::binary | std::ios::trunc);
+    WriteHeader(m_File, GetDescr<TValue>(), { m_NbPatchesY, m_NbPatchesX, patchSize, patchSize, nbBands });
+    return static_cast<bool>(m_File);
+  }
+
+  unsigned long
+  GetNumberOfPatchesX() const
+  {
+    return m_NbPatchesX;
+  }
+
+  unsigned long
+  GetNumberOfPatchesY() const
+  {
+    return m_NbPatchesY;
+  }
+
+  /**
+   * Write the next rows of patches
+   * buffer: first pixel of the rows of patches, in a pixel-interleaved buffer of nbPatchRows * patchSize rows (of at
+   * least patch cols * patchSize pixels)
+   * rowStride: number of values between two consecutive rows of the buffer
+   * nbPatchRows: number of rows of patches
+   * Returns false if the rows can't be written.
+   */
+  template <class TValue>
+  bool
+  WritePatchRows(const TValue * buffer, std::size_t rowStride, unsigned long nbPatchRows)
+  {
+    const std::size_t   rowSize = static_cast<std::size_t>(m_PatchSize) * m_NbBands; // Values of a row of a patch
+    const std::size_t   patchSize = rowSize * m_PatchSize;
+    std::vector<TValue> patches(m_NbPatchesX * patchSize);
+    for (unsigned long py = 0; py < nbPatchRows && m_NbWrittenRows < m_NbPatchesY; py++, m_NbWrittenRows++)
+    {
+      std::uint32_t * counts = m_Counts.data() + m_NbWrittenRows * m_NbPatchesX;
+      for (unsigned int row = 0; row < m_PatchSize; row++)
+      {
+        const TValue * line = buffer + (py * m_PatchSize + row) * rowStride;
+        for (unsigned long px = 0; px < m_NbPatchesX; px++)
+        {
+          const TValue * src = line + px * rowSize;
+          std::copy(src, src + rowSize, patches.data() + px * patchSize + row * rowSize);
+          for (unsigned int col = 0; col < m_PatchSize; col++)
+            counts[px] += IsValid(src + col * m_NbBands);
+        }
+      }
+      m_File.write(reinterpret_cast<const char *>(patches.data()), patches.size() * sizeof(TValue));
+    }
+    return static_cast<bool>(m_File);
+  }
+
+  // Number of valid pixels of each patch, in row-major order
+  const CountListType &
+  GetValidCounts() const
+  {
+    return m_Counts;
+  }
+
+  // Close the file. Returns false if all the rows of patches have not been written.
+  bool
+  Close()
+  {
+    m_File.close();
+    return !m_File.fail() && m_NbWrittenRows == m_NbPatchesY;
+  }
+
+  // Write an array of uint32 values in a .npy file. Returns false if the file can't be written.
+  static bool
+  WriteArray(const std::string & filename, const CountListType & values, const ShapeType & shape)
+  {
+    std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+    WriteHeader(ofs, GetDescr<std::uint32_t>(), shape);
+    ofs.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(std::uint32_t));
+    return static_cast<bool>(ofs);
+  }
+
+  // NumPy type of the values, e.g. "<f4"
+  template <class TValue>
+  static std::string
+  GetDescr()
+  {
+    const std::uint16_t one = 1;
+    char                byteOrder = '<';
+    if (*reinterpret_cast<const unsigned char *>(&one) == 0)
+      byteOrder = '>';
+    const char kind = std::is_floating_point<TValue>::value ? 'f' : (std::is_signed<TValue>::value ? 'i' : 'u');
+    return std::string(1, byteOrder) + kind + std::to_string(sizeof(TValue));
+  }
+
+private:
+  PatchArrayWriter(const PatchArrayWriter &);             // purposely not implemented
+  PatchArrayWriter & operator=(const PatchArrayWriter &); // purposely not implemented
+
+  // Write the header of a .npy file (format version 1.0), padded so that the data is aligned on 64 bytes
+  static void
+  WriteHeader(std::ostream & os, const std::string & descr, const ShapeType & shape)
+  {
+    std::string header = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (";
+    for (std::size_t dim = 0; dim < shape.size(); dim++)
+      header += (dim > 0 ? ", " : "") + std::to_string(shape[dim]);
+    header += shape.size() == 1 ? ",), }" : "), }";
+    const std::size_t preambleSize = 10; // Magic string, version and header length
+    header.append(63 - (preambleSize + header.size()) % 64, ' ');
+    header += '\n';
+    const std::uint16_t headerSize = header.size();
+    os.write("\x93NUMPY\x01\x00", 8);
+    const unsigned char size[2] = { static_cast<unsigned char>(headerSize & 0xff),
+                                    static_cast<unsigned char>(headerSize >> 8) };
+    os.write(reinterpret_cast<const char *>(size), 2);
+    os.write(header.data(), header.size());
+  }
+
+  // Tell if a pixel has at least one band different from the no-data value
+  template <class TValue>
+  bool
+  IsValid(const TValue * pixel) const
+  {
+    for (unsigned int band = 0; band < m_NbBands; band++)
+      if (pixel[band] != m_NoDataValue)
+        return true;
+    return false;
+  }
+
+  std::ofstream m_File;
+  unsigned long m_NbPatchesX;
+  unsigned long m_NbPatchesY;
+  unsigned int  m_PatchSize;
+  unsigned int  m_NbBands;
+  double        m_NoDataValue;
+  unsigned long m_NbWrittenRows; // Number of rows of patches already written
+  CountListType m_Counts;        // Number of valid pixels of each patch
+
+}; // end class
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,156 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbStreamingFootprintImageFilter_h
+#define otbStreamingFootprintImageFilter_h
+
+#include "otbPersistentImageFilter.h"
+#include "otbPersistentFilterStreamingDecorator.h"
+#include "otbImageFootprint.h"
+
+namespace otb
+{
+
+/**
+ * \class PersistentFootprintImageFilter
+ *
+ * \brief Computes the footprint of the valid pixels of an image (see ImageFootprint).
+ *
+ * A pixel is valid if at least one of its bands is different from the no-data value.
+ *
+ * This filter persists its temporary data. It means that if you Update it n times on n different requested
+ * regions, the output footprint will be the footprint of the whole set of n regions.
+ *
+ * To get the footprint of the whole image, use StreamingFootprintImageFilter.
+ *
+ * \ingroup OTBDecloud
+ */
+template <class TInputImage>
+class ITK_EXPORT PersistentFootprintImageFilter : public PersistentImageFilter<TInputImage, TInputImage>
+{
+public:
+  /** Standard Self typedef */
+  typedef PersistentFootprintImageFilter                   Self;
+  typedef PersistentImageFilter<TInputImage, TInputImage>  Superclass;
+  typedef itk::SmartPointer<Self>                          Pointer;
+  typedef itk::SmartPointer<const Self>                    ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Runtime information support. */
+  itkTypeMacro(PersistentFootprintImageFilter, PersistentImageFilter);
+
+  /** Image related typedefs. */
+  typedef TInputImage                           ImageType;
+  typedef typename ImageType::InternalPixelType ValueType;
+  typedef typename ImageType::RegionType        RegionType;
+
+  itkSetMacro(NoDataValue, ValueType);
+  itkGetMacro(NoDataValue, ValueType);
+  itkSetMacro(BlockSize, unsigned int);
+  itkGetMacro(BlockSize, unsigned int);
+
+  /** Return the computed footprint */
+  const ImageFootprint & GetFootprint() const
+  {
+    return m_Footprint;
+  }
+
+  void Reset() override;
+
+  void Synthetize() override;
+
+protected:
+  PersistentFootprintImageFilter();
+  ~PersistentFootprintImageFilter() override {}
+
+  void GenerateOutputInformation() override;
+
+  void AllocateOutputs() override;
+
+  void ThreadedGenerateData(const RegionType & outputRegionForThread, itk::ThreadIdType threadId) override;
+
+private:
+  PersistentFootprintImageFilter(const Self &); // purposely not implemented
+  void operator=(const Self &);                 // purposely not implemented
+
+  ValueType                   m_NoDataValue;
+  unsigned int                m_BlockSize;
+  ImageFootprint              m_Footprint;
+  std::vector<ImageFootprint> m_ThreadFootprints;
+
+}; // end of class PersistentFootprintImageFilter
+
+
+/**
+ * \class StreamingFootprintImageFilter
+ *
+ * \brief Computes the footprint of the valid pixels of a whole image, in streaming.
+ *
+ * \ingroup OTBDecloud
+ */
+template <class TInputImage>
+class ITK_EXPORT StreamingFootprintImageFilter
+  : public PersistentFilterStreamingDecorator<PersistentFootprintImageFilter<TInputImage>>
+{
+public:
+  /** Standard Self typedef */
+  typedef StreamingFootprintImageFilter                                                  Self;
+  typedef PersistentFilterStreamingDecorator<PersistentFootprintImageFilter<TInputImage>> Superclass;
+  typedef itk::SmartPointer<Self>                                                        Pointer;
+  typedef itk::SmartPointer<const Self>                                                  ConstPointer;
+
+  /** Type macro */
+  itkNewMacro(Self);
+
+  /** Creation through object factory macro */
+  itkTypeMacro(StreamingFootprintImageFilter, PersistentFilterStreamingDecorator);
+
+  typedef TInputImage                           ImageType;
+  typedef typename ImageType::InternalPixelType ValueType;
+
+  using Superclass::SetInput;
+  virtual void SetInput(ImageType * input)
+  {
+    this->GetFilter()->SetInput(input);
+  }
+
+  void SetNoDataValue(ValueType noDataValue)
+  {
+    this->GetFilter()->SetNoDataValue(noDataValue);
+  }
+
+  void SetBlockSize(unsigned int blockSize)
+  {
+    this->GetFilter()->SetBlockSize(blockSize);
+  }
+
+  const ImageFootprint & GetFootprint() const
+  {
+    return this->GetFilter()->GetFootprint();
+  }
+
+protected:
+  StreamingFootprintImageFilter() {}
+  ~StreamingFootprintImageFilter() override {}
+
+private:
+  StreamingFootprintImageFilter(const Self &); // purposely not implemented
+  void operator=(const Self &);                // purposely not implemented
+};
+
+} // end namespace otb
+
+#ifndef OTB_MANUAL_INSTANTIATION
+#include "otbStreamingFootprintImageFilter.hxx"
+#endif
+
+#endif
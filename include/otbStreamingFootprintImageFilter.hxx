@@ -0,0 +1,115 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbStreamingFootprintImageFilter_hxx
+#define otbStreamingFootprintImageFilter_hxx
+
+#include "otbStreamingFootprintImageFilter.h"
+
+namespace otb
+{
+
+template <class TInputImage>
+PersistentFootprintImageFilter<TInputImage>::PersistentFootprintImageFilter()
+  : m_NoDataValue(0)
+  , m_BlockSize(256)
+{}
+
+template <class TInputImage>
+void
+PersistentFootprintImageFilter<TInputImage>::GenerateOutputInformation()
+{
+  Superclass::GenerateOutputInformation();
+  if (this->GetInput())
+  {
+    this->GetOutput()->CopyInformation(this->GetInput());
+    this->GetOutput()->SetLargestPossibleRegion(this->GetInput()->GetLargestPossibleRegion());
+
+    if (this->GetOutput()->GetRequestedRegion().GetNumberOfPixels() == 0)
+      this->GetOutput()->SetRequestedRegion(this->GetOutput()->GetLargestPossibleRegion());
+  }
+}
+
+template <class TInputImage>
+void
+PersistentFootprintImageFilter<TInputImage>::AllocateOutputs()
+{
+  // The output image of this filter is not intended to be used
+}
+
+template <class TInputImage>
+void
+PersistentFootprintImageFilter<TInputImage>::Reset()
+{
+  ImageType * inputPtr = const_cast<ImageType *>(this->GetInput());
+  inputPtr->UpdateOutputInformation();
+
+  const RegionType & largestRegion = inputPtr->GetLargestPossibleRegion();
+  m_Footprint.Initialize(largestRegion.GetIndex(0),
+                         largestRegion.GetIndex(1),
+                         largestRegion.GetSize(0),
+                         largestRegion.GetSize(1),
+                         m_BlockSize,
+                         static_cast<double>(m_NoDataValue));
+  m_ThreadFootprints.assign(this->GetNumberOfThreads(), m_Footprint);
+}
+
+template <class TInputImage>
+void
+PersistentFootprintImageFilter<TInputImage>::Synthetize()
+{
+  for (const auto & threadFootprint : m_ThreadFootprints)
+    m_Footprint.Merge(threadFootprint);
+}
+
+template <class TInputImage>
+void
+PersistentFootprintImageFilter<TInputImage>::ThreadedGenerateData(const RegionType & outputRegionForThread,
+                                                                  itk::ThreadIdType  threadId)
+{
+  const ImageType *  image = this->GetInput();
+  const unsigned int nbBands = image->GetNumberOfComponentsPerPixel();
+  ImageFootprint &   footprint = m_ThreadFootprints[threadId];
+
+  const long startX = outputRegionForThread.GetIndex(0);
+  const long endX = startX + outputRegionForThread.GetSize(0);
+  const long originX = image->GetLargestPossibleRegion().GetIndex(0);
+
+  typename RegionType::IndexType index = outputRegionForThread.GetIndex();
+  for (unsigned long line = 0; line < outputRegionForThread.GetSize(1); line++)
+  {
+    index[1] = outputRegionForThread.GetIndex(1) + line;
+    index[0] = startX;
+    const ValueType * pix = image->GetBufferPointer() + image->ComputeOffset(index) * nbBands;
+    for (long x = startX; x < endX;)
+    {
+      // Blocks that are already valid don't need to be scanned anymore
+      const long blockEndX = std::min<long>(endX, originX + ((x - originX) / m_BlockSize + 1) * m_BlockSize);
+      if (footprint.IsValid(x, index[1]))
+      {
+        pix += (blockEndX - x) * nbBands;
+        x = blockEndX;
+        continue;
+      }
+      for (; x < blockEndX; x++, pix += nbBands)
+        if (!std::all_of(pix, pix + nbBands, [this](ValueType v) { return v == m_NoDataValue; }))
+        {
+          footprint.SetValid(x, index[1]);
+          pix += (blockEndX - x) * nbBands;
+          x = blockEndX;
+          break;
+        }
+    }
+  }
+}
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,152 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbStreamingValidityBitmapImageFilter_h
+#define otbStreamingValidityBitmapImageFilter_h
+
+#include "otbPersistentImageFilter.h"
+#include "otbPersistentFilterStreamingDecorator.h"
+#include "otbValidityBitmap.h"
+#include <memory>
+
+namespace otb
+{
+
+/**
+ * \class PersistentValidityBitmapImageFilter
+ *
+ * \brief Computes the validity bitmap of an image (see ValidityBitmap).
+ *
+ * A pixel is valid if at least one of its bands is different from the no-data value.
+ *
+ * This filter persists its temporary data. It means that if you Update it n times on n different requested
+ * regions, the output bitmap will be the bitmap of the whole set of n regions. Regions are split across threads
+ * along the rows (which is the default of the multi-threader), so that the threads set the bits of different words
+ * of the bitmap.
+ *
+ * To get the bitmap of the whole image, use StreamingValidityBitmapImageFilter.
+ *
+ * \ingroup OTBDecloud
+ */
+template <class TInputImage>
+class ITK_EXPORT PersistentValidityBitmapImageFilter : public PersistentImageFilter<TInputImage, TInputImage>
+{
+public:
+  /** Standard Self typedef */
+  typedef PersistentValidityBitmapImageFilter             Self;
+  typedef PersistentImageFilter<TInputImage, TInputImage> Superclass;
+  typedef itk::SmartPointer<Self>                         Pointer;
+  typedef itk::SmartPointer<const Self>                   ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Runtime information support. */
+  itkTypeMacro(PersistentValidityBitmapImageFilter, PersistentImageFilter);
+
+  /** Image related typedefs. */
+  typedef TInputImage                           ImageType;
+  typedef typename ImageType::InternalPixelType ValueType;
+  typedef typename ImageType::RegionType        RegionType;
+  typedef std::shared_ptr<ValidityBitmap>       BitmapPointerType;
+
+  itkSetMacro(NoDataValue, ValueType);
+  itkGetMacro(NoDataValue, ValueType);
+
+  /** Return the computed bitmap */
+  BitmapPointerType GetBitmap() const
+  {
+    return m_Bitmap;
+  }
+
+  void Reset() override;
+
+  void Synthetize() override;
+
+protected:
+  PersistentValidityBitmapImageFilter();
+  ~PersistentValidityBitmapImageFilter() override {}
+
+  void GenerateOutputInformation() override;
+
+  void AllocateOutputs() override;
+
+  void ThreadedGenerateData(const RegionType & outputRegionForThread, itk::ThreadIdType threadId) override;
+
+private:
+  PersistentValidityBitmapImageFilter(const Self &); // purposely not implemented
+  void operator=(const Self &);                      // purposely not implemented
+
+  ValueType         m_NoDataValue;
+  BitmapPointerType m_Bitmap;
+
+}; // end of class PersistentValidityBitmapImageFilter
+
+
+/**
+ * \class StreamingValidityBitmapImageFilter
+ *
+ * \brief Computes the validity bitmap of a whole image, in streaming.
+ *
+ * \ingroup OTBDecloud
+ */
+template <class TInputImage>
+class ITK_EXPORT StreamingValidityBitmapImageFilter
+  : public PersistentFilterStreamingDecorator<PersistentValidityBitmapImageFilter<TInputImage>>
+{
+public:
+  /** Standard Self typedef */
+  typedef StreamingValidityBitmapImageFilter                                                   Self;
+  typedef PersistentFilterStreamingDecorator<PersistentValidityBitmapImageFilter<TInputImage>> Superclass;
+  typedef itk::SmartPointer<Self>                                                              Pointer;
+  typedef itk::SmartPointer<const Self>                                                        ConstPointer;
+
+  /** Type macro */
+  itkNewMacro(Self);
+
+  /** Creation through object factory macro */
+  itkTypeMacro(StreamingValidityBitmapImageFilter, PersistentFilterStreamingDecorator);
+
+  typedef TInputImage                                                                  ImageType;
+  typedef typename ImageType::InternalPixelType                                        ValueType;
+  typedef typename PersistentValidityBitmapImageFilter<TInputImage>::BitmapPointerType BitmapPointerType;
+
+  using Superclass::SetInput;
+  virtual void SetInput(ImageType * input)
+  {
+    this->GetFilter()->SetInput(input);
+  }
+
+  void SetNoDataValue(ValueType noDataValue)
+  {
+    this->GetFilter()->SetNoDataValue(noDataValue);
+  }
+
+  BitmapPointerType GetBitmap() const
+  {
+    return this->GetFilter()->GetBitmap();
+  }
+
+protected:
+  StreamingValidityBitmapImageFilter() {}
+  ~StreamingValidityBitmapImageFilter() override {}
+
+private:
+  StreamingValidityBitmapImageFilter(const Self &); // purposely not implemented
+  void operator=(const Self &);                     // purposely not implemented
+};
+
+} // end namespace otb
+
+#ifndef OTB_MANUAL_INSTANTIATION
+#include "otbStreamingValidityBitmapImageFilter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbStreamingValidityBitmapImageFilter_hxx
+#define otbStreamingValidityBitmapImageFilter_hxx
+
+#include "otbStreamingValidityBitmapImageFilter.h"
+
+namespace otb
+{
+
+template <class TInputImage>
+PersistentValidityBitmapImageFilter<TInputImage>::PersistentValidityBitmapImageFilter()
+  : m_NoDataValue(0)
+  , m_Bitmap(std::make_shared<ValidityBitmap>())
+{}
+
+template <class TInputImage>
+void
+PersistentValidityBitmapImageFilter<TInputImage>::GenerateOutputInformation()
+{
+  Superclass::GenerateOutputInformation();
+  if (this->GetInput())
+  {
+    this->GetOutput()->CopyInformation(this->GetInput());
+    this->GetOutput()->SetLargestPossibleRegion(this->GetInput()->GetLargestPossibleRegion());
+
+    if (this->GetOutput()->GetRequestedRegion().GetNumberOfPixels() == 0)
+      this->GetOutput()->SetRequestedRegion(this->GetOutput()->GetLargestPossibleRegion());
+  }
+}
+
+template <class TInputImage>
+void
+PersistentValidityBitmapImageFilter<TInputImage>::AllocateOutputs()
+{
+  // The output image of this filter is not intended to be used
+}
+
+template <class TInputImage>
+void
+PersistentValidityBitmapImageFilter<TInputImage>::Reset()
+{
+  ImageType * inputPtr = const_cast<ImageType *>(this->GetInput());
+  inputPtr->UpdateOutputInformation();
+
+  // A new bitmap, so that the bitmaps previously returned are left untouched
+  const RegionType & largestRegion = inputPtr->GetLargestPossibleRegion();
+  m_Bitmap = std::make_shared<ValidityBitmap>();
+  m_Bitmap->Initialize(largestRegion.GetIndex(0),
+                       largestRegion.GetIndex(1),
+                       largestRegion.GetSize(0),
+                       largestRegion.GetSize(1),
+                       static_cast<double>(m_NoDataValue));
+}
+
+template <class TInputImage>
+void
+PersistentValidityBitmapImageFilter<TInputImage>::Synthetize()
+{
+  // Threads have directly set the bits of the bitmap
+}
+
+template <class TInputImage>
+void
+PersistentValidityBitmapImageFilter<TInputImage>::ThreadedGenerateData(const RegionType & outputRegionForThread,
+                                                                       itk::ThreadIdType  itkNotUsed(threadId))
+{
+  const ImageType *  image = this->GetInput();
+  const unsigned int nbBands = image->GetNumberOfComponentsPerPixel();
+
+  const long startX = outputRegionForThread.GetIndex(0);
+  const long endX = startX + outputRegionForThread.GetSize(0);
+
+  typename RegionType::IndexType index = outputRegionForThread.GetIndex();
+  for (unsigned long line = 0; line < outputRegionForThread.GetSize(1); line++)
+  {
+    index[1] = outputRegionForThread.GetIndex(1) + line;
+    index[0] = startX;
+    const ValueType * pix = image->GetBufferPointer() + image->ComputeOffset(index) * nbBands;
+    for (long x = startX; x < endX; x++, pix += nbBands)
+      if (!std::all_of(pix, pix + nbBands, [this](ValueType v) { return v == m_NoDataValue; }))
+        m_Bitmap->SetValid(x, index[1]);
+  }
+}
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,178 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTemporalIndex_h
+#define otbTemporalIndex_h
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace otb
+{
+
+/**
+ * \class TemporalIndex
+ *
+ * \brief Sorted index of the timestamps of a time series, to select images from their dates.
+ *
+ * Images are identified by their index in the timestamps list given at construction. Timestamps are sorted once;
+ * then, the images the closest to a date are found with a binary search followed by a walk from the date outwards,
+ * and the images within a gap of a list of dates are found in a single sweep over the sorted timestamps.
+ *
+ * Selected images are always ordered from the closest to the farthest, images at the same gap being ordered by
+ * index, so that the selection does not depend on the sorting algorithm.
+ *
+ * Timestamps are stored as double, which represent epoch seconds exactly.
+ *
+ * \ingroup OTBDecloud
+ */
+class TemporalIndex
+{
+public:
+  typedef double                     TimestampType;
+  typedef std::vector<TimestampType> TimestampListType;
+  typedef std::vector<unsigned int>  IndexListType;
+
+  // Periods of the selected images, relatively to a date
+  enum Period
+  {
+    ANY,    // Any image
+    BEFORE, // Images strictly before the date
+    AFTER   // Images strictly after the date
+  };
+
+  TemporalIndex() {}
+
+  explicit TemporalIndex(const TimestampListType & timestamps)
+  {
+    m_Indices.resize(timestamps.size());
+    std::iota(m_Indices.begin(), m_Indices.end(), 0);
+    std::stable_sort(m_Indices.begin(), m_Indices.end(), [&timestamps](unsigned int a, unsigned int b) {
+      return timestamps[a] < timestamps[b];
+    });
+    m_Timestamps.reserve(timestamps.size());
+    for (const auto idx : m_Indices)
+      m_Timestamps.push_back(timestamps[idx]);
+  }
+
+  // Number of images
+  std::size_t
+  Size() const
+  {
+    return m_Indices.size();
+  }
+
+  /**
+   * Returns the (at most) n images the closest to a date, within maxGap of the date, in the period
+   * date: timestamp of the date
+   * period: period of the selected images, relatively to the date
+   * n: maximum number of selected images
+   * maxGap: maximum gap between the selected images and the date
+   */
+  IndexListType
+  GetClosest(TimestampType date,
+             Period        period = ANY,
+             std::size_t   n = std::numeric_limits<std::size_t>::max(),
+             TimestampType maxGap = std::numeric_limits<TimestampType>::max()) const
+  {
+    if (n == 0)
+      return IndexListType();
+
+    // Images at the date, then walk outwards: [left, right) is the range of the visited sorted timestamps
+    CandidateListType candidates;
+    std::size_t       left = std::lower_bound(m_Timestamps.begin(), m_Timestamps.end(), date) - m_Timestamps.begin();
+    std::size_t       right = std::upper_bound(m_Timestamps.begin(), m_Timestamps.end(), date) - m_Timestamps.begin();
+    if (period == ANY)
+      for (std::size_t pos = left; pos < right; pos++)
+        candidates.push_back({ 0, m_Indices[pos] });
+    if (period == AFTER)
+      left = 0;
+    else if (period == BEFORE)
+      right = Size();
+
+    const TimestampType noGap = std::numeric_limits<TimestampType>::max();
+    while (left > 0 || right < Size())
+    {
+      const TimestampType leftGap = left > 0 ? date - m_Timestamps[left - 1] : noGap;
+      const TimestampType rightGap = right < Size() ? m_Timestamps[right] - date : noGap;
+      const TimestampType gap = std::min(leftGap, rightGap);
+
+      // Stop once n images are found, but keep the images at the same gap as the last one to order them by index
+      if (gap > maxGap || (candidates.size() >= n && gap > candidates.back().first))
+        break;
+      if (leftGap <= rightGap)
+        candidates.push_back({ leftGap, m_Indices[--left] });
+      else
+        candidates.push_back({ rightGap, m_Indices[right++] });
+    }
+    return GetSortedIndices(candidates, n);
+  }
+
+  /**
+   * Returns, for each date, the images within maxGap of the date, from the closest to the farthest.
+   * The dates are processed in chronological order, so that the bounds of the window of images within maxGap of
+   * the date only move forward on the sorted timestamps.
+   * dates: timestamps of the dates
+   * maxGap: maximum gap between the selected images and the date
+   */
+  std::vector<IndexListType>
+  GetWindows(const TimestampListType & dates, TimestampType maxGap) const
+  {
+    IndexListType datesOrder(dates.size());
+    std::iota(datesOrder.begin(), datesOrder.end(), 0);
+    std::stable_sort(
+      datesOrder.begin(), datesOrder.end(), [&dates](unsigned int a, unsigned int b) { return dates[a] < dates[b]; });
+
+    std::vector<IndexListType> windows(dates.size());
+    std::size_t                lower = 0; // First image not before date - maxGap
+    std::size_t                upper = 0; // First image after date + maxGap
+    CandidateListType          candidates;
+    for (const auto dateIdx : datesOrder)
+    {
+      const TimestampType date = dates[dateIdx];
+      while (lower < Size() && m_Timestamps[lower] < date - maxGap)
+        lower++;
+      while (upper < Size() && m_Timestamps[upper] <= date + maxGap)
+        upper++;
+      candidates.clear();
+      for (std::size_t pos = lower; pos < upper; pos++)
+        candidates.push_back({ std::abs(m_Timestamps[pos] - date), m_Indices[pos] });
+      windows[dateIdx] = GetSortedIndices(candidates, candidates.size());
+    }
+    return windows;
+  }
+
+private:
+  typedef std::pair<TimestampType, unsigned int> CandidateType; // Gap with the date, and index of the image
+  typedef std::vector<CandidateType>             CandidateListType;
+
+  // Indices of the n first candidates, ordered by gap, then by index
+  static IndexListType
+  GetSortedIndices(CandidateListType & candidates, std::size_t n)
+  {
+    std::sort(candidates.begin(), candidates.end());
+    IndexListType indices;
+    for (std::size_t i = 0; i < std::min(n, candidates.size()); i++)
+      indices.push_back(candidates[i].second);
+    return indices;
+  }
+
+  IndexListType     m_Indices;    // Indices of the images, in chronological order
+  TimestampListType m_Timestamps; // Timestamps of the images, in chronological order
+
+}; // end class
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,196 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTileGrid_h
+#define otbTileGrid_h
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace otb
+{
+
+/**
+ * \class TileGrid
+ *
+ * \brief Deterministic partition of an image extent in square tiles, shared between the jobs of a multi-node run.
+ *
+ * Tiles are numbered in row-major order, and the tiles of the job #j of n jobs are the contiguous range
+ * [j * N / n, (j + 1) * N / n[ of the N tiles, so that every job computes the same partition from the same extent,
+ * tile size and number of jobs, without communicating.
+ *
+ * Each processed tile has a manifest (the tile extent, its output files, and the signature of the inputs it has been
+ * computed from) which is written once all the outputs of the tile are written: a tile is done when its manifest
+ * exists, all the files it lists exist, and its signature is the current one. A job restarted after a pre-emption
+ * skips the tiles already done, and a job run again after new inputs are added only recomputes the tiles whose
+ * inputs have changed. Manifests are written in a temporary file renamed afterwards, so that an interrupted job
+ * never leaves a partial manifest.
+ *
+ * \ingroup OTBDecloud
+ */
+class TileGrid
+{
+public:
+  /** Output files of a tile, as (output key, file name) */
+  typedef std::vector<std::pair<std::string, std::string>> FileListType;
+
+  /** Signature of the inputs of a tile, one item (without line breaks) per input */
+  typedef std::vector<std::string> SignatureType;
+
+  TileGrid()
+    : m_OriginX(0)
+    , m_OriginY(0)
+    , m_SizeX(0)
+    , m_SizeY(0)
+    , m_TileSize(1)
+  {}
+
+  // Initialize the grid of an extent (index and size, in pixels)
+  void
+  Initialize(long originX, long originY, unsigned long sizeX, unsigned long sizeY, unsigned long tileSize)
+  {
+    m_OriginX = originX;
+    m_OriginY = originY;
+    m_SizeX = sizeX;
+    m_SizeY = sizeY;
+    m_TileSize = tileSize;
+  }
+
+  unsigned long
+  GetNumberOfTilesX() const
+  {
+    return (m_SizeX + m_TileSize - 1) / m_TileSize;
+  }
+  unsigned long
+  GetNumberOfTilesY() const
+  {
+    return (m_SizeY + m_TileSize - 1) / m_TileSize;
+  }
+  unsigned long
+  GetNumberOfTiles() const
+  {
+    return GetNumberOfTilesX() * GetNumberOfTilesY();
+  }
+
+  // Extent of a tile (the tiles of the last row and column are cropped to the extent)
+  void
+  GetTile(unsigned long tile, long & x, long & y, unsigned long & sizeX, unsigned long & sizeY) const
+  {
+    const unsigned long col = tile % GetNumberOfTilesX(), row = tile / GetNumberOfTilesX();
+    x = m_OriginX + col * m_TileSize;
+    y = m_OriginY + row * m_TileSize;
+    sizeX = std::min(m_TileSize, m_SizeX - col * m_TileSize);
+    sizeY = std::min(m_TileSize, m_SizeY - row * m_TileSize);
+  }
+
+  // Name of a tile, from its row and column (e.g. "r0_c3")
+  std::string
+  GetTileName(unsigned long tile) const
+  {
+    return "r" + std::to_string(tile / GetNumberOfTilesX()) + "_c" + std::to_string(tile % GetNumberOfTilesX());
+  }
+
+  // Tiles of a job, as the range [first, last[
+  std::pair<unsigned long, unsigned long>
+  GetJobTiles(unsigned int jobIndex, unsigned int jobCount) const
+  {
+    const unsigned long nbTiles = GetNumberOfTiles();
+    return { nbTiles * jobIndex / jobCount, nbTiles * (jobIndex + 1) / jobCount };
+  }
+
+  // Write the manifest of a done tile. Returns false if the file can't be written.
+  bool
+  SaveManifest(const std::string &   filename,
+               unsigned long         tile,
+               const FileListType &  files,
+               const SignatureType & signature) const
+  {
+    long          x, y;
+    unsigned long sizeX, sizeY;
+    GetTile(tile, x, y, sizeX, sizeY);
+    const std::string tmpFilename = filename + ".tmp";
+    {
+      std::ofstream ofs(tmpFilename);
+      if (!ofs)
+        return false;
+      ofs << "DECLOUD_TILE 2\n" << x << " " << y << " " << sizeX << " " << sizeY << "\n" << files.size() << "\n";
+      for (const auto & file : files)
+        ofs << file.first << " " << file.second << "\n";
+      ofs << signature.size() << "\n";
+      for (const auto & item : signature)
+        ofs << item << "\n";
+      if (!ofs)
+        return false;
+    }
+    return std::rename(tmpFilename.c_str(), filename.c_str()) == 0;
+  }
+
+  // Tell if a tile is done: its manifest exists, matches the tile extent, all its files exist, and it has been
+  // computed from the inputs of the signature
+  bool
+  IsDone(const std::string & filename, unsigned long tile, const SignatureType & signature) const
+  {
+    FileListType  files;
+    SignatureType doneSignature;
+    return LoadManifest(filename, tile, files, doneSignature) && doneSignature == signature;
+  }
+
+  // Read the output files of a tile, and the signature of its inputs. Returns false if the manifest can't be read,
+  // or if a file it lists does not exist.
+  bool
+  LoadManifest(const std::string & filename, unsigned long tile, FileListType & files, SignatureType & signature) const
+  {
+    std::ifstream ifs(filename);
+    std::string   magic;
+    int           version = 0;
+    if (!(ifs >> magic >> version) || magic != "DECLOUD_TILE" || version != 2)
+      return false;
+
+    long          x, y, tileX, tileY;
+    unsigned long sizeX, sizeY, tileSizeX, tileSizeY;
+    std::size_t   nbFiles;
+    GetTile(tile, tileX, tileY, tileSizeX, tileSizeY);
+    if (!(ifs >> x >> y >> sizeX >> sizeY >> nbFiles) || x != tileX || y != tileY || sizeX != tileSizeX ||
+        sizeY != tileSizeY)
+      return false;
+
+    // One file per line: the file name is the end of the line, so that it can contain spaces
+    files.resize(nbFiles);
+    for (auto & file : files)
+      if (!(ifs >> file.first) || ifs.get() != ' ' || !std::getline(ifs, file.second) ||
+          !std::ifstream(file.second).good())
+        return false;
+
+    std::size_t nbItems;
+    if (!(ifs >> nbItems) || ifs.get() != '\n')
+      return false;
+    signature.resize(nbItems);
+    for (auto & item : signature)
+      if (!std::getline(ifs, item))
+        return false;
+    return true;
+  }
+
+private:
+  long          m_OriginX;
+  long          m_OriginY;
+  unsigned long m_SizeX;
+  unsigned long m_SizeY;
+  unsigned long m_TileSize;
+
+}; // end class
+
+} // end namespace otb
+
+#endif
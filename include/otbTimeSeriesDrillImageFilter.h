@@ -0,0 +1,470 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTimeSeriesDrillImageFilter_h
+#define otbTimeSeriesDrillImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "otbImageList.h"
+#include "otbImageFootprint.h"
+#include "otbValidityBitmap.h"
+#include "otbTimeSeriesDrillingKernel.h"
+#ifdef OTB_DECLOUD_CUDA
+#include "otbTimeSeriesDrillingCUDA.h"
+#endif
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+
+namespace otb
+{
+
+/**
+ * \class TimeSeriesDrillImageFilter
+ *
+ * \brief "Drills" a SAR and an optical time series to build sync SAR/Optical pairs.
+ *
+ * The inputs of the filter are the N SAR images (inputs 0 to N-1), followed by the M optical images (inputs N to
+ * N+M-1). They are set with SetInputs().
+ *
+ * For each pixel, the NumberOfOutputImages first [SAR, Optical] pairs of the pairs list for which neither the SAR
+ * nor the optical pixel is no-data are selected (see TimeSeriesDrillingKernel). The filter has one output per SAR
+ * and optical slot: outputs 0 to NumberOfOutputImages-1 are the SAR images of the selected pairs (see
+ * GetSAROutput()), and outputs NumberOfOutputImages to 2xNumberOfOutputImages-1 are their optical images (see
+ * GetOptOutput()). Each output is written directly by the kernel.
+ *
+ * Several pair-plans (pairs list and number of output images) can be processed over the same inputs in a single
+ * pass (see SetNumberOfPlans()), e.g. the T-1 and T+1 pairs of a reconstruction. The outputs of the plans follow
+ * each other (2xNumberOfOutputImages outputs per plan), and the inputs used by several plans are read only once
+ * per requested region. Methods without plan index apply to the first plan.
+ *
+ * SAR and optical images can have different pixel types (e.g. uint16 SAR images and int16 optical images), so
+ * that the images are processed, and the outputs produced, in the native encoding of the inputs.
+ *
+ * Input images are read on demand: the filter requests an empty region to all its inputs, then, in GenerateData(),
+ * pairs are applied one after the other to the whole requested region, and only the images of the current pair
+ * are updated over the requested region. The pairs loop stops as soon as each pixel of the region has
+ * NumberOfOutputImages valid pairs, so that the images of the remaining pairs are never read.
+ *
+ * Optionally, the footprints of the valid pixels of the inputs can be set (see ImageFootprint): pairs whose SAR or
+ * optical footprint does not intersect the requested region are skipped, and their images are not read. When no
+ * pair is left, the output region is directly filled with no-data.
+ *
+ * Without optical images, the pairs are SAR images only (their optical index is ignored), and the optical outputs
+ * have no band and are not allocated: the SAR outputs of a plan are the first valid SAR pixels, e.g. a mosaic of SAR
+ * images sorted from the closest to the farthest to a date.
+ *
+ * With SetNumberOfIOThreads(), inputs are read ahead in background threads: the inputs of the next pairs over the
+ * requested region, and, once the region is generated, the inputs it has used over the next streamed region, so that
+ * their reading overlaps the writing of the outputs. The inputs read ahead are not read again when the next region is
+ * the expected one.
+ *
+ * The pairs of a plan are applied in a single multi-threaded call per region, directly on the images buffers. The
+ * cost of a pixel varies with the pairs it needs (resolved pixels are skipped), so the region is not split in equal
+ * parts: threads claim small chunks of contiguous pixels one after the other, and apply the pairs one after the other
+ * to each chunk until its pixels are resolved (see RunThreads()). The inputs of a pair are fetched by the first
+ * thread that needs them, and the pairs without valid pixel left in a chunk are skipped. Optionally, when
+ * the module is built with -DOTBDecloud_USE_CUDA=ON, pairs are applied on a CUDA device (see SetUseGPU()): the inputs
+ * are uploaded once per requested region, and the outputs are downloaded once per plan.
+ *
+ * \ingroup OTBDecloud
+ */
+template <class TSARImage, class TOptImage = TSARImage>
+class ITK_EXPORT TimeSeriesDrillImageFilter : public itk::ImageToImageFilter<TSARImage, TSARImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef TimeSeriesDrillImageFilter                    Self;
+  typedef itk::ImageToImageFilter<TSARImage, TSARImage> Superclass;
+  typedef itk::SmartPointer<Self>                       Pointer;
+  typedef itk::SmartPointer<const Self>                 ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(TimeSeriesDrillImageFilter, itk::ImageToImageFilter);
+
+  /** Images typedefs */
+  typedef TSARImage                                          SARImageType;
+  typedef TOptImage                                          OptImageType;
+  typedef typename SARImageType::InternalPixelType           SARValueType;
+  typedef typename OptImageType::InternalPixelType           OptValueType;
+  typedef typename SARImageType::RegionType                  RegionType;
+  typedef itk::ImageBase<SARImageType::ImageDimension>       ImageBaseType;
+  typedef otb::ImageList<SARImageType>                       SARImageListType;
+  typedef otb::ImageList<OptImageType>                       OptImageListType;
+  typedef std::vector<ImageFootprint>                        FootprintListType;
+  typedef std::shared_ptr<const ValidityBitmap>              ValidityBitmapPointerType;
+  typedef std::vector<ValidityBitmapPointerType>             ValidityBitmapListType;
+  typedef itk::ProcessObject::DataObjectPointerArraySizeType DataObjectPointerArraySizeType;
+
+  /** Kernel typedefs */
+  typedef TimeSeriesDrillingKernel<SARValueType, OptValueType> KernelType;
+  typedef typename KernelType::IndicesPairListType             IndicesPairListType;
+
+  /** Inputs (the optical images list may be empty: pairs are then SAR images only) */
+  void SetInputs(const SARImageListType * sarList, const OptImageListType * optList);
+  const SARImageType * GetSARInput(unsigned int idx) const;
+  const OptImageType * GetOptInput(unsigned int idx) const;
+  itkGetMacro(NumberOfSARImages, unsigned int);
+  itkGetMacro(NumberOfOptImages, unsigned int);
+  bool HasOptInputs() const
+  {
+    return m_NumberOfOptImages > 0;
+  }
+
+  /** Outputs: SAR and optical images of the n-th selected pair of a plan */
+  SARImageType * GetSAROutput(unsigned int plan, unsigned int n);
+  OptImageType * GetOptOutput(unsigned int plan, unsigned int n);
+  SARImageType * GetSAROutput(unsigned int n)
+  {
+    return GetSAROutput(0, n);
+  }
+  OptImageType * GetOptOutput(unsigned int n)
+  {
+    return GetOptOutput(0, n);
+  }
+
+  /** Pair-plans */
+  void SetNumberOfPlans(unsigned int nbPlans);
+  unsigned int GetNumberOfPlans() const
+  {
+    return m_Pairs.size();
+  }
+
+  /** Parameters */
+  void SetPairs(unsigned int plan, const IndicesPairListType & pairs)
+  {
+    m_Pairs.at(plan) = pairs;
+    this->Modified();
+  }
+  void SetPairs(const IndicesPairListType & pairs)
+  {
+    SetPairs(0, pairs);
+  }
+  const IndicesPairListType & GetPairs(unsigned int plan = 0) const
+  {
+    return m_Pairs.at(plan);
+  }
+  itkSetMacro(SARNoDataValue, SARValueType);
+  itkGetMacro(SARNoDataValue, SARValueType);
+  itkSetMacro(OptNoDataValue, OptValueType);
+  itkGetMacro(OptNoDataValue, OptValueType);
+  void SetNumberOfOutputImages(unsigned int plan, unsigned int nbOutputImages);
+  void SetNumberOfOutputImages(unsigned int nbOutputImages)
+  {
+    SetNumberOfOutputImages(0, nbOutputImages);
+  }
+  unsigned int GetNumberOfOutputImages(unsigned int plan = 0) const
+  {
+    return m_NumberOfOutputImages.at(plan);
+  }
+
+  /** Instruction set of the drilling kernel (default: simd::AUTO, the best one supported by the CPU, selected at
+   * runtime) */
+  itkSetMacro(InstructionSet, simd::InstructionSet);
+  itkGetMacro(InstructionSet, simd::InstructionSet);
+
+  /** Apply the pairs on the CUDA device (default: off). The CPU kernel is used when the module is built without CUDA
+   * (see IsGPUAvailable()). Outputs are bit-identical. */
+  itkSetMacro(UseGPU, bool);
+  itkGetMacro(UseGPU, bool);
+  itkBooleanMacro(UseGPU);
+
+  /** Tell if the pairs can be applied on a CUDA device */
+  static bool IsGPUAvailable()
+  {
+#ifdef OTB_DECLOUD_CUDA
+    return cuda::IsAvailable();
+#else
+    return false;
+#endif
+  }
+
+  /** Footprints of the SAR and optical inputs (optional). Inputs without footprint are never skipped. */
+  void SetSARFootprints(const FootprintListType & footprints)
+  {
+    m_SARFootprints = footprints;
+    this->Modified();
+  }
+  void SetOptFootprints(const FootprintListType & footprints)
+  {
+    m_OptFootprints = footprints;
+    this->Modified();
+  }
+
+  /** Validity bitmaps of the SAR and optical inputs (optional). A pair is skipped when no pixel of the region which
+   * is not resolved yet is valid in both images. Inputs without bitmap (or with a null one) are never skipped. */
+  void SetSARValidityBitmaps(const ValidityBitmapListType & bitmaps)
+  {
+    m_SARValidityBitmaps = bitmaps;
+    this->Modified();
+  }
+  void SetOptValidityBitmaps(const ValidityBitmapListType & bitmaps)
+  {
+    m_OptValidityBitmaps = bitmaps;
+    this->Modified();
+  }
+
+  /** Pairs of a plan which may have valid pixels in a region, from the footprints and the validity bitmaps (all the
+   * pairs of the plan when no footprint or bitmap is set) */
+  IndicesPairListType GetCandidatePairs(unsigned int plan, const RegionType & region) const;
+
+  /** Number of inputs read concurrently ahead of the pairs being processed (default: 0, inputs are read one after
+   * the other, when needed). Over the requested region, the inputs of the next pairs are read while the current pair
+   * is applied. Once the region is generated, the inputs it has used are read over the next streamed region (see
+   * GetNextRegion()) while the outputs are written. Inputs are updated from different threads: their pipelines must
+   * not share filters. */
+  itkSetMacro(NumberOfIOThreads, unsigned int);
+  itkGetMacro(NumberOfIOThreads, unsigned int);
+
+  /** Number of pairs skipped from their footprints or validity bitmaps, over all the regions processed so far */
+  itkGetMacro(NumberOfPrunedPairs, unsigned long);
+
+  /** Number of regions filled with no-data without reading any input, over all the regions processed so far */
+  itkGetMacro(NumberOfSkippedRegions, unsigned long);
+
+  /** Number of regions processed so far */
+  itkGetMacro(NumberOfProcessedRegions, unsigned long);
+
+  /** Statistics of the processing, over all the regions processed so far */
+  struct StatisticsType
+  {
+    // Per input
+    std::vector<double>        InputReadTime;  // Wall time spent updating the input, in seconds
+    std::vector<unsigned long> InputReads;     // Number of updates of the input
+    std::vector<std::size_t>   InputBytesRead; // Size of the input buffers updated, in bytes
+
+    // Per plan
+    std::vector<std::vector<std::size_t>> ResolvedPixels;   // Number of pixels resolved by each pair of the plan
+    std::vector<std::size_t>              Pixels;           // Number of pixels processed
+    std::vector<std::size_t>              UnresolvedPixels; // Number of pixels not resolved by the pairs
+    std::vector<std::size_t>              NoDataPixels;     // Number of output pixels filled with no-data
+
+    double      KernelTime;    // Wall time spent in the drilling kernel, in seconds
+    double      InputWaitTime; // Wall time spent waiting for the inputs, in seconds
+    std::size_t GPUPairs;      // Number of pairs applied on the CUDA device
+  };
+
+  /** Collect the statistics of the processing (default: off) */
+  itkSetMacro(CollectStatistics, bool);
+  itkGetMacro(CollectStatistics, bool);
+  const StatisticsType & GetStatistics()
+  {
+    WaitForReadAhead(); // Inputs read ahead update their statistics
+    return m_Statistics;
+  }
+
+  /** Number of bands of SAR and optical images (available after UpdateOutputInformation()) */
+  itkGetMacro(SARNbBands, unsigned int);
+  itkGetMacro(OptNbBands, unsigned int);
+
+  /** Estimated memory used per pixel of the processed regions, in bytes (available after UpdateOutputInformation()).
+   * Inputs: buffers of the inputs used by the plans (all of them are fetched in the worst case). Outputs: buffers
+   * of the outputs of all the plans. Total: inputs, outputs, and state of the drilling. */
+  std::size_t GetInputsMemoryPrintPerPixel() const;
+  std::size_t GetOutputsMemoryPrintPerPixel() const;
+  std::size_t GetMemoryPrintPerPixel() const
+  {
+    return GetInputsMemoryPrintPerPixel() + GetOutputsMemoryPrintPerPixel() + sizeof(unsigned int);
+  }
+
+  /** Pipeline methods waiting for the inputs read ahead over the next streamed region, before the pipeline of the
+   * inputs is used again. UpdateOutputData() starts the read-ahead once the region is generated. */
+  void UpdateOutputInformation() override;
+  void PropagateRequestedRegion(itk::DataObject * output) override;
+  void UpdateOutputData(itk::DataObject * output) override;
+
+protected:
+  TimeSeriesDrillImageFilter();
+  virtual ~TimeSeriesDrillImageFilter() {}
+
+  /** Create the SAR and the optical outputs of the plans */
+  using Superclass::MakeOutput;
+  itk::DataObject::Pointer MakeOutput(DataObjectPointerArraySizeType idx) override;
+
+  void GenerateOutputInformation() override;
+
+  void AllocateOutputs() override;
+
+  void GenerateInputRequestedRegion() override;
+
+  void GenerateData() override;
+
+private:
+  TimeSeriesDrillImageFilter(const Self &); // purposely not implemented
+  void operator=(const Self &);             // purposely not implemented
+
+  // Update the input #idx over the region, if not already done for the current output region (waits for the input
+  // if it is being prefetched)
+  void FetchInput(unsigned int idx, const RegionType & region);
+
+  // Update the input #idx over the region
+  void UpdateInput(unsigned int idx, const RegionType & region);
+
+  // Start reading, in background threads, the inputs of the pair #pass of the current plan and of the next pairs (of
+  // the current plan, then of the next plans) that have valid pixels in the region, up to NumberOfIOThreads inputs
+  // read ahead
+  void PrefetchInputs(const RegionType & region, std::size_t pass);
+
+  // Region expected to be requested after the region (the next strip, or the next tile of the same row of tiles,
+  // in the largest possible region). Returns false after the last region.
+  bool GetNextRegion(const RegionType & region, RegionType & next) const;
+
+  // Start reading, in background threads, the inputs used by the region just generated over the next region
+  void StartReadAhead();
+
+  // Wait for the inputs read ahead over the next region (rethrows the exceptions of the background threads)
+  void WaitForReadAhead();
+
+  // Tell if the footprint of an input intersects the region
+  static bool Intersects(const FootprintListType & footprints, unsigned int idx, const RegionType & region);
+
+  // Tell if the validity bitmap of an input has valid pixels in the region
+  static bool Intersects(const ValidityBitmapListType & bitmaps, unsigned int idx, const RegionType & region);
+
+  // Tell if a pair may have valid pixels in the region, from the footprints and the validity bitmaps
+  bool Intersects(const typename IndicesPairListType::value_type & pair, const RegionType & region) const;
+
+  // Tell if a pair may resolve pixels [begin, end[ of the region (row-major offsets in the region), i.e. if one of the
+  // pixels that are not resolved yet is valid in both validity bitmaps (always true if one of the images has no
+  // bitmap)
+  bool ResolvesPixels(const typename IndicesPairListType::value_type & pair,
+                      const RegionType &                               region,
+                      std::size_t                                      begin,
+                      std::size_t                                      end) const;
+
+  // Process the current plan over the region. Returns false if no input has been read (i.e. the outputs of the
+  // plan have been filled with no-data from the footprints only)
+  bool GeneratePlanData(const RegionType & region);
+
+  // Fill the whole output buffers of the current plan with no-data
+  void FillNoData();
+
+  // Apply the pairs of the current plan to the region, and fill the output slots that have not been found with
+  // no-data. Returns the number of pixels not resolved by the pairs.
+  std::size_t ApplyPairs(const RegionType & region);
+
+#ifdef OTB_DECLOUD_CUDA
+  // Apply the pairs of the current plan to the region on the CUDA device, one after the other. Returns the number of
+  // pixels not resolved by the pairs.
+  std::size_t ApplyPairsGPU(const RegionType & region);
+
+  // Apply a pair of the current plan on the CUDA device, uploading its inputs if needed
+  std::size_t ApplyPairGPU(const typename IndicesPairListType::value_type & pair, const RegionType & region);
+
+  // Fill the output slots of the current plan that have not been found, and download them from the CUDA device
+  void EndPlanGPU();
+#endif
+
+  // Apply the pairs of the current plan to the region in a single multi-threaded call: the threads claim chunks of
+  // contiguous pixels of the region (in row-major order) from a shared cursor, so that threads which process cheap
+  // pixels take more chunks (rethrows the exceptions of the threads)
+  void RunThreads();
+
+  // Threader callback of RunThreads(): processes chunks until the region is processed
+  static ITK_THREAD_RETURN_TYPE ChunksThreaderCallback(void * arg);
+
+  // Apply the pairs of the current plan to the pixels [begin, end[ of the region (row-major offsets in the region),
+  // until they are resolved, then fill the output slots that have not been found with no-data
+  void ProcessChunk(std::size_t begin, std::size_t end, itk::ThreadIdType threadId);
+
+  // Apply the pair #pass of the current plan to the pixels [begin, end[ of the region, or fill them with no-data if
+  // pass is the number of pairs. Returns the number of pixels resolved.
+  std::size_t ProcessPixels(std::size_t begin, std::size_t end, std::size_t pass, itk::ThreadIdType threadId);
+
+  // Create the outputs for the current plans
+  void CreateOutputs();
+
+  // Index of the first output of a plan
+  unsigned int GetFirstOutputIndex(unsigned int plan) const;
+
+  // Size the statistics for the current inputs and plans (keeping the ones already collected)
+  void InitializeStatistics();
+
+  // Wall time elapsed since a time point, in seconds
+  static double GetElapsedTime(const std::chrono::steady_clock::time_point & start)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  unsigned int           m_NumberOfSARImages;
+  unsigned int           m_NumberOfOptImages;
+  unsigned int           m_SARNbBands;
+  unsigned int           m_OptNbBands;
+  SARValueType           m_SARNoDataValue;
+  OptValueType           m_OptNoDataValue;
+  simd::InstructionSet   m_InstructionSet;
+  bool                   m_UseGPU;
+  unsigned int           m_NumberOfIOThreads;
+  bool                   m_CollectStatistics;
+  StatisticsType         m_Statistics;
+  FootprintListType      m_SARFootprints;
+  FootprintListType      m_OptFootprints;
+  ValidityBitmapListType m_SARValidityBitmaps;
+  ValidityBitmapListType m_OptValidityBitmaps;
+  unsigned long          m_NumberOfPrunedPairs;
+  unsigned long          m_NumberOfSkippedRegions;
+  unsigned long          m_NumberOfProcessedRegions;
+
+  // Plans
+  std::vector<IndicesPairListType> m_Pairs;
+  std::vector<unsigned int>        m_NumberOfOutputImages;
+
+  KernelType m_Kernel;
+#ifdef OTB_DECLOUD_CUDA
+  std::unique_ptr<cuda::DrillingContext<SARValueType, OptValueType>> m_GPUContext; // Created on first use
+#endif
+
+  // State of the current GenerateData() call
+  unsigned int                   m_CurrentPlan;    // Index of the plan being processed
+  std::vector<unsigned int>      m_Filled;         // Number of valid pairs found, for each pixel of the output region
+  std::vector<bool>              m_PairIntersects; // Tell if each pair of the current plan may have valid pixels
+  std::atomic<std::size_t>       m_NextChunk;      // First pixel of the next chunk claimed by a thread
+  std::size_t                    m_ChunkSize;      // Number of pixels of the chunks of the current plan
+  std::mutex                     m_FetchMutex;     // Serializes the fetches of the inputs by the threads
+  std::exception_ptr             m_ThreadError;    // First exception thrown by a thread (guarded by m_FetchMutex)
+
+  // State of a thread for the current plan: pointers to the current run of each output of the plan, and statistics
+  // of the pairs over the chunks processed by the thread
+  struct ThreadScratchType
+  {
+    std::vector<SARValueType *> SAROut;
+    std::vector<OptValueType *> OptOut;
+    std::vector<char>           Fetched;  // Pairs whose inputs are known to be fetched by the thread
+    std::vector<char>           Examined; // Pairs examined for a chunk with unresolved pixels
+    std::vector<char>           Applied;  // Pairs applied to a chunk
+    std::vector<std::size_t>    Resolved; // Number of pixels resolved by each pair
+  };
+  std::vector<ThreadScratchType> m_ThreadScratch;
+  std::vector<bool>              m_Fetched;        // Inputs updated over the current output region
+  std::vector<std::future<void>> m_Prefetched;     // Inputs being read in background threads
+
+  // Read-ahead of the next streamed region
+  RegionType                     m_GeneratedRegion;  // Region generated by the last GenerateData() call
+  bool                           m_RegionGenerated;  // Tell if GenerateData() has run in the current update
+  RegionType                     m_ReadAheadRegion;  // Region over which inputs are read ahead
+  std::vector<unsigned int>      m_ReadAheadInputs;  // Inputs read ahead over m_ReadAheadRegion
+  std::vector<std::future<void>> m_ReadAhead;        // Background reads of the inputs (joined before the pipeline
+                                                     // of the inputs is used, and destroyed first)
+
+}; // end class
+
+} // end namespace otb
+
+#ifndef OTB_MANUAL_INSTANTIATION
+#include "otbTimeSeriesDrillImageFilter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,915 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTimeSeriesDrillImageFilter_hxx
+#define otbTimeSeriesDrillImageFilter_hxx
+
+#include "otbTimeSeriesDrillImageFilter.h"
+#include <numeric>
+
+namespace otb
+{
+
+template <class TSARImage, class TOptImage>
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::TimeSeriesDrillImageFilter()
+  : m_NumberOfSARImages(0)
+  , m_NumberOfOptImages(0)
+  , m_SARNbBands(0)
+  , m_OptNbBands(0)
+  , m_SARNoDataValue(0)
+  , m_OptNoDataValue(0)
+  , m_InstructionSet(simd::AUTO)
+  , m_UseGPU(false)
+  , m_NumberOfIOThreads(0)
+  , m_CollectStatistics(false)
+  , m_NumberOfPrunedPairs(0)
+  , m_NumberOfSkippedRegions(0)
+  , m_NumberOfProcessedRegions(0)
+  , m_Pairs(1)
+  , m_NumberOfOutputImages(1, 1)
+  , m_CurrentPlan(0)
+  , m_NextChunk(0)
+  , m_ChunkSize(0)
+  , m_RegionGenerated(false)
+{
+  this->SetNumberOfRequiredInputs(2);
+  CreateOutputs();
+  m_Statistics.KernelTime = 0;
+  m_Statistics.InputWaitTime = 0;
+  m_Statistics.GPUPairs = 0;
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::InitializeStatistics()
+{
+  const std::size_t nbInputs = this->GetNumberOfIndexedInputs();
+  m_Statistics.InputReadTime.resize(nbInputs, 0);
+  m_Statistics.InputReads.resize(nbInputs, 0);
+  m_Statistics.InputBytesRead.resize(nbInputs, 0);
+  m_Statistics.ResolvedPixels.resize(m_Pairs.size());
+  for (unsigned int plan = 0; plan < m_Pairs.size(); plan++)
+    m_Statistics.ResolvedPixels[plan].resize(m_Pairs[plan].size(), 0);
+  m_Statistics.Pixels.resize(m_Pairs.size(), 0);
+  m_Statistics.UnresolvedPixels.resize(m_Pairs.size(), 0);
+  m_Statistics.NoDataPixels.resize(m_Pairs.size(), 0);
+}
+
+template <class TSARImage, class TOptImage>
+itk::DataObject::Pointer
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::MakeOutput(DataObjectPointerArraySizeType idx)
+{
+  // Find the plan of the output, and tell if it is a SAR or an optical output
+  unsigned int first = 0;
+  for (const auto nbOutputImages : m_NumberOfOutputImages)
+  {
+    if (idx < first + 2 * nbOutputImages)
+    {
+      if (idx >= first + nbOutputImages)
+        return OptImageType::New().GetPointer();
+      break;
+    }
+    first += 2 * nbOutputImages;
+  }
+  return Superclass::MakeOutput(idx);
+}
+
+template <class TSARImage, class TOptImage>
+unsigned int
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GetFirstOutputIndex(unsigned int plan) const
+{
+  unsigned int first = 0;
+  for (unsigned int p = 0; p < plan; p++)
+    first += 2 * m_NumberOfOutputImages[p];
+  return first;
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::CreateOutputs()
+{
+  const unsigned int nbOutputs = GetFirstOutputIndex(m_NumberOfOutputImages.size());
+  this->SetNumberOfIndexedOutputs(nbOutputs);
+  this->SetNumberOfRequiredOutputs(nbOutputs);
+  for (unsigned int idx = 0; idx < nbOutputs; idx++)
+    this->SetNthOutput(idx, this->MakeOutput(idx));
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::SetNumberOfPlans(unsigned int nbPlans)
+{
+  if (nbPlans == 0)
+    itkExceptionMacro("The number of plans must be at least 1");
+  if (nbPlans == m_Pairs.size())
+    return;
+
+  m_Pairs.resize(nbPlans);
+  m_NumberOfOutputImages.resize(nbPlans, 1);
+  CreateOutputs();
+  this->Modified();
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::SetNumberOfOutputImages(unsigned int plan,
+                                                                          unsigned int nbOutputImages)
+{
+  if (nbOutputImages == 0)
+    itkExceptionMacro("The number of output images must be at least 1");
+  if (nbOutputImages == m_NumberOfOutputImages.at(plan))
+    return;
+
+  m_NumberOfOutputImages[plan] = nbOutputImages;
+  CreateOutputs();
+  this->Modified();
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::SetInputs(const SARImageListType * sarList,
+                                                            const OptImageListType * optList)
+{
+  m_NumberOfSARImages = sarList->Size();
+  m_NumberOfOptImages = optList->Size();
+
+  unsigned int idx = 0;
+  for (unsigned int i = 0; i < m_NumberOfSARImages; i++)
+    this->itk::ProcessObject::SetNthInput(idx++, const_cast<SARImageType *>(sarList->GetNthElement(i)));
+  for (unsigned int i = 0; i < m_NumberOfOptImages; i++)
+    this->itk::ProcessObject::SetNthInput(idx++, const_cast<OptImageType *>(optList->GetNthElement(i)));
+
+  this->SetNumberOfIndexedInputs(idx);
+  this->SetNumberOfRequiredInputs(idx);
+}
+
+template <class TSARImage, class TOptImage>
+const TSARImage *
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GetSARInput(unsigned int idx) const
+{
+  return static_cast<const SARImageType *>(this->itk::ProcessObject::GetInput(idx));
+}
+
+template <class TSARImage, class TOptImage>
+const TOptImage *
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GetOptInput(unsigned int idx) const
+{
+  return static_cast<const OptImageType *>(this->itk::ProcessObject::GetInput(m_NumberOfSARImages + idx));
+}
+
+template <class TSARImage, class TOptImage>
+TSARImage *
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GetSAROutput(unsigned int plan, unsigned int n)
+{
+  return static_cast<SARImageType *>(this->itk::ProcessObject::GetOutput(GetFirstOutputIndex(plan) + n));
+}
+
+template <class TSARImage, class TOptImage>
+TOptImage *
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GetOptOutput(unsigned int plan, unsigned int n)
+{
+  return static_cast<OptImageType *>(
+    this->itk::ProcessObject::GetOutput(GetFirstOutputIndex(plan) + m_NumberOfOutputImages.at(plan) + n));
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GenerateOutputInformation()
+{
+  Superclass::GenerateOutputInformation();
+
+  if (m_NumberOfSARImages == 0)
+    itkExceptionMacro("At least one SAR image is required");
+
+  // Check inputs (no optical band without optical images)
+  m_SARNbBands = this->GetSARInput(0)->GetNumberOfComponentsPerPixel();
+  m_OptNbBands = HasOptInputs() ? this->GetOptInput(0)->GetNumberOfComponentsPerPixel() : 0;
+  const RegionType & largestRegion = this->GetSARInput(0)->GetLargestPossibleRegion();
+  for (unsigned int i = 0; i < m_NumberOfSARImages; i++)
+  {
+    if (this->GetSARInput(i)->GetNumberOfComponentsPerPixel() != m_SARNbBands)
+      itkExceptionMacro("SAR image #" << i << " has " << this->GetSARInput(i)->GetNumberOfComponentsPerPixel()
+                                      << " bands, but SAR image #0 has " << m_SARNbBands);
+    if (this->GetSARInput(i)->GetLargestPossibleRegion() != largestRegion)
+      itkExceptionMacro("SAR image #" << i << " does not have the same size as SAR image #0");
+  }
+  for (unsigned int i = 0; i < m_NumberOfOptImages; i++)
+  {
+    if (this->GetOptInput(i)->GetNumberOfComponentsPerPixel() != m_OptNbBands)
+      itkExceptionMacro("Optical image #" << i << " has " << this->GetOptInput(i)->GetNumberOfComponentsPerPixel()
+                                          << " bands, but optical image #0 has " << m_OptNbBands);
+    if (this->GetOptInput(i)->GetLargestPossibleRegion() != largestRegion)
+      itkExceptionMacro("Optical image #" << i << " does not have the same size as SAR image #0");
+  }
+  for (unsigned int plan = 0; plan < m_Pairs.size(); plan++)
+    for (const auto & pair : m_Pairs[plan])
+    {
+      if (pair.first >= m_NumberOfSARImages)
+        itkExceptionMacro("SAR image index " << pair.first << " of plan #" << plan
+                                             << " is out of the SAR images list");
+      if (HasOptInputs() && pair.second >= m_NumberOfOptImages)
+        itkExceptionMacro("Optical image index " << pair.second << " of plan #" << plan
+                                                 << " is out of the optical images list");
+    }
+
+  // Outputs of each plan: NumberOfOutputImages x SAR, and NumberOfOutputImages x Optical
+  for (unsigned int plan = 0; plan < m_Pairs.size(); plan++)
+    for (unsigned int n = 0; n < m_NumberOfOutputImages[plan]; n++)
+    {
+      this->GetSAROutput(plan, n)->SetNumberOfComponentsPerPixel(m_SARNbBands);
+      this->GetOptOutput(plan, n)->SetNumberOfComponentsPerPixel(m_OptNbBands);
+    }
+}
+
+template <class TSARImage, class TOptImage>
+std::size_t
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GetInputsMemoryPrintPerPixel() const
+{
+  std::vector<bool> usedSAR(m_NumberOfSARImages, false), usedOpt(m_NumberOfOptImages, false);
+  for (const auto & pairs : m_Pairs)
+    for (const auto & pair : pairs)
+    {
+      usedSAR.at(pair.first) = true;
+      if (HasOptInputs())
+        usedOpt.at(pair.second) = true;
+    }
+  return std::count(usedSAR.begin(), usedSAR.end(), true) * m_SARNbBands * sizeof(SARValueType) +
+         std::count(usedOpt.begin(), usedOpt.end(), true) * m_OptNbBands * sizeof(OptValueType);
+}
+
+template <class TSARImage, class TOptImage>
+std::size_t
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GetOutputsMemoryPrintPerPixel() const
+{
+  const std::size_t nbOutputImages =
+    std::accumulate(m_NumberOfOutputImages.begin(), m_NumberOfOutputImages.end(), std::size_t(0));
+  return nbOutputImages * (m_SARNbBands * sizeof(SARValueType) + m_OptNbBands * sizeof(OptValueType));
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::AllocateOutputs()
+{
+  // Optical outputs have no band without optical images: they are not allocated
+  for (unsigned int plan = 0; plan < m_Pairs.size(); plan++)
+    for (unsigned int n = 0; n < m_NumberOfOutputImages[plan]; n++)
+    {
+      SARImageType * sarOutput = this->GetSAROutput(plan, n);
+      sarOutput->SetBufferedRegion(sarOutput->GetRequestedRegion());
+      sarOutput->Allocate();
+      if (!HasOptInputs())
+        continue;
+      OptImageType * optOutput = this->GetOptOutput(plan, n);
+      optOutput->SetBufferedRegion(optOutput->GetRequestedRegion());
+      optOutput->Allocate();
+    }
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GenerateInputRequestedRegion()
+{
+  // Inputs are updated on demand in GenerateData(): we request an empty region, so that the pipeline does not
+  // update them (see itk::ImageBase::UpdateOutputData())
+  RegionType emptyRegion = this->GetSAROutput(0)->GetRequestedRegion();
+  typename RegionType::SizeType emptySize;
+  emptySize.Fill(0);
+  emptyRegion.SetSize(emptySize);
+  for (unsigned int idx = 0; idx < this->GetNumberOfIndexedInputs(); idx++)
+  {
+    ImageBaseType * input = dynamic_cast<ImageBaseType *>(this->itk::ProcessObject::GetInput(idx));
+    if (input)
+      input->SetRequestedRegion(emptyRegion);
+  }
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::FetchInput(unsigned int idx, const RegionType & region)
+{
+  if (m_Fetched[idx])
+    return;
+
+  const auto start = std::chrono::steady_clock::now();
+  if (m_Prefetched[idx].valid())
+    m_Prefetched[idx].get(); // Rethrows the exceptions of the background thread
+  else
+    UpdateInput(idx, region);
+  m_Fetched[idx] = true;
+  if (m_CollectStatistics)
+    m_Statistics.InputWaitTime += GetElapsedTime(start);
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::UpdateInput(unsigned int idx, const RegionType & region)
+{
+  const auto      start = std::chrono::steady_clock::now();
+  ImageBaseType * input = static_cast<ImageBaseType *>(this->itk::ProcessObject::GetInput(idx));
+  input->SetRequestedRegion(region);
+  input->PropagateRequestedRegion();
+  input->UpdateOutputData();
+
+  // Each input is updated by a single thread at a time: its statistics are not shared
+  if (m_CollectStatistics)
+  {
+    const bool sar = idx < m_NumberOfSARImages;
+    m_Statistics.InputReadTime[idx] += GetElapsedTime(start);
+    m_Statistics.InputReads[idx]++;
+    m_Statistics.InputBytesRead[idx] += region.GetNumberOfPixels() * (sar ? m_SARNbBands * sizeof(SARValueType)
+                                                                          : m_OptNbBands * sizeof(OptValueType));
+  }
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::PrefetchInputs(const RegionType & region, std::size_t pass)
+{
+  // Inputs read ahead, and not consumed yet
+  unsigned int nbPending = std::count_if(m_Prefetched.begin(), m_Prefetched.end(), [](const std::future<void> & f) {
+    return f.valid();
+  });
+
+  // Pairs in processing order: the pair #pass and the next ones of the current plan, then the pairs of the next plans
+  for (unsigned int plan = m_CurrentPlan; plan < m_Pairs.size() && nbPending < m_NumberOfIOThreads; plan++, pass = 0)
+    for (; pass < m_Pairs[plan].size() && nbPending < m_NumberOfIOThreads; pass++)
+    {
+      const auto & pair = m_Pairs[plan][pass];
+      if (!Intersects(pair, region))
+        continue;
+      for (const unsigned int idx : { pair.first, m_NumberOfSARImages + pair.second })
+        if (idx < m_Fetched.size() && !m_Fetched[idx] && !m_Prefetched[idx].valid() && nbPending < m_NumberOfIOThreads)
+        {
+          m_Prefetched[idx] = std::async(std::launch::async, [this, idx, region]() { UpdateInput(idx, region); });
+          nbPending++;
+        }
+    }
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::UpdateOutputInformation()
+{
+  WaitForReadAhead();
+  Superclass::UpdateOutputInformation();
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::PropagateRequestedRegion(itk::DataObject * output)
+{
+  WaitForReadAhead();
+  Superclass::PropagateRequestedRegion(output);
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::UpdateOutputData(itk::DataObject * output)
+{
+  // The read-ahead starts once the inputs have been released by the pipeline (if they are marked for release)
+  WaitForReadAhead();
+  m_RegionGenerated = false;
+  Superclass::UpdateOutputData(output);
+  if (m_RegionGenerated)
+    StartReadAhead();
+  m_RegionGenerated = false;
+}
+
+template <class TSARImage, class TOptImage>
+bool
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GetNextRegion(const RegionType & region, RegionType & next) const
+{
+  typedef typename RegionType::IndexValueType IndexValueType;
+  const RegionType &   largestRegion = this->GetSAROutput(0)->GetLargestPossibleRegion();
+  const IndexValueType endX = region.GetIndex(0) + static_cast<IndexValueType>(region.GetSize(0));
+  next = region;
+  if (endX < largestRegion.GetIndex(0) + static_cast<IndexValueType>(largestRegion.GetSize(0)))
+  {
+    next.SetIndex(0, endX);
+  }
+  else
+  {
+    next.SetIndex(0, largestRegion.GetIndex(0));
+    next.SetIndex(1, region.GetIndex(1) + static_cast<IndexValueType>(region.GetSize(1)));
+  }
+  return next.Crop(largestRegion) && next.GetNumberOfPixels() > 0;
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::StartReadAhead()
+{
+  RegionType next;
+  if (m_NumberOfIOThreads == 0 || !GetNextRegion(m_GeneratedRegion, next))
+    return;
+
+  // Inputs used by the region, which may have valid pixels in the next region
+  m_ReadAheadInputs.clear();
+  for (unsigned int idx = 0; idx < m_Fetched.size(); idx++)
+  {
+    const bool sar = idx < m_NumberOfSARImages;
+    if (m_Fetched[idx] &&
+        Intersects(sar ? m_SARFootprints : m_OptFootprints, sar ? idx : idx - m_NumberOfSARImages, next) &&
+        Intersects(sar ? m_SARValidityBitmaps : m_OptValidityBitmaps, sar ? idx : idx - m_NumberOfSARImages, next))
+      m_ReadAheadInputs.push_back(idx);
+  }
+  m_ReadAheadRegion = next;
+
+  // The inputs are shared between up to NumberOfIOThreads background threads
+  const std::size_t nbThreads = std::min<std::size_t>(m_NumberOfIOThreads, m_ReadAheadInputs.size());
+  for (std::size_t t = 0; t < nbThreads; t++)
+    m_ReadAhead.push_back(std::async(std::launch::async, [this, t, nbThreads, next]() {
+      for (std::size_t i = t; i < m_ReadAheadInputs.size(); i += nbThreads)
+        UpdateInput(m_ReadAheadInputs[i], next);
+    }));
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::WaitForReadAhead()
+{
+  std::vector<std::future<void>> readAhead;
+  readAhead.swap(m_ReadAhead);
+  for (auto & future : readAhead)
+    future.get();
+}
+
+template <class TSARImage, class TOptImage>
+bool
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::Intersects(const FootprintListType & footprints,
+                                                             unsigned int              idx,
+                                                             const RegionType &        region)
+{
+  if (idx >= footprints.size())
+    return true;
+  return footprints[idx].Intersects(region.GetIndex(0), region.GetIndex(1), region.GetSize(0), region.GetSize(1));
+}
+
+template <class TSARImage, class TOptImage>
+bool
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::Intersects(const ValidityBitmapListType & bitmaps,
+                                                             unsigned int                   idx,
+                                                             const RegionType &             region)
+{
+  if (idx >= bitmaps.size() || !bitmaps[idx])
+    return true;
+  return bitmaps[idx]->Intersects(region.GetIndex(0), region.GetIndex(1), region.GetSize(0), region.GetSize(1));
+}
+
+template <class TSARImage, class TOptImage>
+bool
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::Intersects(const typename IndicesPairListType::value_type & pair,
+                                                             const RegionType & region) const
+{
+  if (!HasOptInputs())
+    return Intersects(m_SARFootprints, pair.first, region) && Intersects(m_SARValidityBitmaps, pair.first, region);
+  return Intersects(m_SARFootprints, pair.first, region) && Intersects(m_OptFootprints, pair.second, region) &&
+         Intersects(m_SARValidityBitmaps, pair.first, region) && Intersects(m_OptValidityBitmaps, pair.second, region);
+}
+
+template <class TSARImage, class TOptImage>
+typename TimeSeriesDrillImageFilter<TSARImage, TOptImage>::IndicesPairListType
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GetCandidatePairs(unsigned int plan, const RegionType & region) const
+{
+  IndicesPairListType pairs;
+  for (const auto & pair : m_Pairs.at(plan))
+    if (Intersects(pair, region))
+      pairs.push_back(pair);
+  return pairs;
+}
+
+template <class TSARImage, class TOptImage>
+bool
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::ResolvesPixels(
+  const typename IndicesPairListType::value_type & pair,
+  const RegionType &                               region,
+  std::size_t                                      begin,
+  std::size_t                                      end) const
+{
+  // Without optical images, only the SAR bitmap is used
+  if (pair.first >= m_SARValidityBitmaps.size() || !m_SARValidityBitmaps[pair.first] ||
+      (HasOptInputs() && (pair.second >= m_OptValidityBitmaps.size() || !m_OptValidityBitmaps[pair.second])))
+    return true;
+
+  const ValidityBitmap & sarBitmap = *m_SARValidityBitmaps[pair.first];
+  const ValidityBitmap * optBitmap = HasOptInputs() ? m_OptValidityBitmaps[pair.second].get() : nullptr;
+  const unsigned int     nbOutputImages = m_NumberOfOutputImages[m_CurrentPlan];
+  const std::size_t      sizeX = region.GetSize(0);
+  std::size_t            x = begin % sizeX;
+  std::size_t            y = begin / sizeX;
+  for (std::size_t offset = begin; offset < end; offset++)
+  {
+    if (m_Filled[offset] < nbOutputImages && sarBitmap.IsValid(region.GetIndex(0) + x, region.GetIndex(1) + y) &&
+        (optBitmap == nullptr || optBitmap->IsValid(region.GetIndex(0) + x, region.GetIndex(1) + y)))
+      return true;
+    if (++x == sizeX)
+    {
+      x = 0;
+      y++;
+    }
+  }
+  return false;
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::FillNoData()
+{
+  for (unsigned int n = 0; n < m_NumberOfOutputImages[m_CurrentPlan]; n++)
+  {
+    SARImageType *    sarOutput = this->GetSAROutput(m_CurrentPlan, n);
+    const std::size_t sarSize = sarOutput->GetBufferedRegion().GetNumberOfPixels() * m_SARNbBands;
+    std::fill(sarOutput->GetBufferPointer(), sarOutput->GetBufferPointer() + sarSize, m_SARNoDataValue);
+
+    if (!HasOptInputs())
+      continue;
+    OptImageType *    optOutput = this->GetOptOutput(m_CurrentPlan, n);
+    const std::size_t optSize = optOutput->GetBufferedRegion().GetNumberOfPixels() * m_OptNbBands;
+    std::fill(optOutput->GetBufferPointer(), optOutput->GetBufferPointer() + optSize, m_OptNoDataValue);
+  }
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::RunThreads()
+{
+  itk::MultiThreader * threader = this->GetMultiThreader();
+  threader->SetNumberOfThreads(this->GetNumberOfThreads());
+  const unsigned int nbThreads = threader->GetNumberOfThreads();
+  const std::size_t  nbPairs = m_Pairs[m_CurrentPlan].size();
+  m_ThreadScratch.resize(nbThreads);
+  for (auto & scratch : m_ThreadScratch)
+  {
+    scratch.Fetched.assign(nbPairs, false);
+    scratch.Examined.assign(nbPairs, false);
+    scratch.Applied.assign(nbPairs, false);
+    scratch.Resolved.assign(nbPairs, 0);
+  }
+
+  // Chunks small enough for each thread to take many of them (about 16), but long enough to amortize the claims
+  const std::size_t nbPixels = this->GetSAROutput(0)->GetRequestedRegion().GetNumberOfPixels();
+  const std::size_t minChunkSize = 1024;
+  const std::size_t chunksPerThread = 16;
+  m_ChunkSize = std::max(minChunkSize, nbPixels / (chunksPerThread * nbThreads));
+  m_NextChunk = 0;
+  m_ThreadError = nullptr;
+
+  threader->SetSingleMethod(Self::ChunksThreaderCallback, this);
+  threader->SingleMethodExecute();
+  if (m_ThreadError)
+    std::rethrow_exception(m_ThreadError);
+}
+
+template <class TSARImage, class TOptImage>
+ITK_THREAD_RETURN_TYPE
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::ChunksThreaderCallback(void * arg)
+{
+  const itk::MultiThreader::ThreadInfoStruct * info = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  Self *                                       filter = static_cast<Self *>(info->UserData);
+  const itk::ThreadIdType                      threadId = info->ThreadID;
+
+  const std::size_t nbPixels = filter->GetSAROutput(0)->GetRequestedRegion().GetNumberOfPixels();
+  try
+  {
+    for (std::size_t begin = filter->m_NextChunk.fetch_add(filter->m_ChunkSize); begin < nbPixels;
+         begin = filter->m_NextChunk.fetch_add(filter->m_ChunkSize))
+      filter->ProcessChunk(begin, std::min(begin + filter->m_ChunkSize, nbPixels), threadId);
+  }
+  catch (...)
+  {
+    // The other threads stop claiming chunks, and the exception is rethrown by RunThreads()
+    std::lock_guard<std::mutex> lock(filter->m_FetchMutex);
+    if (!filter->m_ThreadError)
+      filter->m_ThreadError = std::current_exception();
+    filter->m_NextChunk = nbPixels;
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GenerateData()
+{
+  this->AllocateOutputs();
+  const RegionType & region = this->GetSAROutput(0)->GetRequestedRegion();
+
+  m_NumberOfProcessedRegions++;
+  m_Fetched.assign(this->GetNumberOfIndexedInputs(), false);
+  m_Prefetched.clear(); // Waits for the inputs still read in background, from a previous interrupted region
+  m_Prefetched.resize(this->GetNumberOfIndexedInputs());
+
+  // Inputs read ahead while the previous region was written, if this region is the expected one
+  WaitForReadAhead();
+  for (const unsigned int idx : m_ReadAheadInputs)
+    if (region == m_ReadAheadRegion && idx < m_Fetched.size() &&
+        static_cast<ImageBaseType *>(this->itk::ProcessObject::GetInput(idx))->GetBufferedRegion() == region)
+      m_Fetched[idx] = true;
+  m_ReadAheadInputs.clear();
+  if (m_CollectStatistics)
+    InitializeStatistics();
+#ifdef OTB_DECLOUD_CUDA
+  if (m_UseGPU)
+  {
+    if (!m_GPUContext)
+      m_GPUContext.reset(new cuda::DrillingContext<SARValueType, OptValueType>());
+    m_GPUContext->BeginRegion(
+      region.GetSize(0), region.GetSize(1), this->GetNumberOfIndexedInputs(), m_SARNbBands, m_OptNbBands);
+  }
+#endif
+
+  // Process plans one after the other: inputs fetched for a plan are reused by the next plans
+  bool inputsRead = false;
+  for (m_CurrentPlan = 0; m_CurrentPlan < m_Pairs.size(); m_CurrentPlan++)
+    inputsRead |= GeneratePlanData(region);
+  m_Prefetched.clear(); // Inputs read ahead for pairs that have not been needed
+  if (!inputsRead)
+    m_NumberOfSkippedRegions++;
+  m_GeneratedRegion = region;
+  m_RegionGenerated = true;
+  this->UpdateProgress(1.0);
+}
+
+template <class TSARImage, class TOptImage>
+bool
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::GeneratePlanData(const RegionType & region)
+{
+  const IndicesPairListType & pairs = m_Pairs[m_CurrentPlan];
+  const float                 nbPlans = m_Pairs.size();
+
+  m_Kernel.SetParameters(
+    pairs, m_SARNbBands, m_OptNbBands, m_SARNoDataValue, m_OptNoDataValue, m_NumberOfOutputImages[m_CurrentPlan]);
+  m_Kernel.SetInstructionSet(m_InstructionSet);
+
+  // Fast path: no pair has valid pixels in the region (from the footprints and the validity bitmaps), the outputs
+  // are filled with no-data without reading any input
+  if (std::none_of(pairs.begin(), pairs.end(), [&](const typename IndicesPairListType::value_type & pair) {
+        return Intersects(pair, region);
+      }))
+  {
+    FillNoData();
+    if (m_CollectStatistics)
+    {
+      m_Statistics.Pixels[m_CurrentPlan] += region.GetNumberOfPixels();
+      m_Statistics.UnresolvedPixels[m_CurrentPlan] += region.GetNumberOfPixels();
+      m_Statistics.NoDataPixels[m_CurrentPlan] +=
+        region.GetNumberOfPixels() * m_NumberOfOutputImages[m_CurrentPlan];
+    }
+    return false;
+  }
+
+  m_Filled.assign(region.GetNumberOfPixels(), 0);
+#ifdef OTB_DECLOUD_CUDA
+  const std::size_t nbUnresolved = m_UseGPU ? ApplyPairsGPU(region) : ApplyPairs(region);
+#else
+  const std::size_t nbUnresolved = ApplyPairs(region);
+#endif
+  if (m_CollectStatistics)
+  {
+    const unsigned int nbOutputImages = m_NumberOfOutputImages[m_CurrentPlan];
+    m_Statistics.Pixels[m_CurrentPlan] += region.GetNumberOfPixels();
+    m_Statistics.UnresolvedPixels[m_CurrentPlan] += nbUnresolved;
+    for (const auto filled : m_Filled)
+      m_Statistics.NoDataPixels[m_CurrentPlan] += nbOutputImages - std::min(filled, nbOutputImages);
+  }
+#ifdef OTB_DECLOUD_CUDA
+  if (m_UseGPU)
+    EndPlanGPU();
+#endif
+  this->UpdateProgress(static_cast<float>(m_CurrentPlan + 1) / nbPlans);
+  return true;
+}
+
+template <class TSARImage, class TOptImage>
+std::size_t
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::ApplyPairs(const RegionType & region)
+{
+  const IndicesPairListType & pairs = m_Pairs[m_CurrentPlan];
+  m_PairIntersects.resize(pairs.size());
+  for (std::size_t pass = 0; pass < pairs.size(); pass++)
+    m_PairIntersects[pass] = Intersects(pairs[pass], region);
+
+  // The time spent waiting for the inputs fetched by the threads is not counted in the kernel time
+  const auto   start = std::chrono::steady_clock::now();
+  const double inputWaitTime = m_Statistics.InputWaitTime;
+  RunThreads();
+  if (m_CollectStatistics)
+    m_Statistics.KernelTime += std::max(0.0, GetElapsedTime(start) - (m_Statistics.InputWaitTime - inputWaitTime));
+
+  // Pairs examined for a chunk with unresolved pixels, but applied to none (no valid pixel in the SAR or in the
+  // optical image of the pair, or only over pixels already resolved)
+  std::size_t nbResolved = 0;
+  for (std::size_t pass = 0; pass < pairs.size(); pass++)
+  {
+    bool examined = false;
+    bool applied = false;
+    for (const auto & scratch : m_ThreadScratch)
+    {
+      examined |= static_cast<bool>(scratch.Examined[pass]);
+      applied |= static_cast<bool>(scratch.Applied[pass]);
+      nbResolved += scratch.Resolved[pass];
+      if (m_CollectStatistics)
+        m_Statistics.ResolvedPixels[m_CurrentPlan][pass] += scratch.Resolved[pass];
+    }
+    if (examined && !applied)
+      m_NumberOfPrunedPairs++;
+  }
+  return region.GetNumberOfPixels() - nbResolved;
+}
+
+#ifdef OTB_DECLOUD_CUDA
+template <class TSARImage, class TOptImage>
+std::size_t
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::ApplyPairsGPU(const RegionType & region)
+{
+  const IndicesPairListType & pairs = m_Pairs[m_CurrentPlan];
+  const float                 nbPlans = m_Pairs.size();
+  std::size_t                 nbUnresolved = region.GetNumberOfPixels();
+  m_GPUContext->BeginPlan(m_NumberOfOutputImages[m_CurrentPlan], m_SARNoDataValue, m_OptNoDataValue);
+
+  // Apply pairs in priority order, until all pixels are resolved
+  for (std::size_t pass = 0; pass < pairs.size() && nbUnresolved > 0; pass++)
+  {
+    const auto & pair = pairs[pass];
+    if (Intersects(pair, region) && ResolvesPixels(pair, region, 0, region.GetNumberOfPixels()))
+    {
+      PrefetchInputs(region, pass);
+      FetchInput(pair.first, region);
+      if (HasOptInputs())
+        FetchInput(m_NumberOfSARImages + pair.second, region);
+      const auto        start = std::chrono::steady_clock::now();
+      const std::size_t nbResolved = ApplyPairGPU(pair, region);
+      nbUnresolved -= nbResolved;
+      if (m_CollectStatistics)
+      {
+        m_Statistics.KernelTime += GetElapsedTime(start);
+        m_Statistics.ResolvedPixels[m_CurrentPlan][pass] += nbResolved;
+      }
+    }
+    else
+    {
+      // No valid pixel in the SAR or in the optical image of the pair, or only over pixels already resolved
+      m_NumberOfPrunedPairs++;
+    }
+    this->UpdateProgress((m_CurrentPlan + static_cast<float>(pass + 1) / pairs.size()) / nbPlans);
+  }
+  if (m_CollectStatistics)
+    m_GPUContext->DownloadFilled(m_Filled.data());
+  return nbUnresolved;
+}
+
+template <class TSARImage, class TOptImage>
+std::size_t
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::ApplyPairGPU(const typename IndicesPairListType::value_type & pair,
+                                                               const RegionType & region)
+{
+  // Inputs are uploaded once per region, and shared by the plans
+  const unsigned int sarIdx = pair.first;
+  const unsigned int optIdx = m_NumberOfSARImages + pair.second;
+  if (!m_GPUContext->HasInput(sarIdx))
+  {
+    const SARImageType * sarImage = this->GetSARInput(pair.first);
+    m_GPUContext->UploadSARInput(sarIdx,
+                                 sarImage->GetBufferPointer() +
+                                   sarImage->ComputeOffset(region.GetIndex()) * m_SARNbBands,
+                                 sarImage->GetBufferedRegion().GetSize(0) * m_SARNbBands);
+  }
+  if (HasOptInputs() && !m_GPUContext->HasInput(optIdx))
+  {
+    const OptImageType * optImage = this->GetOptInput(pair.second);
+    m_GPUContext->UploadOptInput(optIdx,
+                                 optImage->GetBufferPointer() +
+                                   optImage->ComputeOffset(region.GetIndex()) * m_OptNbBands,
+                                 optImage->GetBufferedRegion().GetSize(0) * m_OptNbBands);
+  }
+  const std::size_t nbResolved = m_GPUContext->ProcessPair(sarIdx, optIdx);
+  if (m_CollectStatistics)
+    m_Statistics.GPUPairs++;
+
+  // The validity bitmaps test the pixels which are not resolved yet (see ResolvesPixels())
+  if (!m_SARValidityBitmaps.empty() || !m_OptValidityBitmaps.empty())
+    m_GPUContext->DownloadFilled(m_Filled.data());
+  return nbResolved;
+}
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::EndPlanGPU()
+{
+  const unsigned int          nbOutputImages = m_NumberOfOutputImages[m_CurrentPlan];
+  std::vector<SARValueType *> sarOut(nbOutputImages);
+  std::vector<OptValueType *> optOut(nbOutputImages, nullptr);
+  for (unsigned int n = 0; n < nbOutputImages; n++)
+  {
+    sarOut[n] = this->GetSAROutput(m_CurrentPlan, n)->GetBufferPointer();
+    if (HasOptInputs())
+      optOut[n] = this->GetOptOutput(m_CurrentPlan, n)->GetBufferPointer();
+  }
+  m_GPUContext->EndPlan(sarOut.data(), optOut.data());
+}
+#endif
+
+template <class TSARImage, class TOptImage>
+void
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::ProcessChunk(std::size_t       begin,
+                                                               std::size_t       end,
+                                                               itk::ThreadIdType threadId)
+{
+  const RegionType &          region = this->GetSAROutput(0)->GetRequestedRegion();
+  const IndicesPairListType & pairs = m_Pairs[m_CurrentPlan];
+  ThreadScratchType &         scratch = m_ThreadScratch[threadId];
+
+  // Apply pairs in priority order, until all pixels of the chunk are resolved
+  std::size_t nbUnresolved = end - begin;
+  for (std::size_t pass = 0; pass < pairs.size() && nbUnresolved > 0; pass++)
+  {
+    const auto & pair = pairs[pass];
+    scratch.Examined[pass] = true;
+    if (!m_PairIntersects[pass] || !ResolvesPixels(pair, region, begin, end))
+      continue;
+    if (!scratch.Fetched[pass])
+    {
+      std::lock_guard<std::mutex> lock(m_FetchMutex);
+      PrefetchInputs(region, pass);
+      FetchInput(pair.first, region);
+      if (HasOptInputs())
+        FetchInput(m_NumberOfSARImages + pair.second, region);
+      scratch.Fetched[pass] = true;
+    }
+    const std::size_t nbResolved = ProcessPixels(begin, end, pass, threadId);
+    scratch.Applied[pass] = true;
+    scratch.Resolved[pass] += nbResolved;
+    nbUnresolved -= nbResolved;
+  }
+
+  // Fill the output images that have not been found with no-data
+  if (nbUnresolved > 0)
+    ProcessPixels(begin, end, pairs.size(), threadId);
+}
+
+template <class TSARImage, class TOptImage>
+std::size_t
+TimeSeriesDrillImageFilter<TSARImage, TOptImage>::ProcessPixels(std::size_t       begin,
+                                                                std::size_t       end,
+                                                                std::size_t       pass,
+                                                                itk::ThreadIdType threadId)
+{
+  const RegionType &          region = this->GetSAROutput(0)->GetRequestedRegion();
+  const IndicesPairListType & pairs = m_Pairs[m_CurrentPlan];
+  const unsigned int          nbOutputImages = m_NumberOfOutputImages[m_CurrentPlan];
+
+  const bool           fillPass = (pass == pairs.size());
+  const SARImageType * sarImage = fillPass ? nullptr : this->GetSARInput(pairs[pass].first);
+  const OptImageType * optImage = (fillPass || !HasOptInputs()) ? nullptr : this->GetOptInput(pairs[pass].second);
+
+  // Pointers to the current run of each output, in the scratch buffers of the thread
+  std::vector<SARValueType *> & sarOut = m_ThreadScratch[threadId].SAROut;
+  std::vector<OptValueType *> & optOut = m_ThreadScratch[threadId].OptOut;
+  sarOut.resize(nbOutputImages);
+  optOut.resize(nbOutputImages);
+
+  // Process the pixels by runs of contiguous pixels of the same scanline
+  const std::size_t              sizeX = region.GetSize(0);
+  std::size_t                    nbResolved = 0;
+  typename RegionType::IndexType index;
+  for (std::size_t offset = begin; offset < end;)
+  {
+    index[0] = region.GetIndex(0) + offset % sizeX;
+    index[1] = region.GetIndex(1) + offset / sizeX;
+    const std::size_t nbPixels = std::min(end - offset, sizeX - offset % sizeX);
+
+    for (unsigned int n = 0; n < nbOutputImages; n++)
+    {
+      SARImageType * sarOutput = this->GetSAROutput(m_CurrentPlan, n);
+      OptImageType * optOutput = this->GetOptOutput(m_CurrentPlan, n);
+      sarOut[n] = sarOutput->GetBufferPointer() + sarOutput->ComputeOffset(index) * m_SARNbBands;
+      optOut[n] = HasOptInputs() ? optOutput->GetBufferPointer() + optOutput->ComputeOffset(index) * m_OptNbBands
+                                 : nullptr;
+    }
+    unsigned int * filled = m_Filled.data() + offset;
+    if (fillPass)
+    {
+      m_Kernel.FillNoData(sarOut.data(), optOut.data(), nbPixels, filled);
+    }
+    else
+    {
+      const SARValueType * sar = sarImage->GetBufferPointer() + sarImage->ComputeOffset(index) * m_SARNbBands;
+      const OptValueType * opt =
+        optImage ? optImage->GetBufferPointer() + optImage->ComputeOffset(index) * m_OptNbBands : nullptr;
+      nbResolved +=
+        m_Kernel.ProcessPair(sar, m_SARNbBands, opt, m_OptNbBands, sarOut.data(), optOut.data(), nbPixels, filled);
+    }
+    offset += nbPixels;
+  }
+  return nbResolved;
+}
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,134 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTimeSeriesDrillingCUDA_h
+#define otbTimeSeriesDrillingCUDA_h
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace otb
+{
+namespace cuda
+{
+
+// Tell if a CUDA device can be used by the drilling kernel
+bool
+IsAvailable();
+
+// Name of the CUDA device used by the drilling kernel (empty if no device is available)
+std::string
+GetDeviceName();
+
+/**
+ * \class DrillingContext
+ *
+ * \brief Applies the drilling kernel (see TimeSeriesDrillingKernel) on a CUDA device, for one region at a time.
+ *
+ * The inputs of the region are uploaded once in device memory (UploadSARInput(), UploadOptInput()), and are shared by
+ * all the plans processed over the region. For each plan, the output slots and the per-pixel counters of the valid
+ * pairs found so far are kept in device memory while the pairs are applied one after the other (ProcessPair()), one
+ * device thread per pixel. EndPlan() fills the missing outputs with no-data, and downloads the outputs in the output
+ * buffers. The numbers of resolved pixels returned by ProcessPair() let the caller stop as soon as all pixels are
+ * resolved, like on the CPU, and produce bit-identical outputs.
+ *
+ * Buffers are pixel-interleaved (like otb::VectorImage buffers). The class is implemented in the OTBDecloudCUDA
+ * library (built with -DOTBDecloud_USE_CUDA=ON), explicitly instantiated for float, uint16 and int16 values. Errors
+ * of the CUDA runtime are thrown as std::runtime_error.
+ *
+ * \ingroup OTBDecloud
+ */
+template <class TSARValue, class TOptValue = TSARValue>
+class DrillingContext
+{
+public:
+  typedef TSARValue SARValueType;
+  typedef TOptValue OptValueType;
+
+  DrillingContext();
+  ~DrillingContext();
+
+  /**
+   * Start a new region: the inputs of the previous region are discarded (their buffers are reused for a region of
+   * the same size)
+   * sizeX, sizeY: size of the region, in pixels
+   * nbInputs: number of inputs (SAR and optical)
+   * sarNbBands, optNbBands: numbers of bands of the SAR and optical images
+   */
+  void
+  BeginRegion(std::size_t  sizeX,
+              std::size_t  sizeY,
+              unsigned int nbInputs,
+              unsigned int sarNbBands,
+              unsigned int optNbBands);
+
+  // Tell if an input has been uploaded for the current region
+  bool
+  HasInput(unsigned int idx) const;
+
+  // Upload the input #idx over the region: buffer is its first pixel, rowStride the number of values between two
+  // consecutive rows of the buffer
+  void
+  UploadSARInput(unsigned int idx, const SARValueType * buffer, std::size_t rowStride);
+  void
+  UploadOptInput(unsigned int idx, const OptValueType * buffer, std::size_t rowStride);
+
+  // Start a plan over the current region: no pair has been applied to its nbOutputImages output slots yet
+  void
+  BeginPlan(unsigned int nbOutputImages, SARValueType sarNoDataValue, OptValueType optNoDataValue);
+
+  // Apply the pair of the inputs #sarIdx and #optIdx (ignored without optical bands) to the current plan. Returns the
+  // number of pixels resolved by the pair.
+  std::size_t
+  ProcessPair(unsigned int sarIdx, unsigned int optIdx);
+
+  // Download the number of valid pairs found so far for each pixel of the region
+  void
+  DownloadFilled(unsigned int * filled) const;
+
+  // Fill the output slots that have not been found with no-data, and download the outputs in the output buffers
+  // (nbOutputImages pointers to contiguous buffers of the region, optOut is ignored without optical bands)
+  void
+  EndPlan(SARValueType * const * sarOut, OptValueType * const * optOut);
+
+private:
+  DrillingContext(const DrillingContext &);             // purposely not implemented
+  DrillingContext & operator=(const DrillingContext &); // purposely not implemented
+
+  // Release the device buffers
+  void
+  Release();
+
+  std::size_t  m_NbPixels;
+  std::size_t  m_SizeX;
+  std::size_t  m_SizeY;
+  unsigned int m_SARNbBands;
+  unsigned int m_OptNbBands;
+  unsigned int m_NbOutputImages;
+  SARValueType m_SARNoDataValue;
+  OptValueType m_OptNoDataValue;
+
+  // Device buffers
+  std::vector<void *>  m_Inputs;       // Inputs buffers (allocated for the size of the region)
+  std::vector<bool>    m_Uploaded;     // Inputs uploaded for the current region
+  SARValueType *       m_SAROutputs;   // Output slots of the plan, one after the other
+  OptValueType *       m_OptOutputs;   // Output slots of the plan, one after the other
+  std::size_t          m_OutputsSize;  // Number of pixels allocated per output slot
+  unsigned int         m_OutputsSlots; // Number of output slots allocated
+  unsigned int *       m_Filled;       // Number of valid pairs found, for each pixel of the region
+  unsigned long long * m_NbResolved;   // Number of pixels resolved by the last pair
+  std::size_t          m_FilledSize;   // Number of pixels allocated for the counters
+};
+
+} // end namespace cuda
+} // end namespace otb
+
+#endif
@@ -0,0 +1,445 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTimeSeriesDrillingKernel_h
+#define otbTimeSeriesDrillingKernel_h
+
+#include "otbTimeSeriesDrillingSIMD.h"
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace otb
+{
+
+/**
+ * \class TimeSeriesDrillingKernel
+ *
+ * \brief Computes the output pixels of a run of contiguous pixels from
+ * - SAR pixels
+ * - Optical pixels
+ * - pairs (list of pair of SAR and Optical input images indices)
+ * - Nodata (of SAR, and Optical)
+ * - Number of channels (in SAR, and Optical)
+ *
+ * For each pixel, the first m_NbOutputImages pairs (in the pairs list order) for which neither the SAR pixel nor
+ * the optical pixel is no-data are selected. The SAR and optical pixels of the n-th selected pair are copied in the
+ * n-th SAR and optical output slots. Missing outputs are filled with the no-data values. Without optical bands,
+ * pairs are SAR images only (e.g. for a mosaic of SAR images): the first valid SAR pixels are selected.
+ *
+ * The kernel is applied one pair at a time (ProcessPair()) to all pixels of a run, so that the images of a pair
+ * are only needed once the previous pairs have been applied, and that the caller can stop as soon as all pixels
+ * are resolved. A per-pixel counter of the valid pairs found so far ("filled") is kept by the caller between calls.
+ * ProcessRun() does the whole job on stacked input buffers.
+ *
+ * Each output slot is a separate buffer, so that outputs are written directly in the output images, without
+ * intermediate stacking. Buffers are pixel-interleaved (like otb::VectorImage buffers). SAR and optical values can
+ * have different types (e.g. uint16 SAR and int16 optical images), so that images are processed in their native
+ * encoding.
+ *
+ * The common layouts (2 SAR bands, with 4 or 6 optical bands) have implementations with numbers of bands known at
+ * compile time. With AVX2 or AVX-512 instructions (see SetInstructionSet()), their no-data tests are vectorized across
+ * the pixels: the bands of a block of 8 consecutive pixels are compared in a few vectors, and only the valid pixels
+ * of the block are copied. For the other layouts, the no-data tests and the copies of the bands of each float pixel
+ * are vectorized. Vectorized and scalar code paths produce bit-identical outputs. The implementation is selected
+ * once, when parameters or instruction set are set.
+ *
+ * \ingroup OTBDecloud
+ */
+template <class TSARValue, class TOptValue = TSARValue>
+class TimeSeriesDrillingKernel
+{
+public:
+  typedef TSARValue                             SARValueType;
+  typedef TOptValue                             OptValueType;
+  typedef std::pair<unsigned int, unsigned int> IndicesPairType;
+  typedef std::vector<IndicesPairType>          IndicesPairListType;
+
+  TimeSeriesDrillingKernel()
+    : m_NbOutputImages(1)
+    , m_SARNbBands(0)
+    , m_OptNbBands(0)
+    , m_SARNoDataValue(0)
+    , m_OptNoDataValue(0)
+    , m_InstructionSet(simd::SCALAR)
+  {
+    SelectImplementation();
+  }
+
+  // Set parameters
+  void
+  SetParameters(const IndicesPairListType & pairs,
+                unsigned int                sarNbBands,
+                unsigned int                optNbBands,
+                SARValueType                sarNdVal,
+                OptValueType                optNdVal,
+                unsigned int                nbOutputImages)
+  {
+    m_Pairs = pairs;
+    m_SARNbBands = sarNbBands;
+    m_OptNbBands = optNbBands;
+    m_SARNoDataValue = sarNdVal;
+    m_OptNoDataValue = optNdVal;
+    m_NbOutputImages = nbOutputImages;
+    SelectImplementation();
+  }
+
+  // Set the instruction set of the kernel. simd::AUTO and unsupported instruction sets fall back to the best one
+  // supported by the CPU (see simd::Resolve()).
+  void
+  SetInstructionSet(simd::InstructionSet is)
+  {
+    m_InstructionSet = simd::Resolve(is);
+    SelectImplementation();
+  }
+
+  simd::InstructionSet
+  GetInstructionSet() const
+  {
+    return m_InstructionSet;
+  }
+
+  // Tell if the kernel has an implementation specialized for a number of SAR and optical bands
+  static bool
+  IsSpecialized(unsigned int sarNbBands, unsigned int optNbBands)
+  {
+    return sarNbBands == 2 && (optNbBands == 4 || optNbBands == 6);
+  }
+
+  // Returns the numbers of bands of the inputs (and of the output slots)
+  unsigned int
+  GetSARNbBands() const
+  {
+    return m_SARNbBands;
+  }
+
+  unsigned int
+  GetOptNbBands() const
+  {
+    return m_OptNbBands;
+  }
+
+  unsigned int
+  GetNbOutputImages() const
+  {
+    return m_NbOutputImages;
+  }
+
+  const IndicesPairListType &
+  GetPairs() const
+  {
+    return m_Pairs;
+  }
+
+  /*
+   * Apply one pair to a run of nbPixels contiguous pixels.
+   * sarPix: SAR pixel of the pair, for the first pixel of the run
+   * sarStride: number of values between two consecutive SAR pixels
+   * optPix: optical pixel of the pair, for the first pixel of the run
+   * optStride: number of values between two consecutive optical pixels
+   * sarOut: first pixel of the run, in each SAR output slot (m_NbOutputImages pointers)
+   * optOut: first pixel of the run, in each optical output slot (m_NbOutputImages pointers)
+   * filled: number of valid pairs already found for each pixel of the run (updated)
+   * Returns the number of pixels of the run which have been resolved by this pair (i.e. for which all output images
+   * are now filled).
+   */
+  std::size_t
+  ProcessPair(const SARValueType *   sarPix,
+              unsigned int           sarStride,
+              const OptValueType *   optPix,
+              unsigned int           optStride,
+              SARValueType * const * sarOut,
+              OptValueType * const * optOut,
+              std::size_t            nbPixels,
+              unsigned int *         filled) const
+  {
+    return (this->*m_ProcessPairFunction)(sarPix, sarStride, optPix, optStride, sarOut, optOut, nbPixels, filled);
+  }
+
+  /*
+   * Fill the output images that have not been found with no-data, for a run of nbPixels contiguous pixels.
+   */
+  void
+  FillNoData(SARValueType * const * sarOut,
+             OptValueType * const * optOut,
+             std::size_t            nbPixels,
+             const unsigned int *   filled) const
+  {
+    for (std::size_t k = 0; k < nbPixels; k++)
+      for (unsigned int n = filled[k]; n < m_NbOutputImages; n++)
+      {
+        std::fill(sarOut[n] + k * m_SARNbBands, sarOut[n] + (k + 1) * m_SARNbBands, m_SARNoDataValue);
+        std::fill(optOut[n] + k * m_OptNbBands, optOut[n] + (k + 1) * m_OptNbBands, m_OptNoDataValue);
+      }
+  }
+
+  /*
+   * Compute the output pixels of a run of nbPixels contiguous pixels, from stacked input pixels.
+   * sar: first stacked SAR pixel of the run (N x m_SARNbBands per pixel)
+   * sarStride: number of values between two consecutive stacked SAR pixels
+   * opt: first stacked optical pixel of the run (M x m_OptNbBands per pixel)
+   * optStride: number of values between two consecutive stacked optical pixels
+   * sarOut: first pixel of the run, in each SAR output slot (m_NbOutputImages pointers)
+   * optOut: first pixel of the run, in each optical output slot (m_NbOutputImages pointers)
+   * filled: scratch buffer of nbPixels elements, receives the number of valid pairs found for each pixel
+   */
+  void
+  ProcessRun(const SARValueType *   sar,
+             unsigned int           sarStride,
+             const OptValueType *   opt,
+             unsigned int           optStride,
+             SARValueType * const * sarOut,
+             OptValueType * const * optOut,
+             std::size_t            nbPixels,
+             unsigned int *         filled) const
+  {
+    std::fill(filled, filled + nbPixels, 0);
+    std::size_t nbUnresolved = nbPixels;
+
+    // Iterate through pairs
+    for (auto pair = m_Pairs.begin(); pair != m_Pairs.end() && nbUnresolved > 0; ++pair)
+      nbUnresolved -= ProcessPair(sar + pair->first * m_SARNbBands,
+                                  sarStride,
+                                  opt + pair->second * m_OptNbBands,
+                                  optStride,
+                                  sarOut,
+                                  optOut,
+                                  nbPixels,
+                                  filled);
+
+    // Fill the remaining output images with no-data
+    if (nbUnresolved > 0)
+      FillNoData(sarOut, optOut, nbPixels, filled);
+  }
+
+private:
+  typedef TimeSeriesDrillingKernel Self;
+  typedef std::size_t (Self::*ProcessPairFunctionType)(const SARValueType *,
+                                                       unsigned int,
+                                                       const OptValueType *,
+                                                       unsigned int,
+                                                       SARValueType * const *,
+                                                       OptValueType * const *,
+                                                       std::size_t,
+                                                       unsigned int *) const;
+
+  // Select the implementation of ProcessPair() from the number of bands and the instruction set
+  void
+  SelectImplementation()
+  {
+    if (m_SARNbBands == 2 && m_OptNbBands == 4)
+      m_ProcessPairFunction = GetProcessPairFunction<2, 4>();
+    else if (m_SARNbBands == 2 && m_OptNbBands == 6)
+      m_ProcessPairFunction = GetProcessPairFunction<2, 6>();
+    else
+      m_ProcessPairFunction = GetProcessPairFunction<0, 0>();
+  }
+
+  // Select the code path from the instruction set
+  template <unsigned int VSARNbBands, unsigned int VOptNbBands>
+  ProcessPairFunctionType
+  GetProcessPairFunction() const
+  {
+#ifdef OTB_DECLOUD_SIMD_X86
+    if (m_InstructionSet == simd::AVX512)
+      return &Self::template ProcessPairAVX512<VSARNbBands, VOptNbBands>;
+    if (m_InstructionSet == simd::AVX2)
+      return &Self::template ProcessPairAVX2<VSARNbBands, VOptNbBands>;
+#endif
+    return &Self::template ProcessPairImpl<simd::ScalarOps<SARValueType>,
+                                           simd::ScalarOps<OptValueType>,
+                                           VSARNbBands,
+                                           VOptNbBands>;
+  }
+
+#ifdef OTB_DECLOUD_SIMD_X86
+  template <unsigned int VSARNbBands, unsigned int VOptNbBands>
+  OTB_DECLOUD_TARGET_AVX2 std::size_t
+  ProcessPairAVX2(const SARValueType *   sarPix,
+                  unsigned int           sarStride,
+                  const OptValueType *   optPix,
+                  unsigned int           optStride,
+                  SARValueType * const * sarOut,
+                  OptValueType * const * optOut,
+                  std::size_t            nbPixels,
+                  unsigned int *         filled) const
+  {
+    if (VSARNbBands > 0)
+      return ProcessPairBlocks<typename simd::AVX2BlockOpsFor<SARValueType>::Type,
+                               typename simd::AVX2BlockOpsFor<OptValueType>::Type,
+                               VSARNbBands,
+                               VOptNbBands>(sarPix, sarStride, optPix, optStride, sarOut, optOut, nbPixels, filled);
+    return ProcessPairImpl<typename simd::AVX2OpsFor<SARValueType>::Type,
+                           typename simd::AVX2OpsFor<OptValueType>::Type,
+                           VSARNbBands,
+                           VOptNbBands>(sarPix, sarStride, optPix, optStride, sarOut, optOut, nbPixels, filled);
+  }
+
+  template <unsigned int VSARNbBands, unsigned int VOptNbBands>
+  OTB_DECLOUD_TARGET_AVX512 std::size_t
+  ProcessPairAVX512(const SARValueType *   sarPix,
+                    unsigned int           sarStride,
+                    const OptValueType *   optPix,
+                    unsigned int           optStride,
+                    SARValueType * const * sarOut,
+                    OptValueType * const * optOut,
+                    std::size_t            nbPixels,
+                    unsigned int *         filled) const
+  {
+    if (VSARNbBands > 0)
+      return ProcessPairBlocks<typename simd::AVX512BlockOpsFor<SARValueType>::Type,
+                               typename simd::AVX512BlockOpsFor<OptValueType>::Type,
+                               VSARNbBands,
+                               VOptNbBands>(sarPix, sarStride, optPix, optStride, sarOut, optOut, nbPixels, filled);
+    return ProcessPairImpl<typename simd::AVX512OpsFor<SARValueType>::Type,
+                           typename simd::AVX512OpsFor<OptValueType>::Type,
+                           VSARNbBands,
+                           VOptNbBands>(sarPix, sarStride, optPix, optStride, sarOut, optOut, nbPixels, filled);
+  }
+#endif
+
+  // Kernel body, for given sets of operations on SAR and optical pixels bands (IsNoData and Copy).
+  // VSARNbBands and VOptNbBands are the numbers of bands known at compile time (0: runtime number of bands).
+  template <class TSAROps, class TOptOps, unsigned int VSARNbBands, unsigned int VOptNbBands>
+  inline std::size_t
+  ProcessPairImpl(const SARValueType *   sarPix,
+                  unsigned int           sarStride,
+                  const OptValueType *   optPix,
+                  unsigned int           optStride,
+                  SARValueType * const * sarOut,
+                  OptValueType * const * optOut,
+                  std::size_t            nbPixels,
+                  unsigned int *         filled) const
+  {
+    const unsigned int sarNbBands = VSARNbBands > 0 ? VSARNbBands : m_SARNbBands;
+    const unsigned int optNbBands = VOptNbBands > 0 ? VOptNbBands : m_OptNbBands;
+    std::size_t        nbResolved = 0;
+    for (std::size_t k = 0; k < nbPixels; k++, sarPix += sarStride, optPix += optStride)
+    {
+      unsigned int & n = filled[k];
+      if (n == m_NbOutputImages)
+        continue;
+
+      // Copy SAR and optical pixels in the output pixels if both pixels are not no-data
+      if (!TSAROps::IsNoData(sarPix, sarNbBands, m_SARNoDataValue) &&
+          (optNbBands == 0 || !TOptOps::IsNoData(optPix, optNbBands, m_OptNoDataValue)))
+      {
+        TSAROps::Copy(sarOut[n] + k * sarNbBands, sarPix, sarNbBands);
+        TOptOps::Copy(optOut[n] + k * optNbBands, optPix, optNbBands);
+        n++;
+        if (n == m_NbOutputImages)
+          nbResolved++;
+      }
+    }
+    return nbResolved;
+  }
+
+  // Kernel body of the specialized layouts, for given block operations on SAR and optical pixels (GetDataBits). The
+  // no-data tests of the pixels are vectorized for blocks of simd::BLOCK_SIZE pixels, and the valid pixels of a block
+  // are copied one after the other. Pixels after the last whole block, and pixels which are not contiguous (e.g.
+  // stacked input pixels), are processed by the pixel-wise kernel body.
+  template <class TSARBlockOps, class TOptBlockOps, unsigned int VSARNbBands, unsigned int VOptNbBands>
+  inline std::size_t
+  ProcessPairBlocks(const SARValueType *   sarPix,
+                    unsigned int           sarStride,
+                    const OptValueType *   optPix,
+                    unsigned int           optStride,
+                    SARValueType * const * sarOut,
+                    OptValueType * const * optOut,
+                    std::size_t            nbPixels,
+                    unsigned int *         filled) const
+  {
+    typedef simd::ScalarOps<SARValueType> SAROps;
+    typedef simd::ScalarOps<OptValueType> OptOps;
+    const unsigned int                    blockSize = simd::BLOCK_SIZE;
+    if (sarStride != VSARNbBands || optStride != VOptNbBands)
+      return ProcessPairImpl<SAROps, OptOps, VSARNbBands, VOptNbBands>(
+        sarPix, sarStride, optPix, optStride, sarOut, optOut, nbPixels, filled);
+
+    std::size_t nbResolved = 0;
+    std::size_t k = 0;
+    for (; k + blockSize <= nbPixels; k += blockSize)
+    {
+      // Pixels of the block which are not resolved yet
+      unsigned int pending = 0;
+      for (unsigned int j = 0; j < blockSize; j++)
+        pending |= static_cast<unsigned int>(filled[k + j] != m_NbOutputImages) << j;
+      if (pending == 0)
+        continue;
+
+      // Pixels of the block for which both SAR and optical pixels are not no-data
+      const SARValueType * sarBlock = sarPix + k * VSARNbBands;
+      const OptValueType * optBlock = optPix + k * VOptNbBands;
+      unsigned int         valid = pending & simd::GetPixelBits<VSARNbBands>(TSARBlockOps::GetDataBits(
+                                       sarBlock, blockSize * VSARNbBands, m_SARNoDataValue));
+      if (valid != 0)
+        valid &= simd::GetPixelBits<VOptNbBands>(
+          TOptBlockOps::GetDataBits(optBlock, blockSize * VOptNbBands, m_OptNoDataValue));
+
+      // Copy the whole block when all its pixels are valid and go to the same output slot, otherwise copy the valid
+      // pixels one after the other
+      const unsigned int n = filled[k];
+      if (valid == (1u << blockSize) - 1 &&
+          std::all_of(filled + k, filled + k + blockSize, [n](unsigned int other) { return other == n; }))
+      {
+        std::copy(sarBlock, sarBlock + blockSize * VSARNbBands, sarOut[n] + k * VSARNbBands);
+        std::copy(optBlock, optBlock + blockSize * VOptNbBands, optOut[n] + k * VOptNbBands);
+        std::fill(filled + k, filled + k + blockSize, n + 1);
+        if (n + 1 == m_NbOutputImages)
+          nbResolved += blockSize;
+        continue;
+      }
+      for (; valid != 0; valid &= valid - 1)
+        nbResolved +=
+          CopyPixel<VSARNbBands, VOptNbBands>(k + __builtin_ctz(valid), sarPix, optPix, sarOut, optOut, filled);
+    }
+
+    // Pixels after the last whole block
+    for (; k < nbPixels; k++)
+      if (filled[k] != m_NbOutputImages &&
+          !SAROps::IsNoData(sarPix + k * VSARNbBands, VSARNbBands, m_SARNoDataValue) &&
+          !OptOps::IsNoData(optPix + k * VOptNbBands, VOptNbBands, m_OptNoDataValue))
+        nbResolved += CopyPixel<VSARNbBands, VOptNbBands>(k, sarPix, optPix, sarOut, optOut, filled);
+    return nbResolved;
+  }
+
+  // Copy the valid SAR and optical pixels #k of contiguous pixels in their output pixels. Returns 1 if the pixel is
+  // resolved, 0 otherwise.
+  template <unsigned int VSARNbBands, unsigned int VOptNbBands>
+  inline std::size_t
+  CopyPixel(std::size_t            k,
+            const SARValueType *   sarPix,
+            const OptValueType *   optPix,
+            SARValueType * const * sarOut,
+            OptValueType * const * optOut,
+            unsigned int *         filled) const
+  {
+    unsigned int & n = filled[k];
+    std::copy(sarPix + k * VSARNbBands, sarPix + (k + 1) * VSARNbBands, sarOut[n] + k * VSARNbBands);
+    std::copy(optPix + k * VOptNbBands, optPix + (k + 1) * VOptNbBands, optOut[n] + k * VOptNbBands);
+    n++;
+    return n == m_NbOutputImages ? 1 : 0;
+  }
+
+  unsigned int         m_NbOutputImages;
+  IndicesPairListType  m_Pairs;
+  unsigned int         m_SARNbBands;
+  unsigned int         m_OptNbBands;
+  SARValueType         m_SARNoDataValue;
+  OptValueType         m_OptNoDataValue;
+  simd::InstructionSet m_InstructionSet;
+
+  ProcessPairFunctionType m_ProcessPairFunction;
+}; // TimeSeriesDrillingKernel
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,374 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTimeSeriesDrillingSIMD_h
+#define otbTimeSeriesDrillingSIMD_h
+
+#include <algorithm>
+#include <cstdint>
+
+// x86 vectorized code paths are compiled with function-level target attributes, so that the module can be built
+// without any -m flag and still run on CPUs without AVX2/AVX-512 (the instruction set is selected at runtime).
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OTB_DECLOUD_SIMD_X86 1
+#include <immintrin.h>
+#define OTB_DECLOUD_TARGET_AVX2 __attribute__((target("avx2"), flatten))
+#define OTB_DECLOUD_TARGET_AVX512 __attribute__((target("avx512f"), flatten))
+#define OTB_DECLOUD_INLINE_AVX2 __attribute__((target("avx2"))) inline
+#define OTB_DECLOUD_INLINE_AVX512 __attribute__((target("avx512f"))) inline
+#endif
+
+namespace otb
+{
+namespace simd
+{
+
+// Instruction sets of the drilling kernel
+enum InstructionSet
+{
+  SCALAR, // Portable scalar code
+  AVX2,   // 256 bits vectors
+  AVX512, // 512 bits vectors (AVX-512F)
+  AUTO    // Best instruction set supported by the CPU (runtime dispatch)
+};
+
+// Returns the best instruction set supported by the running CPU
+inline InstructionSet
+GetBestInstructionSet()
+{
+#ifdef OTB_DECLOUD_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return AVX2;
+#endif
+  return SCALAR;
+}
+
+// Tell if the running CPU supports an instruction set
+inline bool
+IsSupported(InstructionSet is)
+{
+  return is == SCALAR || is == AUTO || is <= GetBestInstructionSet();
+}
+
+// Returns the instruction set that will actually be used when "is" is requested: AUTO and unsupported instruction
+// sets fall back to the best one supported by the CPU (the scalar code on other CPUs)
+inline InstructionSet
+Resolve(InstructionSet is)
+{
+  if (is == AUTO || !IsSupported(is))
+    return GetBestInstructionSet();
+  return is;
+}
+
+inline const char *
+GetName(InstructionSet is)
+{
+  switch (is)
+  {
+    case AVX2:
+      return "AVX2";
+    case AVX512:
+      return "AVX-512";
+    case AUTO:
+      return "auto";
+    default:
+      return "scalar";
+  }
+}
+
+/**
+ * Scalar operations on the bands of one pixel
+ */
+template <class TValue>
+struct ScalarOps
+{
+  // Tell if the n values are all equal to noDataValue
+  static inline bool
+  IsNoData(const TValue * pix, const unsigned int n, const TValue noDataValue)
+  {
+    for (unsigned int i = 0; i < n; i++)
+      if (pix[i] != noDataValue)
+        return false;
+    return true;
+  }
+
+  // Copy the n values of src in dst
+  static inline void
+  Copy(TValue * dst, const TValue * src, const unsigned int n)
+  {
+    std::copy(src, src + n, dst);
+  }
+};
+
+// Number of consecutive pixels of the blocks processed by the block operations
+const unsigned int BLOCK_SIZE = 8;
+
+/**
+ * Scalar operations on the values of a block of consecutive pixels (reference of the vectorized block operations)
+ */
+template <class TValue>
+struct ScalarBlockOps
+{
+  // Bit #i is set if the value #i differs from noDataValue, for the n values of a block (n <= 64)
+  static inline std::uint64_t
+  GetDataBits(const TValue * values, const unsigned int n, const TValue noDataValue)
+  {
+    std::uint64_t bits = 0;
+    for (unsigned int i = 0; i < n; i++)
+      if (values[i] != noDataValue)
+        bits |= std::uint64_t(1) << i;
+    return bits;
+  }
+};
+
+// Bit #j is set if one of the VNbBands bits of the pixel #j of a block is set in bits (see GetDataBits())
+template <unsigned int VNbBands>
+inline unsigned int
+GetPixelBits(const std::uint64_t bits)
+{
+  unsigned int pixelBits = 0;
+  for (unsigned int j = 0; j < BLOCK_SIZE; j++)
+    if ((bits >> (j * VNbBands)) & ((std::uint64_t(1) << VNbBands) - 1))
+      pixelBits |= 1u << j;
+  return pixelBits;
+}
+
+#ifdef OTB_DECLOUD_SIMD_X86
+
+/**
+ * AVX2 operations on the values of a block of consecutive float pixels: the values of several pixels are compared
+ * with no-data in each vector. n must be a multiple of 8. Comparisons are unordered, like in AVX2Ops.
+ */
+struct AVX2FloatBlockOps
+{
+  static OTB_DECLOUD_INLINE_AVX2 std::uint64_t
+  GetDataBits(const float * values, const unsigned int n, const float noDataValue)
+  {
+    const __m256  nd = _mm256_set1_ps(noDataValue);
+    std::uint64_t bits = 0;
+    for (unsigned int i = 0; i < n; i += 8)
+    {
+      const __m256 neq = _mm256_cmp_ps(_mm256_loadu_ps(values + i), nd, _CMP_NEQ_UQ);
+      bits |= static_cast<std::uint64_t>(static_cast<unsigned int>(_mm256_movemask_ps(neq))) << i;
+    }
+    return bits;
+  }
+};
+
+/**
+ * AVX2 operations on the values of a block of consecutive 16 bits integer pixels (int16 or uint16): the values of
+ * several pixels are compared with no-data in each vector. n must be a multiple of 16.
+ */
+template <class TValue>
+struct AVX2Int16BlockOps
+{
+  static OTB_DECLOUD_INLINE_AVX2 std::uint64_t
+  GetDataBits(const TValue * values, const unsigned int n, const TValue noDataValue)
+  {
+    const __m256i nd = _mm256_set1_epi16(static_cast<short>(noDataValue));
+    std::uint64_t bits = 0;
+    unsigned int  i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+      // Pack the 16 bits comparisons of 32 values in 8 bits, in the order of the values
+      const __m256i eq0 = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i)), nd);
+      const __m256i eq1 =
+        _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i + 16)), nd);
+      const __m256i eq = _mm256_permute4x64_epi64(_mm256_packs_epi16(eq0, eq1), 0xD8);
+      bits |= static_cast<std::uint64_t>(~static_cast<unsigned int>(_mm256_movemask_epi8(eq))) << i;
+    }
+    if (i < n)
+    {
+      const __m256i eq0 = _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i)), nd);
+      const __m256i eq = _mm256_permute4x64_epi64(_mm256_packs_epi16(eq0, _mm256_setzero_si256()), 0xD8);
+      bits |= static_cast<std::uint64_t>(~static_cast<unsigned int>(_mm256_movemask_epi8(eq)) & 0xFFFFu) << i;
+    }
+    return bits;
+  }
+};
+
+/**
+ * AVX-512 operations on the values of a block of consecutive float pixels (see AVX2FloatBlockOps). n must be a
+ * multiple of 16.
+ */
+struct AVX512FloatBlockOps
+{
+  static OTB_DECLOUD_INLINE_AVX512 std::uint64_t
+  GetDataBits(const float * values, const unsigned int n, const float noDataValue)
+  {
+    const __m512  nd = _mm512_set1_ps(noDataValue);
+    std::uint64_t bits = 0;
+    for (unsigned int i = 0; i < n; i += 16)
+      bits |= static_cast<std::uint64_t>(_mm512_cmp_ps_mask(_mm512_loadu_ps(values + i), nd, _CMP_NEQ_UQ)) << i;
+    return bits;
+  }
+};
+
+/**
+ * AVX2 operations on the bands of one float pixel.
+ * The remainder of the bands is processed with masked loads/stores, so that no value outside the pixel is read or
+ * written. Comparisons are unordered (NaN is never no-data), like the scalar operator!=.
+ */
+struct AVX2Ops
+{
+  // Mask of the r first lanes
+  static OTB_DECLOUD_INLINE_AVX2 __m256i
+  Mask(const unsigned int r)
+  {
+    static const int table[16] = { -1, -1, -1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0 };
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(table + 8 - r));
+  }
+
+  static OTB_DECLOUD_INLINE_AVX2 bool
+  IsNoData(const float * pix, const unsigned int n, const float noDataValue)
+  {
+    const __m256 nd = _mm256_set1_ps(noDataValue);
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8)
+      if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(pix + i), nd, _CMP_NEQ_UQ)))
+        return false;
+    if (i < n)
+    {
+      const unsigned int r = n - i;
+      const __m256       v = _mm256_maskload_ps(pix + i, Mask(r));
+      if (_mm256_movemask_ps(_mm256_cmp_ps(v, nd, _CMP_NEQ_UQ)) & ((1 << r) - 1))
+        return false;
+    }
+    return true;
+  }
+
+  static OTB_DECLOUD_INLINE_AVX2 void
+  Copy(float * dst, const float * src, const unsigned int n)
+  {
+    unsigned int i = 0;
+    for (; i + 8 <= n; i += 8)
+      _mm256_storeu_ps(dst + i, _mm256_loadu_ps(src + i));
+    if (i < n)
+    {
+      const __m256i mask = Mask(n - i);
+      _mm256_maskstore_ps(dst + i, mask, _mm256_maskload_ps(src + i, mask));
+    }
+  }
+};
+
+/**
+ * AVX-512 operations on the bands of one float pixel (see AVX2Ops).
+ */
+struct AVX512Ops
+{
+  static OTB_DECLOUD_INLINE_AVX512 bool
+  IsNoData(const float * pix, const unsigned int n, const float noDataValue)
+  {
+    const __m512 nd = _mm512_set1_ps(noDataValue);
+    unsigned int i = 0;
+    for (; i + 16 <= n; i += 16)
+      if (_mm512_cmp_ps_mask(_mm512_loadu_ps(pix + i), nd, _CMP_NEQ_UQ))
+        return false;
+    if (i < n)
+    {
+      const __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1);
+      if (_mm512_mask_cmp_ps_mask(mask, _mm512_maskz_loadu_ps(mask, pix + i), nd, _CMP_NEQ_UQ))
+        return false;
+    }
+    return true;
+  }
+
+  static OTB_DECLOUD_INLINE_AVX512 void
+  Copy(float * dst, const float * src, const unsigned int n)
+  {
+    unsigned int i = 0;
+    for (; i + 16 <= n; i += 16)
+      _mm512_storeu_ps(dst + i, _mm512_loadu_ps(src + i));
+    if (i < n)
+    {
+      const __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1);
+      _mm512_mask_storeu_ps(dst + i, mask, _mm512_maskz_loadu_ps(mask, src + i));
+    }
+  }
+};
+
+/**
+ * Operations used for a value type in the AVX2 and AVX-512 code paths: vectorized operations for float values, and
+ * scalar operations (compiled for the target instruction set) for other value types.
+ */
+template <class TValue>
+struct AVX2OpsFor
+{
+  typedef ScalarOps<TValue> Type;
+};
+
+template <>
+struct AVX2OpsFor<float>
+{
+  typedef AVX2Ops Type;
+};
+
+template <class TValue>
+struct AVX512OpsFor
+{
+  typedef ScalarOps<TValue> Type;
+};
+
+template <>
+struct AVX512OpsFor<float>
+{
+  typedef AVX512Ops Type;
+};
+
+/**
+ * Block operations used for a value type in the AVX2 and AVX-512 code paths: vectorized operations for float and
+ * 16 bits integer values (AVX-512F has no 16 bits comparisons: AVX2 ones are used), and scalar operations for other
+ * value types.
+ */
+template <class TValue>
+struct AVX2BlockOpsFor
+{
+  typedef ScalarBlockOps<TValue> Type;
+};
+
+template <>
+struct AVX2BlockOpsFor<float>
+{
+  typedef AVX2FloatBlockOps Type;
+};
+
+template <>
+struct AVX2BlockOpsFor<std::int16_t>
+{
+  typedef AVX2Int16BlockOps<std::int16_t> Type;
+};
+
+template <>
+struct AVX2BlockOpsFor<std::uint16_t>
+{
+  typedef AVX2Int16BlockOps<std::uint16_t> Type;
+};
+
+template <class TValue>
+struct AVX512BlockOpsFor
+{
+  typedef typename AVX2BlockOpsFor<TValue>::Type Type;
+};
+
+template <>
+struct AVX512BlockOpsFor<float>
+{
+  typedef AVX512FloatBlockOps Type;
+};
+
+#endif // OTB_DECLOUD_SIMD_X86
+
+} // end namespace simd
+} // end namespace otb
+
+#endif
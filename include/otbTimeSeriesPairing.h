@@ -0,0 +1,136 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbTimeSeriesPairing_h
+#define otbTimeSeriesPairing_h
+
+#include "otbTemporalIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace otb
+{
+
+// Structure to store one timestamp and one index
+template <class TimestampType>
+struct TimestampWithIndex
+{
+  TimestampType timestamp;
+  unsigned int  index;
+};
+
+// Sorting modes of the optical images of the pairs
+enum SortMode
+{
+  ASC, // Ascending order
+  DES, // Descending order
+  ABS  // Ascending order computed from the abs(t-tref)
+};
+
+/**
+ * \class TimeSeriesPairing
+ *
+ * \brief Pairs of SAR and optical images of a time series, formed from the images timestamps.
+ *
+ * The optical images are sorted (ascending or descending order, or closest first to a reference date), then each
+ * optical image is paired with the SAR images within the maximum gap of its date, from the closest to the farthest.
+ * The pairs are the input of TimeSeriesDrillingKernel.
+ *
+ * This is the pairing of DecloudTimeSeriesPreProcessor. It only depends on the standard library, so that it is
+ * shared with the Python bindings of the module.
+ *
+ * \ingroup OTBDecloud
+ */
+class TimeSeriesPairing
+{
+public:
+  typedef TemporalIndex::TimestampType          TimestampType;
+  typedef TemporalIndex::TimestampListType      TimestampListType;
+  typedef TimestampWithIndex<TimestampType>     TimestampWithIndexType;
+  typedef std::vector<TimestampWithIndexType>   TimestampWithIndexList;
+  typedef std::pair<unsigned int, unsigned int> IndicesPairType;
+  typedef std::vector<IndicesPairType>          IndicesPairListType;
+
+  // Timestamps with their indices in the list
+  static TimestampWithIndexList
+  GetTimestampsWithIndices(const TimestampListType & timestamps)
+  {
+    TimestampWithIndexList ts;
+    for (unsigned int i = 0; i < timestamps.size(); i++)
+      ts.push_back({ timestamps[i], i });
+    return ts;
+  }
+
+  // Sort the elements from the timestamp (stable: elements with the same key keep their order)
+  static void
+  SortTimestampsWithIndices(TimestampWithIndexList & ts, SortMode sortMode, TimestampType refTimestamp)
+  {
+    if (sortMode == ASC)
+      std::stable_sort(ts.begin(), ts.end(), [](const TimestampWithIndexType & a, const TimestampWithIndexType & b) {
+        return a.timestamp < b.timestamp;
+      });
+    else if (sortMode == DES)
+      std::stable_sort(ts.begin(), ts.end(), [](const TimestampWithIndexType & a, const TimestampWithIndexType & b) {
+        return a.timestamp > b.timestamp;
+      });
+    else if (sortMode == ABS)
+      std::stable_sort(
+        ts.begin(), ts.end(), [refTimestamp](const TimestampWithIndexType & a, const TimestampWithIndexType & b) {
+          return std::abs(a.timestamp - refTimestamp) < std::abs(b.timestamp - refTimestamp);
+        });
+  }
+
+  // Temporal index of a list of timestamps: the indices of the index are the positions in the list
+  static TemporalIndex
+  GetTemporalIndex(const TimestampWithIndexList & ts)
+  {
+    TimestampListType timestamps;
+    for (const auto & tsWithIdx : ts)
+      timestamps.push_back(tsWithIdx.timestamp);
+    return TemporalIndex(timestamps);
+  }
+
+  /**
+   * Returns the pairs of SAR and optical images indices, formed from SAR and optical images timestamps
+   * sarTsWithIdxList, optTsWithIdxList: timestamps and indices of the SAR and optical images
+   * sortMode, refTimestamp: sorting strategy of the optical images
+   * maxGap: maximum gap between the SAR and the optical images of a pair
+   */
+  static IndicesPairListType
+  GetCandidatesPairs(const TimestampWithIndexList & sarTsWithIdxList,
+                     TimestampWithIndexList         optTsWithIdxList,
+                     SortMode                       sortMode,
+                     TimestampType                  refTimestamp,
+                     TimestampType                  maxGap)
+  {
+    SortTimestampsWithIndices(optTsWithIdxList, sortMode, refTimestamp);
+
+    // For each optical image, the SAR images satisfying the maxgap, from the closest to the farthest. They are found
+    // in a single sweep over the sorted SAR timestamps
+    TimestampListType optTimestamps;
+    for (const auto & optTsWithIdx : optTsWithIdxList)
+      optTimestamps.push_back(optTsWithIdx.timestamp);
+    const std::vector<TemporalIndex::IndexListType> windows =
+      GetTemporalIndex(sarTsWithIdxList).GetWindows(optTimestamps, maxGap);
+
+    IndicesPairListType indicesPairs;
+    for (unsigned int i = 0; i < optTsWithIdxList.size(); i++)
+      for (const auto sarPos : windows[i])
+        indicesPairs.push_back({ sarTsWithIdxList[sarPos].index, optTsWithIdxList[i].index });
+    return indicesPairs;
+  }
+
+}; // end class
+
+} // end namespace otb
+
+#endif
@@ -0,0 +1,329 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef otbValidityBitmap_h
+#define otbValidityBitmap_h
+
+#include "otbImageFootprint.h"
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define OTB_DECLOUD_MMAP
+#endif
+
+namespace otb
+{
+
+/**
+ * \class ValidityBitmap
+ *
+ * \brief Validity of each pixel of an image, packed in one bit per pixel.
+ *
+ * A pixel is valid if at least one of its bands is different from the no-data value. Each row of the image is
+ * stored in 64 bits words (bit x%64 of the word x/64 is the validity of the column x), so that a bitmap is 16 times
+ * smaller than a single 16 bits band, and a test of the validity of a pixel never decodes the image.
+ *
+ * Bitmaps can be saved to a binary file: a 64 bytes header (magic number, extent, no-data value) followed by the
+ * rows. Loaded bitmaps are memory-mapped when the platform supports it, so that only the rows which are tested are
+ * actually read from the file.
+ *
+ * \ingroup OTBDecloud
+ */
+class ValidityBitmap
+{
+public:
+  typedef std::uint64_t WordType;
+
+  ValidityBitmap()
+    : m_OriginX(0)
+    , m_OriginY(0)
+    , m_SizeX(0)
+    , m_SizeY(0)
+    , m_WordsPerRow(0)
+    , m_NoDataValue(0)
+    , m_Words(nullptr)
+    , m_Map(nullptr)
+    , m_MapSize(0)
+  {}
+
+  ~ValidityBitmap()
+  {
+    Unmap();
+  }
+
+  // Initialize a bitmap without valid pixel for the image extent
+  void
+  Initialize(long originX, long originY, unsigned long sizeX, unsigned long sizeY, double noDataValue)
+  {
+    Unmap();
+    m_OriginX = originX;
+    m_OriginY = originY;
+    m_SizeX = sizeX;
+    m_SizeY = sizeY;
+    m_WordsPerRow = (sizeX + 63) / 64;
+    m_NoDataValue = noDataValue;
+    m_Buffer.assign(m_WordsPerRow * sizeY, 0);
+    m_Words = m_Buffer.data();
+  }
+
+  // Tell if the bitmap has been computed (or loaded)
+  bool
+  IsDefined() const
+  {
+    return m_Words != nullptr;
+  }
+
+  // Tell if the bitmap has been computed for the given image extent and no-data value
+  bool
+  Matches(long originX, long originY, unsigned long sizeX, unsigned long sizeY, double noDataValue) const
+  {
+    return IsDefined() && m_OriginX == originX && m_OriginY == originY && m_SizeX == sizeX && m_SizeY == sizeY &&
+           m_NoDataValue == noDataValue;
+  }
+
+  // Flag the pixel (x, y) as valid (only for initialized bitmaps). Rows are stored in separate words: rows can be
+  // set from different threads.
+  void
+  SetValid(long x, long y)
+  {
+    m_Buffer[(y - m_OriginY) * m_WordsPerRow + (x - m_OriginX) / 64] |= WordType(1) << ((x - m_OriginX) % 64);
+  }
+
+  bool
+  IsValid(long x, long y) const
+  {
+    return (m_Words[(y - m_OriginY) * m_WordsPerRow + (x - m_OriginX) / 64] >> ((x - m_OriginX) % 64)) & 1;
+  }
+
+  // Number of valid pixels of the image
+  unsigned long
+  GetNumberOfValidPixels() const
+  {
+    unsigned long count = 0;
+    for (unsigned long i = 0; i < m_WordsPerRow * m_SizeY; i++)
+      count += std::bitset<64>(m_Words[i]).count();
+    return count;
+  }
+
+  // Tell if a region (index and size, in pixels) has at least one valid pixel
+  bool
+  Intersects(long x, long y, unsigned long sizeX, unsigned long sizeY) const
+  {
+    if (!IsDefined())
+      return true;
+
+    // Clip the region to the image extent
+    const long startX = std::max(x, m_OriginX) - m_OriginX;
+    const long startY = std::max(y, m_OriginY) - m_OriginY;
+    const long endX = std::min<long>(x + sizeX, m_OriginX + m_SizeX) - m_OriginX; // Excluded
+    const long endY = std::min<long>(y + sizeY, m_OriginY + m_SizeY) - m_OriginY; // Excluded
+    if (startX >= endX || startY >= endY)
+      return false;
+
+    // Bits of the region in the first and the last words of the rows
+    const unsigned long firstWord = startX / 64, lastWord = (endX - 1) / 64;
+    const WordType      firstMask = ~WordType(0) << (startX % 64);
+    const WordType      lastMask = ~WordType(0) >> (63 - (endX - 1) % 64);
+    for (long row = startY; row < endY; row++)
+    {
+      const WordType * words = m_Words + row * m_WordsPerRow;
+      if (firstWord == lastWord)
+      {
+        if (words[firstWord] & firstMask & lastMask)
+          return true;
+        continue;
+      }
+      if ((words[firstWord] & firstMask) || (words[lastWord] & lastMask))
+        return true;
+      for (unsigned long word = firstWord + 1; word < lastWord; word++)
+        if (words[word])
+          return true;
+    }
+    return false;
+  }
+
+  // Number of valid pixels of a region (index and size, in pixels), clipped to the image extent
+  unsigned long
+  GetNumberOfValidPixels(long x, long y, unsigned long sizeX, unsigned long sizeY) const
+  {
+    const long startX = std::max(x, m_OriginX) - m_OriginX;
+    const long startY = std::max(y, m_OriginY) - m_OriginY;
+    const long endX = std::min<long>(x + sizeX, m_OriginX + m_SizeX) - m_OriginX; // Excluded
+    const long endY = std::min<long>(y + sizeY, m_OriginY + m_SizeY) - m_OriginY; // Excluded
+    if (startX >= endX || startY >= endY)
+      return 0;
+
+    const unsigned long firstWord = startX / 64, lastWord = (endX - 1) / 64;
+    const WordType      firstMask = ~WordType(0) << (startX % 64);
+    const WordType      lastMask = ~WordType(0) >> (63 - (endX - 1) % 64);
+    unsigned long       count = 0;
+    for (long row = startY; row < endY; row++)
+    {
+      const WordType * words = m_Words + row * m_WordsPerRow;
+      if (firstWord == lastWord)
+      {
+        count += std::bitset<64>(words[firstWord] & firstMask & lastMask).count();
+        continue;
+      }
+      count += std::bitset<64>(words[firstWord] & firstMask).count();
+      count += std::bitset<64>(words[lastWord] & lastMask).count();
+      for (unsigned long word = firstWord + 1; word < lastWord; word++)
+        count += std::bitset<64>(words[word]).count();
+    }
+    return count;
+  }
+
+  // Footprint of the valid pixels (see ImageFootprint), without reading the image
+  ImageFootprint
+  ToFootprint(unsigned int blockSize) const
+  {
+    ImageFootprint footprint;
+    footprint.Initialize(m_OriginX, m_OriginY, m_SizeX, m_SizeY, blockSize, m_NoDataValue);
+    for (unsigned long by = 0; by * blockSize < m_SizeY; by++)
+      for (unsigned long bx = 0; bx * blockSize < m_SizeX; bx++)
+      {
+        const long x = m_OriginX + bx * blockSize, y = m_OriginY + by * blockSize;
+        if (Intersects(x, y, blockSize, blockSize))
+          footprint.SetValid(x, y);
+      }
+    return footprint;
+  }
+
+  // Save the bitmap in a binary file. Returns false if the file can't be written.
+  bool
+  Save(const std::string & filename) const
+  {
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs)
+      return false;
+    HeaderType header;
+    std::memcpy(header.magic, GetMagic(), sizeof(header.magic));
+    header.originX = m_OriginX;
+    header.originY = m_OriginY;
+    header.sizeX = m_SizeX;
+    header.sizeY = m_SizeY;
+    header.wordsPerRow = m_WordsPerRow;
+    header.noDataValue = m_NoDataValue;
+    header.reserved = 0;
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char *>(m_Words), m_WordsPerRow * m_SizeY * sizeof(WordType));
+    return static_cast<bool>(ofs);
+  }
+
+  // Load the bitmap from a binary file. Returns false if the file can't be read.
+  bool
+  Load(const std::string & filename)
+  {
+    HeaderType header;
+    {
+      std::ifstream ifs(filename, std::ios::binary);
+      if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+          std::memcmp(header.magic, GetMagic(), sizeof(header.magic)) != 0 ||
+          header.wordsPerRow != (header.sizeX + 63) / 64)
+        return false;
+    }
+    const std::size_t dataSize = header.wordsPerRow * header.sizeY * sizeof(WordType);
+
+#ifdef OTB_DECLOUD_MMAP
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    void *      map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(header) + dataSize)
+      map = mmap(nullptr, sizeof(header) + dataSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return false;
+    Unmap();
+    m_Buffer.clear();
+    m_Map = map;
+    m_MapSize = sizeof(header) + dataSize;
+    m_Words = reinterpret_cast<const WordType *>(static_cast<const char *>(map) + sizeof(header));
+#else
+    std::vector<WordType> buffer(header.wordsPerRow * header.sizeY);
+    std::ifstream         ifs(filename, std::ios::binary);
+    if (!ifs.seekg(sizeof(header)) || !ifs.read(reinterpret_cast<char *>(buffer.data()), dataSize))
+      return false;
+    m_Buffer.swap(buffer);
+    m_Words = m_Buffer.data();
+#endif
+
+    m_OriginX = header.originX;
+    m_OriginY = header.originY;
+    m_SizeX = header.sizeX;
+    m_SizeY = header.sizeY;
+    m_WordsPerRow = header.wordsPerRow;
+    m_NoDataValue = header.noDataValue;
+    return true;
+  }
+
+private:
+  ValidityBitmap(const ValidityBitmap &);            // purposely not implemented
+  ValidityBitmap & operator=(const ValidityBitmap &); // purposely not implemented
+
+  // Header of the bitmap files (64 bytes, so that the rows are aligned on words)
+  struct HeaderType
+  {
+    char          magic[8];
+    std::int64_t  originX;
+    std::int64_t  originY;
+    std::uint64_t sizeX;
+    std::uint64_t sizeY;
+    std::uint64_t wordsPerRow;
+    double        noDataValue;
+    std::uint64_t reserved;
+  };
+
+  // Magic number of the bitmap files
+  static const char *
+  GetMagic()
+  {
+    return "DCLDVAL1";
+  }
+
+  void
+  Unmap()
+  {
+#ifdef OTB_DECLOUD_MMAP
+    if (m_Map != nullptr)
+      munmap(m_Map, m_MapSize);
+#endif
+    m_Map = nullptr;
+    m_MapSize = 0;
+    m_Words = nullptr;
+  }
+
+  long                  m_OriginX;
+  long                  m_OriginY;
+  unsigned long         m_SizeX;
+  unsigned long         m_SizeY;
+  unsigned long         m_WordsPerRow;
+  double                m_NoDataValue;
+  std::vector<WordType> m_Buffer; // Rows of the bitmap, when it is not memory-mapped
+  const WordType *      m_Words;  // Rows of the bitmap (buffer, or mapped file)
+  void *                m_Map;    // Mapped file
+  std::size_t           m_MapSize;
+
+}; // end class
+
+} // end namespace otb
+
+#endif
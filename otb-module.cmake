@@ -4,6 +4,7 @@ set(DOCUMENTATION "Remote clouds in optical imagery")
 otb_module(OTBDecloud
   DEPENDS
     OTBTensorflow
+    OTBGDAL
   TEST_DEPENDS
     OTBTestKernel
     OTBCommandLine
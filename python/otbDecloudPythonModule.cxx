@@ -0,0 +1,435 @@
+/*=========================================================================
+
+     Copyright (c) INRAE 2020-2022. All rights reserved.
+
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "otbTimeSeriesDrillingKernel.h"
+#include "otbTimeSeriesPairing.h"
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+/**
+ * Python bindings of the pairing and of the drilling of the time series pre-processing (module "decloud_core").
+ *
+ * Images are exchanged through the buffer protocol, without copy: the inputs are read, and the outputs written, in
+ * the memory of the Python objects (e.g. numpy arrays). Images stacks are C-contiguous arrays of shape
+ * (images, rows, cols, bands), of float32, uint16 or int16 values. The GIL is released while drilling.
+ *
+ * The Python API is the decloud.core.timeseries module.
+ */
+
+namespace
+{
+
+typedef otb::TimeSeriesPairing PairingType;
+
+// Buffer of a Python object, released at destruction
+class Buffer
+{
+public:
+  Buffer()
+    : m_Acquired(false)
+  {}
+
+  ~Buffer()
+  {
+    if (m_Acquired)
+      PyBuffer_Release(&m_View);
+  }
+
+  // Get the C-contiguous buffer of an object. Returns false (with a Python exception set) on failure.
+  bool
+  Acquire(PyObject * obj, bool writable)
+  {
+    const int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+    m_Acquired = PyObject_GetBuffer(obj, &m_View, flags) == 0;
+    if (m_Acquired && m_View.ndim < 2)
+    {
+      PyErr_SetString(PyExc_ValueError, "images stacks must have at least 2 dimensions (images, ..., bands)");
+      return false;
+    }
+    return m_Acquired;
+  }
+
+  // Value type, as a struct module format character ('f', 'H', 'h'), without byte order prefix
+  char
+  GetFormat() const
+  {
+    const char * format = m_View.format != nullptr ? m_View.format : "B";
+    while (*format == '@' || *format == '=')
+      format++;
+    return format[1] == '\0' ? format[0] : '\0';
+  }
+
+  // Number of images of the stack, of pixels of each image, and of bands of each pixel
+  Py_ssize_t
+  GetNumberOfImages() const
+  {
+    return m_View.shape[0];
+  }
+  Py_ssize_t
+  GetNumberOfPixels() const
+  {
+    Py_ssize_t nbPixels = 1;
+    for (int dim = 1; dim < m_View.ndim - 1; dim++)
+      nbPixels *= m_View.shape[dim];
+    return nbPixels;
+  }
+  Py_ssize_t
+  GetNumberOfBands() const
+  {
+    return m_View.shape[m_View.ndim - 1];
+  }
+
+  template <class TValue>
+  TValue *
+  GetPointer() const
+  {
+    return static_cast<TValue *>(m_View.buf);
+  }
+
+private:
+  Buffer(const Buffer &);             // purposely not implemented
+  Buffer & operator=(const Buffer &); // purposely not implemented
+
+  Py_buffer m_View;
+  bool      m_Acquired;
+};
+
+// Read a sequence of timestamps. Returns false (with a Python exception set) on failure.
+bool
+GetTimestamps(PyObject * obj, PairingType::TimestampListType & timestamps)
+{
+  PyObject * seq = PySequence_Fast(obj, "timestamps must be a sequence of numbers");
+  if (seq == nullptr)
+    return false;
+  const Py_ssize_t size = PySequence_Fast_GET_SIZE(seq);
+  timestamps.resize(size);
+  for (Py_ssize_t i = 0; i < size; i++)
+    timestamps[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+  Py_DECREF(seq);
+  return !PyErr_Occurred();
+}
+
+// Read a sequence of pairs of indices. Returns false (with a Python exception set) on failure.
+bool
+GetPairs(PyObject * obj, PairingType::IndicesPairListType & pairs)
+{
+  PyObject * seq = PySequence_Fast(obj, "pairs must be a sequence of (SAR index, optical index)");
+  if (seq == nullptr)
+    return false;
+  const Py_ssize_t size = PySequence_Fast_GET_SIZE(seq);
+  pairs.resize(size);
+  for (Py_ssize_t i = 0; i < size && !PyErr_Occurred(); i++)
+  {
+    PyObject * pair = PySequence_Fast(PySequence_Fast_GET_ITEM(seq, i), "pairs must be sequences of 2 indices");
+    if (pair == nullptr)
+      break;
+    Py_ssize_t idx[2] = { -1, -1 };
+    if (PySequence_Fast_GET_SIZE(pair) == 2)
+      for (int j = 0; j < 2; j++)
+        idx[j] = PyNumber_AsSsize_t(PySequence_Fast_GET_ITEM(pair, j), PyExc_OverflowError);
+    Py_DECREF(pair);
+    if (!PyErr_Occurred() && (idx[0] < 0 || idx[1] < 0))
+      PyErr_SetString(PyExc_ValueError, "pairs must be sequences of 2 positive indices");
+    pairs[i] = { static_cast<unsigned int>(idx[0]), static_cast<unsigned int>(idx[1]) };
+  }
+  Py_DECREF(seq);
+  return !PyErr_Occurred();
+}
+
+// List of lists of indices
+PyObject *
+ToList(const std::vector<otb::TemporalIndex::IndexListType> & indices)
+{
+  PyObject * list = PyList_New(indices.size());
+  for (std::size_t i = 0; list != nullptr && i < indices.size(); i++)
+  {
+    PyObject * item = PyList_New(indices[i].size());
+    if (item == nullptr)
+    {
+      Py_CLEAR(list);
+      break;
+    }
+    for (std::size_t j = 0; j < indices[i].size(); j++)
+      PyList_SET_ITEM(item, j, PyLong_FromUnsignedLong(indices[i][j]));
+    PyList_SET_ITEM(list, i, item);
+  }
+  return list;
+}
+
+PyObject *
+CandidatePairs(PyObject *, PyObject * args, PyObject * kwargs)
+{
+  static const char * keywords[] = {
+    "sar_timestamps", "opt_timestamps", "maxgap", "sorting", "reftimestamp", nullptr
+  };
+  PyObject *          sarObj = nullptr;
+  PyObject *          optObj = nullptr;
+  double              maxGap = 0;
+  int                 sortMode = otb::ASC;
+  double              refTimestamp = 0;
+  if (!PyArg_ParseTupleAndKeywords(
+        args, kwargs, "OOd|id", const_cast<char **>(keywords), &sarObj, &optObj, &maxGap, &sortMode, &refTimestamp))
+    return nullptr;
+  if (sortMode < otb::ASC || sortMode > otb::ABS)
+  {
+    PyErr_SetString(PyExc_ValueError, "Wrong sorting mode");
+    return nullptr;
+  }
+
+  PairingType::TimestampListType sarTimestamps, optTimestamps;
+  if (!GetTimestamps(sarObj, sarTimestamps) || !GetTimestamps(optObj, optTimestamps))
+    return nullptr;
+  const PairingType::IndicesPairListType pairs =
+    PairingType::GetCandidatesPairs(PairingType::GetTimestampsWithIndices(sarTimestamps),
+                                    PairingType::GetTimestampsWithIndices(optTimestamps),
+                                    static_cast<otb::SortMode>(sortMode),
+                                    refTimestamp,
+                                    maxGap);
+
+  PyObject * list = PyList_New(pairs.size());
+  for (std::size_t i = 0; list != nullptr && i < pairs.size(); i++)
+  {
+    const unsigned long sarIdx = pairs[i].first, optIdx = pairs[i].second;
+    PyList_SET_ITEM(list, i, Py_BuildValue("(kk)", sarIdx, optIdx));
+  }
+  return list;
+}
+
+PyObject *
+Closest(PyObject *, PyObject * args, PyObject * kwargs)
+{
+  static const char * keywords[] = { "timestamps", "targets", "n", "period", "maxgap", nullptr };
+  PyObject *          tsObj = nullptr;
+  PyObject *          targetsObj = nullptr;
+  Py_ssize_t          n = -1;
+  int                 period = otb::TemporalIndex::ANY;
+  double              maxGap = std::numeric_limits<double>::max();
+  if (!PyArg_ParseTupleAndKeywords(
+        args, kwargs, "OO|nid", const_cast<char **>(keywords), &tsObj, &targetsObj, &n, &period, &maxGap))
+    return nullptr;
+  if (period < otb::TemporalIndex::ANY || period > otb::TemporalIndex::AFTER)
+  {
+    PyErr_SetString(PyExc_ValueError, "Wrong period");
+    return nullptr;
+  }
+
+  PairingType::TimestampListType timestamps, targets;
+  if (!GetTimestamps(tsObj, timestamps) || !GetTimestamps(targetsObj, targets))
+    return nullptr;
+  const otb::TemporalIndex                        index(timestamps);
+  std::vector<otb::TemporalIndex::IndexListType> closest;
+  for (const auto target : targets)
+    closest.push_back(index.GetClosest(target,
+                                       static_cast<otb::TemporalIndex::Period>(period),
+                                       n < 0 ? std::numeric_limits<std::size_t>::max() : n,
+                                       maxGap));
+  return ToList(closest);
+}
+
+// Drill SAR and optical stacks of value types TSARValue and TOptValue, one pair at a time, like
+// TimeSeriesDrillImageFilter does. Without optical stack, pairs are SAR images only.
+template <class TSARValue, class TOptValue>
+void
+Drill(const Buffer &                           sar,
+      const Buffer *                           opt,
+      const PairingType::IndicesPairListType & pairs,
+      const Buffer &                           sarOut,
+      const Buffer *                           optOut,
+      double                                   sarNoData,
+      double                                   optNoData,
+      otb::simd::InstructionSet                instructionSet)
+{
+  const std::size_t  nbPixels = sar.GetNumberOfPixels();
+  const unsigned int nbOutputs = sarOut.GetNumberOfImages();
+  const unsigned int sarNbBands = sar.GetNumberOfBands();
+  const unsigned int optNbBands = opt != nullptr ? opt->GetNumberOfBands() : 0;
+
+  otb::TimeSeriesDrillingKernel<TSARValue, TOptValue> kernel;
+  kernel.SetParameters(pairs,
+                       sarNbBands,
+                       optNbBands,
+                       static_cast<TSARValue>(sarNoData),
+                       static_cast<TOptValue>(optNoData),
+                       nbOutputs);
+  kernel.SetInstructionSet(instructionSet);
+
+  std::vector<TSARValue *> sarSlots(nbOutputs);
+  std::vector<TOptValue *> optSlots(nbOutputs, nullptr);
+  for (unsigned int n = 0; n < nbOutputs; n++)
+  {
+    sarSlots[n] = sarOut.GetPointer<TSARValue>() + n * nbPixels * sarNbBands;
+    if (optOut != nullptr)
+      optSlots[n] = optOut->GetPointer<TOptValue>() + n * nbPixels * optNbBands;
+  }
+
+  std::vector<unsigned int> filled(nbPixels, 0);
+  std::size_t               nbUnresolved = nbPixels;
+  for (auto pair = pairs.begin(); pair != pairs.end() && nbUnresolved > 0; ++pair)
+    nbUnresolved -= kernel.ProcessPair(sar.GetPointer<const TSARValue>() + pair->first * nbPixels * sarNbBands,
+                                       sarNbBands,
+                                       opt != nullptr ? opt->GetPointer<const TOptValue>() +
+                                                          pair->second * nbPixels * optNbBands
+                                                      : nullptr,
+                                       optNbBands,
+                                       sarSlots.data(),
+                                       optSlots.data(),
+                                       nbPixels,
+                                       filled.data());
+  if (nbUnresolved > 0)
+    kernel.FillNoData(sarSlots.data(), optSlots.data(), nbPixels, filled.data());
+}
+
+// Drill, for the optical value type of the stacks
+template <class TSARValue>
+bool
+Drill(char                                     optFormat,
+      const Buffer &                           sar,
+      const Buffer *                           opt,
+      const PairingType::IndicesPairListType & pairs,
+      const Buffer &                           sarOut,
+      const Buffer *                           optOut,
+      double                                   sarNoData,
+      double                                   optNoData,
+      otb::simd::InstructionSet                instructionSet)
+{
+  if (optFormat == 'f')
+    Drill<TSARValue, float>(sar, opt, pairs, sarOut, optOut, sarNoData, optNoData, instructionSet);
+  else if (optFormat == 'H')
+    Drill<TSARValue, std::uint16_t>(sar, opt, pairs, sarOut, optOut, sarNoData, optNoData, instructionSet);
+  else if (optFormat == 'h')
+    Drill<TSARValue, std::int16_t>(sar, opt, pairs, sarOut, optOut, sarNoData, optNoData, instructionSet);
+  else
+    return false;
+  return true;
+}
+
+PyObject *
+DrillStacks(PyObject *, PyObject * args, PyObject * kwargs)
+{
+  static const char * keywords[] = { "sar",        "opt",        "pairs", "sar_out", "opt_out", "sar_nodata",
+                                     "opt_nodata", "simd",       nullptr };
+  PyObject *          sarObj = nullptr;
+  PyObject *          optObj = nullptr;
+  PyObject *          pairsObj = nullptr;
+  PyObject *          sarOutObj = nullptr;
+  PyObject *          optOutObj = nullptr;
+  double              sarNoData = 0;
+  double              optNoData = 0;
+  int                 instructionSet = otb::simd::AUTO;
+  if (!PyArg_ParseTupleAndKeywords(args,
+                                   kwargs,
+                                   "OOOOO|ddi",
+                                   const_cast<char **>(keywords),
+                                   &sarObj,
+                                   &optObj,
+                                   &pairsObj,
+                                   &sarOutObj,
+                                   &optOutObj,
+                                   &sarNoData,
+                                   &optNoData,
+                                   &instructionSet))
+    return nullptr;
+
+  // Without optical stack (None), pairs are SAR images only and there is no optical output
+  const bool                       hasOpt = optObj != Py_None;
+  Buffer                           sar, opt, sarOut, optOut;
+  PairingType::IndicesPairListType pairs;
+  if (!sar.Acquire(sarObj, false) || !sarOut.Acquire(sarOutObj, true) || !GetPairs(pairsObj, pairs))
+    return nullptr;
+  if (hasOpt && (!opt.Acquire(optObj, false) || !optOut.Acquire(optOutObj, true)))
+    return nullptr;
+
+  // Check the stacks
+  std::string error;
+  if (sarOut.GetFormat() != sar.GetFormat() || (hasOpt && optOut.GetFormat() != opt.GetFormat()))
+    error = "outputs must have the value types of the inputs";
+  else if (sarOut.GetNumberOfPixels() != sar.GetNumberOfPixels() ||
+           sarOut.GetNumberOfBands() != sar.GetNumberOfBands() ||
+           (hasOpt && (opt.GetNumberOfPixels() != sar.GetNumberOfPixels() ||
+                       optOut.GetNumberOfPixels() != sar.GetNumberOfPixels() ||
+                       optOut.GetNumberOfBands() != opt.GetNumberOfBands() ||
+                       optOut.GetNumberOfImages() != sarOut.GetNumberOfImages())))
+    error = "inputs and outputs must have the same number of pixels, and outputs the bands of the inputs";
+  for (const auto & pair : pairs)
+    if (pair.first >= sar.GetNumberOfImages() || (hasOpt && pair.second >= opt.GetNumberOfImages()))
+      error = "pair (" + std::to_string(pair.first) + ", " + std::to_string(pair.second) + ") is out of the stacks";
+  if (!error.empty())
+  {
+    PyErr_SetString(PyExc_ValueError, error.c_str());
+    return nullptr;
+  }
+
+  const char sarFormat = sar.GetFormat();
+  const char optFormat = hasOpt ? opt.GetFormat() : sarFormat;
+  const auto is = static_cast<otb::simd::InstructionSet>(instructionSet);
+  bool       supported = false;
+  Py_BEGIN_ALLOW_THREADS;
+  if (sarFormat == 'f')
+    supported = Drill<float>(
+      optFormat, sar, hasOpt ? &opt : nullptr, pairs, sarOut, hasOpt ? &optOut : nullptr, sarNoData, optNoData, is);
+  else if (sarFormat == 'H')
+    supported = Drill<std::uint16_t>(
+      optFormat, sar, hasOpt ? &opt : nullptr, pairs, sarOut, hasOpt ? &optOut : nullptr, sarNoData, optNoData, is);
+  else if (sarFormat == 'h')
+    supported = Drill<std::int16_t>(
+      optFormat, sar, hasOpt ? &opt : nullptr, pairs, sarOut, hasOpt ? &optOut : nullptr, sarNoData, optNoData, is);
+  Py_END_ALLOW_THREADS;
+  if (!supported)
+  {
+    PyErr_SetString(PyExc_TypeError, "values must be float32, uint16 or int16");
+    return nullptr;
+  }
+  Py_RETURN_NONE;
+}
+
+PyMethodDef Methods[] = {
+  { "candidate_pairs",
+    reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(CandidatePairs)),
+    METH_VARARGS | METH_KEYWORDS,
+    "candidate_pairs(sar_timestamps, opt_timestamps, maxgap, sorting=0, reftimestamp=0.0)\n\n"
+    "Pairs (SAR index, optical index) of DecloudTimeSeriesPreProcessor. sorting: 0 (ascending), 1 (descending) or "
+    "2 (closest first to reftimestamp)." },
+  { "closest",
+    reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(Closest)),
+    METH_VARARGS | METH_KEYWORDS,
+    "closest(timestamps, targets, n=-1, period=0, maxgap=inf)\n\n"
+    "For each target, the indices of the (at most n) images the closest to the target, from the closest to the "
+    "farthest. period: 0 (any), 1 (strictly before) or 2 (strictly after)." },
+  { "drill",
+    reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)(void)>(DrillStacks)),
+    METH_VARARGS | METH_KEYWORDS,
+    "drill(sar, opt, pairs, sar_out, opt_out, sar_nodata=0, opt_nodata=0, simd=3)\n\n"
+    "Write in sar_out and opt_out (outputs, rows, cols, bands) the pixels of the first valid pairs of the sar and opt "
+    "stacks (images, rows, cols, bands). opt and opt_out can be None (pairs of SAR images only)." },
+  { nullptr, nullptr, 0, nullptr }
+};
+
+PyModuleDef Module = { PyModuleDef_HEAD_INIT,
+                       "decloud_core",
+                       "Pairing and drilling of the time series pre-processing",
+                       -1,
+                       Methods,
+                       nullptr,
+                       nullptr,
+                       nullptr,
+                       nullptr };
+
+} // namespace
+
+PyMODINIT_FUNC
+PyInit_decloud_core()
+{
+  return PyModule_Create(&Module);
+}
@@ -86,7 +86,7 @@ class InferenceTest(DecloudTest):
         self.compare_images(outpath, baseline_path)
         self.compare_raster_metadata(outpath, baseline_path)
 
-    def test_inference_with_generic_preprocessor(self):
+    def test_inference_with_generic_preprocessor(self, fused=False):
         # Logger
         system.basic_logging_init()
 
@@ -117,12 +117,12 @@ class InferenceTest(DecloudTest):
             self.get_path('baseline/PREPARE/S2_PREPARE/T31TEJ/SENTINEL2B_20201026-103901-924_L2A_T31TEJ_C_V2-2'),
             self.get_path('baseline/PREPARE/S2_PREPARE/T31TEJ/SENTINEL2A_20201024-104859-766_L2A_T31TEJ_C_V2-2/')]
 
-        outpath = '/tmp/reconstructed_w_preprocessor.tif'
+        outpath = '/tmp/reconstructed_w_preprocessor{}.tif'.format('_fused' if fused else '')
         crga_processor.crga_processor(il_s1before=s1_tm1, il_s2before=s2_tm1,
                                       il_s1=s1_t, in_s2=s2_t,
                                       il_s1after=s1_tp1, il_s2after=s2_tp1,
                                       dem=self.get_path('baseline/PREPARE/DEM_PREPARE/T31TEJ.tif'),
-                                      output=outpath, maxgap=48, savedmodel=model_path)
+                                      output=outpath, maxgap=48, savedmodel=model_path, fused=fused)
 
         # Just a dummy test
         self.assertTrue(system.file_exists(outpath))
@@ -130,6 +130,9 @@ class InferenceTest(DecloudTest):
         self.compare_images(outpath, baseline_path)
         self.compare_raster_metadata(outpath, baseline_path)
 
+    def test_inference_with_fused_preprocessor(self):
+        self.test_inference_with_generic_preprocessor(fused=True)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,415 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""Tests for the DecloudTimeSeriesPreProcessor application"""
+import datetime
+import json
+import os
+import shutil
+import unittest
+import gdal
+import numpy as np
+import otbApplication as otb
+import pyotb
+from decloud.core import system, raster, tile_io, timeseries
+from .decloud_unittest import DecloudTest
+
+
+def get_timestamp(yyyymmdd):
+    dt = datetime.datetime.strptime(yyyymmdd, '%Y%m%d')
+    ts = dt.replace(tzinfo=datetime.timezone.utc).timestamp()
+    return str(ts)
+
+
+def gpu_available():
+    """Tell if the application drills the time series on a CUDA device (module built with CUDA, and device found)"""
+    images = {}
+    for key, nbands in [('sar', 2), ('opt', 4)]:
+        images[key] = '/tmp/preproc_gpu_probe_{}.tif'.format(key)
+        ds = gdal.GetDriverByName('GTiff').Create(images[key], 1, 1, nbands, gdal.GDT_Float32)
+        for band in range(nbands):
+            ds.GetRasterBand(band + 1).Fill(1)
+        ds = None
+    report = '/tmp/preproc_gpu_probe.json'
+    app = pyotb.DecloudTimeSeriesPreProcessor(ilsar=[images['sar']], ilopt=[images['opt']],
+                                              timestampssar=[get_timestamp('20200929')],
+                                              timestampsopt=[get_timestamp('20200929')], gpu=True, report=report)
+    app.outsar1.write('/tmp/preproc_gpu_probe_outsar1.tif')
+    with open(report) as f:
+        return json.load(f)['gpu_pairs'] > 0
+
+
+class PreProcessorTest(DecloudTest):
+
+    S1_DIR = 'baseline/PREPARE/S1_PREPARE/T31TEJ/'
+    S2_DIR = 'baseline/PREPARE/S2_PREPARE/T31TEJ/'
+
+    def crop(self, path):
+        """Crop a small area of the T31TEJ tile"""
+        return pyotb.ExtractROI({'in': self.get_path(path), 'startx': 4000, 'starty': 4000,
+                                 'sizex': 517, 'sizey': 263})
+
+    def crop_to_file(self, path, pixel_type):
+        """Crop a small area of the T31TEJ tile, and write it in a file with its native pixel type"""
+        outpath = '/tmp/crop_' + system.basename(path)
+        self.crop(path).write(outpath, pixel_type=pixel_type)
+        return outpath
+
+    def get_inputs(self, files=False):
+        sar = [self.S1_DIR + 's1b_31TEJ_vvvh_DES_110_20200929t060008_from-10to3dB.tif',
+               self.S1_DIR + 's1a_31TEJ_vvvh_DES_037_20200930txxxxxx_from-10to3dB.tif',
+               self.S1_DIR + 's1b_31TEJ_vvvh_DES_139_20201001txxxxxx_from-10to3dB.tif']
+        opt = [self.S2_DIR + 'SENTINEL2B_20200926-103901-393_L2A_T31TEJ_C_V2-2/'
+                             'SENTINEL2B_20200926-103901-393_L2A_T31TEJ_C_V2-2_FRE_10m.tif',
+               self.S2_DIR + 'SENTINEL2B_20200929-104857-489_L2A_T31TEJ_C_V2-2/'
+                             'SENTINEL2B_20200929-104857-489_L2A_T31TEJ_C_V2-2_FRE_10m.tif']
+        if files:
+            ilsar = [self.crop_to_file(path, 'uint16') for path in sar]
+            ilopt = [self.crop_to_file(path, 'int16') for path in opt]
+        else:
+            ilsar = [self.crop(path) for path in sar]
+            ilopt = [self.crop(path) for path in opt]
+        timestampssar = [get_timestamp(d) for d in ['20200929', '20200930', '20201001']]
+        timestampsopt = [get_timestamp(d) for d in ['20200926', '20200929']]
+        return dict(ilsar=ilsar, ilopt=ilopt, timestampssar=timestampssar, timestampsopt=timestampsopt)
+
+    def run_preprocessor(self, prefix, files=False, keys=('outsar1', 'outopt1'), **kwargs):
+        """Run the preprocessor, write outputs, and return them as numpy arrays"""
+        params = dict(maxgap=144 * 3600, sorting="asc", **self.get_inputs(files))
+        params.update(kwargs)
+        app = pyotb.DecloudTimeSeriesPreProcessor(params)
+        arrays = {}
+        for key in keys:
+            outpath = '/tmp/{}_{}.tif'.format(prefix, key)
+            getattr(app, key).write(outpath)
+            self.assertTrue(system.file_exists(outpath))
+            arrays[key] = gdal.Open(outpath).ReadAsArray()
+        return arrays
+
+    def assert_identical(self, arrays, reference):
+        for key, ref in reference.items():
+            self.assertEqual(arrays[key].dtype, ref.dtype)
+            self.assertTrue(np.array_equal(arrays[key].view(np.uint32), ref.view(np.uint32)))
+
+    def test_parameters_bit_identical(self):
+        # Parameters which only change how the outputs are computed
+        system.basic_logging_init()
+        reference = self.run_preprocessor('preproc_reference', files=True, pixeltype='float', simd='scalar',
+                                          iothreads=0)
+        params_list = [dict(pixeltype=pixeltype, simd=simd) for pixeltype in ['float', 'native']
+                       for simd in ['scalar', 'avx2', 'avx512', 'auto']]
+        params_list.append(dict(iothreads=8))
+        # Small streamed regions: the inputs are read ahead over the next region while the outputs are written
+        params_list += [dict(iothreads=iothreads, ram=1) for iothreads in [1, 8]]
+        # Blocks decoded, then read from the cache
+        params_list += [dict(blockcache=64, pixeltype=pixeltype) for pixeltype in ['float', 'float', 'native']]
+        for i, params in enumerate(params_list):
+            with self.subTest(**params):
+                self.assert_identical(self.run_preprocessor('preproc_params{}'.format(i), files=True, **params),
+                                      reference)
+
+    @unittest.skipUnless(gpu_available(), 'module built without CUDA, or no CUDA device')
+    def test_gpu_bit_identical(self):
+        system.basic_logging_init()
+        report = '/tmp/preproc_gpu_report.json'
+        for pixeltype in ['float', 'native']:
+            reference = self.run_preprocessor('preproc_cpu_' + pixeltype, files=True, pixeltype=pixeltype)
+            self.assert_identical(self.run_preprocessor('preproc_gpu_' + pixeltype, files=True, pixeltype=pixeltype,
+                                                        gpu=True, report=report), reference)
+            # The pairs have been applied on the device, and not on the CPU after a fallback
+            with open(report) as f:
+                self.assertGreater(json.load(f)['gpu_pairs'], 0)
+        reference = self.run_preprocessor('preproc_cpu_bitmaps', files=True, footprints='compute', ram=1,
+                                          **{'footprints.compute.bitmaps': True})
+        self.assert_identical(self.run_preprocessor('preproc_gpu_bitmaps', files=True, footprints='compute', ram=1,
+                                                    gpu=True, report=report, **{'footprints.compute.bitmaps': True}),
+                              reference)
+        with open(report) as f:
+            self.assertGreater(json.load(f)['gpu_pairs'], 0)
+
+    def test_plans_single_pass(self):
+        system.basic_logging_init()
+        reference_asc = self.run_preprocessor('preproc_asc', sorting='asc')
+        reference_des = self.run_preprocessor('preproc_des', sorting='des')
+        plan2 = {'plan2.' + key: value for key, value in self.get_inputs().items()}
+        system.set_env_var("DECLOUD_PREPROCESSING_NPLANS", "2")
+        try:
+            arrays = self.run_preprocessor('preproc_plans', sorting='asc', **plan2, **{'plan2.sorting': 'des'},
+                                           keys=('outsar1', 'outopt1', 'plan2.outsar1', 'plan2.outopt1'))
+        finally:
+            system.set_env_var("DECLOUD_PREPROCESSING_NPLANS", "1")
+        self.assert_identical({key: arrays[key] for key in reference_asc}, reference_asc)
+        self.assert_identical({key: arrays['plan2.' + key] for key in reference_des}, reference_des)
+
+    def test_pair_plans_import(self):
+        system.basic_logging_init()
+        reference = self.run_preprocessor('preproc_export', files=True, outplans='/tmp/preproc_plans.txt')
+        self.assertTrue(system.file_exists('/tmp/preproc_plans.txt'))
+        self.assert_identical(self.run_preprocessor('preproc_import', files=True, inplans='/tmp/preproc_plans.txt'),
+                              reference)
+
+    def test_temporal_selection(self):
+        timestamps = [get_timestamp(d) for d in ['20200926', '20200929', '20200920', '20201003', '20201001']]
+        app = otb.Registry.CreateApplication('DecloudTemporalSelection')
+        app.SetParameterStringList('timestamps', timestamps)
+        app.SetParameterStringList('targets', [get_timestamp('20200929'), get_timestamp('20200801')])
+        expected = {'any': ['1,4,0', '2,0,1'], 'before': ['0,2', ''], 'after': ['4,3', '2,0,1']}
+        for period, selections in expected.items():
+            app.SetParameterString('period', period)
+            app.SetParameterInt('nimages', 3)
+            app.Execute()
+            self.assertEqual(list(app.GetParameterStringList('out')), selections)
+
+    def test_batch_mode(self):
+        system.basic_logging_init()
+        reference_asc = self.run_preprocessor('preproc_asc', sorting='asc')
+        reference_des = self.run_preprocessor('preproc_des', sorting='des')
+        # All images are before the first target date, and after the second one
+        params = dict(maxgap=144 * 3600, mode='batch', **{'mode.batch.outdir': '/tmp/preproc_batch',
+                                                          'mode.batch.targets': [get_timestamp('20201002'),
+                                                                                 get_timestamp('20200901')],
+                                                          'mode.batch.names': ['after', 'before']})
+        params.update(self.get_inputs())
+        pyotb.DecloudTimeSeriesPreProcessor(params)
+        for reference, name in [(reference_asc, 'after_tm1'), (reference_des, 'before_tp1')]:
+            arrays = {key: gdal.Open('/tmp/preproc_batch/{}_{}.tif'.format(name, key)).ReadAsArray()
+                      for key in reference}
+            self.assert_identical(arrays, reference)
+
+    def test_batch_mode_without_pairs(self):
+        system.basic_logging_init()
+        # The optical image is 3 days before the first SAR image: no pair is within the maxgap
+        inputs = self.get_inputs()
+        inputs.update(ilopt=inputs['ilopt'][:1], timestampsopt=inputs['timestampsopt'][:1])
+        params = dict(maxgap=24 * 3600, mode='batch', **{'mode.batch.outdir': '/tmp/preproc_batch_nopairs',
+                                                         'mode.batch.targets': [get_timestamp('20201002')],
+                                                         'mode.batch.names': ['after']}, **inputs)
+        pyotb.DecloudTimeSeriesPreProcessor(params)
+        for suffix in ['tm1', 'tp1']:
+            sar = gdal.Open('/tmp/preproc_batch_nopairs/after_{}_outsar1.tif'.format(suffix)).ReadAsArray()
+            opt = gdal.Open('/tmp/preproc_batch_nopairs/after_{}_outopt1.tif'.format(suffix)).ReadAsArray()
+            self.assertEqual((sar.shape[0], opt.shape[0]), (2, 4))
+            self.assertTrue(np.all(sar == 0) and np.all(opt == -10000))
+        # Incremental mode: the target date is computed again as long as its outputs are missing
+        os.remove('/tmp/preproc_batch_nopairs/after_tp1_outopt1.tif')
+        app = pyotb.DecloudTimeSeriesPreProcessor(dict(params, **{'mode.batch.incremental': True}))
+        self.assertEqual(list(app.app.GetParameterStringList('mode.batch.updated')), ['after'])
+        self.assertTrue(system.file_exists('/tmp/preproc_batch_nopairs/after_tp1_outopt1.tif'))
+
+    def test_validity_bitmap(self):
+        system.basic_logging_init()
+        inputs = self.get_inputs(files=True)
+        app = otb.Registry.CreateApplication('DecloudValidityBitmap')
+        app.SetParameterString('in', inputs['ilopt'][0])
+        app.SetParameterFloat('nodata', -10000)
+        app.SetParameterString('out', '/tmp/preproc_bitmap.validity')
+        app.ExecuteAndWriteOutput()
+        bitmap, nodata = raster.read_validity_bitmap('/tmp/preproc_bitmap.validity')
+        expected = np.any(gdal.Open(inputs['ilopt'][0]).ReadAsArray() != -10000, axis=0)
+        self.assertEqual(nodata, -10000)
+        self.assertTrue(np.array_equal(bitmap, expected))
+        self.assertEqual(app.GetParameterInt('nbvalid'), np.count_nonzero(expected))
+
+    def test_patches_statistics(self):
+        system.basic_logging_init()
+        inputs = self.get_inputs(files=True)
+        images = inputs['ilsar'] + inputs['ilopt']
+        outputs = ['/tmp/preproc_stats_{}_{}.tif'.format(i, size) for i in range(len(images)) for size in [16, 64]]
+        app = otb.Registry.CreateApplication('DecloudPatchesStatistics')
+        app.SetParameterStringList('il', images)
+        app.SetParameterStringList('patchsizes', ['16', '64'])
+        app.SetParameterStringList('out', outputs)
+        app.SetParameterString('count', 'nodata')
+        app.SetParameterFloat('nodata', 0)
+        app.SetParameterInt('jobs', 3)
+        app.ExecuteAndWriteOutput()
+        for i, image in enumerate(images):
+            nodata = np.all(gdal.Open(image).ReadAsArray() == 0, axis=0)
+            for j, size in enumerate([16, 64]):
+                rows, cols = nodata.shape[0] // size, nodata.shape[1] // size
+                expected = nodata[:rows * size, :cols * size].reshape(rows, size, cols, size).sum(axis=(1, 3))
+                stats = gdal.Open(outputs[2 * i + j]).ReadAsArray()
+                self.assertTrue(np.array_equal(stats, expected))
+
+    def test_validity_bitmaps_bit_identical(self):
+        system.basic_logging_init()
+        reference = self.run_preprocessor('preproc_nobitmaps', files=True)
+        for _ in range(2):  # bitmaps computed, then read from the cache directory
+            self.assert_identical(self.run_preprocessor('preproc_bitmaps', files=True, footprints='compute',
+                                                        **{'footprints.compute.bitmaps': True,
+                                                           'footprints.compute.cachedir': '/tmp'}), reference)
+
+    def test_memory_model(self):
+        system.basic_logging_init()
+        app = pyotb.DecloudTimeSeriesPreProcessor(dict(maxgap=144 * 3600, sorting="asc", ram=1, **self.get_inputs()))
+        bytes_per_pixel = app.app.GetParameterInt('bytesperpixel')
+        # At least the float SAR (2 bands) and optical (4 bands) outputs, and their conversion
+        self.assertGreaterEqual(bytes_per_pixel, 2 * (2 + 4) * 4)
+        self.assertEqual(app.app.GetParameterInt('tileheight'), max(1, min(263, 2 ** 20 // (517 * bytes_per_pixel))))
+
+    def test_report(self):
+        system.basic_logging_init()
+        reference = self.run_preprocessor('preproc_noreport', files=True)
+        self.assert_identical(self.run_preprocessor('preproc_report', files=True, report='/tmp/preproc_report.json'),
+                              reference)
+        with open('/tmp/preproc_report.json') as f:
+            report = json.load(f)
+        self.assertEqual(len(report['inputs']), 5)
+        self.assertEqual(report['bytes_read'], sum(inp['bytes_read'] for inp in report['inputs']))
+        self.assertGreater(report['peak_memory_kb'], 0)
+        plan = report['plans'][0]
+        self.assertEqual(plan['pixels'], 517 * 263)
+        self.assertEqual(len(plan['resolved_by_pair']), plan['pairs'])
+        self.assertEqual(sum(plan['pairs_examined']), plan['pixels'])
+        self.assertAlmostEqual(sum(plan['resolved_by_pair']) + plan['unresolved_pixels'] / plan['pixels'], 1.0,
+                               places=5)
+        self.assertTrue(0.0 <= plan['nodata_fraction'] <= 1.0)
+
+    def test_tile_grid(self):
+        system.basic_logging_init()
+        reference = self.run_preprocessor('preproc_nogrid', files=True, pixeltype='float')
+        outdir = '/tmp/preproc_grid'
+        shutil.rmtree(outdir, ignore_errors=True)
+        params = dict(maxgap=144 * 3600, sorting='asc', pixeltype='float', **self.get_inputs(files=True),
+                      **{'grid.outdir': outdir, 'grid.size': 128, 'grid.jobcount': 2})
+        pyotb.DecloudTimeSeriesPreProcessor(dict(params, **{'grid.jobindex': 0}))
+        tile = os.path.join(outdir, 'tiles', 'outsar1_r0_c0.tif')
+        mtime = os.path.getmtime(tile)
+        self.assertFalse(system.file_exists(os.path.join(outdir, 'outsar1.vrt')))
+        pyotb.DecloudTimeSeriesPreProcessor(dict(params, **{'grid.jobindex': 1}))
+        arrays = {key: gdal.Open(os.path.join(outdir, key + '.vrt')).ReadAsArray() for key in reference}
+        self.assert_identical(arrays, reference)
+        # Tiles already done are skipped when a job is restarted
+        pyotb.DecloudTimeSeriesPreProcessor(dict(params, **{'grid.jobindex': 0}))
+        self.assertEqual(os.path.getmtime(tile), mtime)
+
+    def test_batch_incremental(self):
+        system.basic_logging_init()
+        outdir = '/tmp/preproc_incremental'
+        shutil.rmtree(outdir, ignore_errors=True)
+        params = dict(maxgap=144 * 3600, mode='batch', **{'mode.batch.outdir': outdir, 'mode.batch.incremental': True,
+                                                          'mode.batch.targets': [get_timestamp('20201002'),
+                                                                                 get_timestamp('20200901')],
+                                                          'mode.batch.names': ['after', 'before']})
+        inputs = self.get_inputs(files=True)
+        app = pyotb.DecloudTimeSeriesPreProcessor(dict(params, **inputs))
+        self.assertEqual(list(app.app.GetParameterStringList('mode.batch.updated')), ['after', 'before'])
+        self.assertTrue(system.file_exists(os.path.join(outdir, 'after.plans')))
+        output = os.path.join(outdir, 'after_tm1_outopt1.tif')
+        mtime = os.path.getmtime(output)
+        # Same inputs: nothing is computed again
+        app = pyotb.DecloudTimeSeriesPreProcessor(dict(params, **inputs))
+        self.assertEqual(list(app.app.GetParameterStringList('mode.batch.updated')), [])
+        self.assertEqual(os.path.getmtime(output), mtime)
+        # Outputs of one date removed: only this date is computed again, from its own images
+        before = {key: os.path.join(outdir, 'before_' + key + '.tif')
+                  for key in ('tm1_outsar1', 'tm1_outopt1', 'tp1_outsar1', 'tp1_outopt1')}
+        reference = {key: gdal.Open(path).ReadAsArray() for key, path in before.items()}
+        os.remove(before['tp1_outopt1'])
+        app = pyotb.DecloudTimeSeriesPreProcessor(dict(params, **inputs))
+        self.assertEqual(list(app.app.GetParameterStringList('mode.batch.updated')), ['before'])
+        self.assertEqual(os.path.getmtime(output), mtime)
+        for key, path in before.items():
+            self.assertTrue(np.array_equal(gdal.Open(path).ReadAsArray(), reference[key]))
+        # One optical image less: the pairs of both dates change
+        inputs.update(ilopt=inputs['ilopt'][:1], timestampsopt=inputs['timestampsopt'][:1])
+        app = pyotb.DecloudTimeSeriesPreProcessor(dict(params, **inputs))
+        self.assertEqual(list(app.app.GetParameterStringList('mode.batch.updated')), ['after', 'before'])
+
+    def test_sar_mosaic(self):
+        system.basic_logging_init()
+        inputs = self.get_inputs(files=True)
+        arrays = self.run_preprocessor('preproc_mosaic', keys=('mode.mosaic.out',), mode='mosaic',
+                                       **{'mode.mosaic.timestamp': get_timestamp('20201001')})
+        # Closest images first: a pixel is taken from the first image where one of its bands is not no-data
+        reference = None
+        for path in reversed(inputs['ilsar']):
+            array = gdal.Open(path).ReadAsArray().astype(np.float32)
+            if reference is None:
+                reference = array
+            else:
+                nodata = np.all(reference == 0, axis=0)
+                reference[:, nodata] = array[:, nodata]
+        self.assertTrue(np.array_equal(arrays['mode.mosaic.out'], reference))
+
+    def test_lowres_outputs(self):
+        system.basic_logging_init()
+        inputs = self.get_inputs(files=True)
+        # 20m bands of the same area
+        ilopt_20m = []
+        for path in inputs['ilopt']:
+            name = system.basename(path)[len('crop_'):-len('_FRE_10m.tif')]
+            outpath = '/tmp/crop_{}_FRE_20m.tif'.format(name)
+            pyotb.ExtractROI({'in': self.get_path('{}{}/{}_FRE_20m.tif'.format(self.S2_DIR, name, name)),
+                              'startx': 2000, 'starty': 2000, 'sizex': 258, 'sizey': 131}).write(outpath,
+                                                                                                 pixel_type='int16')
+            ilopt_20m.append(outpath)
+        arrays = self.run_preprocessor('preproc_lowres', files=True, keys=('outopt1lowres', 'outsar1lowres'),
+                                       iloptlowres=ilopt_20m)
+        # Reference: the same pairs drilled from SAR images downsampled beforehand (nearest neighbour, the shrink
+        # filter takes the pixels of odd indices for the sizes of the crop)
+        ilsar_20m = []
+        geotransform = gdal.Open(ilopt_20m[0]).GetGeoTransform()
+        for path in inputs['ilsar']:
+            array = gdal.Open(path).ReadAsArray()[:, 1::2, 1::2][:, :131, :258]
+            outpath = path.replace('.tif', '_20m.tif')
+            out = gdal.GetDriverByName('GTiff').Create(outpath, 258, 131, array.shape[0], gdal.GDT_UInt16)
+            out.SetGeoTransform(geotransform)
+            out.SetProjection(gdal.Open(ilopt_20m[0]).GetProjection())
+            for band in range(array.shape[0]):
+                out.GetRasterBand(band + 1).WriteArray(array[band])
+            out = None
+            ilsar_20m.append(outpath)
+        reference = self.run_preprocessor('preproc_lowres_reference', ilsar=ilsar_20m, ilopt=ilopt_20m)
+        self.assertTrue(np.array_equal(arrays['outsar1lowres'], reference['outsar1']))
+        self.assertTrue(np.array_equal(arrays['outopt1lowres'], reference['outopt1']))
+
+    def test_patches_mode(self):
+        system.basic_logging_init()
+        reference = self.run_preprocessor('preproc_patches_reference', files=True, pixeltype='native')
+        outdir = '/tmp/preproc_patches'
+        params = dict(maxgap=144 * 3600, sorting='asc', pixeltype='native', mode='patches', ram=1,
+                      **{'mode.patches.outdir': outdir, 'mode.patches.size': 32}, **self.get_inputs(files=True))
+        pyotb.DecloudTimeSeriesPreProcessor(params)
+        with open(os.path.join(outdir, 'patches.json')) as f:
+            description = json.load(f)
+        self.assertEqual((description['rows'], description['cols']), (263 // 32, 517 // 32))
+        valid = np.ones((263 // 32, 517 // 32), dtype=bool)
+        for key, ref in reference.items():
+            # Reference patches, channel-last, from the GeoTIFF outputs
+            ref = ref[:, :8 * 32, :16 * 32].reshape(-1, 8, 32, 16, 32).transpose(1, 3, 2, 4, 0)
+            array = np.load(os.path.join(outdir, description['outputs'][key]['array']), mmap_mode='r')
+            self.assertEqual(array.dtype, ref.dtype)
+            self.assertTrue(np.array_equal(array, ref))
+            nodata = 0 if key.startswith('outsar') else -10000
+            counts = np.sum(np.any(ref != nodata, axis=-1), axis=(2, 3))
+            self.assertTrue(np.array_equal(np.load(os.path.join(outdir, description['outputs'][key]['valid'])),
+                                           counts))
+            valid &= counts == 32 * 32
+            reader = tile_io.PatchArrayReader(outdir, key)
+            self.assertTrue(np.array_equal(reader.get((3, 5)), ref[5, 3]))
+        self.assertEqual(tile_io.get_valid_patches_locations(outdir),
+                         [(int(col), int(row)) for row, col in np.argwhere(valid)])
+
+    @unittest.skipUnless(timeseries.is_available(), "decloud_core module not built")
+    def test_python_bindings(self):
+        system.basic_logging_init()
+        timestamps = [get_timestamp(d) for d in ['20200926', '20200929', '20200920', '20201003', '20201001']]
+        targets = [get_timestamp('20200929'), get_timestamp('20200801')]
+        self.assertEqual(timeseries.closest(timestamps, targets, 3, 'any'), [[1, 4, 0], [2, 0, 1]])
+        self.assertEqual(timeseries.closest(timestamps, targets, 3, 'before'), [[0, 2], []])
+        self.assertEqual(timeseries.closest(timestamps, targets, 0, 'any'), [[], []])
+        # Pairs and outputs of the pre-processor, from the numpy arrays of its input files
+        inputs = self.get_inputs(files=True)
+        reference = self.run_preprocessor('preproc_bindings', files=True, pixeltype='native')
+        sar = np.ascontiguousarray(np.stack([gdal.Open(path).ReadAsArray() for path in inputs['ilsar']])
+                                   .transpose(0, 2, 3, 1))
+        opt = np.ascontiguousarray(np.stack([gdal.Open(path).ReadAsArray() for path in inputs['ilopt']])
+                                   .transpose(0, 2, 3, 1))
+        pairs = timeseries.candidate_pairs(inputs['timestampssar'], inputs['timestampsopt'], 144 * 3600, 'asc')
+        sar_out, opt_out = timeseries.drill(sar, opt, pairs, 1)
+        self.assertTrue(np.array_equal(sar_out[0].transpose(2, 0, 1), reference['outsar1']))
+        self.assertTrue(np.array_equal(opt_out[0].transpose(2, 0, 1), reference['outopt1']))
+
+
+if __name__ == '__main__':
+    unittest.main()